@@ -0,0 +1,960 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cerrno>
+#include <atomic>
+#include <exception>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "serial_video/avdecoder.hpp"
+#include "serial_video/gray2bw.hpp"
+#include "serial_video/fft.hpp"
+#include "serial_video/transfer.hpp"
+#include "serial_video/pipeline.hpp"
+#include "serial_video/metrics.hpp"
+#include "serial_video/ring_buffer.hpp"
+#include "serial_video/executor.hpp"
+#ifdef HAVE_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+#define BENCH_OUT_WIDTH 128           // 输出屏幕宽度
+#define BENCH_OUT_HEIGHT 64           // 输出屏幕高度
+#define BENCH_SAMPLERATE 44100        // FFT测试的音频采样率
+#define BENCH_FRAMERATE 30            // FFT测试的输出帧率
+#define BENCH_AUDIO_SECONDS 60        // FFT测试的音频长度
+#define BENCH_HANDOFF_FRAMES 64       // 队列交接测试每轮传递的帧数
+#define BENCH_ALLOC_WARMUP 64         // 分配计数前的预热帧数
+#define BENCH_ALLOC_FRAMES 128        // 分配计数的帧数
+#define BENCH_ALLOC_FRAMERATE 500     // 分配计数时的传输帧率（越高越快跑完）
+#define BENCH_ALLOC_QUEUE_FRAMES 4    // 模拟解码器最多领先的帧数
+#define BENCH_EXECUTOR_FRAMERATE 60   // 执行方式对比时的传输帧率
+#define BENCH_EXECUTOR_WARMUP 30      // 执行方式对比前的预热帧数
+#define BENCH_EXECUTOR_FRAMES 120     // 执行方式对比计量的帧数
+#define BENCH_CHURN_FRAMES 120        // 抖动迟滞测试的合成画面帧数
+
+/**
+ * @brief 一项测试结果
+ *
+ */
+struct bench_result
+{
+    std::string name, params;
+    long iterations;
+    double ns_per_op;
+    std::string unit; // 一次操作代表什么
+};
+
+static double min_seconds = 0.5;
+static int failed = 0; // 有断言失败的测试项
+static int json_output = 0;
+static const char *filter = NULL;
+static std::vector<bench_result> results;
+
+/**
+ * @brief 重复执行op直到总时长超过min_seconds，返回每次执行的平均耗时
+ *
+ * @param op 被测操作
+ * @param iterations 实际执行次数
+ * @return double 纳秒/次
+ */
+template <typename F>
+static double measure(F &&op, long &iterations)
+{
+    op(); // 预热
+    iterations = 0;
+    auto begin = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    while (elapsed.count() < min_seconds)
+    {
+        op();
+        iterations++;
+        elapsed = std::chrono::steady_clock::now() - begin;
+    }
+    return elapsed.count() * 1e9 / iterations;
+}
+
+/**
+ * @brief 判断测试项是否被过滤掉
+ *
+ * @param name 测试项名称
+ * @return int 需要运行时返回1
+ */
+static int selected(const char *name)
+{
+    return filter == NULL || strstr(name, filter) != NULL;
+}
+
+/**
+ * @brief 记录并输出一项结果
+ *
+ * @param counters 附加的计数（如系统调用次数），输出在结果末尾
+ */
+static void report(const char *name, const std::string &params, long iterations, double ns, const char *unit, const std::vector<std::pair<std::string, uint64_t>> &counters = {})
+{
+    results.push_back({name, params, iterations, ns, unit});
+    if (json_output)
+    {
+        std::cout << "{\"bench\":\"" << name << "\",\"params\":\"" << params << "\",\"iterations\":" << iterations
+                  << ",\"ns_per_op\":" << std::fixed << std::setprecision(1) << ns << ",\"ops_per_sec\":" << std::setprecision(2) << 1e9 / ns
+                  << ",\"unit\":\"" << unit << "\"";
+        for (auto &c : counters)
+            std::cout << ",\"" << c.first << "\":" << c.second;
+        std::cout << "}" << std::endl;
+    }
+    else
+    {
+        std::cout << std::left << std::setw(16) << name << std::setw(24) << params << std::right << std::setw(14) << std::fixed << std::setprecision(1) << ns << " ns/" << unit
+                  << std::setw(14) << std::setprecision(1) << 1e9 / ns << " " << unit << "/s";
+        for (auto &c : counters)
+            std::cout << "  " << c.first << "=" << c.second;
+        std::cout << std::endl;
+    }
+}
+
+/**
+ * @brief 生成确定性的测试图像（斜条纹叠加渐变）
+ *
+ * @param frame 输出缓冲区
+ * @param width 宽度
+ * @param height 高度
+ * @param t 帧序号
+ */
+static void synth_frame(uint8_t *frame, int width, int height, int t)
+{
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int stripe = ((x + y + 4 * t) / 16) & 1;
+            frame[y * width + x] = (uint8_t)(stripe ? 40 + x * 160 / width : 255 - y * 160 / height);
+        }
+    }
+}
+
+/**
+ * @brief gray2bw各计算核（缩放、抖动、取模）
+ *
+ */
+static void bench_gray2bw(int width, int height)
+{
+    std::string params = std::to_string(width) + "x" + std::to_string(height);
+    gray2bw gray(width, height, BENCH_OUT_WIDTH, BENCH_OUT_HEIGHT);
+    std::vector<uint8_t> in(width * height), resized(BENCH_OUT_WIDTH * BENCH_OUT_HEIGHT), bw(BENCH_OUT_WIDTH * BENCH_OUT_HEIGHT), packed(gray.get_frame_size());
+    synth_frame(in.data(), width, height, 0);
+    long n;
+    double ns;
+
+    if (selected("resize"))
+    {
+        ns = measure([&] { gray.resize(in.data(), resized.data()); }, n);
+        report("resize", params, n, ns, "frame");
+    }
+    gray.resize(in.data(), resized.data());
+#ifdef HAVE_OPENCV
+    // 与原先依赖的OpenCV区域缩放对比耗时和结果
+    cv::Mat src(height, width, CV_8UC1, in.data());
+    cv::Mat dst(BENCH_OUT_HEIGHT, BENCH_OUT_WIDTH, CV_8UC1);
+    if (selected("resize_opencv"))
+    {
+        ns = measure([&] { cv::resize(src, dst, cv::Size(BENCH_OUT_WIDTH, BENCH_OUT_HEIGHT), 0, 0, cv::INTER_AREA); }, n);
+        report("resize_opencv", params, n, ns, "frame");
+    }
+    if (selected("resize_verify"))
+    {
+        uint64_t max_diff = 0, total_diff = 0;
+        for (int t = 0; t < 8; t++)
+        {
+            synth_frame(in.data(), width, height, t);
+            gray.resize(in.data(), resized.data());
+            cv::resize(src, dst, cv::Size(BENCH_OUT_WIDTH, BENCH_OUT_HEIGHT), 0, 0, cv::INTER_AREA);
+            for (int i = 0; i < BENCH_OUT_WIDTH * BENCH_OUT_HEIGHT; i++)
+            {
+                uint64_t diff = abs((int)resized[i] - (int)dst.data[i]);
+                max_diff = std::max(max_diff, diff);
+                total_diff += diff;
+            }
+        }
+        synth_frame(in.data(), width, height, 0);
+        gray.resize(in.data(), resized.data());
+        // 平均误差以千分之一灰度级为单位
+        report("resize_verify", params, 8, 0, "frame", {{"max_abs_diff", max_diff}, {"mean_abs_diff_milli", total_diff * 1000 / (8 * BENCH_OUT_WIDTH * BENCH_OUT_HEIGHT)}});
+    }
+#endif
+    if (selected("dither"))
+    {
+        ns = measure([&] { gray.dither(resized.data(), bw.data()); }, n);
+        report("dither", "128x64", n, ns, "frame");
+    }
+    gray.dither(resized.data(), bw.data());
+    if (selected("pack"))
+    {
+        ns = measure([&] { gray.pack(bw.data(), packed.data()); }, n);
+        report("pack", "128x64", n, ns, "frame");
+    }
+}
+
+/**
+ * @brief 两个线程之间通过加锁的环形队列传递整帧（与流水线各阶段之间的交接方式相同）
+ *
+ */
+static void bench_queue_handoff(int width, int height)
+{
+    if (!selected("queue_handoff"))
+        return;
+    std::string params = std::to_string(width) + "x" + std::to_string(height);
+    const size_t frame_size = width * height;
+    std::vector<uint8_t> frame(frame_size), sink(frame_size);
+    synth_frame(frame.data(), width, height, 0);
+    ring_buffer<uint8_t> queue(frame_size * BENCH_HANDOFF_FRAMES);
+    std::mutex lock;
+    long n;
+    double ns = measure([&]
+                        {
+        std::thread consumer([&]
+                             {
+            for (int f = 0; f < BENCH_HANDOFF_FRAMES; f++)
+            {
+                while (1)
+                {
+                    lock.lock();
+                    if (queue.size() >= frame_size)
+                        break;
+                    lock.unlock();
+                    std::this_thread::yield();
+                }
+                queue.pop(sink.data(), frame_size);
+                lock.unlock();
+            } });
+        for (int f = 0; f < BENCH_HANDOFF_FRAMES; f++)
+        {
+            lock.lock();
+            queue.push(frame.data(), frame_size);
+            lock.unlock();
+        }
+        consumer.join(); }, n);
+    report("queue_handoff", params, n * BENCH_HANDOFF_FRAMES, ns / BENCH_HANDOFF_FRAMES, "frame");
+}
+
+/**
+ * @brief 解码器输出格式到8位灰度的像素格式转换
+ *
+ */
+static void bench_sws(int width, int height)
+{
+    if (!selected("sws"))
+        return;
+    std::string params = std::to_string(width) + "x" + std::to_string(height) + " yuv420p";
+    SwsContext *ctx = sws_getContext(width, height, AV_PIX_FMT_YUV420P, width, height, AV_PIX_FMT_GRAY8, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    AVFrame *src = av_frame_alloc();
+    AVFrame *dst = av_frame_alloc();
+    if (ctx == NULL || src == NULL || dst == NULL)
+    {
+        std::cerr << "Unable to setup sws benchmark" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    src->format = AV_PIX_FMT_YUV420P;
+    src->width  = width;
+    src->height = height;
+    dst->format = AV_PIX_FMT_GRAY8;
+    dst->width  = width;
+    dst->height = height;
+    if (av_frame_get_buffer(src, 0) < 0 || av_frame_get_buffer(dst, 0) < 0)
+    {
+        std::cerr << "Unable to allocate sws benchmark frames" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    for (int y = 0; y < height; y++)
+    {
+        synth_frame(src->data[0] + y * src->linesize[0], width, 1, y);
+    }
+    for (int y = 0; y < height / 2; y++)
+    {
+        memset(src->data[1] + y * src->linesize[1], 128, width / 2);
+        memset(src->data[2] + y * src->linesize[2], 128, width / 2);
+    }
+    long n;
+    double ns = measure([&] { sws_scale(ctx, src->data, src->linesize, 0, height, dst->data, dst->linesize); }, n);
+    report("sws", params, n, ns, "frame");
+    av_frame_free(&src);
+    av_frame_free(&dst);
+    sws_freeContext(ctx);
+}
+
+/**
+ * @brief FFT+峰值搜索，对比逐块的队列路径和批量路径
+ *
+ * @param samplerate 输入采样率
+ */
+static void bench_fft(int samplerate)
+{
+    std::string params = std::to_string(samplerate) + "Hz/" + std::to_string(BENCH_FRAMERATE) + "fps";
+    std::vector<uint16_t> pcm((size_t)samplerate * BENCH_AUDIO_SECONDS);
+    for (size_t i = 0; i < pcm.size(); i++)
+    {
+        double f = 200.0 + 100.0 * (i / samplerate); // 每秒升高100Hz
+        pcm[i] = (uint16_t)(int16_t)(8000.0 * sin(2 * M_PI * f * i / samplerate));
+    }
+    fft freq(samplerate, BENCH_FRAMERATE, 0);
+    size_t windows = pcm.size() / (samplerate / BENCH_FRAMERATE);
+    long n;
+    double ns;
+
+    if (selected("fft_queue"))
+    {
+        ring_buffer<uint8_t> out;
+        ns = measure([&]
+                     {
+            ring_buffer<uint16_t> in;
+            in.push(pcm.data(), pcm.size());
+            freq.calculate(in, out);
+            out.clear(); }, n);
+        report("fft_queue", params, n * windows, ns / windows, "window");
+    }
+    std::vector<uint8_t> track;
+    if (selected("fft_batch"))
+    {
+        ns = measure([&] { freq.batch_calculate(pcm.data(), pcm.size(), track, 1); }, n);
+        report("fft_batch", params + " 1thr", n * windows, ns / windows, "window");
+        int threads = std::thread::hardware_concurrency();
+        if (threads > 1)
+        {
+            ns = measure([&] { freq.batch_calculate(pcm.data(), pcm.size(), track, threads); }, n);
+            report("fft_batch", params + " " + std::to_string(threads) + "thr", n * windows, ns / windows, "window");
+        }
+    }
+}
+
+/**
+ * @brief 读取本进程累计的read类系统调用次数
+ *
+ * @return uint64_t 次数，/proc不可用时返回0
+ */
+static uint64_t read_syscalls(void)
+{
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    while (io >> key >> value)
+    {
+        if (key == "syscr:")
+            return value;
+    }
+    return 0;
+}
+
+/**
+ * @brief 完整解码一个媒体文件（灰度视频+单声道音频），对比默认file协议和mmap读取
+ *
+ * @param input 媒体文件路径
+ */
+static void bench_decode(const char *input)
+{
+    if (input == NULL)
+        return;
+    for (int use_mmap = 0; use_mmap <= 1; use_mmap++)
+    {
+        const char *name = use_mmap ? "decode_mmap" : "decode";
+        if (!selected(name))
+            continue;
+        long frames = 0;
+        uint64_t io_callbacks = 0;
+        std::string params;
+        uint64_t syscalls = read_syscalls();
+        auto begin = std::chrono::steady_clock::now();
+        {
+            ring_buffer<uint8_t> video;
+            ring_buffer<uint16_t> audio;
+            avdecoder av(input);
+            av.set_mmap_io(use_mmap);
+            av.open();
+            av.decode(video, audio);
+            frames = video.size() / ((size_t)av.get_video_width() * av.get_video_height());
+            params = std::to_string(av.get_video_width()) + "x" + std::to_string(av.get_video_height());
+            io_callbacks = av.get_io_read_calls();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        syscalls = read_syscalls() - syscalls;
+        if (frames > 0)
+            report(name, params, frames, seconds * 1e9 / frames, "frame", {{"read_syscalls", syscalls}, {"io_callbacks", io_callbacks}});
+    }
+}
+
+/*
+ * 分配计数：替换glibc的malloc族函数（operator new也经由malloc），只在计数窗口内累加
+ */
+static std::atomic<int> alloc_counting(0);
+static std::atomic<uint64_t> alloc_count(0);
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+
+    void *malloc(size_t size) noexcept
+    {
+        if (alloc_counting.load(std::memory_order_relaxed))
+            alloc_count.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size) noexcept
+    {
+        if (alloc_counting.load(std::memory_order_relaxed))
+            alloc_count.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *ptr, size_t size) noexcept
+    {
+        if (alloc_counting.load(std::memory_order_relaxed))
+            alloc_count.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(ptr, size);
+    }
+
+    void *memalign(size_t alignment, size_t size) noexcept
+    {
+        if (alloc_counting.load(std::memory_order_relaxed))
+            alloc_count.fetch_add(1, std::memory_order_relaxed);
+        return __libc_memalign(alignment, size);
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size) noexcept
+    {
+        return memalign(alignment, size);
+    }
+
+    int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept
+    {
+        *ptr = memalign(alignment, size);
+        return *ptr != NULL ? 0 : ENOMEM;
+    }
+}
+
+/**
+ * @brief 打开一对伪终端，作为传输阶段的串口
+ *
+ * @param slave_path 从端路径
+ * @return int 主端文件描述符，失败返回-1
+ */
+static int open_pty(std::string &slave_path)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0)
+        return -1;
+    if (grantpt(master) < 0 || unlockpt(master) < 0 || ptsname(master) == NULL)
+    {
+        close(master);
+        return -1;
+    }
+    slave_path = ptsname(master);
+    return master;
+}
+
+/**
+ * @brief 在帧计数达到warmup后开始计数分配，再经过frames帧后停止
+ *
+ * @param frames_out 已发送帧数
+ * @param warmup 预热帧数
+ * @param frames 计数帧数
+ * @param running 被测对象仍在运行
+ * @return uint64_t 计数窗口内的分配次数，被测对象提前结束时返回UINT64_MAX
+ */
+template <typename F>
+static uint64_t count_steady_allocations(std::atomic<uint64_t> &frames_out, uint64_t warmup, uint64_t frames, F &&running)
+{
+    while (frames_out.load() < warmup)
+    {
+        if (!running())
+            return UINT64_MAX;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    uint64_t begin = frames_out.load();
+    alloc_count = 0;
+    alloc_counting = 1;
+    while (frames_out.load() < begin + frames && running())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    alloc_counting = 0;
+    return frames_out.load() >= begin + frames ? alloc_count.load() : UINT64_MAX;
+}
+
+/**
+ * @brief 模拟解码器：不断生成测试图像和一帧对应的PCM，最多领先BENCH_ALLOC_QUEUE_FRAMES帧
+ *
+ * @param pcm 每帧的PCM
+ */
+static void synth_decode(ring_buffer<uint8_t> &av_video, std::mutex &av_video_lock, ring_buffer<uint16_t> &av_audio, std::mutex &av_audio_lock, std::atomic<int> &decode_done, int width, int height, const std::vector<uint16_t> &pcm)
+{
+    const size_t frame_size = width * height;
+    std::vector<uint8_t> frame(frame_size);
+    for (int t = 0; decode_done == 0; t++)
+    {
+        synth_frame(frame.data(), width, height, t);
+        while (decode_done == 0)
+        {
+            av_video_lock.lock();
+            if (av_video.size() < frame_size * BENCH_ALLOC_QUEUE_FRAMES)
+                break;
+            av_video_lock.unlock();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        if (decode_done > 0)
+            break;
+        av_video.push(frame.data(), frame_size);
+        av_video_lock.unlock();
+        av_audio_lock.lock();
+        av_audio.push(pcm.data(), pcm.size());
+        av_audio_lock.unlock();
+    }
+}
+
+/**
+ * @brief 稳定运行时的堆分配次数：模拟解码器 -> gray2bw -> fft -> transfer -> 伪终端，预热后应为0
+ *
+ */
+static void bench_alloc_steady(int width, int height)
+{
+    if (!selected("alloc_steady"))
+        return;
+    std::string params = std::to_string(width) + "x" + std::to_string(height);
+    std::string slave_path;
+    int master = open_pty(slave_path);
+    if (master < 0)
+    {
+        std::cerr << "alloc_steady: unable to open pty, skipped" << std::endl;
+        return;
+    }
+    const size_t frame_size = width * height;
+    const int window = BENCH_SAMPLERATE / BENCH_ALLOC_FRAMERATE; // 每帧对应的音频采样数
+    metrics stats;
+    gray2bw gray(width, height, BENCH_OUT_WIDTH, BENCH_OUT_HEIGHT);
+    fft freq(BENCH_SAMPLERATE, BENCH_ALLOC_FRAMERATE, -1);
+    transfer trans(slave_path.c_str(), 115200, BENCH_ALLOC_FRAMERATE, gray.get_frame_size(), 1);
+    trans.set_metrics(&stats);
+    // 与pipeline相同，各队列按上限预先分配
+    ring_buffer<uint8_t> av_video(frame_size * (BENCH_ALLOC_QUEUE_FRAMES + 1)), gray_video(BW_QUEUE_LENGTH_MAX + gray.get_frame_size()), fft_audio(FFT_QUEUE_LENGTH_MAX + 1);
+    ring_buffer<uint16_t> av_audio(window * (BENCH_ALLOC_QUEUE_FRAMES + 1));
+    std::mutex av_video_lock, av_audio_lock, gray_video_lock, fft_audio_lock;
+    std::atomic<int> decode_done(0), gray_done(0), fft_done(0), transfer_done(0), drain_stop(0);
+    std::vector<uint16_t> pcm(window);
+    for (int i = 0; i < window; i++)
+        pcm[i] = 32768 + 8000 * sin(2 * M_PI * 440 * i / BENCH_SAMPLERATE);
+    std::exception_ptr failure = NULL;
+
+    std::thread drain_t([&] {
+        uint8_t buffer[4096];
+        while (drain_stop == 0)
+        {
+            if (read(master, buffer, sizeof(buffer)) <= 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    std::thread gray_t([&] { gray.streamed_convert(av_video, av_video_lock, gray_video, gray_video_lock, decode_done, gray_done); });
+    std::thread fft_t([&] { freq.streamed_calculate(av_audio, av_audio_lock, fft_audio, fft_audio_lock, decode_done, fft_done); });
+    std::thread transfer_t([&] {
+        try
+        {
+            trans.streamed_start(gray_video, gray_video_lock, fft_audio, fft_audio_lock, gray_done, fft_done);
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+        transfer_done = 1;
+    });
+    std::thread decoder_t([&] { synth_decode(av_video, av_video_lock, av_audio, av_audio_lock, decode_done, width, height, pcm); });
+
+    uint64_t allocations = count_steady_allocations(stats.transfer.frames_out, BENCH_ALLOC_WARMUP, BENCH_ALLOC_FRAMES, [&] { return transfer_done == 0; });
+    decode_done = 1;
+    decoder_t.join();
+    gray_t.join();
+    fft_t.join();
+    transfer_t.join();
+    drain_stop = 1;
+    drain_t.join();
+    close(master);
+    if (failure)
+        std::rethrow_exception(failure);
+    if (allocations == UINT64_MAX)
+    {
+        std::cerr << "alloc_steady: pipeline ended before the measurement finished" << std::endl;
+        failed = 1;
+        return;
+    }
+    report("alloc_steady", params, BENCH_ALLOC_FRAMES, 0, "frame", {{"allocations", allocations}});
+    if (allocations > 0)
+    {
+        std::cerr << "alloc_steady " << params << ": " << allocations << " heap allocations in " << BENCH_ALLOC_FRAMES << " steady-state frames" << std::endl;
+        failed = 1;
+    }
+}
+
+/**
+ * @brief 进程已用的CPU时间
+ *
+ * @param switches 累计的上下文切换次数
+ * @return double 用户态加内核态秒数
+ */
+static double cpu_seconds(uint64_t &switches)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    switches = usage.ru_nvcsw + usage.ru_nivcsw;
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * @brief 每阶段一个线程与协作式执行器（1、2个线程）的对比：模拟解码器 -> gray2bw -> fft -> transfer -> 伪终端，
+ * 按BENCH_EXECUTOR_FRAMERATE节奏发送，报告每帧占用的CPU时间（整个进程）、节奏定时器的唤醒延迟和上下文切换次数
+ *
+ */
+static void bench_executor(int width, int height)
+{
+    if (!selected("executor"))
+        return;
+    for (int threads = 0; threads <= 2; threads++) // 0为每阶段一个线程
+    {
+        std::string params = std::to_string(width) + "x" + std::to_string(height) + (threads == 0 ? " threads" : " executor:" + std::to_string(threads));
+        std::string slave_path;
+        int master = open_pty(slave_path);
+        if (master < 0)
+        {
+            std::cerr << "executor: unable to open pty, skipped" << std::endl;
+            return;
+        }
+        const size_t frame_size = width * height;
+        const int window = BENCH_SAMPLERATE / BENCH_EXECUTOR_FRAMERATE;
+        metrics stats;
+        gray2bw gray(width, height, BENCH_OUT_WIDTH, BENCH_OUT_HEIGHT);
+        fft freq(BENCH_SAMPLERATE, BENCH_EXECUTOR_FRAMERATE, -1);
+        transfer trans(slave_path.c_str(), 4000000, BENCH_EXECUTOR_FRAMERATE, gray.get_frame_size(), 1);
+        trans.set_metrics(&stats);
+        ring_buffer<uint8_t> av_video(frame_size * (BENCH_ALLOC_QUEUE_FRAMES + 1)), gray_video(BW_QUEUE_LENGTH_MAX + gray.get_frame_size()), fft_audio(FFT_QUEUE_LENGTH_MAX + 1);
+        ring_buffer<uint16_t> av_audio(window * (BENCH_ALLOC_QUEUE_FRAMES + 1));
+        std::mutex av_video_lock, av_audio_lock, gray_video_lock, fft_audio_lock;
+        std::atomic<int> decode_done(0), gray_done(0), fft_done(0), transfer_done(0), drain_stop(0);
+        std::vector<uint16_t> pcm(window);
+        for (int i = 0; i < window; i++)
+            pcm[i] = 32768 + 8000 * sin(2 * M_PI * 440 * i / BENCH_SAMPLERATE);
+        std::exception_ptr failure = NULL;
+
+        std::thread drain_t([&] {
+            uint8_t buffer[4096];
+            while (drain_stop == 0)
+            {
+                if (read(master, buffer, sizeof(buffer)) <= 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        std::vector<std::thread> stages;
+        if (threads == 0)
+        {
+            stages.emplace_back([&] { gray.streamed_convert(av_video, av_video_lock, gray_video, gray_video_lock, decode_done, gray_done); });
+            stages.emplace_back([&] { freq.streamed_calculate(av_audio, av_audio_lock, fft_audio, fft_audio_lock, decode_done, fft_done); });
+            stages.emplace_back([&] {
+                try
+                {
+                    trans.streamed_start(gray_video, gray_video_lock, fft_audio, fft_audio_lock, gray_done, fft_done);
+                }
+                catch (...)
+                {
+                    failure = std::current_exception();
+                }
+                transfer_done = 1;
+            });
+        }
+        else
+        {
+            stages.emplace_back([&] {
+                executor exec(threads);
+                exec.add([&](std::chrono::steady_clock::time_point &) { return gray.resume_convert(av_video, av_video_lock, gray_video, gray_video_lock, decode_done, gray_done); });
+                exec.add([&](std::chrono::steady_clock::time_point &) { return freq.resume_calculate(av_audio, av_audio_lock, fft_audio, fft_audio_lock, decode_done, fft_done); });
+                exec.add([&](std::chrono::steady_clock::time_point &wakeup) { return trans.resume_start(gray_video, gray_video_lock, fft_audio, fft_audio_lock, gray_done, fft_done, wakeup); });
+                try
+                {
+                    exec.run();
+                }
+                catch (...)
+                {
+                    failure = std::current_exception();
+                }
+                transfer_done = 1;
+            });
+        }
+        std::thread decoder_t([&] { synth_decode(av_video, av_video_lock, av_audio, av_audio_lock, decode_done, width, height, pcm); });
+
+        // 预热后计量
+        while (stats.transfer.frames_out.load() < BENCH_EXECUTOR_WARMUP && transfer_done == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        uint64_t switches_begin, switches_end;
+        double cpu_begin = cpu_seconds(switches_begin);
+        uint64_t frames_begin = stats.transfer.frames_out.load(), wakeups_begin = stats.wakeups.load(), wakeup_ns_begin = stats.wakeup_ns.load();
+        while (stats.transfer.frames_out.load() < frames_begin + BENCH_EXECUTOR_FRAMES && transfer_done == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        double cpu = cpu_seconds(switches_end) - cpu_begin;
+        uint64_t frames = stats.transfer.frames_out.load() - frames_begin, wakeups = stats.wakeups.load() - wakeups_begin;
+        uint64_t wakeup_avg_us = wakeups > 0 ? (stats.wakeup_ns.load() - wakeup_ns_begin) / wakeups / 1000 : 0;
+
+        decode_done = 1;
+        decoder_t.join();
+        for (std::thread &t : stages)
+            t.join();
+        drain_stop = 1;
+        drain_t.join();
+        close(master);
+        if (failure)
+            std::rethrow_exception(failure);
+        if (frames < BENCH_EXECUTOR_FRAMES)
+        {
+            std::cerr << "executor " << params << ": pipeline ended before the measurement finished" << std::endl;
+            failed = 1;
+            continue;
+        }
+        report("executor", params, frames, cpu * 1e9 / frames, "frame",
+               {{"wakeup_avg_us", wakeup_avg_us}, {"wakeup_max_us", stats.wakeup_ns_max.load() / 1000}, {"context_switches", switches_end - switches_begin}});
+    }
+}
+
+/**
+ * @brief 抖动迟滞对帧间变化的影响：逐帧转换一段视频，统计每帧与上一帧不同的取模字节数
+ *
+ * 没有给出媒体文件时使用缓慢变亮并叠加噪声的合成画面（模拟压缩噪声和渐变）
+ *
+ * @param input 媒体文件路径，为NULL时使用合成画面
+ */
+static void bench_dither_churn(const char *input)
+{
+    if (!selected("dither_churn"))
+        return;
+    int width = 640, height = 360;
+    ring_buffer<uint8_t> clip;
+    std::string params = "synthetic";
+    if (input != NULL)
+    {
+        ring_buffer<uint16_t> audio;
+        avdecoder av(input);
+        av.open();
+        av.decode(clip, audio);
+        width = av.get_video_width();
+        height = av.get_video_height();
+        params = basename(input);
+    }
+    else
+    {
+        std::vector<uint8_t> frame(width * height);
+        uint32_t seed = 1;
+        for (int t = 0; t < BENCH_CHURN_FRAMES; t++)
+        {
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    seed = seed * 1103515245 + 12345; // 确定性的伪随机噪声，±6灰度级
+                    int v = x * 200 / width + y * 40 / height + t * 40 / BENCH_CHURN_FRAMES + (int)((seed >> 16) % 13) - 6;
+                    frame[y * width + x] = (uint8_t)std::max(0, std::min(255, v));
+                }
+            }
+            clip.push(frame.data(), frame.size());
+        }
+    }
+    const size_t frame_size = (size_t)width * height;
+    const long frames = clip.size() / frame_size;
+    if (frames < 2)
+    {
+        std::cerr << "dither_churn: input too short" << std::endl;
+        return;
+    }
+    std::vector<uint8_t> all(frames * frame_size);
+    clip.pop(all.data(), all.size());
+    const int margins[] = {0, BW_HYSTERESIS_DEFAULT / 2, BW_HYSTERESIS_DEFAULT, BW_HYSTERESIS_DEFAULT * 2};
+    for (int margin : margins)
+    {
+        metrics stats;
+        gray2bw gray(width, height, BENCH_OUT_WIDTH, BENCH_OUT_HEIGHT);
+        gray.set_metrics(&stats);
+        gray.set_hysteresis(margin);
+        ring_buffer<uint8_t> in, out;
+        in.push(all.data(), frame_size);
+        gray.convert(in, out); // 第一帧与全0比较，不计入
+        uint64_t first = stats.changed_bytes.load();
+        for (long f = 1; f < frames; f++)
+        {
+            in.push(all.data() + f * frame_size, frame_size);
+            out.clear();
+            gray.convert(in, out);
+        }
+        uint64_t changed = stats.changed_bytes.load() - first;
+        report("dither_churn", params + " margin=" + std::to_string(margin), frames - 1, 0, "frame",
+               {{"changed_bytes_per_frame", changed / (frames - 1)}, {"frame_bytes", (uint64_t)gray.get_frame_size()}});
+    }
+}
+
+/**
+ * @brief 实际媒体文件经完整流水线（含libav解码）稳定运行时的堆分配次数，只报告不断言
+ *
+ * libav读取数据包时为数据分配引用计数缓冲区，这部分不在本工程控制之内
+ */
+static void bench_alloc_decode(const char *input)
+{
+    if (input == NULL || !selected("alloc_decode"))
+        return;
+    std::string slave_path;
+    int master = open_pty(slave_path);
+    if (master < 0)
+    {
+        std::cerr << "alloc_decode: unable to open pty, skipped" << std::endl;
+        return;
+    }
+    std::atomic<int> drain_stop(0);
+    std::thread drain_t([&] {
+        uint8_t buffer[4096];
+        while (drain_stop == 0)
+        {
+            if (read(master, buffer, sizeof(buffer)) <= 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    pipeline_config config;
+    config.input_media = input;
+    config.output_device = slave_path;
+    config.baudrate = 4000000;
+    pipeline pipe(config);
+    uint64_t allocations = UINT64_MAX;
+    try
+    {
+        pipe.start();
+        allocations = count_steady_allocations(pipe.get_metrics().transfer.frames_out, BENCH_ALLOC_WARMUP, BENCH_ALLOC_FRAMES / 2, [&] { return pipe.is_running() != 0; });
+        pipe.stop();
+        pipe.wait();
+    }
+    catch (...)
+    {
+        drain_stop = 1;
+        drain_t.join();
+        close(master);
+        throw;
+    }
+    drain_stop = 1;
+    drain_t.join();
+    close(master);
+    if (allocations == UINT64_MAX)
+    {
+        std::cerr << "alloc_decode: input too short for the measurement" << std::endl;
+        return;
+    }
+    report("alloc_decode", "", BENCH_ALLOC_FRAMES / 2, 0, "frame", {{"allocations", allocations}});
+}
+
+void usage(const char *progname)
+{
+    std::cout << "Usage: " << progname << " [OPTION]..." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "\t-h, --help\t\t\tdisplay this help" << std::endl;
+    std::cout << "\t-r, --resolutions=WxH,...\tinput resolutions (default 640x360,1280x720,1920x1080)" << std::endl;
+    std::cout << "\t-s, --samplerates=HZ,...\taudio samplerates for fft (default 11025,44100,48000)" << std::endl;
+    std::cout << "\t-t, --min-time=SECONDS\t\tminimum run time of each benchmark (default 0.5)" << std::endl;
+    std::cout << "\t-f, --filter=NAME\t\tonly run benchmarks whose name contains NAME" << std::endl;
+    std::cout << "\t-i, --input-media=FILE\t\talso benchmark decoding FILE with and without mmap, and count its steady-state allocations (see vons_gen)" << std::endl;
+    std::cout << "\t-j, --json\t\t\tone JSON object per result, for comparing commits" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"resolutions", required_argument, NULL, 'r'},
+        {"samplerates", required_argument, NULL, 's'},
+        {"min-time", required_argument, NULL, 't'},
+        {"filter", required_argument, NULL, 'f'},
+        {"input-media", required_argument, NULL, 'i'},
+        {"json", no_argument, NULL, 'j'},
+        {NULL, 0, NULL, 0}};
+    std::string resolutions = "640x360,1280x720,1920x1080", samplerates = "11025,44100,48000";
+    const char *input = NULL;
+    int optc;
+    while ((optc = getopt_long(argc, argv, "hr:s:t:f:i:j", longopts, NULL)) != -1)
+    {
+        switch (optc)
+        {
+        case 'h':
+            usage(basename(argv[0]));
+            exit(EXIT_SUCCESS);
+        case 'r':
+            resolutions = optarg;
+            break;
+        case 's':
+            samplerates = optarg;
+            break;
+        case 't':
+            min_seconds = atof(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'i':
+            input = optarg;
+            break;
+        case 'j':
+            json_output = 1;
+            break;
+        default:
+            usage(basename(argv[0]));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    try
+    {
+        std::stringstream rs(resolutions);
+        std::string item;
+        while (std::getline(rs, item, ','))
+        {
+            int width, height;
+            if (sscanf(item.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                std::cerr << "Invalid resolution: " << item << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            bench_gray2bw(width, height);
+            bench_queue_handoff(width, height);
+            bench_sws(width, height);
+            bench_alloc_steady(width, height);
+            bench_executor(width, height);
+        }
+        std::stringstream ss(samplerates);
+        while (std::getline(ss, item, ','))
+        {
+            int samplerate = atoi(item.c_str());
+            if (samplerate < BENCH_FRAMERATE)
+            {
+                std::cerr << "Invalid samplerate: " << item << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            bench_fft(samplerate);
+        }
+        bench_decode(input);
+        bench_dither_churn(input);
+        bench_alloc_decode(input);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,379 @@
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <getopt.h>
+
+#include "serial_video/shm_ring.hpp"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+}
+
+#define GEN_SAMPLERATE 44100 // 生成音频的采样率
+#define GEN_AUDIO_CHUNK 1024 // 每个音频包的采样数
+#define GEN_SHM_SLOTS 3      // 共享内存帧环的槽数
+
+/**
+ * @brief 生成参数
+ *
+ */
+struct gen_options
+{
+    const char *output;
+    const char *shm_name;
+    const char *video_codec;
+    const char *pattern;
+    int width, height, fps;
+    double duration, tone;
+};
+
+/**
+ * @brief 确定性的伪随机数（线性同余），保证每次生成的文件相同
+ *
+ * @param state 状态
+ * @return uint8_t 随机字节
+ */
+static uint8_t lcg_next(uint32_t &state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state >> 24;
+}
+
+/**
+ * @brief 按图案填充一帧的亮度平面
+ *
+ * @param plane 亮度平面
+ * @param linesize 行跨度（字节）
+ * @param w 宽度
+ * @param h 高度
+ * @param pattern 图案名称
+ * @param t 帧序号
+ * @param seed 噪声图案的随机数状态
+ */
+static void fill_luma(uint8_t *plane, int linesize, int w, int h, const char *pattern, int t, uint32_t &seed)
+{
+    for (int y = 0; y < h; y++)
+    {
+        uint8_t *row = plane + y * linesize;
+        for (int x = 0; x < w; x++)
+        {
+            if (strcmp(pattern, "bars") == 0) // 8级灰阶竖条，缓慢向右移动
+                row[x] = (((x + t * 2) * 8 / w) % 8) * 255 / 7;
+            else if (strcmp(pattern, "gradient") == 0) // 对角渐变
+                row[x] = (x * 255 / w + y * 255 / h + t * 4) / 2;
+            else if (strcmp(pattern, "checker") == 0) // 每秒翻转若干次的棋盘格
+                row[x] = (((x / 16) + (y / 16) + t / 8) & 1) ? 255 : 0;
+            else // 噪声
+                row[x] = lcg_next(seed);
+        }
+    }
+}
+
+/**
+ * @brief 按图案填充一帧的亮度平面，色度平面置灰
+ *
+ * @param frame 视频帧（YUV420P）
+ * @param pattern 图案名称
+ * @param t 帧序号
+ * @param seed 噪声图案的随机数状态
+ */
+static void fill_frame(AVFrame *frame, const char *pattern, int t, uint32_t &seed)
+{
+    const int w = frame->width, h = frame->height;
+    fill_luma(frame->data[0], frame->linesize[0], w, h, pattern, t, seed);
+    for (int y = 0; y < h / 2; y++)
+    {
+        memset(frame->data[1] + y * frame->linesize[1], 128, w / 2);
+        memset(frame->data[2] + y * frame->linesize[2], 128, w / 2);
+    }
+}
+
+/**
+ * @brief 把编码器输出的所有包写入文件
+ *
+ * @return int 成功返回0
+ */
+static int write_packets(AVFormatContext *fmt_ctx, AVCodecContext *codec_ctx, AVStream *stream, AVPacket *packet)
+{
+    int ret;
+    while ((ret = avcodec_receive_packet(codec_ctx, packet)) >= 0)
+    {
+        av_packet_rescale_ts(packet, codec_ctx->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        ret = av_interleaved_write_frame(fmt_ctx, packet);
+        if (ret < 0)
+            return ret;
+    }
+    return (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) ? 0 : ret;
+}
+
+/**
+ * @brief 打开一路编码器并新建对应的输出流
+ *
+ * @return AVCodecContext* 失败返回NULL
+ */
+static AVCodecContext *open_encoder(AVFormatContext *fmt_ctx, const AVCodec *codec, AVStream **stream, const gen_options &opt)
+{
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (ctx == NULL)
+        return NULL;
+    if (codec->type == AVMEDIA_TYPE_VIDEO)
+    {
+        ctx->width     = opt.width;
+        ctx->height    = opt.height;
+        ctx->time_base = AVRational{1, opt.fps};
+        ctx->framerate = AVRational{opt.fps, 1};
+        ctx->gop_size  = opt.fps;
+        ctx->pix_fmt   = codec->id == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+    }
+    else
+    {
+        ctx->sample_rate = GEN_SAMPLERATE;
+        ctx->sample_fmt  = AV_SAMPLE_FMT_S16;
+        ctx->time_base   = AVRational{1, GEN_SAMPLERATE};
+        av_channel_layout_default(&ctx->ch_layout, 1);
+    }
+    ctx->thread_count = 1;                 // 单线程编码，保证输出确定
+    ctx->flags |= AV_CODEC_FLAG_BITEXACT;
+    if (fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    *stream = avformat_new_stream(fmt_ctx, NULL);
+    if (*stream == NULL || avcodec_open2(ctx, codec, NULL) < 0 || avcodec_parameters_from_context((*stream)->codecpar, ctx) < 0)
+    {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+    (*stream)->time_base = ctx->time_base;
+    return ctx;
+}
+
+/**
+ * @brief 生成测试片段
+ *
+ * @return int 成功返回0
+ */
+static int generate(const gen_options &opt)
+{
+    int ret = -1;
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *video_ctx = NULL, *audio_ctx = NULL;
+    AVStream *video_stream = NULL, *audio_stream = NULL;
+    AVFrame *video_frame = NULL, *audio_frame = NULL;
+    AVPacket *packet = NULL;
+    const AVCodec *video_codec, *audio_codec;
+    uint32_t seed = 1;
+    int64_t total_frames = (int64_t)(opt.duration * opt.fps), samples = 0;
+    double phase = 0;
+
+    if (avformat_alloc_output_context2(&fmt_ctx, NULL, NULL, opt.output) < 0)
+    {
+        std::cerr << "Unknown output format: " << opt.output << std::endl;
+        goto fail;
+    }
+    fmt_ctx->flags |= AVFMT_FLAG_BITEXACT;
+    video_codec = avcodec_find_encoder_by_name(opt.video_codec);
+    audio_codec = avcodec_find_encoder(AV_CODEC_ID_PCM_S16LE);
+    if (video_codec == NULL || audio_codec == NULL)
+    {
+        std::cerr << "Encoder not found: " << (video_codec == NULL ? opt.video_codec : "pcm_s16le") << std::endl;
+        goto fail;
+    }
+    video_ctx = open_encoder(fmt_ctx, video_codec, &video_stream, opt);
+    audio_ctx = open_encoder(fmt_ctx, audio_codec, &audio_stream, opt);
+    if (video_ctx == NULL || audio_ctx == NULL)
+    {
+        std::cerr << "Unable to open encoders" << std::endl;
+        goto fail;
+    }
+
+    video_frame = av_frame_alloc();
+    audio_frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    if (video_frame == NULL || audio_frame == NULL || packet == NULL)
+        goto fail;
+    video_frame->format = video_ctx->pix_fmt;
+    video_frame->width  = opt.width;
+    video_frame->height = opt.height;
+    audio_frame->format     = AV_SAMPLE_FMT_S16;
+    audio_frame->nb_samples = GEN_AUDIO_CHUNK;
+    audio_frame->sample_rate = GEN_SAMPLERATE;
+    av_channel_layout_copy(&audio_frame->ch_layout, &audio_ctx->ch_layout);
+    if (av_frame_get_buffer(video_frame, 0) < 0 || av_frame_get_buffer(audio_frame, 0) < 0)
+        goto fail;
+
+    if (!(fmt_ctx->oformat->flags & AVFMT_NOFILE) && avio_open(&fmt_ctx->pb, opt.output, AVIO_FLAG_WRITE) < 0)
+    {
+        std::cerr << "Unable to open " << opt.output << std::endl;
+        goto fail;
+    }
+    if (avformat_write_header(fmt_ctx, NULL) < 0)
+        goto fail;
+
+    for (int64_t t = 0; t < total_frames; t++)
+    {
+        if (av_frame_make_writable(video_frame) < 0)
+            goto fail;
+        fill_frame(video_frame, opt.pattern, t, seed);
+        video_frame->pts = t;
+        if (avcodec_send_frame(video_ctx, video_frame) < 0 || write_packets(fmt_ctx, video_ctx, video_stream, packet) < 0)
+            goto fail;
+
+        // 补齐到当前视频时间为止的音频
+        while (samples < (t + 1) * GEN_SAMPLERATE / opt.fps)
+        {
+            if (av_frame_make_writable(audio_frame) < 0)
+                goto fail;
+            int16_t *pcm = (int16_t *)audio_frame->data[0];
+            for (int i = 0; i < GEN_AUDIO_CHUNK; i++)
+            {
+                // 音调每秒升高一个八度的1/12，方便肉眼检查蜂鸣器输出
+                double freq = opt.tone * pow(2.0, (double)(samples + i) / GEN_SAMPLERATE / 12);
+                phase += 2 * M_PI * freq / GEN_SAMPLERATE;
+                pcm[i] = (int16_t)(opt.tone > 0 ? 12000 * sin(phase) : 0);
+            }
+            audio_frame->pts = samples;
+            samples += GEN_AUDIO_CHUNK;
+            if (avcodec_send_frame(audio_ctx, audio_frame) < 0 || write_packets(fmt_ctx, audio_ctx, audio_stream, packet) < 0)
+                goto fail;
+        }
+    }
+    // 冲洗编码器
+    if (avcodec_send_frame(video_ctx, NULL) < 0 || write_packets(fmt_ctx, video_ctx, video_stream, packet) < 0)
+        goto fail;
+    if (avcodec_send_frame(audio_ctx, NULL) < 0 || write_packets(fmt_ctx, audio_ctx, audio_stream, packet) < 0)
+        goto fail;
+    if (av_write_trailer(fmt_ctx) < 0)
+        goto fail;
+    ret = 0;
+
+fail:
+    av_packet_free(&packet);
+    av_frame_free(&video_frame);
+    av_frame_free(&audio_frame);
+    avcodec_free_context(&video_ctx);
+    avcodec_free_context(&audio_ctx);
+    if (fmt_ctx != NULL && !(fmt_ctx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&fmt_ctx->pb);
+    avformat_free_context(fmt_ctx);
+    return ret;
+}
+
+/**
+ * @brief 模拟外部渲染程序：按帧率把图案实时写入共享内存帧环，供vons -i shm:NAME读取
+ *
+ * @return int 成功返回0
+ */
+static int generate_shm(const gen_options &opt)
+{
+    uint32_t seed = 1;
+    int64_t total_frames = (int64_t)(opt.duration * opt.fps);
+    try
+    {
+        shm_writer ring(opt.shm_name, opt.width, opt.height, opt.fps, 1, GEN_SHM_SLOTS);
+        auto next = std::chrono::steady_clock::now();
+        for (int64_t t = 0; t < total_frames; t++)
+        {
+            fill_luma(ring.begin_frame(), opt.width, opt.width, opt.height, opt.pattern, t, seed);
+            ring.end_frame();
+            next += std::chrono::microseconds(1000000 / opt.fps);
+            std::this_thread::sleep_until(next);
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+void usage(const char *progname)
+{
+    std::cout << "Usage: " << progname << " [OPTION]... OUTPUT" << std::endl;
+    std::cout << "  or:  " << progname << " [OPTION]... --shm=NAME" << std::endl;
+    std::cout << "Generate a deterministic test clip (container chosen by OUTPUT extension, e.g. .mkv)," << std::endl;
+    std::cout << "or render the pattern in real time into a shared-memory ring for vons -i shm:NAME." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "\t-h, --help\t\t\tdisplay this help" << std::endl;
+    std::cout << "\t-s, --size=WxH\t\t\tvideo size (default 640x360)" << std::endl;
+    std::cout << "\t-f, --fps=FPS\t\t\tframe rate (default 30)" << std::endl;
+    std::cout << "\t-d, --duration=SECONDS\t\tclip length (default 10)" << std::endl;
+    std::cout << "\t-c, --video-codec=NAME\t\tvideo encoder, e.g. mpeg4, mjpeg, libx264 (default mpeg4)" << std::endl;
+    std::cout << "\t-p, --pattern=NAME\t\tbars, gradient, checker or noise (default bars)" << std::endl;
+    std::cout << "\t-a, --tone=HZ\t\t\tstarting frequency of the audio sweep, 0 for silence (default 440)" << std::endl;
+    std::cout << "\t-S, --shm=NAME\t\t\twrite grayscale frames to the shared-memory ring NAME at FPS for the duration instead of encoding a clip" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"size", required_argument, NULL, 's'},
+        {"fps", required_argument, NULL, 'f'},
+        {"duration", required_argument, NULL, 'd'},
+        {"video-codec", required_argument, NULL, 'c'},
+        {"pattern", required_argument, NULL, 'p'},
+        {"tone", required_argument, NULL, 'a'},
+        {"shm", required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0}};
+    gen_options opt = {NULL, NULL, "mpeg4", "bars", 640, 360, 30, 10, 440};
+    int optc;
+    while ((optc = getopt_long(argc, argv, "hs:f:d:c:p:a:S:", longopts, NULL)) != -1)
+    {
+        switch (optc)
+        {
+        case 'h':
+            usage(basename(argv[0]));
+            exit(EXIT_SUCCESS);
+        case 's':
+            if (sscanf(optarg, "%dx%d", &opt.width, &opt.height) != 2)
+            {
+                usage(basename(argv[0]));
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            opt.fps = atoi(optarg);
+            break;
+        case 'd':
+            opt.duration = atof(optarg);
+            break;
+        case 'c':
+            opt.video_codec = optarg;
+            break;
+        case 'p':
+            opt.pattern = optarg;
+            break;
+        case 'a':
+            opt.tone = atof(optarg);
+            break;
+        case 'S':
+            opt.shm_name = optarg;
+            break;
+        default:
+            usage(basename(argv[0]));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ((optind >= argc && opt.shm_name == NULL) || opt.width <= 0 || opt.height <= 0 || opt.width % 2 || opt.height % 2 || opt.fps <= 0 || opt.duration <= 0)
+    {
+        usage(basename(argv[0]));
+        exit(EXIT_FAILURE);
+    }
+    if (strcmp(opt.pattern, "bars") && strcmp(opt.pattern, "gradient") && strcmp(opt.pattern, "checker") && strcmp(opt.pattern, "noise"))
+    {
+        std::cerr << "Unknown pattern: " << opt.pattern << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (opt.shm_name != NULL)
+        return generate_shm(opt) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    opt.output = argv[optind];
+    return generate(opt) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,534 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+#include "serial_video/link_protocol.hpp"
+#include "serial_video/rate_control.hpp"
+#include "serial_video/dirty_rect.hpp"
+
+#define PTY_IDLE_TIMEOUT_MS 1000 // vons退出后超过1秒无数据即认为传输结束
+#define PTY_READ_SLICE_US 200    // 模拟串口的读取间隔
+#define PTY_CREDIT_IDLE_MS 50    // 流量控制模式下空闲时重发CREDIT帧的间隔
+
+/**
+ * @brief 接收端仿真参数
+ *
+ */
+struct receiver_options
+{
+    int baudrate;
+    int width, height, audio_size;
+    const char *dump_path;
+    int protocol;     // LINK_PROTOCOL_*
+    int slots;        // 流量控制模式下接收端的帧缓冲区数
+    double drain_fps; // 接收端显示（取走）帧的速率
+    const char *color; // 彩色屏（RGB565）的抖动模式，为NULL时为单色屏
+};
+
+/**
+ * @brief 接收端一帧的字节数
+ *
+ * @param opt 仿真参数
+ * @return int 单色屏为列行式取模数据，彩色屏为RGB565
+ */
+static int frame_bytes(const receiver_options &opt)
+{
+    return opt.color != NULL ? opt.width * opt.height * RECT_BYTES_PER_PIXEL : opt.width * opt.height / 8;
+}
+
+/**
+ * @brief 接收端统计结果
+ *
+ */
+struct receiver_stats
+{
+    int64_t bytes, packets, changed_frames, tone_packets;
+    int64_t crc_errors, seq_gaps, overruns, credits_sent; // 帧协议：CRC错误、序号不连续、缓冲区溢出、发出的CREDIT帧
+    int64_t encoded_packets, decode_errors; // 码率控制：RLE或变化段编码的数据包、无法解码的数据包
+    std::vector<double> arrivals; // 每个数据包收齐的时刻（秒，相对第一个字节）
+};
+
+/**
+ * @brief 把列行式取模数据还原为PBM（P4）格式的位图
+ *
+ * @param packed 取模数据
+ * @param width 宽度
+ * @param height 高度
+ * @param path 输出文件
+ */
+static void dump_pbm(const std::vector<uint8_t> &packed, int width, int height, const char *path)
+{
+    std::ofstream out(path, std::ios::binary);
+    out << "P4\n" << width << " " << height << "\n";
+    std::vector<uint8_t> row((width + 7) / 8);
+    for (int y = 0; y < height; y++)
+    {
+        std::fill(row.begin(), row.end(), 0);
+        for (int x = 0; x < width; x++)
+        {
+            if (!((packed[(y / 8) * width + x] >> (y % 8)) & 1)) // PBM中1为黑色
+                row[x / 8] |= 0x80 >> (x % 8);
+        }
+        out.write((const char *)row.data(), row.size());
+    }
+}
+
+/**
+ * @brief 把RGB565（大端）帧保存为PPM（P6）格式的图像
+ *
+ * @param frame RGB565帧
+ * @param width 宽度
+ * @param height 高度
+ * @param path 输出文件
+ */
+static void dump_ppm(const std::vector<uint8_t> &frame, int width, int height, const char *path)
+{
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<uint8_t> row(width * 3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint16_t pixel = frame[(y * width + x) * 2] << 8 | frame[(y * width + x) * 2 + 1];
+            row[x * 3] = (pixel >> 11) << 3;
+            row[x * 3 + 1] = ((pixel >> 5) & 0x3F) << 2;
+            row[x * 3 + 2] = (pixel & 0x1F) << 3;
+        }
+        out.write((const char *)row.data(), row.size());
+    }
+}
+
+/**
+ * @brief 统计收齐的一个数据包
+ *
+ * @param packet 视频帧+音频字节
+ * @param last_frame 上一帧
+ * @param opt 仿真参数
+ * @param stats 统计结果
+ * @param arrival 收齐的时刻
+ */
+static void count_packet(const uint8_t *packet, std::vector<uint8_t> &last_frame, const receiver_options &opt, receiver_stats &stats, double arrival)
+{
+    const int frame_size = frame_bytes(opt);
+    stats.packets++;
+    stats.arrivals.push_back(arrival);
+    if (stats.packets == 1 || memcmp(packet, last_frame.data(), frame_size) != 0)
+        stats.changed_frames++;
+    memcpy(last_frame.data(), packet, frame_size);
+    for (int j = 0; j < opt.audio_size; j++)
+    {
+        if (packet[frame_size + j] != 0)
+        {
+            stats.tone_packets++;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief 向主机回报接收缓冲区状态
+ *
+ * @param master pty主端
+ * @param ack_seq 最后收到的序号
+ * @param free_slots 空闲缓冲区数
+ * @param stats 统计结果
+ */
+static void send_credit(int master, uint16_t ack_seq, int free_slots, receiver_stats &stats)
+{
+    uint8_t payload[3] = {(uint8_t)(ack_seq & 0xFF), (uint8_t)(ack_seq >> 8), (uint8_t)free_slots};
+    uint8_t frame[LINK_OVERHEAD + sizeof(payload)];
+    size_t length = link_protocol::encode(frame, 0, LINK_TYPE_CREDIT, 0, payload, sizeof(payload));
+    if (write(master, frame, length) == (ssize_t)length)
+        stats.credits_sent++;
+}
+
+/**
+ * @brief 在pty主端仿真单片机接收端，以模拟波特率读取并按包重组帧
+ *
+ * @param master pty主端
+ * @param child vons进程
+ * @param opt 仿真参数
+ * @param stats 统计结果
+ * @return int vons的退出状态
+ */
+static int run_receiver(int master, pid_t child, const receiver_options &opt, receiver_stats &stats)
+{
+    const int frame_size = frame_bytes(opt), packet_size = frame_size + opt.audio_size;
+    const double bytes_per_sec = opt.baudrate / 10.0; // 8N1，每字节10位
+    std::vector<uint8_t> packet(packet_size), last_frame(frame_size), screen(packet_size); // screen：按编码数据包重建的帧+音频字节
+    std::vector<uint8_t> buffer(65536);
+    int filled = 0, status = 0, child_running = 1;
+    double credit = 0;
+    auto begin = std::chrono::steady_clock::now(), last = begin, last_data = begin, last_credit = begin;
+    int started = 0;
+    link_protocol parser(packet_size);
+    uint16_t expected_seq = 0, ack_seq = 0xFFFF;
+    int synced = 0, occupied = 0; // 流量控制模式：已占用的帧缓冲区
+    double drained = 0;
+
+    while (1)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (child_running && waitpid(child, &status, WNOHANG) == child)
+            child_running = 0;
+        if (!child_running && std::chrono::duration_cast<std::chrono::milliseconds>(now - last_data).count() > PTY_IDLE_TIMEOUT_MS)
+            break;
+        if (opt.protocol == LINK_PROTOCOL_CREDIT)
+        {
+            // 接收端按显示速率取走缓冲的帧，有空位或长时间空闲时回报
+            drained += std::chrono::duration<double>(now - last).count() * opt.drain_fps;
+            int freed = std::min((int)drained, occupied);
+            drained = occupied > 0 ? drained - freed : 0;
+            occupied -= freed;
+            if (freed > 0 || std::chrono::duration_cast<std::chrono::milliseconds>(now - last_credit).count() > PTY_CREDIT_IDLE_MS)
+            {
+                send_credit(master, ack_seq, opt.slots - occupied, stats);
+                last_credit = now;
+            }
+        }
+
+        // 线路速率限制：只读取这段时间内串口能送达的字节数，pty缓冲区满后发送端的write会阻塞，模拟真实的串口背压
+        credit += std::chrono::duration<double>(now - last).count() * bytes_per_sec;
+        last = now;
+        if (credit > buffer.size())
+            credit = buffer.size();
+        int allowed = (int)credit;
+        if (allowed == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(PTY_READ_SLICE_US));
+            continue;
+        }
+        struct pollfd pfd = {master, POLLIN, 0};
+        if (poll(&pfd, 1, 10) <= 0 || !(pfd.revents & POLLIN))
+        {
+            if (pfd.revents & POLLHUP) // 从端已全部关闭
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            credit = std::min(credit, (double)packet_size); // 线路空闲时不累积过多额度
+            continue;
+        }
+        ssize_t n = read(master, buffer.data(), allowed);
+        if (n <= 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1)); // EIO：从端已关闭
+            continue;
+        }
+        credit -= n;
+        last_data = std::chrono::steady_clock::now();
+        if (!started)
+        {
+            begin = last_data;
+            started = 1;
+        }
+        stats.bytes += n;
+        double arrival = std::chrono::duration<double>(last_data - begin).count();
+        if (opt.protocol == LINK_PROTOCOL_RAW)
+        {
+            for (ssize_t i = 0; i < n; i++)
+            {
+                packet[filled++] = buffer[i];
+                if (filled < packet_size)
+                    continue;
+                filled = 0;
+                count_packet(packet.data(), last_frame, opt, stats, arrival);
+            }
+            continue;
+        }
+        size_t offset = 0, consumed;
+        while (parser.feed(buffer.data() + offset, n - offset, consumed))
+        {
+            offset += consumed;
+            uint8_t type = parser.get_type();
+            if (type != LINK_TYPE_AV && type != LINK_TYPE_AV_RLE && type != LINK_TYPE_AV_DELTA && type != LINK_TYPE_AV_RECT)
+                continue;
+            if (type == LINK_TYPE_AV && parser.get_length() != packet_size)
+                continue;
+            if (type != LINK_TYPE_AV)
+            {
+                stats.encoded_packets++;
+                int ret = -1;
+                if (opt.audio_size == 1 && type == LINK_TYPE_AV_RECT)
+                    ret = opt.color != NULL ? dirty_rect::decode(parser.get_payload(), parser.get_length(), screen.data(), opt.width, opt.height, screen[frame_size]) : -1;
+                else if (opt.audio_size == 1)
+                    ret = rate_control::decode(type, parser.get_payload(), parser.get_length(), screen.data(), frame_size, screen[frame_size]);
+                if (ret < 0)
+                {
+                    stats.decode_errors++;
+                    continue;
+                }
+            }
+            else
+                memcpy(screen.data(), parser.get_payload(), packet_size);
+            if (synced && parser.get_seq() != expected_seq)
+                stats.seq_gaps++;
+            synced = 1;
+            expected_seq = parser.get_seq() + 1;
+            ack_seq = parser.get_seq();
+            count_packet(screen.data(), last_frame, opt, stats, arrival);
+            if (opt.protocol == LINK_PROTOCOL_CREDIT)
+            {
+                if (occupied >= opt.slots)
+                    stats.overruns++; // 主机违反了流量控制，真实接收端只能丢掉这一帧
+                else
+                    occupied++;
+                send_credit(master, ack_seq, opt.slots - occupied, stats);
+                last_credit = last_data;
+            }
+        }
+        stats.crc_errors = parser.get_crc_errors();
+    }
+    if (child_running)
+        waitpid(child, &status, 0);
+    if (opt.dump_path != NULL && stats.packets > 0 && opt.color != NULL)
+        dump_ppm(last_frame, opt.width, opt.height, opt.dump_path);
+    else if (opt.dump_path != NULL && stats.packets > 0)
+        dump_pbm(last_frame, opt.width, opt.height, opt.dump_path);
+    return status;
+}
+
+/**
+ * @brief 打开pty对，并设置为原始模式
+ *
+ * @param slave_path 从端路径
+ * @return int 主端，失败返回-1
+ */
+static int open_pty(std::string &slave_path)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0)
+        return -1;
+    if (grantpt(master) < 0 || unlockpt(master) < 0 || ptsname(master) == NULL)
+    {
+        close(master);
+        return -1;
+    }
+    slave_path = ptsname(master);
+    struct termios cfg;
+    if (tcgetattr(master, &cfg) == 0)
+    {
+        cfmakeraw(&cfg);
+        tcsetattr(master, TCSANOW, &cfg);
+    }
+    return master;
+}
+
+void usage(const char *progname)
+{
+    std::cout << "Usage: " << progname << " [OPTION]... -- [VONS OPTION]..." << std::endl;
+    std::cout << "Run vons against a pseudo-terminal and emulate the receiver on the other end." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "\t-h, --help\t\t\tdisplay this help" << std::endl;
+    std::cout << "\t-x, --vons=PATH\t\t\tvons executable (default ./vons)" << std::endl;
+    std::cout << "\t-b, --baudrate=BAUDRATE\t\tsimulated line rate, also passed to vons (default 2000000)" << std::endl;
+    std::cout << "\t-s, --size=WxH\t\t\tscreen size of the receiver (default 128x64)" << std::endl;
+    std::cout << "\t-a, --audio-size=BYTES\t\taudio bytes per packet (default 1)" << std::endl;
+    std::cout << "\t-d, --dump=FILE.pbm\t\tsave the last reconstructed frame (PPM for color panels)" << std::endl;
+    std::cout << "\t-m, --min-fps=FPS\t\texit with failure if the achieved frame rate is lower" << std::endl;
+    std::cout << "\t-j, --json\t\t\tprint the report as a JSON object" << std::endl;
+    std::cout << "\t-p, --protocol=raw|framed|credit\tlink protocol, also passed to vons (default raw)" << std::endl;
+    std::cout << "\t-q, --slots=N\t\t\tframe buffers of the receiver in credit mode (default 2)" << std::endl;
+    std::cout << "\t-r, --drain-fps=FPS\t\trate at which the receiver displays buffered frames in credit mode (default 30)" << std::endl;
+    std::cout << "\t-c, --color=plain|dither\temulate an RGB565 panel (default size 160x128), also passed to vons" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"vons", required_argument, NULL, 'x'},
+        {"baudrate", required_argument, NULL, 'b'},
+        {"size", required_argument, NULL, 's'},
+        {"audio-size", required_argument, NULL, 'a'},
+        {"dump", required_argument, NULL, 'd'},
+        {"min-fps", required_argument, NULL, 'm'},
+        {"json", no_argument, NULL, 'j'},
+        {"protocol", required_argument, NULL, 'p'},
+        {"slots", required_argument, NULL, 'q'},
+        {"drain-fps", required_argument, NULL, 'r'},
+        {"color", required_argument, NULL, 'c'},
+        {NULL, 0, NULL, 0}};
+    receiver_options opt = {2000000, 0, 0, 1, NULL, LINK_PROTOCOL_RAW, 2, 30, NULL};
+    const char *protocol_names[3] = {"raw", "framed", "credit"};
+    const char *vons = "./vons";
+    double min_fps = 0;
+    int json_output = 0, optc;
+    while ((optc = getopt_long(argc, argv, "hx:b:s:a:d:m:jp:q:r:c:", longopts, NULL)) != -1)
+    {
+        switch (optc)
+        {
+        case 'h':
+            usage(basename(argv[0]));
+            exit(EXIT_SUCCESS);
+        case 'x':
+            vons = optarg;
+            break;
+        case 'b':
+            opt.baudrate = atoi(optarg);
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &opt.width, &opt.height) != 2)
+            {
+                usage(basename(argv[0]));
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'a':
+            opt.audio_size = atoi(optarg);
+            break;
+        case 'd':
+            opt.dump_path = optarg;
+            break;
+        case 'm':
+            min_fps = atof(optarg);
+            break;
+        case 'j':
+            json_output = 1;
+            break;
+        case 'p':
+            opt.protocol = -1;
+            for (int i = 0; i < 3; i++)
+            {
+                if (strcmp(optarg, protocol_names[i]) == 0)
+                    opt.protocol = i;
+            }
+            break;
+        case 'q':
+            opt.slots = atoi(optarg);
+            break;
+        case 'r':
+            opt.drain_fps = atof(optarg);
+            break;
+        case 'c':
+            opt.color = optarg;
+            break;
+        default:
+            usage(basename(argv[0]));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (opt.width == 0 && opt.height == 0) // 未指定时按屏幕类型取默认尺寸
+    {
+        opt.width = opt.color != NULL ? 160 : 128;
+        opt.height = opt.color != NULL ? 128 : 64;
+    }
+    if (opt.baudrate <= 0 || opt.width <= 0 || opt.height <= 0 || (opt.color == NULL && opt.height % 8) || opt.audio_size < 0 || opt.protocol < 0 || opt.slots <= 0 || opt.slots > 255 || opt.drain_fps <= 0)
+    {
+        usage(basename(argv[0]));
+        exit(EXIT_FAILURE);
+    }
+
+    std::string slave_path;
+    int master = open_pty(slave_path);
+    if (master < 0)
+    {
+        perror("Unable to open pty");
+        exit(EXIT_FAILURE);
+    }
+
+    // vons的参数：--之后的全部参数，再加上输出设备、波特率、协议和屏幕尺寸
+    std::string baud_str = std::to_string(opt.baudrate), size_str = std::to_string(opt.width) + "x" + std::to_string(opt.height);
+    std::vector<char *> child_argv;
+    child_argv.push_back((char *)vons);
+    for (int i = optind; i < argc; i++)
+        child_argv.push_back(argv[i]);
+    child_argv.push_back((char *)"-o");
+    child_argv.push_back((char *)slave_path.c_str());
+    child_argv.push_back((char *)"-b");
+    child_argv.push_back((char *)baud_str.c_str());
+    child_argv.push_back((char *)"-p");
+    child_argv.push_back((char *)protocol_names[opt.protocol]);
+    child_argv.push_back((char *)"-S");
+    child_argv.push_back((char *)size_str.c_str());
+    if (opt.color != NULL)
+    {
+        child_argv.push_back((char *)"-c");
+        child_argv.push_back((char *)opt.color);
+    }
+    child_argv.push_back(NULL);
+
+    pid_t child = fork();
+    if (child < 0)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (child == 0)
+    {
+        close(master);
+        execvp(vons, child_argv.data());
+        perror("Unable to exec vons");
+        _exit(127);
+    }
+
+    receiver_stats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {}};
+    int status = run_receiver(master, child, opt, stats);
+    close(master);
+
+    // 统计包间隔
+    double duration = stats.arrivals.size() > 1 ? stats.arrivals.back() - stats.arrivals.front() : 0;
+    double fps = duration > 0 ? (stats.arrivals.size() - 1) / duration : 0;
+    double mean = 0, stddev = 0, max_gap = 0, p99 = 0;
+    std::vector<double> gaps;
+    for (size_t i = 1; i < stats.arrivals.size(); i++)
+        gaps.push_back(stats.arrivals[i] - stats.arrivals[i - 1]);
+    if (!gaps.empty())
+    {
+        for (double g : gaps)
+            mean += g;
+        mean /= gaps.size();
+        for (double g : gaps)
+            stddev += (g - mean) * (g - mean);
+        stddev = sqrt(stddev / gaps.size());
+        std::sort(gaps.begin(), gaps.end());
+        max_gap = gaps.back();
+        p99 = gaps[(gaps.size() - 1) * 99 / 100];
+    }
+    double throughput = stats.arrivals.empty() || stats.arrivals.back() <= 0 ? 0 : stats.bytes / stats.arrivals.back();
+    int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    if (json_output)
+    {
+        std::cout << std::fixed << std::setprecision(3) << "{\"baudrate\":" << opt.baudrate << ",\"bytes\":" << stats.bytes << ",\"packets\":" << stats.packets
+                  << ",\"changed_frames\":" << stats.changed_frames << ",\"tone_packets\":" << stats.tone_packets << ",\"duration_s\":" << duration
+                  << ",\"fps\":" << fps << ",\"gap_mean_ms\":" << mean * 1e3 << ",\"gap_stddev_ms\":" << stddev * 1e3 << ",\"gap_p99_ms\":" << p99 * 1e3
+                  << ",\"gap_max_ms\":" << max_gap * 1e3 << ",\"throughput_Bps\":" << throughput << ",\"line_utilization\":" << throughput * 10 / opt.baudrate
+                  << ",\"protocol\":\"" << protocol_names[opt.protocol] << "\",\"crc_errors\":" << stats.crc_errors << ",\"seq_gaps\":" << stats.seq_gaps
+                  << ",\"overruns\":" << stats.overruns << ",\"credits_sent\":" << stats.credits_sent << ",\"encoded_packets\":" << stats.encoded_packets
+                  << ",\"decode_errors\":" << stats.decode_errors << ",\"vons_exit\":" << exit_code << "}" << std::endl;
+    }
+    else
+    {
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "baudrate:         " << opt.baudrate << std::endl;
+        std::cout << "bytes received:   " << stats.bytes << std::endl;
+        std::cout << "packets:          " << stats.packets << " (" << stats.changed_frames << " distinct frames, " << stats.tone_packets << " with tone)" << std::endl;
+        std::cout << "duration:         " << duration << " s" << std::endl;
+        std::cout << "achieved fps:     " << fps << std::endl;
+        std::cout << "packet gap:       mean " << mean * 1e3 << " ms, stddev " << stddev * 1e3 << " ms, p99 " << p99 * 1e3 << " ms, max " << max_gap * 1e3 << " ms" << std::endl;
+        std::cout << "throughput:       " << throughput << " B/s (" << throughput * 1000 / opt.baudrate << "% of line)" << std::endl;
+        if (opt.protocol != LINK_PROTOCOL_RAW)
+            std::cout << "link:             " << protocol_names[opt.protocol] << ", " << stats.crc_errors << " CRC errors, " << stats.seq_gaps << " sequence gaps, "
+                      << stats.overruns << " overruns, " << stats.credits_sent << " credits sent" << std::endl;
+        if (stats.encoded_packets > 0)
+            std::cout << "rate control:     " << stats.encoded_packets << " RLE/delta packets, " << stats.decode_errors << " decode errors" << std::endl;
+        std::cout << "vons exit status: " << exit_code << std::endl;
+    }
+    if (exit_code != 0 || (min_fps > 0 && fps < min_fps) || stats.overruns > 0 || stats.decode_errors > 0)
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
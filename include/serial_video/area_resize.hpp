@@ -0,0 +1,41 @@
+#ifndef __AREA_RESIZE_HPP__
+#define __AREA_RESIZE_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#define AREA_WEIGHT_BITS 14                    // 系数定点数的小数位数（Q14）
+#define AREA_WEIGHT_ONE (1 << AREA_WEIGHT_BITS) // 每个输出像素在单个方向上的系数之和
+
+/**
+ * @brief 8位灰度图像的区域（盒式）缩放，结果与OpenCV的INTER_AREA一致（缩小时误差不超过1）
+ *
+ * 构造时为任意缩放比例预先计算两个方向的定点系数表，运行时先按行加权累加（SIMD），再按列加权求和
+ */
+class area_resize
+{
+public:
+    area_resize(int in_width, int in_height, int out_width, int out_height);
+    void resize(const uint8_t *in, uint8_t *out);
+
+private:
+    /**
+     * @brief 一个输出像素在某个方向上覆盖的输入像素范围及其系数
+     *
+     */
+    struct span
+    {
+        int first;  // 第一个输入像素
+        int count;  // 输入像素数
+        int weight; // 在weights中的起始下标
+    };
+
+    int in_width, in_height, out_width, out_height;
+    std::vector<span> x_spans, y_spans;
+    std::vector<uint16_t> x_weights, y_weights;
+    std::vector<uint32_t> row_acc; // 一个输出行对应的纵向加权累加结果（Q14）
+    static void build_table(int in_size, int out_size, std::vector<span> &spans, std::vector<uint16_t> &weights);
+    static void accumulate_row(const uint8_t *row, uint16_t weight, uint32_t *acc, int length, int first);
+};
+
+#endif
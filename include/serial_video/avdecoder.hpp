@@ -6,12 +6,31 @@
 #define DEFAULT_THREAD_NUM 4                       // 软解默认4线程
 #define VIDEO_QUEUE_LENGTH_MAX (1024 * 1024 * 100) // 视频队列长度最大100MiB
 #define AUDIO_QUEUE_LENGTH_MAX (1024 * 10)         // 音频队列长度最大20KiB（10240 * sizeof(uint16_t)）
+#define AUDIO_SAMPLERATE_MIN 8192                  // 蜂鸣器最高输出255*16Hz，分析采样率至少为其两倍
+#define AUDIO_ANALYSIS_SAMPLERATE 11025            // 推荐的降采样分析采样率
+#define AUDIO_RESAMPLE_FILTER_SIZE 32              // 重采样抗混叠滤波器长度
+#define AUDIO_RESAMPLE_CUTOFF 0.9                  // 重采样滤波器截止频率（相对于输出奈奎斯特频率）
+#define FAST_START_PROBESIZE (32 * 1024)           // 快速启动模式下最多探测32KiB数据
+#define FAST_START_ANALYZE_DURATION 200000         // 快速启动模式下最多分析200ms（单位：微秒）
+#define LIVE_PROBESIZE 32                          // 实时输入只探测libav允许的最小字节数
+#define DEMUX_VIDEO_PACKETS_MAX 64                 // 解复用后最多缓冲的视频数据包数
+#define DEMUX_AUDIO_PACKETS_MAX 256                // 解复用后最多缓冲的音频数据包数（音频包小且密集）
 
 #include <string>
 #include <cstdint>
 #include <mutex>
 #include <atomic>
-#include <queue>
+#include <vector>
+#include <utility>
+#include <thread>
+
+#include "serial_video/ring_buffer.hpp"
+
+class startup_timer;
+class metrics;
+class tracer;
+class trace_buffer;
+class mmap_io;
 
 extern "C"
 {
@@ -23,6 +42,32 @@ extern "C"
 #include <libswscale/swscale.h>
 };
 
+/**
+ * @brief 队列中的一个数据包
+ *
+ */
+struct queued_packet
+{
+    AVPacket *pkt;
+    uint64_t arrival_ns;    // 到达时刻
+    uint64_t seek_serial;   // 不为0时是跳转标记（pkt为NULL）：解码线程冲洗解码器，之后的数据来自新位置
+    int64_t seek_target_us; // 跳转标记的目标位置（微秒，相对于媒体开头）
+};
+
+/**
+ * @brief 解复用线程到解码线程之间的有界数据包队列
+ *
+ * 解码线程用完的数据包结构体放回spare，解复用线程优先从中取用，稳定运行时不再分配AVPacket
+ */
+struct packet_queue
+{
+    ring_buffer<queued_packet> packets; // 数据包及其到达时刻
+    ring_buffer<AVPacket *> spare;      // 可复用的空数据包
+    std::mutex lock;
+    std::atomic<int> eof{0}; // 解复用已结束，不会再有新数据包
+    size_t limit = 0;        // 最多缓冲的数据包数
+};
+
 /**
  * @brief 视频解码类（将视频解码为灰度视频帧和单声道16bit音频）
  *
@@ -38,9 +83,30 @@ public:
     double get_audio_samplerate(void);
     int get_video_width(void);
     int get_video_height(void);
+    int get_video_frame_size(void);
+    void set_audio_samplerate(int samplerate);
+    void set_output_format(int width, int height, double framerate, int samplerate);
+    void set_pixel_format(AVPixelFormat format);
+    void set_audio_skip(int64_t samples);
+    void set_audio_enabled(int enabled);
+    int64_t get_video_frames_out(void);
+    int64_t get_audio_samples_out(void);
+    void request_seek(double seconds);
+    void set_probe_limit(int64_t probesize, int64_t analyze_duration);
+    void set_input_format(const std::string &format);
+    void set_input_option(const std::string &key, const std::string &value);
+    void set_live(int live);
+    void set_queue_limit(size_t length);
+    void set_audio_queue_limit(size_t length);
+    void set_mmap_io(int enabled);
+    void set_interrupt_flag(std::atomic<int> *flag);
+    uint64_t get_io_read_calls(void);
+    void set_startup_timer(startup_timer *timer);
+    void set_metrics(metrics *stats);
+    void set_tracer(tracer *trace);
 
-    void decode(std::queue<uint8_t> &video_frame, std::queue<uint16_t> &audio_pcm);
-    void streamed_decode(std::queue<uint8_t> &video_frame, std::mutex &video_lock, std::queue<uint16_t> &audio_pcm, std::mutex &audio_lock, std::atomic<int> &abort_flag);
+    void decode(ring_buffer<uint8_t> &video_frame, ring_buffer<uint16_t> &audio_pcm);
+    void streamed_decode(ring_buffer<uint8_t> &video_frame, std::mutex &video_lock, ring_buffer<uint16_t> &audio_pcm, std::mutex &audio_lock, std::atomic<int> &abort_flag);
 
 private:
     std::string filepath;
@@ -51,6 +117,42 @@ private:
     AVCodecContext *video_decoder_ctx, *audio_decoder_ctx;
     AVBufferRef *hw_device_ctx;
     const AVCodec *video_decoder, *audio_decoder;
+    int audio_out_samplerate;
+    int64_t probesize, analyze_duration;
+    std::string input_format;
+    std::vector<std::pair<std::string, std::string>> input_options;
+    int live;
+    size_t video_queue_limit;
+    size_t audio_queue_limit;
+    int use_mmap_io;
+    mmap_io *mapped_input;
+    std::atomic<int> *interrupt_flag;    // 置1后中断阻塞中的打开和读取（如没有写入端的命名管道、缓慢的网络地址）
+    startup_timer *timer;
+    metrics *stats;
+    tracer *trace;
+    int output_width, output_height;     // 固定的输出尺寸，为0时保持原尺寸
+    AVPixelFormat output_pix_fmt;        // 视频帧的像素格式（灰度或RGB24）
+    double output_framerate;             // 固定的输出帧率，为0时保持原帧率
+    int forced_samplerate;               // 固定的输出采样率，为0时不固定
+    int64_t video_frames_out, audio_samples_out; // 已输出的视频帧数和音频样本数
+    int64_t audio_skip;                  // 音频输出开头还需丢弃的样本数
+    int audio_enabled;
+    std::atomic<uint64_t> seek_serial;    // 每次请求跳转加1
+    std::atomic<int64_t> seek_target_us;  // 最近一次请求的目标位置（微秒）
+    int get_audio_out_samplerate(void);
+    int get_sws_flags(void);
+    int setup_audio_resampler(SwrContext **swr_ctx);
+    void demux_packets(packet_queue &video_packets, packet_queue &audio_packets, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed);
+    void decode_video_packets(packet_queue &packets, ring_buffer<uint8_t> &video_frame, std::mutex &video_lock, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed);
+    void decode_audio_packets(packet_queue &packets, ring_buffer<uint16_t> &audio_pcm, std::mutex &audio_lock, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed);
+    int push_audio(ring_buffer<uint16_t> &audio_pcm, std::mutex &audio_lock, uint16_t *samples, int count, uint64_t serial, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed, trace_buffer *tb, int64_t audio_frames);
+    int pop_packet(packet_queue &queue, queued_packet &item, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed);
+    void seek_input(packet_queue &video_packets, packet_queue &audio_packets, uint64_t serial, int64_t target_us);
+    int64_t frame_time_us(const AVFrame *frame, const AVStream *stream);
+    double source_framerate(void);
+    static int interrupt_requested(void *flag);
+    static void recycle_packet(packet_queue &queue, AVPacket *&pkt);
+    static void clear_packets(packet_queue &queue);
     static AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts);
 };
 
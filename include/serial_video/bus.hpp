@@ -0,0 +1,70 @@
+#ifndef __BUS_HPP__
+#define __BUS_HPP__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+#include <condition_variable>
+#include <cstdint>
+
+#include "serial_video/sink.hpp"
+
+class bus;
+
+/**
+ * @brief 多点总线上一个地址的输出端，交给该地址流水线的传输阶段使用
+ *
+ * write把数据包交给总线排队，轮到它时由调用线程自己写入共用的输出端，写完才返回（与直接写串口一样阻塞）
+ */
+class bus_sink : public sink
+{
+public:
+    bus_sink(bus *owner, uint8_t addr, double framerate);
+    void open(void) override;
+    ssize_t write(const uint8_t *data, size_t length) override;
+    void close(void) override;
+    int is_serial(void) override;
+
+private:
+    friend class bus;
+    bus *owner;
+    uint8_t addr;
+    std::chrono::steady_clock::duration period; // 该地址的帧周期，数据包须在下一帧之前发完
+    int opened;
+    // 正在排队的数据包
+    int pending;
+    std::chrono::steady_clock::time_point deadline;
+    // 统计
+    uint64_t bytes, packets, late_packets, wait_ns;
+};
+
+/**
+ * @brief 多点总线（RS-485）：多路流水线共用一个输出端，各自的数据包以帧头中的地址区分
+ *
+ * 同时有多个数据包等待时按截止时刻最早优先（EDF）依次写出，截止时刻为该地址提交数据包的时刻加一个帧周期，
+ * 所以帧率不同的各路都能保持自己的节奏；线路总容量不够时，超出截止时刻的数据包计入late。
+ * 只支持不需要回传的帧协议（流量控制的回报在半双工总线上无法按地址区分）
+ */
+class bus
+{
+public:
+    bus(sink *output);
+    sink *attach(uint8_t addr, double framerate);
+    void report(std::ostream &out, double seconds, int baudrate);
+
+private:
+    friend class bus_sink;
+    sink *output;
+    std::mutex lock;
+    std::condition_variable turn;          // 总线空闲，排队的数据包重新比较截止时刻
+    std::vector<std::unique_ptr<bus_sink>> endpoints;
+    int opened;                            // 已打开的地址数，第一个打开时打开输出端，最后一个关闭时关闭
+    int busy;                              // 有数据包正在写入
+    uint64_t bytes;                        // 总字节数
+    bus_sink *earliest(void);
+};
+
+#endif
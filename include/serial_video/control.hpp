@@ -0,0 +1,39 @@
+#ifndef __CONTROL_HPP__
+#define __CONTROL_HPP__
+
+#include <string>
+#include <atomic>
+#include <thread>
+
+class pipeline;
+
+#define CONTROL_POLL_INTERVAL_MS 100 // 服务线程检查停止标志的间隔
+#define CONTROL_SEEK_WAIT_MS 2000    // 跳转后等待新位置第一个数据包写出的最长时间
+#define CONTROL_LINE_MAX 256         // 一条命令的最大长度
+
+/**
+ * @brief 运行时控制通道，按行接收命令并逐行回复
+ *
+ * 命令：pause、resume、seek SECONDS、rate FACTOR、status、stop，回复以"ok"或"error:"开头。
+ * 通道为Unix域套接字（同一时刻服务一个连接），为"-"时读取标准输入、回复写到标准输出
+ */
+class control_server
+{
+public:
+    control_server(pipeline &target, const char *path);
+    ~control_server();
+    void start();
+    void stop();
+
+private:
+    pipeline &target;
+    std::string path;
+    int listen_fd, client_fd;
+    std::atomic<int> stop_flag;
+    std::thread serve_thread;
+    void serve();
+    std::string execute(const std::string &line);
+    void reply(int fd, const std::string &text);
+};
+
+#endif
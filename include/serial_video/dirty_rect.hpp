@@ -0,0 +1,48 @@
+#ifndef __DIRTY_RECT_HPP__
+#define __DIRTY_RECT_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define RECT_TILE_SIZE 8          // 以8x8像素的块为单位比较帧间变化
+#define RECT_HEADER_SIZE 8        // 每个矩形的头：x y w h（各2字节，小端）
+#define RECT_BYTES_PER_PIXEL 2    // RGB565
+#define RECT_CARRY_FRAMES 4       // 未用完的预算最多累积几帧
+
+/**
+ * @brief 按脏矩形编码彩色视频帧，用于驱动ST7735/ILI9341一类可以按窗口写入显存的TFT屏
+ *
+ * 编码器保存接收端当前的帧，逐块与新帧比较，把相邻的变化块合并为矩形，每个矩形的像素按行原样发送，
+ * 接收端设置窗口（CASET/RASET）后直接写入显存。限定预算时只发送预算内的矩形（放不下的矩形按整块截断），
+ * 其余留到之后的帧从中断处继续；预算有余时再按块行轮流重发未变化的部分，丢包的接收端据此逐步恢复。
+ * 从未发送过的块总是视为有变化，所以第一帧（以及reset之后）会发送整个画面。
+ *
+ * 负载格式（LINK_TYPE_AV_RECT）：音频字节 | 若干矩形：x y w h（各2字节小端） 像素（w*h*2字节，逐行）
+ */
+class dirty_rect
+{
+public:
+    dirty_rect(int width, int height, size_t max_payload);
+    size_t encode(const uint8_t *packet, double budget);
+    const uint8_t *get_output(void);
+    int get_rects(void);
+    void reset(void);
+    static int decode(const uint8_t *payload, size_t length, uint8_t *frame, int width, int height, uint8_t &audio);
+
+private:
+    int width, height, tiles_x, tiles_y;
+    size_t max_payload;                 // 负载的上限（含音频字节）
+    std::vector<uint8_t> reference;     // 接收端当前的帧
+    std::vector<uint8_t> sent;          // 每块：接收端已有这一块
+    std::vector<uint8_t> dirty;         // 每块：本帧需要发送
+    std::vector<uint8_t> output;        // 编码结果
+    double balance;                     // 可用的字节数（已累积的预算）
+    int rects;                          // 上一帧发送的矩形数
+    int resume_row;                     // 预算不足时下一帧从这一块行开始
+    int refresh_row;                    // 下一次重发的块行
+    void add_rect(const uint8_t *frame, int x, int y, int w, int h, size_t &used);
+    int send_rows(const uint8_t *frame, int first_row, size_t &used, size_t limit);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __EXECUTOR_HPP__
+#define __EXECUTOR_HPP__
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+
+#define TASK_YIELD 0   // 有进展，可以立即再次运行
+#define TASK_BLOCKED 1 // 等待队列（输入不足或输出已满）或终止标志，由wake唤醒
+#define TASK_SLEEP 2   // 休眠到任务给出的时刻（节奏定时器）
+#define TASK_DONE 3    // 已结束
+
+/**
+ * @brief 协作式执行器：在少量线程上轮流运行多个可恢复的任务
+ *
+ * 任务每次被恢复时最多处理一个单位（一帧、一个音频块或一个数据包）后返回TASK_*，
+ * 因等待队列或定时器而挂起时不占用线程。同一任务不会被两个线程同时恢复。
+ * 返回TASK_BLOCKED的任务挂起到下一次wake（队列的push/pop经ring_buffer::set_notify调用，终止标志由设置者调用）或有任务结束
+ */
+class executor
+{
+public:
+    typedef std::function<int(std::chrono::steady_clock::time_point &wakeup)> task;
+    executor(int threads);
+    void add(task step);
+    void set_thread_runner(std::function<void(const std::function<void(void)> &body)> runner);
+    void run(void);
+    void wake(void);
+    static void notify(void *exec);
+
+private:
+    struct entry
+    {
+        task step;
+        int state;
+        int running;
+        std::chrono::steady_clock::time_point wakeup; // 阻塞或休眠的任务在这之后才再次运行
+    };
+    int threads;
+    std::vector<entry> tasks;
+    std::function<void(const std::function<void(void)> &)> thread_runner; // 额外线程通过它运行，可在前后设置线程属性（绑定CPU、实时优先级）
+    std::mutex lock;
+    std::condition_variable task_returned;
+    size_t next;
+    int remaining;
+    int untimed_waiters; // 因所有任务都在运行而无限期等待的线程数
+    std::atomic<uint64_t> wakes; // wake的次数，任务恢复前记下，返回TASK_BLOCKED时变了说明期间有过唤醒
+    std::atomic<int> parked;     // 返回TASK_BLOCKED后挂起、等待wake的任务数
+    std::exception_ptr failure;
+    void worker(void);
+    void unpark(void);
+};
+
+#endif
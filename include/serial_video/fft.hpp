@@ -3,11 +3,21 @@
 
 #include <ccomplex>
 #include <fftw3.h>
-#include <queue>
 #include <mutex>
 #include <atomic>
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include "serial_video/ring_buffer.hpp"
 
 #define FFT_QUEUE_LENGTH_MAX 10240 // 队列长度最大10KiB
+#define FFT_BATCH_WINDOWS 256      // 批量变换时单个计划包含的窗口数
+
+class startup_timer;
+class metrics;
+class tracer;
+class trace_buffer;
 
 /**
  * @brief 音频快速傅立叶变换，取功率最大的频率
@@ -16,13 +26,48 @@
 class fft
 {
 public:
-    fft(int input_samplerate, int output_samplerate, double threshold);
-    void calculate(std::queue<uint16_t> &input, std::queue<uint8_t> &output);
-    void streamed_calculate(std::queue<uint16_t> &input, std::mutex &input_lock, std::queue<uint8_t> &output, std::mutex &output_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    fft(int input_samplerate, double output_samplerate, double threshold);
+    ~fft();
+    void calculate(ring_buffer<uint16_t> &input, ring_buffer<uint8_t> &output);
+    void streamed_calculate(ring_buffer<uint16_t> &input, std::mutex &input_lock, ring_buffer<uint8_t> &output, std::mutex &output_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    int resume_calculate(ring_buffer<uint16_t> &input, std::mutex &input_lock, ring_buffer<uint8_t> &output, std::mutex &output_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    void batch_calculate(const uint16_t *pcm, size_t count, std::vector<uint8_t> &output, int thread_num = 1);
+    void set_wisdom_dir(const std::string &dir);
+    void set_startup_timer(startup_timer *timer);
+    void set_metrics(metrics *stats);
+    void set_tracer(tracer *trace);
+    void set_queue_limit(size_t length);
+    void set_epoch(std::atomic<uint32_t> *epoch);
+    void set_batch(int enabled);
+    int get_window_length(void);
 
 private:
-    int input_samplerate, output_samplerate;
+    int input_samplerate;
+    double output_samplerate;
     double threshold;
+    size_t queue_limit;
+    std::string wisdom_dir;
+    startup_timer *timer;
+    metrics *stats;
+    tracer *trace;
+    std::atomic<uint32_t> *epoch;
+    int batch;                                        // 流式计算时输入够FFT_BATCH_WINDOWS个窗口就批量变换（离线渲染）
+    // resume_calculate在两次恢复之间保存的状态
+    int resume_length;                                // 缓冲区长度，为0时尚未创建计划
+    double *resume_input;
+    fftw_complex *resume_output;
+    fftw_plan resume_plan;
+    int pending;                                      // 已算出的频率等待输出
+    uint8_t pending_freq;
+    uint32_t pending_epoch;                           // 这一块取出时的纪元
+    int64_t blocks;                                   // 音频块序号
+    std::chrono::steady_clock::time_point wait_begin; // 开始等待队列的时刻
+    trace_buffer *tb;
+    void release_resume(void);
+    uint8_t peak_frequency(const fftw_complex *spectrum, int length);
+    void execute_batch(fftw_plan p, const uint16_t *pcm, size_t windows, double *input_array, fftw_complex *output_array, uint8_t *freqs);
+    fftw_plan make_plan(int length, int howmany, double *input_array, fftw_complex *output_array);
+    static void destroy_plan(fftw_plan p);
 };
 
 #endif
\ No newline at end of file
@@ -1,12 +1,23 @@
 #ifndef __GRAY2BW_HPP__
 #define __GRAY2BW_HPP__
 
-#include <opencv2/opencv.hpp>
+#include "serial_video/area_resize.hpp"
+#include "serial_video/ring_buffer.hpp"
 #include <cstdint>
 #include <mutex>
-#include <queue>
 #include <atomic>
+#include <vector>
+#include <memory>
+#include <chrono>
 #define BW_QUEUE_LENGTH_MAX (1024 * 100) // 队列长度最大100KiB
+#define BW_LEVEL_STEP 51                  // 五档抖动每档覆盖的灰度范围
+#define BW_HYSTERESIS_DEFAULT 12          // 推荐的抖动迟滞量（灰度级），约为一档的四分之一
+
+class startup_timer;
+class metrics;
+class tracer;
+class trace_buffer;
+class shm_reader;
 
 /**
  * @brief 灰度转抖动后的二值图像
@@ -16,12 +27,41 @@ class gray2bw
 {
 public:
     gray2bw(int in_width, int in_height, int out_width, int out_height);
-    void convert(std::queue<uint8_t> &in_stream, std::queue<uint8_t> &out_stream);
-    void streamed_convert(std::queue<uint8_t> &in_stream, std::mutex &in_lock, std::queue<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    void convert(ring_buffer<uint8_t> &in_stream, ring_buffer<uint8_t> &out_stream);
+    void streamed_convert(ring_buffer<uint8_t> &in_stream, std::mutex &in_lock, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    void streamed_convert(shm_reader &source, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    int resume_convert(ring_buffer<uint8_t> &in_stream, std::mutex &in_lock, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    void set_startup_timer(startup_timer *timer);
+    void set_metrics(metrics *stats);
+    void set_tracer(tracer *trace);
+    void set_queue_limit(size_t length);
+    void set_epoch(std::atomic<uint32_t> *epoch);
+    void set_hysteresis(int margin);
+    void resize(const uint8_t *in, uint8_t *out);
+    void dither(const uint8_t *in, uint8_t *out);
+    void pack(const uint8_t *in, uint8_t *out);
+    int get_frame_size(void);
 
 private:
-    cv::Mat in_frame, out_frame;
+    std::vector<uint8_t> in_frame, resized_frame, bw_frame, packed_frame;
+    std::vector<uint8_t> m_prev_packed; // 上一帧的取模结果，用于统计帧间变化的字节数
+    std::vector<uint8_t> m_levels;      // 每个2x2块上一帧的档位，迟滞抖动时使用
+    int m_hysteresis;                   // 迟滞量，为0时每帧独立抖动
     int m_in_width, m_in_height, m_out_width, m_out_height;
+    size_t m_queue_limit;
+    std::unique_ptr<area_resize> m_resizer;
+    startup_timer *m_timer;
+    metrics *m_stats;
+    tracer *m_trace;
+    std::atomic<uint32_t> *m_epoch;
+    // resume_convert在两次恢复之间保存的状态
+    int m_pending;                                      // 已转换的一帧等待输出
+    uint32_t m_pending_epoch;                           // 这一帧取出时的纪元
+    int64_t m_frames;                                   // 帧序号
+    std::chrono::steady_clock::time_point m_wait_begin; // 开始等待队列的时刻
+    trace_buffer *m_tb;                                 // 跟踪缓冲区，第一次恢复时注册
+    void process(trace_buffer *tb, int64_t frame);
+    void finish(trace_buffer *tb, int64_t frame);
 };
 
 #endif
\ No newline at end of file
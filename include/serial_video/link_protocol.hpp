@@ -0,0 +1,60 @@
+#ifndef __LINK_PROTOCOL_HPP__
+#define __LINK_PROTOCOL_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define LINK_PROTOCOL_RAW 0    // 原始模式：不加帧头，直接发送视频帧+音频字节（兼容旧固件）
+#define LINK_PROTOCOL_FRAMED 1 // 带帧头、序号和CRC的帧
+#define LINK_PROTOCOL_CREDIT 2 // 帧协议+接收端通过RX回报空闲缓冲区的流量控制
+
+#define LINK_SYNC_0 0xA5      // 同步字第一字节
+#define LINK_SYNC_1 0x5A      // 同步字第二字节
+#define LINK_HEADER_SIZE 8    // sync(2) addr(1) type(1) seq(2) len(2)
+#define LINK_CRC_SIZE 2       // CRC-16/CCITT-FALSE，覆盖addr到负载末尾
+#define LINK_OVERHEAD (LINK_HEADER_SIZE + LINK_CRC_SIZE)
+#define LINK_BROADCAST 0xFF   // 广播地址
+
+#define LINK_TYPE_AV 0x01     // 主机->接收端：视频帧+音频字节
+#define LINK_TYPE_AV_RLE 0x02   // 主机->接收端：音频字节+整帧的游程编码（见rate_control）
+#define LINK_TYPE_AV_DELTA 0x03 // 主机->接收端：音频字节+相对接收端当前帧的变化段（见rate_control）
+#define LINK_TYPE_AV_RECT 0x04  // 主机->接收端：音频字节+RGB565脏矩形（见dirty_rect）
+#define LINK_TYPE_CREDIT 0x81 // 接收端->主机：ack_seq(2) free_slots(1)
+
+/**
+ * @brief 串口链路的帧格式
+ *
+ * 帧：A5 5A | addr | type | seq（小端） | len（小端） | payload | crc16（小端）。
+ * 接收端以同步字定位帧头，长度越界或CRC错误时从同步字的下一字节重新搜索，所以丢字节后最多丢失当前这一帧。
+ *
+ * 流量控制：接收端在每收完一帧（以及空闲时定期）发送CREDIT帧，报告最后收到的序号ack_seq和此后还能缓冲的帧数free_slots。
+ * 主机只在 已发送但未被确认的帧数 < free_slots 时发送；回报的是绝对值，丢失的CREDIT帧会被下一个CREDIT帧覆盖。
+ */
+class link_protocol
+{
+public:
+    link_protocol(size_t max_payload);
+    static uint16_t crc16(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF);
+    static void write_header(uint8_t *frame, uint8_t addr, uint8_t type, uint16_t seq, uint16_t length);
+    static void write_crc(uint8_t *frame, uint16_t length);
+    static size_t encode(uint8_t *frame, uint8_t addr, uint8_t type, uint16_t seq, const uint8_t *payload, uint16_t length);
+
+    int feed(const uint8_t *data, size_t length, size_t &consumed);
+    uint8_t get_addr(void);
+    uint8_t get_type(void);
+    uint16_t get_seq(void);
+    uint16_t get_length(void);
+    const uint8_t *get_payload(void);
+    uint64_t get_crc_errors(void);
+    uint64_t get_discarded_bytes(void);
+
+private:
+    std::vector<uint8_t> buffer; // 已收到但尚未解析完的字节，有效帧从同步字开始
+    size_t filled, max_payload;
+    size_t frame_size;           // 上次返回的帧的长度，下次输入时丢弃
+    uint64_t crc_errors, discarded_bytes;
+    void drop(size_t count);
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#define METRICS_LATENCY_RING 256 // 记录视频帧到达时刻的环形缓冲区容量（帧）
+#define METRICS_WAKEUP_BUCKETS 10 // 唤醒延迟直方图的有限桶数（另有一个+Inf桶）
+
+/**
+ * @brief 单个处理阶段的计数器，每个计数器只由该阶段所在线程写入
+ *
+ */
+struct stage_metrics
+{
+    std::atomic<uint64_t> frames_in{0};      // 输入的帧（数据包、音频块）数
+    std::atomic<uint64_t> frames_out{0};     // 输出的帧数
+    std::atomic<uint64_t> wait_input_ns{0};  // 等待输入的时间
+    std::atomic<uint64_t> wait_output_ns{0}; // 等待输出队列空间的时间
+    std::atomic<uint64_t> dropped_frames{0}; // 丢弃的帧数
+};
+
+/**
+ * @brief 流水线运行指标，以Prometheus文本格式导出
+ *
+ */
+class metrics
+{
+public:
+    metrics();
+    void render(std::string &out);
+
+    /**
+     * @brief 单写者计数器累加，不需要原子读-改-写指令（热路径上无锁无总线锁定）
+     *
+     * @param counter 计数器
+     * @param value 增量
+     */
+    static inline void add(std::atomic<uint64_t> &counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    /**
+     * @brief 设置仪表值
+     *
+     * @param gauge 仪表
+     * @param value 当前值
+     */
+    static inline void set(std::atomic<uint64_t> &gauge, uint64_t value)
+    {
+        gauge.store(value, std::memory_order_relaxed);
+    }
+    /**
+     * @brief 计算从给定时刻到现在经过的时间
+     *
+     * @param since 起始时刻
+     * @return uint64_t 经过的纳秒数
+     */
+    static inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+    }
+    /**
+     * @brief 获取当前时刻（steady_clock纳秒数）
+     *
+     * @return uint64_t 纳秒
+     */
+    static inline uint64_t now_ns(void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    void frame_arrived(uint64_t frame, uint64_t arrival_ns);
+    void frame_written(uint64_t frame);
+    void record_wakeup(uint64_t late_ns);
+    void report_wakeup(std::ostream &out);
+
+    stage_metrics decoder, audio_decoder, gray, fft, transfer; // decoder为解复用+视频解码，audio_decoder为独立的音频解码线程
+    std::atomic<uint64_t> av_video_depth{0}, gray_video_depth{0}, av_audio_depth{0}, fft_audio_depth{0}; // 各队列当前长度（元素个数），由持有队列锁的一方写入
+    std::atomic<uint64_t> encoded_full{0}, encoded_rle{0}, encoded_delta{0}, encoded_partial{0}, encoded_bytes{0}; // 码率控制：各编码的帧数、编码后的字节数（含帧头），仅由传输线程写入
+    std::atomic<uint64_t> encoded_rect{0}, rects{0}; // 彩色输出：按脏矩形发送的帧数、矩形数，仅由传输线程写入
+    std::atomic<uint64_t> changed_bytes{0};                                                             // 转换后与上一帧不同的字节数，仅由gray2bw线程写入
+    std::atomic<uint64_t> bytes_written{0}, writes{0}, write_ns{0}, write_ns_max{0}, late_frames{0};     // 串口写入统计，仅由传输线程写入
+    std::atomic<uint64_t> latency_ns{0}, latency_ns_max{0}, latency_ns_last{0}, latency_samples{0};   // 端到端延迟（视频帧到达至串口写完），仅由传输线程写入
+    std::atomic<uint64_t> credit_wait_ns{0}, credit_timeouts{0}, link_rx_errors{0};                   // 帧协议流量控制：等待接收端空闲缓冲区的时间、超时次数、回传帧CRC错误数
+    std::atomic<uint64_t> seek_begin_ns{0}, seeks{0}, seek_latency_ns{0}, seek_latency_ns_max{0}, seek_latency_ns_last{0}; // 跳转：请求时刻（由控制方写入），请求到新位置第一个数据包写完的延迟（由传输线程写入）
+    std::atomic<uint64_t> wakeup_ns{0}, wakeup_ns_max{0}, wakeups{0};                                 // 传输线程定时唤醒比预定时刻晚的时间
+    std::atomic<uint64_t> wakeup_buckets[METRICS_WAKEUP_BUCKETS + 1];                               // 唤醒延迟直方图（非累积）
+
+private:
+    std::atomic<uint64_t> arrival_frame[METRICS_LATENCY_RING]; // 环形缓冲区中各位置对应的帧序号+1（0表示空）
+    std::atomic<uint64_t> arrival_ns[METRICS_LATENCY_RING];    // 对应帧的到达时刻，由解码线程写入
+};
+
+/**
+ * @brief 在Unix域套接字上提供指标（兼容直接读取和HTTP GET）
+ *
+ */
+class metrics_server
+{
+public:
+    metrics_server(metrics &source, const char *socket_path);
+    ~metrics_server();
+    void start();
+    void stop();
+
+private:
+    metrics &source;
+    std::string socket_path;
+    int listen_fd;
+    std::atomic<int> stop_flag;
+    std::thread serve_thread;
+    void serve();
+};
+
+#endif
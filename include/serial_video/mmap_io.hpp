@@ -0,0 +1,38 @@
+#ifndef __MMAP_IO_HPP__
+#define __MMAP_IO_HPP__
+
+#include <string>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavformat/avio.h>
+};
+
+#define MMAP_IO_BUFFER_SIZE (1024 * 1024) // 每次向libav交付的读取窗口1MiB（默认file协议为32KiB）
+
+/**
+ * @brief 基于mmap的自定义AVIOContext，用于读取本地媒体文件
+ *
+ * 整个文件只映射一次并提示内核顺序预读，读取回调只做内存复制，不再产生read系统调用
+ */
+class mmap_io
+{
+public:
+    mmap_io(const char *path);
+    ~mmap_io();
+    AVIOContext *get_context(void);
+    uint64_t get_read_calls(void);
+
+private:
+    std::string path;
+    int fd;
+    uint8_t *data;
+    size_t size, pos;
+    AVIOContext *ctx;
+    uint64_t read_calls;
+    static int read_packet(void *opaque, uint8_t *buf, int buf_size);
+    static int64_t seek(void *opaque, int64_t offset, int whence);
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef __PIPELINE_HPP__
+#define __PIPELINE_HPP__
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <condition_variable>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+#include "serial_video/metrics.hpp"
+#include "serial_video/ring_buffer.hpp"
+#include "serial_video/link_protocol.hpp"
+
+#define PIPELINE_SCREEN_WIDTH 128 // 默认屏幕宽度
+#define PIPELINE_SCREEN_HEIGHT 64 // 默认屏幕高度
+#define PIPELINE_COLOR_WIDTH 160 // 彩色输出的默认屏幕宽度（ST7735）
+#define PIPELINE_COLOR_HEIGHT 128 // 彩色输出的默认屏幕高度
+#define PIPELINE_LIVE_AUDIO_FRAMES 2 // 实时模式下FFT输出队列最多缓冲的帧数
+
+class avdecoder;
+class gray2bw;
+class rgb565;
+class fft;
+class transfer;
+class thread_pool;
+class startup_timer;
+class tracer;
+class sink;
+class bus;
+class shm_reader;
+class executor;
+
+/**
+ * @brief 流水线参数
+ *
+ */
+struct pipeline_config
+{
+    std::string input_media;                    // 输入媒体，shm:NAME为外部渲染程序的共享内存帧环（只支持黑白输出，不能有播放列表）
+    std::vector<std::string> playlist;          // 之后依次无缝播放的媒体，输出格式与第一项一致
+    std::string output_device;                  // 串口设备或输出端描述（serial: file: unix: null: pgm: y4m:）
+    int unpaced = 0;                            // 不按帧率控制节奏，以最快速度输出（用于测量吞吐）
+    int link_protocol = LINK_PROTOCOL_RAW;      // 链路协议：裸数据包、带帧头和CRC的帧、帧加接收端流量控制
+    int link_addr = 0;                          // 帧头中的接收端地址
+    bus *shared_bus = NULL;                     // 多点总线，不为NULL时以link_addr挂在总线上，不按output_device创建输出端
+    int rate_control = 0;                       // 按每帧字节预算编码视频帧（需要帧协议）
+    double link_share = 1;                      // 本路可用的线路份额，码率控制按它计算预算（多点总线上各路均分）
+    int baudrate = 115200;                      // 波特率
+    double audio_threshold = -1;                // FFT功率谱阈值
+    int audio_samplerate = 0;                   // FFT分析采样率，为0时保持原采样率
+    int screen_width = PIPELINE_SCREEN_WIDTH;   // 屏幕宽度
+    int screen_height = PIPELINE_SCREEN_HEIGHT; // 屏幕高度
+    int dither_hysteresis = 0;                  // 抖动迟滞量（灰度级），为0时每帧独立抖动
+    int color = 0;                              // RGB565彩色输出（TFT屏），帧协议下按脏矩形发送
+    int color_dither = 0;                       // 彩色输出时使用有序抖动
+    int64_t probesize = 0;                      // 最大探测字节数，为0时使用libav默认值
+    int64_t analyze_duration = 0;               // 最大分析时长（微秒），为0时使用libav默认值
+    std::string wisdom_dir;                     // FFTW wisdom缓存目录，为空时不缓存
+    int mmap_io = 0;                            // 通过mmap读取本地文件
+    int transfer_priority = 0;                  // 传输线程的SCHED_FIFO优先级，为0时不使用实时调度
+    std::vector<int> decoder_cpus, gray_cpus, fft_cpus, transfer_cpus; // 各阶段绑定的CPU，为空时不绑定（解码器的子线程随解复用线程）
+    int prefault = 0;                           // 进入循环前预先触碰线程栈（配合mlockall使用）
+    int executor_threads = 0;                   // 大于0时gray2bw、FFT和传输作为协作任务运行在这么多个线程上（单核、双核板子），为0时每阶段一个线程
+    int live = 0;                               // 实时输入（标准输入、命名管道），最少探测、每级只缓冲一帧
+    std::string input_format;                   // 输入格式（如rawvideo、yuv4mpegpipe），为空时自动探测
+    std::vector<std::pair<std::string, std::string>> input_options; // 输入格式的私有选项（如video_size、pixel_format、framerate）
+    startup_timer *timer = NULL;                // 启动计时器，为NULL时不计时
+    tracer *trace = NULL;                       // 跟踪记录器，为NULL时不跟踪
+};
+
+/**
+ * @brief 解码-转换-FFT-传输流水线，持有自己的全部阶段、队列和状态，同一进程中可以同时运行多个
+ *
+ */
+class pipeline
+{
+public:
+    pipeline(const pipeline_config &config, thread_pool *pool = NULL);
+    ~pipeline();
+    void start(void);
+    void stop(void);
+    void wait(void);
+    int is_running(void);
+    double get_video_framerate(void);
+    metrics &get_metrics(void);
+    int pause(int paused);
+    int set_rate(double rate);
+    int seek(double seconds);
+    int is_paused(void);
+    double get_rate(void);
+
+private:
+    pipeline_config config;
+    std::unique_ptr<thread_pool> own_pool; // 未指定线程池时自己持有一个
+    thread_pool *pool;
+    std::unique_ptr<avdecoder> av;
+    std::unique_ptr<shm_reader> shm; // 共享内存输入时代替解码器
+    std::unique_ptr<gray2bw> gray;
+    std::unique_ptr<rgb565> color; // 彩色输出时代替gray2bw
+    std::unique_ptr<fft> freq;
+    std::unique_ptr<transfer> trans;
+    std::unique_ptr<sink> output; // 不在总线上时自己持有输出端
+    metrics stats;
+
+    ring_buffer<uint8_t> av_video, gray_video, fft_audio;
+    ring_buffer<uint16_t> av_audio;
+    std::mutex av_video_lock, av_audio_lock, gray_video_lock, fft_audio_lock;
+    std::atomic<int> decode_done, gray_done, fft_done;
+    std::atomic<int> item_done; // 播放列表中当前一项的解码结束标志
+    size_t audio_queue_limit; // 解码器音频队列的上限（字节），离线渲染时放大以便FFT批量变换
+    std::atomic<uint32_t> epoch; // 冲洗纪元，跳转清空队列时加1，各阶段据此丢弃处理中的旧数据
+
+    std::mutex state_lock;
+    std::condition_variable state_changed;
+    int started, running_stages, stop_requested;
+    avdecoder *playing; // 正在解码的一项，跳转作用于它
+    executor *coop;     // 协作式执行时的执行器，终止标志改变时唤醒其中挂起的任务
+    int paused;
+    double rate;
+    std::exception_ptr failure; // 第一个失败阶段的异常
+
+    avdecoder *open_decoder(const std::string &media, int first);
+    void align_audio(avdecoder *finished, avdecoder *next);
+    void run_stage(void (pipeline::*body)(void), std::atomic<int> *done_flag, const char *name, const std::vector<int> &cpus, int priority);
+    void run_decoder(void);
+    void run_shm(void);
+    void run_gray(void);
+    void run_fft(void);
+    void run_transfer(void);
+    void run_cooperative(void);
+    void drain(void);
+    void set_queue_notify(executor *exec);
+};
+
+#endif
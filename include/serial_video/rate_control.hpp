@@ -0,0 +1,54 @@
+#ifndef __RATE_CONTROL_HPP__
+#define __RATE_CONTROL_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define RATE_CARRY_FRAMES 4          // 未用完的预算最多累积几帧
+#define RATE_KEYFRAME_INTERVAL 150   // 每隔这么多帧尝试发送一次完整帧（全帧或RLE），丢帧的接收端借此恢复
+#define RATE_DELTA_GAP 3             // 两个变化之间相同的字节不超过这个数时合并为一段（段头3字节）
+#define RATE_SEGMENT_MAX 255         // 一段最多的字节数
+
+#define RATE_ENCODING_FULL 0    // 原样发送整帧
+#define RATE_ENCODING_RLE 1     // 整帧游程编码
+#define RATE_ENCODING_DELTA 2   // 全部变化段
+#define RATE_ENCODING_PARTIAL 3 // 预算内能发出的变化段，其余留到后面的帧（降低细节）
+#define RATE_ENCODINGS 4
+
+/**
+ * @brief 按每帧字节预算选择视频帧的编码
+ *
+ * 每帧的预算由波特率和帧率决定，未用完的部分最多累积RATE_CARRY_FRAMES帧。在预算内的无损编码
+ * （全帧、RLE、变化段）中选最短的；都超出预算时只发送预算内的变化段，从上次中断处继续，
+ * 所以画面在连续几帧内逐步补全而不是降低帧率。编码器保存接收端当前的帧，只有真正发出的部分才更新它。
+ *
+ * 负载格式（帧类型见link_protocol）：
+ *  LINK_TYPE_AV：视频帧 | 音频字节
+ *  LINK_TYPE_AV_RLE：音频字节 | 若干组：控制字节c，c<128时后跟c+1个原样字节，否则后跟1个字节重复c-125次
+ *  LINK_TYPE_AV_DELTA：音频字节 | 若干段：偏移（2字节小端） 长度（1字节） 数据
+ */
+class rate_control
+{
+public:
+    rate_control(size_t frame_size);
+    size_t encode(const uint8_t *packet, double budget, uint8_t &type);
+    const uint8_t *get_output(void);
+    int get_encoding(void);
+    void reset(void);
+    static size_t encode_rle(const uint8_t *in, size_t length, uint8_t *out, size_t limit);
+    static size_t encode_delta(const uint8_t *frame, const uint8_t *reference, size_t length, uint8_t *out, size_t limit, size_t start, size_t &resume);
+    static int decode(uint8_t type, const uint8_t *payload, size_t length, uint8_t *frame, size_t frame_size, uint8_t &audio);
+
+private:
+    size_t frame_size;
+    std::vector<uint8_t> reference;           // 接收端当前的帧
+    std::vector<uint8_t> output, rle, delta;  // 各候选编码（含开头的音频字节）
+    double balance;                           // 可用的字节数（已累积的预算），可以为负（超支由之后的帧偿还）
+    int synced;                               // 接收端已有完整的一帧
+    int since_key;                            // 距上一个完整帧的帧数
+    size_t refresh_offset;                    // 部分发送时下一帧从这里开始
+    int encoding;                             // 上一帧选择的编码
+};
+
+#endif
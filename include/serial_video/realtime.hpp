@@ -0,0 +1,34 @@
+#ifndef __REALTIME_HPP__
+#define __REALTIME_HPP__
+
+#include <vector>
+#include <cstddef>
+#include <pthread.h>
+#include <sched.h>
+
+#define REALTIME_STACK_PREFAULT (256 * 1024) // 锁定内存后预先触碰的线程栈大小
+
+/**
+ * @brief 当前线程的实时调度与CPU绑定设置，析构时恢复原设置（线程池中的线程会被其他任务复用）
+ *
+ */
+class realtime
+{
+public:
+    realtime();
+    ~realtime();
+    int pin(const std::vector<int> &cpus);
+    int set_fifo(int priority);
+    static int lock_memory(void);
+    static void prefault(void *buffer, size_t length);
+    static void prefault_stack(void);
+    static int parse_cpu_list(const char *list, std::vector<int> &cpus);
+
+private:
+    pthread_t thread;
+    cpu_set_t saved_cpus;
+    int saved_policy, cpus_changed, policy_changed;
+    struct sched_param saved_param;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __RGB565_HPP__
+#define __RGB565_HPP__
+
+#include "serial_video/ring_buffer.hpp"
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#define RGB565_QUEUE_LENGTH_MAX (1024 * 256) // 队列长度最大256KiB（160x128时6帧）
+
+class startup_timer;
+class metrics;
+class tracer;
+class trace_buffer;
+
+/**
+ * @brief RGB24转TFT屏使用的RGB565（大端，与ST7735/ILI9341的RAMWR顺序一致），可选4x4有序抖动
+ *
+ * 输入已由解码器的swscale缩放到屏幕尺寸，这里只做量化和打包；运行指标与gray2bw共用转换阶段的计数
+ */
+class rgb565
+{
+public:
+    rgb565(int width, int height);
+    void convert(ring_buffer<uint8_t> &in_stream, ring_buffer<uint8_t> &out_stream);
+    void streamed_convert(ring_buffer<uint8_t> &in_stream, std::mutex &in_lock, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    int resume_convert(ring_buffer<uint8_t> &in_stream, std::mutex &in_lock, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done);
+    void set_startup_timer(startup_timer *timer);
+    void set_metrics(metrics *stats);
+    void set_tracer(tracer *trace);
+    void set_queue_limit(size_t length);
+    void set_epoch(std::atomic<uint32_t> *epoch);
+    void set_dither(int enabled);
+    void pack(const uint8_t *in, uint8_t *out);
+    int get_frame_size(void);
+
+private:
+    std::vector<uint8_t> in_frame, packed_frame;
+    std::vector<uint8_t> m_prev_packed; // 上一帧的打包结果，用于统计帧间变化的字节数
+    int m_dither;                       // 有序抖动，为0时直接截断
+    int m_width, m_height;
+    size_t m_queue_limit;
+    startup_timer *m_timer;
+    metrics *m_stats;
+    tracer *m_trace;
+    std::atomic<uint32_t> *m_epoch;
+    // resume_convert在两次恢复之间保存的状态
+    int m_pending;                                      // 已转换的一帧等待输出
+    uint32_t m_pending_epoch;                           // 这一帧取出时的纪元
+    int64_t m_frames;                                   // 帧序号
+    std::chrono::steady_clock::time_point m_wait_begin; // 开始等待队列的时刻
+    trace_buffer *m_tb;                                 // 跟踪缓冲区，第一次恢复时注册
+    void process(trace_buffer *tb, int64_t frame);
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef __RING_BUFFER_HPP__
+#define __RING_BUFFER_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#define RING_BUFFER_MIN_CAPACITY 64 // 首次分配的最小容量（元素个数）
+
+/**
+ * @brief 环形缓冲区，用作各阶段之间的队列
+ *
+ * 接口与std::queue的常用部分兼容，另有整块写入/取出。容量为2的幂，写满时翻倍扩容，之后不再缩小，
+ * 所以预热（或预先reserve）之后的稳定运行中不会再分配内存。本身不加锁，由调用者持有对应的锁。
+ * 设置了通知回调时，每次写入或取出后都调用它（持有调用者的锁），用于唤醒等待这个队列的协作任务。
+ *
+ * @tparam T 元素类型，必须可以按字节复制
+ */
+template <typename T>
+class ring_buffer
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ring_buffer element must be trivially copyable");
+
+public:
+    ring_buffer(size_t capacity = 0)
+    {
+        this->head = 0;
+        this->tail = 0;
+        this->mask = 0;
+        this->notify = NULL;
+        this->notify_arg = NULL;
+        if (capacity > 0)
+            this->reserve(capacity);
+    }
+
+    /**
+     * @brief 保证至少能容纳capacity个元素，已有数据保持不变
+     *
+     * @param capacity 容量（元素个数）
+     */
+    void reserve(size_t capacity)
+    {
+        if (capacity <= this->capacity())
+            return;
+        size_t new_capacity = RING_BUFFER_MIN_CAPACITY;
+        while (new_capacity < capacity)
+            new_capacity <<= 1;
+        std::unique_ptr<T[]> new_data(new T[new_capacity]);
+        size_t count = this->size();
+        this->copy_out(new_data.get(), count);
+        this->data = std::move(new_data);
+        this->mask = new_capacity - 1;
+        this->head = 0;
+        this->tail = count;
+    }
+
+    /**
+     * @brief 设置通知回调（见executor::notify）
+     *
+     * @param notify 回调，为NULL时不通知
+     * @param arg 回调的参数
+     */
+    void set_notify(void (*notify)(void *), void *arg)
+    {
+        this->notify = notify;
+        this->notify_arg = arg;
+    }
+
+    size_t size(void) const
+    {
+        return this->tail - this->head;
+    }
+
+    int empty(void) const
+    {
+        return this->tail == this->head;
+    }
+
+    size_t capacity(void) const
+    {
+        return this->data ? this->mask + 1 : 0;
+    }
+
+    void push(const T &value)
+    {
+        if (this->size() == this->capacity())
+            this->reserve(this->capacity() + 1);
+        this->data[this->tail++ & this->mask] = value;
+        this->notify_change();
+    }
+
+    /**
+     * @brief 整块写入
+     *
+     * @param values 数据
+     * @param count 元素个数
+     */
+    void push(const T *values, size_t count)
+    {
+        if (count == 0)
+            return;
+        if (this->size() + count > this->capacity())
+            this->reserve(this->size() + count);
+        size_t start = this->tail & this->mask;
+        size_t first = std::min(count, this->mask + 1 - start); // 到缓冲区末尾为止的部分
+        memcpy(&this->data[start], values, first * sizeof(T));
+        memcpy(&this->data[0], values + first, (count - first) * sizeof(T));
+        this->tail += count;
+        this->notify_change();
+    }
+
+    T &front(void)
+    {
+        return this->data[this->head & this->mask];
+    }
+
+    void pop(void)
+    {
+        this->head++;
+        this->notify_change();
+    }
+
+    /**
+     * @brief 整块取出，调用者保证队列中至少有count个元素
+     *
+     * @param values 输出缓冲区
+     * @param count 元素个数
+     */
+    void pop(T *values, size_t count)
+    {
+        this->copy_out(values, count);
+        this->head += count;
+        this->notify_change();
+    }
+
+    /**
+     * @brief 丢弃开头的count个元素
+     *
+     * @param count 元素个数，超过队列长度时清空
+     */
+    void discard(size_t count)
+    {
+        this->head += std::min(count, this->size());
+        this->notify_change();
+    }
+
+    /**
+     * @brief 清空队列，保留已分配的空间
+     *
+     */
+    void clear(void)
+    {
+        this->head = this->tail;
+        this->notify_change();
+    }
+
+private:
+    std::unique_ptr<T[]> data;
+    uint64_t head, tail; // 只增不减的读写位置，对mask取模后为下标
+    size_t mask;
+    void (*notify)(void *);
+    void *notify_arg;
+
+    void notify_change(void)
+    {
+        if (this->notify != NULL)
+            this->notify(this->notify_arg);
+    }
+
+    void copy_out(T *values, size_t count) const
+    {
+        if (count == 0)
+            return;
+        size_t start = this->head & this->mask;
+        size_t first = std::min(count, this->mask + 1 - start);
+        memcpy(values, &this->data[start], first * sizeof(T));
+        memcpy(values + first, &this->data[0], (count - first) * sizeof(T));
+    }
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef __SERIAL_PORT_HPP__
+#define __SERIAL_PORT_HPP__
+
+#include <cstddef>
+
+#define SERIAL_PORT_BAUD_TOLERANCE 0.02 // 驱动实际设置的波特率与请求值相差超过2%时给出警告
+
+/**
+ * @brief 串口线路配置
+ *
+ * Linux下通过termios2/BOTHER直接设置任意波特率（USB-CDC、FTDI、CH34x等适配器支持远高于4000000的非标准速率），
+ * 不再局限于Bxxx常量。termios2的头文件与<termios.h>冲突，所以单独放在这个编译单元里
+ */
+class serial_port
+{
+public:
+    static int configure(int fd, int baudrate, int receive, int *actual = NULL);
+};
+
+#endif
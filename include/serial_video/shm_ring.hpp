@@ -0,0 +1,117 @@
+#ifndef __SHM_RING_HPP__
+#define __SHM_RING_HPP__
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#define SHM_RING_PREFIX "shm:"    // 输入媒体以此开头时从共享内存帧环读取，其后为共享内存名称
+#define SHM_RING_MAGIC 0x4D485356  // "VSHM"（小端）
+#define SHM_RING_VERSION 1
+#define SHM_RING_ALIGN 64          // 槽描述区和每个帧槽都按缓存行对齐
+#define SHM_RING_SLOTS_MIN 2       // 至少两个槽，写入端写一个槽时另一个槽可读
+#define SHM_RING_WAIT_MS 100       // 等待新帧的futex超时，超时后检查终止标志和写入端是否已关闭
+
+/**
+ * @brief 共享内存帧环的头，位于映像开头，所有字段为本机字节序，外部渲染进程按此布局写入
+ *
+ * 映像布局：头（128字节） | 槽描述 shm_ring_slot[slots] | 帧槽[slots]（第一个槽位于data_offset，每槽slot_size字节）
+ * 帧为GRAY8，逐行存放、行间没有填充（width*height字节），从槽的开头开始。
+ *
+ * 第n帧（从0开始）写入第n % slots个槽，写入端依次：
+ *   1. 槽描述的seq置为2n+1（奇数，正在写入）
+ *   2. 写入像素和timestamp_ns（CLOCK_MONOTONIC，帧渲染完成的时刻，用于统计端到端延迟）
+ *   3. seq置为2n+2（release）
+ *   4. frames置为n+1（release），对frames执行FUTEX_WAKE（共享，非PRIVATE）
+ * 结束时closed置为1并同样唤醒frames。写入端从不等待读取端，读取端也从不写入映像（可以只读映射）。
+ *
+ * 读取端总是取最新的一帧（frames-1），读到seq为2n+2后直接从槽中读取像素，读完再检查seq，
+ * 仍为2n+2说明读取期间没有被覆盖（seqlock），否则丢弃这一帧；没有新帧时在frames上FUTEX_WAIT
+ */
+struct shm_ring_header
+{
+    uint32_t magic;                 // SHM_RING_MAGIC
+    uint32_t version;               // SHM_RING_VERSION
+    uint32_t width, height;         // 帧尺寸（像素）
+    uint32_t fps_num, fps_den;      // 帧率 = fps_num / fps_den，vons按此节奏发送
+    uint32_t slots;                 // 槽数，至少SHM_RING_SLOTS_MIN
+    uint32_t slot_size;             // 每槽字节数，至少width*height
+    uint32_t data_offset;           // 第一个帧槽相对映像开头的偏移，SHM_RING_ALIGN的倍数
+    std::atomic<uint32_t> closed;   // 写入端已结束
+    uint32_t reserved[6];
+    std::atomic<uint32_t> frames;   // 已发布的帧数（回绕），futex字，单独占一个缓存行
+    uint32_t reserved2[15];
+};
+
+/**
+ * @brief 槽描述
+ *
+ */
+struct shm_ring_slot
+{
+    std::atomic<uint32_t> seq;          // 2n+1：正在写入第n帧，2n+2：第n帧已完整
+    uint32_t reserved;
+    std::atomic<uint64_t> timestamp_ns; // 第n帧渲染完成的时刻（CLOCK_MONOTONIC）
+};
+
+static_assert(sizeof(shm_ring_header) == 128, "shm_ring_header layout changed");
+static_assert(sizeof(shm_ring_slot) == 16, "shm_ring_slot layout changed");
+
+class metrics;
+
+/**
+ * @brief 共享内存帧环的读取端：不经过libav，帧直接从共享内存送入gray2bw，不复制
+ *
+ */
+class shm_reader
+{
+public:
+    shm_reader(const std::string &name);
+    ~shm_reader();
+    void open(void);
+    const uint8_t *acquire(std::atomic<int> &abort_flag);
+    int release(void);
+    int get_video_width(void);
+    int get_video_height(void);
+    double get_video_framerate(void);
+    void set_metrics(metrics *stats);
+
+private:
+    std::string name;
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    shm_ring_header *header;
+    shm_ring_slot *slots;
+    metrics *stats;
+    uint32_t next;      // 下一个可以接受的帧号（上一次取得的帧号+1）
+    uint32_t current;   // acquire取得的帧号
+    uint32_t seq;       // 取得时该帧所在槽的seq
+    uint64_t frames;    // 交给下游的帧数，作为端到端延迟统计的帧序号
+};
+
+/**
+ * @brief 共享内存帧环的写入端（参考实现，供vons_gen和用C++编写的渲染程序使用）
+ *
+ */
+class shm_writer
+{
+public:
+    shm_writer(const std::string &name, int width, int height, int fps_num, int fps_den, int slots);
+    ~shm_writer();
+    uint8_t *begin_frame(void);
+    void end_frame(void);
+    void close(void);
+
+private:
+    std::string name;
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    shm_ring_header *header;
+    shm_ring_slot *slots;
+    uint32_t frames;    // 正在写入的帧号
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef __SINK_HPP__
+#define __SINK_HPP__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/types.h>
+
+/**
+ * @brief 输出端参数，由各种输出端按需取用
+ *
+ */
+struct sink_params
+{
+    int baudrate = 115200;     // 串口波特率
+    double framerate = 30;     // 帧率（Y4M文件头）
+    int screen_width = 0;      // 屏幕宽度（预览输出）
+    int screen_height = 0;     // 屏幕高度（预览输出），数据包前width*height/8字节为列行式视频帧
+    int receive = 0;           // 需要读取接收端的回传数据（流量控制）
+    int color = 0;             // 视频帧为RGB565（预览输出只支持1bpp）
+};
+
+/**
+ * @brief 数据包的输出端
+ *
+ * 由描述字符串创建：serial:/dev/ttyUSB0、file:out.bin（也可以是已存在的命名管道）、unix:/path/to/socket、
+ * null:、pgm:preview.pgm、y4m:preview.y4m，不带前缀时视为串口
+ */
+class sink
+{
+public:
+    virtual ~sink();
+    virtual void open(void) = 0;
+    virtual ssize_t write(const uint8_t *data, size_t length) = 0;
+    virtual void close(void) = 0;
+    virtual void drain(void);
+    virtual ssize_t read(uint8_t *data, size_t length);
+    virtual int can_read(void);
+    virtual int is_serial(void);
+    static sink *create(const std::string &spec, const sink_params &params);
+};
+
+/**
+ * @brief 串口输出（8N1，任意波特率）
+ *
+ */
+class serial_sink : public sink
+{
+public:
+    serial_sink(const std::string &device, int baudrate, int receive = 0);
+    ~serial_sink();
+    void open(void) override;
+    ssize_t write(const uint8_t *data, size_t length) override;
+    void close(void) override;
+    void drain(void) override;
+    ssize_t read(uint8_t *data, size_t length) override;
+    int can_read(void) override;
+    int is_serial(void) override;
+
+private:
+    std::string device_path;
+    int baudrate;
+    int receive;
+    int fd;
+};
+
+/**
+ * @brief 原样写入文件或命名管道
+ *
+ */
+class file_sink : public sink
+{
+public:
+    file_sink(const std::string &path);
+    ~file_sink();
+    void open(void) override;
+    ssize_t write(const uint8_t *data, size_t length) override;
+    void close(void) override;
+
+private:
+    std::string path;
+    int fd;
+};
+
+/**
+ * @brief 写入Unix流套接字（连接到已在监听的一端）
+ *
+ */
+class unix_sink : public sink
+{
+public:
+    unix_sink(const std::string &path);
+    ~unix_sink();
+    void open(void) override;
+    ssize_t write(const uint8_t *data, size_t length) override;
+    void close(void) override;
+    ssize_t read(uint8_t *data, size_t length) override;
+    int can_read(void) override;
+
+private:
+    std::string path;
+    int fd;
+};
+
+/**
+ * @brief 丢弃所有数据，用于测量流水线本身的吞吐
+ *
+ */
+class null_sink : public sink
+{
+public:
+    void open(void) override;
+    ssize_t write(const uint8_t *data, size_t length) override;
+    void close(void) override;
+};
+
+/**
+ * @brief 把列行式的1bpp视频帧还原为图像写入文件（多帧PGM或单色Y4M），数据包中的音频字节被忽略
+ *
+ */
+class preview_sink : public sink
+{
+public:
+    enum format
+    {
+        PGM,
+        Y4M
+    };
+    preview_sink(const std::string &path, format type, const sink_params &params);
+    void open(void) override;
+    ssize_t write(const uint8_t *data, size_t length) override;
+    void close(void) override;
+
+private:
+    file_sink file;
+    format type;
+    int width, height;
+    double framerate;
+    std::vector<uint8_t> image; // 一帧图像，带文件头
+    size_t header_size;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __STARTUP_TIMER_HPP__
+#define __STARTUP_TIMER_HPP__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+/**
+ * @brief 启动阶段计时器，记录从程序启动到首个数据包发出之间各阶段的耗时
+ *
+ */
+class startup_timer
+{
+public:
+    startup_timer(const char *final_phase);
+    void mark(const char *phase);
+    void report(std::ostream &out);
+
+private:
+    std::mutex lock;
+    std::chrono::steady_clock::time_point origin;
+    std::vector<std::pair<std::string, std::chrono::steady_clock::time_point>> phases;
+    std::string final_phase;
+    int reported;
+    std::atomic<int> finished; // 已记录最后一个阶段，之后的mark只做一次relaxed读取就返回
+};
+
+#endif
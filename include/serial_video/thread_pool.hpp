@@ -0,0 +1,34 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <functional>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * @brief 可缓存线程的线程池：没有空闲线程时新建，任务结束后线程留待复用
+ *
+ * 流水线各阶段都是长时间阻塞运行的任务，所以不限制线程数，只负责在多个流水线之间复用线程
+ */
+class thread_pool
+{
+public:
+    thread_pool();
+    ~thread_pool();
+    void submit(std::function<void()> task);
+    int get_thread_count(void);
+
+private:
+    std::mutex lock;
+    std::condition_variable task_ready;
+    std::queue<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    int idle_threads;
+    int stop_flag;
+    void worker(void);
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef __TRACER_HPP__
+#define __TRACER_HPP__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+#define TRACE_BUFFER_EVENTS 8192     // 每个线程的事件缓冲区容量
+#define TRACE_FLUSH_INTERVAL_MS 50   // 后台线程写出事件的间隔
+
+/**
+ * @brief 一个已完成的时间段
+ *
+ */
+struct trace_event
+{
+    const char *name; // 必须是字符串常量
+    int64_t frame;    // 帧（数据包）序号
+    int64_t begin_ns, end_ns;
+};
+
+/**
+ * @brief 单线程写入、后台线程读出的无锁环形事件缓冲区
+ *
+ */
+class trace_buffer
+{
+public:
+    trace_buffer(const char *thread_name, int tid);
+    void push(const char *name, int64_t frame, int64_t begin_ns, int64_t end_ns);
+    int pop(trace_event &event);
+
+    std::string thread_name;
+    int tid;
+    std::atomic<uint64_t> dropped; // 缓冲区满时丢弃的事件数
+
+private:
+    trace_event events[TRACE_BUFFER_EVENTS];
+    std::atomic<uint64_t> head, tail;
+};
+
+/**
+ * @brief 以Chrome/Perfetto trace-event JSON格式记录各阶段每一帧的耗时
+ *
+ */
+class tracer
+{
+public:
+    tracer(const char *path);
+    ~tracer();
+    void start();
+    void stop();
+    trace_buffer *register_thread(const char *thread_name);
+    static int64_t now_ns(void);
+
+private:
+    std::string path;
+    FILE *out;
+    int first_event;
+    size_t described; // 已写出线程名的缓冲区个数
+    std::mutex buffers_lock;
+    std::vector<std::unique_ptr<trace_buffer>> buffers;
+    std::atomic<int> stop_flag;
+    std::thread flush_thread;
+    void flush_loop();
+    void flush();
+};
+
+/**
+ * @brief 记录一个时间段，构造时开始，调用end()或析构时结束；缓冲区为NULL时不做任何事
+ *
+ */
+class trace_span
+{
+public:
+    trace_span(trace_buffer *buffer, const char *name, int64_t frame)
+    {
+        this->buffer = buffer;
+        this->name   = name;
+        this->frame  = frame;
+        this->begin  = buffer != NULL ? tracer::now_ns() : 0;
+    }
+    ~trace_span()
+    {
+        this->end();
+    }
+    void end()
+    {
+        if (this->buffer != NULL)
+        {
+            this->buffer->push(this->name, this->frame, this->begin, tracer::now_ns());
+            this->buffer = NULL;
+        }
+    }
+
+private:
+    trace_buffer *buffer;
+    const char *name;
+    int64_t frame, begin;
+};
+
+#endif
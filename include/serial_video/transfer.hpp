@@ -2,10 +2,28 @@
 #define __TRANSFER_HPP__
 
 #include <string>
-#include <queue>
 #include <mutex>
 #include <atomic>
-#include <termios.h>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "serial_video/ring_buffer.hpp"
+
+class startup_timer;
+class metrics;
+class tracer;
+class sink;
+class link_protocol;
+class trace_buffer;
+class rate_control;
+class dirty_rect;
+
+#define LINK_CREDIT_TIMEOUT_MS 200  // 超过200ms没有流量控制回报时发一帧探测
+#define LINK_CREDIT_POLL_US 100     // 等待回报时的轮询间隔
+#define LINK_CREDIT_READ_SIZE 64    // 每次读取回传数据的字节数
+#define LINK_CREDIT_PAYLOAD_MAX 16  // 回传帧的最大负载
+#define TRANSFER_PROBE_WARMUP_MS 500 // 测量吞吐时先写满各级缓冲区，这段时间不计数
 
 /**
  * @brief 音视频交错传输类
@@ -14,13 +32,73 @@
 class transfer
 {
 public:
-    transfer(const char *device, int baudrate, int framerate, int frame_size, int audio_size);
-    void start(std::queue<uint8_t> &video, std::queue<uint8_t> &audio);
-    void streamed_start(std::queue<uint8_t> &video, std::mutex &video_lock, std::queue<uint8_t> &audio, std::mutex &audio_lock, std::atomic<int> &video_abort_flag, std::atomic<int> &audio_abort_flag);
+    transfer(const char *device, int baudrate, double framerate, int frame_size, int audio_size);
+    ~transfer();
+    void start(ring_buffer<uint8_t> &video, ring_buffer<uint8_t> &audio);
+    void streamed_start(ring_buffer<uint8_t> &video, std::mutex &video_lock, ring_buffer<uint8_t> &audio, std::mutex &audio_lock, std::atomic<int> &video_abort_flag, std::atomic<int> &audio_abort_flag);
+    int resume_start(ring_buffer<uint8_t> &video, std::mutex &video_lock, ring_buffer<uint8_t> &audio, std::mutex &audio_lock, std::atomic<int> &video_abort_flag, std::atomic<int> &audio_abort_flag, std::chrono::steady_clock::time_point &wakeup);
+    void set_startup_timer(startup_timer *timer);
+    void set_metrics(metrics *stats);
+    void set_tracer(tracer *trace);
+    void set_audio_enabled(int enabled);
+    void set_sink(sink *output);
+    void set_paced(int paced);
+    void set_protocol(int protocol, uint8_t addr = 0);
+    void set_rate_control(int enabled);
+    void set_link_share(double share);
+    void set_dirty_rects(int width, int height);
+    size_t get_packet_size(void);
+    void set_paused(int paused);
+    void set_rate(double rate);
+    void set_epoch(std::atomic<uint32_t> *epoch);
+    double probe(double seconds);
 private:
     std::string device_path;
-    int frame_size, audio_size, framerate;
-    speed_t baudrate;
+    int frame_size, audio_size;
+    double framerate;
+    int audio_enabled;
+    int baudrate;
+    int paced;
+    std::atomic<int> paused;
+    std::atomic<double> rate;        // 播放速度倍率
+    std::atomic<uint32_t> *epoch;    // 冲洗纪元，见gray2bw::set_epoch
+    sink *output;
+    std::unique_ptr<sink> own_output; // 未设置输出端时按device_path创建
+    int protocol;
+    uint8_t link_addr;
+    uint16_t seq, ack_seq;  // 下一帧的序号、接收端确认的最后一帧
+    int free_slots;         // 接收端在ack_seq之后还能缓冲的帧数
+    std::chrono::steady_clock::time_point last_credit;
+    std::unique_ptr<link_protocol> parser; // 解析回传的流量控制帧
+    int rate_controlled;
+    double link_share;      // 本路可用的线路份额
+    std::unique_ptr<rate_control> encoder; // 按每帧字节预算编码视频帧
+    int rect_width, rect_height;           // RGB565帧的尺寸，为0时不按脏矩形发送
+    std::unique_ptr<dirty_rect> rects;     // 按脏矩形编码RGB565帧
+    startup_timer *timer;
+    metrics *stats;
+    tracer *trace;
+    int64_t packets;                 // 数据包序号
+    uint32_t written_epoch;          // 最近写出的数据包所属的纪元
+    // resume_start在两次恢复之间保存的状态
+    int resume_state;
+    sink *resume_output;
+    std::vector<uint8_t> resume_buffer;
+    size_t resume_packet_size;
+    uint32_t resume_epoch;           // 缓冲区中数据包取出时的纪元
+    int resume_cycle;                // 本周期的发送时刻已确定
+    std::chrono::steady_clock::time_point resume_wakeup, resume_wait_begin;
+    trace_buffer *resume_tb;
+    sink *open_output(void);
+    std::chrono::steady_clock::duration frame_period(void);
+    void seek_reached(void);
+    size_t seal_packet(uint8_t *buffer, int encode = 1);
+    void resync_receiver(void);
+    double frame_budget(void);
+    void poll_credit(sink *output);
+    void wait_credit(sink *output);
+    int credit_ready(sink *output);
+    void write_packet(sink *output, const uint8_t *buffer, size_t packet_size, uint32_t packet_epoch, trace_buffer *tb, std::chrono::steady_clock::time_point wakeup_time);
 };
 
 #endif
\ No newline at end of file
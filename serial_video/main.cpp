@@ -1,20 +1,28 @@
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
 #include <iostream>
-#include <queue>
-#include <thread>
-#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <fstream>
 #include <getopt.h>
 #include <unistd.h>
+#include <sys/resource.h>
 
 #include "serial_video/avdecoder.hpp"
+#include "serial_video/pipeline.hpp"
 #include "serial_video/gray2bw.hpp"
-#include "serial_video/fft.hpp"
 #include "serial_video/transfer.hpp"
-
-std::queue<uint8_t> av_video, gray_video, fft_audio;
-std::queue<uint16_t> av_audio;
-std::mutex av_video_lock, av_audio_lock, gray_video_lock, fft_audio_lock;
-std::atomic<int> decode_done = 0, gray_done = 0, fft_done = 0;
+#include "serial_video/startup_timer.hpp"
+#include "serial_video/metrics.hpp"
+#include "serial_video/tracer.hpp"
+#include "serial_video/realtime.hpp"
+#include "serial_video/control.hpp"
+#include "serial_video/bus.hpp"
+#include "serial_video/sink.hpp"
+#include "serial_video/shm_ring.hpp"
 
 const struct option longopts[]
 {
@@ -22,7 +30,32 @@ const struct option longopts[]
     {"input-media", required_argument, NULL, 'i'},
     {"output-device", required_argument, NULL, 'o'},
     {"baudrate", required_argument, NULL, 'b'},
-	{"audio-fft-threshold", required_argument, NULL, 'a'}
+	{"audio-fft-threshold", required_argument, NULL, 'a'},
+    {"audio-samplerate", required_argument, NULL, 'r'},
+    {"fast-start", no_argument, NULL, 'f'},
+    {"startup-timing", no_argument, NULL, 't'},
+    {"metrics-socket", required_argument, NULL, 'm'},
+    {"trace", required_argument, NULL, 'T'},
+    {"live", no_argument, NULL, 'l'},
+    {"input-format", required_argument, NULL, 'F'},
+    {"input-option", required_argument, NULL, 'O'},
+    {"mmap-io", no_argument, NULL, 'M'},
+    {"rt-priority", required_argument, NULL, 'P'},
+    {"cpus", required_argument, NULL, 'C'},
+    {"mlock", no_argument, NULL, 'L'},
+    {"wakeup-report", no_argument, NULL, 'W'},
+    {"unpaced", no_argument, NULL, 'U'},
+    {"protocol", required_argument, NULL, 'p'},
+    {"probe", required_argument, NULL, 'B'},
+    {"playlist", required_argument, NULL, 'Q'},
+    {"control", required_argument, NULL, 'K'},
+    {"executor-threads", required_argument, NULL, 'E'},
+    {"dither-hysteresis", required_argument, NULL, 'D'},
+    {"rate-control", no_argument, NULL, 'R'},
+    {"color", required_argument, NULL, 'c'},
+    {"screen-size", required_argument, NULL, 'S'},
+    {"drop", required_argument, NULL, 'N'},
+    {NULL, 0, NULL, 0}
 };
 
 void usage(const char *progname)
@@ -30,18 +63,182 @@ void usage(const char *progname)
     std::cout << "Usage: " << progname << " [OPTION]..." << std::endl;
     std::cout << "Options:" << std::endl;
     std::cout << "\t-h, --help\t\t\t\t\tdisplay this help" << std::endl;
-    std::cout << "\t-i, --input-media=path/to/your/media/file\tyour input media" << std::endl;
-    std::cout << "\t-o, --output-device=path/to/serial/port\t\tyour serial port to transmit video" << std::endl;
+    std::cout << "\t-i, --input-media=path/to/your/media/file\tyour input media, repeat to play several files back to back without a gap" << std::endl;
+    std::cout << "\t\t\t\t\t\t\tor " SHM_RING_PREFIX "NAME to take grayscale frames from another process through a shared-memory ring (see shm_ring.hpp), no decoding" << std::endl;
+    std::cout << "\t-o, --output-device=path/to/serial/port\t\tyour serial port to transmit video, or an output spec:" << std::endl;
+    std::cout << "\t\t\t\t\t\t\tserial:DEV file:PATH (also FIFOs) unix:SOCKET null: pgm:PATH y4m:PATH (1bpp preview)" << std::endl;
     std::cout << "\t-b, --baudrate=BAUDRATE\t\t\t\tbaud rate in bps (e.g. 115200 2000000)" << std::endl;
 	std::cout << "\t-a, --audio-fft-threshold\t\t\tthe lowest power in fft power spectrum for playback" << std::endl;
+    std::cout << "\t-r, --audio-samplerate=RATE\t\t\tdecimate audio to RATE Hz before fft (e.g. " << AUDIO_ANALYSIS_SAMPLERATE << "), 0 keeps native rate" << std::endl;
+    std::cout << "\t-f, --fast-start\t\t\t\tbound input probing and cache FFTW wisdom, implies -t" << std::endl;
+    std::cout << "\t-t, --startup-timing\t\t\t\treport a timing breakdown up to the first packet" << std::endl;
+    std::cout << "\t-m, --metrics-socket=path/to/socket\t\texport live metrics in Prometheus text format on a Unix socket" << std::endl;
+    std::cout << "\t-T, --trace=path/to/trace.json\t\t\trecord per-frame stage spans as Chrome/Perfetto trace JSON" << std::endl;
+    std::cout << "\t-l, --live\t\t\t\t\tlow-latency live input (stdin as -, named pipes), reports end-to-end latency" << std::endl;
+    std::cout << "\t-F, --input-format=FORMAT\t\t\tforce input format (e.g. rawvideo yuv4mpegpipe)" << std::endl;
+    std::cout << "\t-O, --input-option=KEY=VALUE\t\t\tinput format option, repeatable (e.g. video_size=320x240 pixel_format=gray framerate=30)" << std::endl;
+    std::cout << "\t-M, --mmap-io\t\t\t\t\tread local media files through mmap instead of buffered read()" << std::endl;
+    std::cout << "\t-P, --rt-priority=PRIORITY\t\t\trun the transfer thread with SCHED_FIFO priority (1-99)" << std::endl;
+    std::cout << "\t-C, --cpus=STAGE:LIST\t\t\t\tpin a stage (decoder gray2bw fft transfer) to CPUs, repeatable (e.g. transfer:3 decoder:0-2)" << std::endl;
+    std::cout << "\t-L, --mlock\t\t\t\t\tlock all memory and pre-fault stage stacks" << std::endl;
+    std::cout << "\t-W, --wakeup-report\t\t\t\tprint a histogram of transfer wakeup latency and the CPU time used on exit" << std::endl;
+    std::cout << "\t-U, --unpaced\t\t\t\t\twrite packets as fast as the pipeline produces them and report throughput" << std::endl;
+    std::cout << "\t-p, --protocol=raw|framed|credit\t\traw packets (default), framed packets with sequence number and CRC, or framed with receiver flow control" << std::endl;
+    std::cout << "\t-B, --probe=SECONDS\t\t\t\tmeasure the sustained throughput of the output and the highest frame rate it can carry, then exit (no input needed)" << std::endl;
+    std::cout << "\t-Q, --playlist=FILE\t\t\t\tappend the media listed in FILE (one per line, # for comments) to the inputs" << std::endl;
+    std::cout << "\t-K, --control=path/to/socket|-\t\t\taccept pause, resume, seek SECONDS, rate FACTOR, status and stop commands on a Unix socket or stdin (-)" << std::endl;
+    std::cout << "\t-E, --executor-threads=THREADS\t\t\trun gray2bw, fft and transfer as cooperative tasks on THREADS threads instead of one thread each (for single/dual-core boards)" << std::endl;
+    std::cout << "\t-D, --dither-hysteresis=MARGIN\t\t\tkeep a block's previous dither pattern unless its level moves more than MARGIN gray levels (0-50, 12 recommended), fewer bytes change between frames" << std::endl;
+    std::cout << "\t-R, --rate-control\t\t\t\tfit every frame into the link's per-frame byte budget with RLE and delta packets (needs -p framed or credit)" << std::endl;
+    std::cout << "\t-c, --color=plain|dither\t\t\tRGB565 output for color TFT panels (ST7735 ILI9341), optionally with ordered dithering; framed protocols send dirty rectangles" << std::endl;
+    std::cout << "\t-N, --drop=ADDR:MEDIA\t\t\t\tplay MEDIA to the receiver at ADDR on a shared RS-485 bus, repeat for each display (needs -p framed), reports each address's share of the bus on exit" << std::endl;
+    std::cout << "\t-S, --screen-size=WxH\t\t\t\tscreen size of the receiver (default " << PIPELINE_SCREEN_WIDTH << "x" << PIPELINE_SCREEN_HEIGHT << ", " << PIPELINE_COLOR_WIDTH << "x" << PIPELINE_COLOR_HEIGHT << " with --color)" << std::endl;
+}
+
+/**
+ * @brief 读取播放列表文件（每行一个媒体，忽略空行和#开头的注释行，兼容简单的m3u）
+ *
+ * @param path 播放列表文件
+ * @param items 读到的媒体追加到这里
+ * @return int 成功返回0，无法打开返回-1
+ */
+static int read_playlist(const char *path, std::vector<std::string> &items)
+{
+    std::ifstream in(path);
+    if (!in)
+        return -1;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        items.push_back(line);
+    }
+    return 0;
+}
+
+/**
+ * @brief 测量输出端的实际吞吐，并据此推算当前数据包大小下能达到的最大帧率
+ *
+ * @param config 流水线参数（输出端、波特率、链路协议、屏幕大小）
+ * @param seconds 测量时长（秒）
+ */
+static void probe_link(const pipeline_config &config, double seconds)
+{
+    transfer trans(config.output_device.c_str(), config.baudrate, 1, config.color ? config.screen_width * config.screen_height * 2 : config.screen_width * config.screen_height / 8, 1);
+    trans.set_protocol(config.link_protocol, config.link_addr);
+    double bytes_per_sec = trans.probe(seconds);
+    double line_rate = config.baudrate / 10.0; // 8N1，每字节10位
+    std::cout << "Link throughput: " << bytes_per_sec << " B/s (" << bytes_per_sec * 100 / line_rate << "% of " << config.baudrate << " baud 8N1)" << std::endl;
+    std::cout << "Packet size: " << trans.get_packet_size() << " bytes, max frame rate: " << bytes_per_sec / trans.get_packet_size() << " fps" << std::endl;
+}
+
+/**
+ * @brief 多点总线：每个地址一条流水线，共用一个输出端，按截止时刻调度各路的数据包，结束后输出各地址的带宽占比
+ *
+ * @param config 流水线参数（各路相同，输入和地址除外）
+ * @param drops 各路的地址和输入媒体
+ */
+static void run_bus(const pipeline_config &config, const std::vector<std::pair<int, std::string>> &drops)
+{
+    sink_params params;
+    params.baudrate = config.baudrate;
+    std::unique_ptr<sink> output(sink::create(config.output_device, params));
+    bus shared(output.get());
+    std::vector<std::unique_ptr<pipeline>> pipelines;
+    for (size_t i = 0; i < drops.size(); i++)
+    {
+        pipeline_config drop_config = config;
+        drop_config.link_addr   = drops[i].first;
+        drop_config.input_media = drops[i].second;
+        drop_config.shared_bus  = &shared;
+        drop_config.link_share  = 1.0 / drops.size(); // 码率控制时各路只用自己的一份，合起来不超过线路
+        drop_config.timer       = i == 0 ? config.timer : NULL; //只为第一路计时
+        pipelines.emplace_back(new pipeline(drop_config));
+    }
+    auto begin = std::chrono::steady_clock::now();
+    for (auto &p : pipelines)
+        p->start();
+    for (auto &p : pipelines)
+        p->wait();
+    shared.report(std::cerr, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(), config.baudrate);
+}
+
+/**
+ * @brief 获取FFTW wisdom缓存目录（$XDG_CACHE_HOME/serial_video或~/.cache/serial_video）
+ *
+ * @return std::string 缓存目录，无法确定时为空
+ */
+std::string wisdom_cache_dir(void)
+{
+    const char *cache = getenv("XDG_CACHE_HOME");
+    if (cache != NULL && cache[0] != '\0')
+        return std::string(cache) + "/serial_video";
+    const char *home = getenv("HOME");
+    if (home != NULL && home[0] != '\0')
+        return std::string(home) + "/.cache/serial_video";
+    return "";
+}
+
+/**
+ * @brief 输出端到端延迟（输入帧到达至串口写完）
+ *
+ * @param stats 流水线指标
+ * @param framerate 视频帧率
+ */
+void report_latency(metrics &stats, double framerate)
+{
+    uint64_t samples = stats.latency_samples.load();
+    if (samples == 0 || framerate <= 0)
+        return;
+    double period_ms = 1000.0 / framerate;
+    double avg_ms = stats.latency_ns.load() / 1e6 / samples, max_ms = stats.latency_ns_max.load() / 1e6;
+    std::cerr << "End-to-end latency over " << samples << " frames: avg " << avg_ms << " ms (" << avg_ms / period_ms << " frame periods), max " << max_ms << " ms (" << max_ms / period_ms << " frame periods)" << std::endl;
+}
+
+/**
+ * @brief 输出进程占用的CPU时间，用于比较每阶段一个线程与协作式执行
+ *
+ * @param seconds 运行时间
+ */
+void report_cpu(double seconds)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0 || seconds <= 0)
+        return;
+    double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6, sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    std::cerr << "CPU time: " << user << " s user, " << sys << " s sys (" << (user + sys) / seconds * 100 << "% of one core), "
+              << usage.ru_nvcsw + usage.ru_nivcsw << " context switches" << std::endl;
+}
+
+/**
+ * @brief 输出不控制节奏时的吞吐
+ *
+ * @param stats 流水线指标
+ * @param seconds 运行时间
+ */
+void report_throughput(metrics &stats, double seconds)
+{
+    uint64_t frames = stats.transfer.frames_out.load(), bytes = stats.bytes_written.load();
+    if (frames == 0 || seconds <= 0)
+        return;
+    std::cerr << "Throughput: " << frames << " frames in " << seconds << " s, " << frames / seconds << " fps, " << bytes / seconds / 1024 << " KiB/s" << std::endl;
 }
 
 int main(int argc, char **argv)
 {
-    int optc, baudrate = -1, parse_failed = 0, audio_threshold = -1;
+    int optc, baudrate = -1, parse_failed = 0, audio_threshold = -1, audio_samplerate = 0, fast_start = 0, startup_timing = 0, live = 0, mmap_input = 0, rt_priority = 0, lock_memory = 0, wakeup_report = 0, unpaced = 0, protocol = LINK_PROTOCOL_RAW, executor_threads = 0, dither_hysteresis = 0, rate_control = 0, color = 0, color_dither = 0, screen_width = 0, screen_height = 0;
+    double probe_seconds = 0;
+    std::vector<std::string> playlist; //第一个之后的输入
+    std::vector<std::pair<int, std::string>> drops; //多点总线上各路的地址和输入
     const char *progname = basename(argv[0]);
-    char *input_media = NULL, *output_device = NULL, *baudrate_str = NULL, *audio_threshold_str = NULL;
-    while ((optc = getopt_long(argc, argv, "hi:o:b:a:", longopts, NULL)) != -1) //获取命令行参数
+    char *input_media = NULL, *output_device = NULL, *baudrate_str = NULL, *audio_threshold_str = NULL, *metrics_socket = NULL, *trace_file = NULL, *input_format = NULL, *control_path = NULL;
+    std::vector<std::pair<std::string, std::string>> input_options;
+    std::vector<int> stage_cpus[4]; //decoder gray2bw fft transfer
+    const char *stage_names[4] = {"decoder", "gray2bw", "fft", "transfer"};
+    while ((optc = getopt_long(argc, argv, "hi:o:b:a:r:ftm:T:lF:O:MP:C:LWUp:B:Q:K:E:D:Rc:S:N:", longopts, NULL)) != -1) //获取命令行参数
     {
         switch(optc)
         {
@@ -49,8 +246,18 @@ int main(int argc, char **argv)
                 usage(progname);
                 exit(EXIT_SUCCESS);
                 break; //理论上不可能执行到这里，但还是加上保险
-            case 'i': //输入
-                input_media = optarg;
+            case 'i': //输入，重复给出时依次播放
+                if (input_media == NULL)
+                    input_media = optarg;
+                else
+                    playlist.push_back(optarg);
+                break;
+            case 'Q': //播放列表
+                if (read_playlist(optarg, playlist) < 0)
+                {
+                    std::cerr << "Cannot open playlist " << optarg << std::endl;
+                    parse_failed = 1;
+                }
                 break;
             case 'o': //输出
                 output_device = optarg;
@@ -63,15 +270,167 @@ int main(int argc, char **argv)
 				audio_threshold_str = optarg;
 				audio_threshold = atoi(audio_threshold_str);
 				break;
+            case 'r': //音频分析采样率
+                audio_samplerate = atoi(optarg);
+                if (audio_samplerate < 0 || (audio_samplerate > 0 && audio_samplerate < AUDIO_SAMPLERATE_MIN))
+                {
+                    std::cerr << "Audio samplerate must be 0 or at least " << AUDIO_SAMPLERATE_MIN << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            case 'f': //快速启动
+                fast_start = 1;
+                startup_timing = 1;
+                break;
+            case 't': //启动计时
+                startup_timing = 1;
+                break;
+            case 'm': //指标套接字
+                metrics_socket = optarg;
+                break;
+            case 'T': //逐帧跟踪
+                trace_file = optarg;
+                break;
+            case 'l': //实时输入
+                live = 1;
+                break;
+            case 'M': //mmap读取
+                mmap_input = 1;
+                break;
+            case 'P': //实时优先级
+                rt_priority = atoi(optarg);
+                if (rt_priority < 1 || rt_priority > 99)
+                {
+                    std::cerr << "Realtime priority must be within 1-99" << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            case 'C': //绑定CPU
+            {
+                const char *colon = strchr(optarg, ':');
+                int stage = -1;
+                for (int i = 0; colon != NULL && i < 4; i++)
+                {
+                    if (strncmp(optarg, stage_names[i], colon - optarg) == 0 && strlen(stage_names[i]) == (size_t)(colon - optarg))
+                        stage = i;
+                }
+                if (stage < 0 || realtime::parse_cpu_list(colon + 1, stage_cpus[stage]) < 0)
+                {
+                    std::cerr << "Invalid CPU assignment: " << optarg << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            }
+            case 'L': //锁定内存
+                lock_memory = 1;
+                break;
+            case 'W': //唤醒延迟直方图
+                wakeup_report = 1;
+                break;
+            case 'U': //不控制节奏
+                unpaced = 1;
+                break;
+            case 'B': //测量链路吞吐
+                probe_seconds = atof(optarg);
+                if (probe_seconds <= 0)
+                {
+                    std::cerr << "Invalid probe duration: " << optarg << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            case 'p': //链路协议
+                if (strcmp(optarg, "raw") == 0)
+                    protocol = LINK_PROTOCOL_RAW;
+                else if (strcmp(optarg, "framed") == 0)
+                    protocol = LINK_PROTOCOL_FRAMED;
+                else if (strcmp(optarg, "credit") == 0)
+                    protocol = LINK_PROTOCOL_CREDIT;
+                else
+                {
+                    std::cerr << "Invalid link protocol: " << optarg << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            case 'E': //协作式执行
+                executor_threads = atoi(optarg);
+                if (executor_threads < 1)
+                {
+                    std::cerr << "Executor threads must be at least 1" << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            case 'D': //抖动迟滞
+                dither_hysteresis = atoi(optarg);
+                if (dither_hysteresis < 0 || dither_hysteresis >= BW_LEVEL_STEP)
+                {
+                    std::cerr << "Dither hysteresis must be within 0-" << BW_LEVEL_STEP - 1 << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            case 'R': //码率控制
+                rate_control = 1;
+                break;
+            case 'c': //彩色输出
+                color = 1;
+                if (strcmp(optarg, "dither") == 0)
+                    color_dither = 1;
+                else if (strcmp(optarg, "plain") != 0)
+                {
+                    std::cerr << "Invalid color mode: " << optarg << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            case 'S': //屏幕尺寸
+                if (sscanf(optarg, "%dx%d", &screen_width, &screen_height) != 2 || screen_width <= 0 || screen_height <= 0)
+                {
+                    std::cerr << "Invalid screen size: " << optarg << std::endl;
+                    parse_failed = 1;
+                }
+                break;
+            case 'N': //多点总线上的一路
+            {
+                char *end = NULL;
+                long addr = strtol(optarg, &end, 0);
+                if (end == optarg || *end != ':' || end[1] == '\0' || addr < 0 || addr >= LINK_BROADCAST)
+                {
+                    std::cerr << "Invalid drop, expected ADDR:MEDIA with ADDR in 0-254: " << optarg << std::endl;
+                    parse_failed = 1;
+                    break;
+                }
+                drops.push_back(std::make_pair((int)addr, std::string(end + 1)));
+                break;
+            }
+            case 'K': //控制通道
+                control_path = optarg;
+                break;
+            case 'F': //输入格式
+                input_format = optarg;
+                break;
+            case 'O': //输入格式选项
+                if (strchr(optarg, '=') == NULL)
+                {
+                    std::cerr << "Input option must be KEY=VALUE: " << optarg << std::endl;
+                    parse_failed = 1;
+                    break;
+                }
+                input_options.push_back(std::make_pair(std::string(optarg, strchr(optarg, '=') - optarg), std::string(strchr(optarg, '=') + 1)));
+                break;
             default:
                 parse_failed = 1;
         }
     }
-    if (parse_failed || optind < argc || baudrate <= 0 || input_media == NULL || output_device == NULL)
+    std::string first_item;
+    if (input_media == NULL && !playlist.empty()) //只给了播放列表
+    {
+        first_item = playlist.front();
+        playlist.erase(playlist.begin());
+        input_media = &first_item[0];
+    }
+    if (parse_failed || optind < argc || baudrate <= 0 || (input_media == NULL && probe_seconds <= 0 && drops.empty()) || output_device == NULL)
     {
         if (optind < argc) //有未被解析出来的参数，属于无效参数
             std::cerr << "Invalid argument: " << argv[optind] << std::endl;
-        if (input_media == NULL)
+        if (input_media == NULL && probe_seconds <= 0 && drops.empty())
             std::cerr << "Input media not given" << std::endl;
         if (output_device == NULL)
             std::cerr << "Output device not given" << std::endl;
@@ -83,36 +442,161 @@ int main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    if (access(input_media, R_OK))
+    int shm_input = input_media != NULL && strncmp(input_media, SHM_RING_PREFIX, strlen(SHM_RING_PREFIX)) == 0;
+    if (input_media != NULL && !shm_input && strcmp(input_media, "-") != 0 && strncmp(input_media, "pipe:", 5) != 0 && access(input_media, R_OK)) //标准输入和管道协议无法检查，共享内存在打开时报错
     {
         std::cerr << "Cannot open " << input_media << std::endl;
         exit(EXIT_FAILURE);
     }
-    if(access(output_device, R_OK|W_OK))
+    if (shm_input) //共享内存输入总是实时的，并统计渲染完成到写完串口的延迟
+        live = 1;
+    if (screen_width == 0) //未指定时按输出类型取默认尺寸
+    {
+        screen_width = color ? PIPELINE_COLOR_WIDTH : PIPELINE_SCREEN_WIDTH;
+        screen_height = color ? PIPELINE_COLOR_HEIGHT : PIPELINE_SCREEN_HEIGHT;
+    }
+    if (!color && (screen_width % 2 != 0 || screen_height % 8 != 0)) //2x2抖动、每8行取模为一页
+    {
+        std::cerr << "Screen width must be even and height a multiple of 8" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!drops.empty()) //多点总线
+    {
+        const char *conflict = input_media != NULL ? "-i/-Q" : (control_path != NULL ? "-K" : (metrics_socket != NULL ? "-m" : NULL));
+        if (conflict != NULL)
+        {
+            std::cerr << "--drop cannot be combined with " << conflict << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (protocol != LINK_PROTOCOL_FRAMED) //裸数据包没有地址，流量控制的回报在半双工总线上无法区分
+        {
+            std::cerr << "--drop needs -p framed" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        for (auto &drop : drops)
+        {
+            if (drop.second == "-" || (drop.second.compare(0, 5, "pipe:") != 0 && drop.second.compare(0, strlen(SHM_RING_PREFIX), SHM_RING_PREFIX) != 0 && access(drop.second.c_str(), R_OK)))
+            {
+                std::cerr << "Cannot open " << drop.second << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            for (auto &other : drops)
+            {
+                if (&other != &drop && other.first == drop.first)
+                {
+                    std::cerr << "Address " << drop.first << " given twice" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+    }
+    if (rate_control && protocol == LINK_PROTOCOL_RAW) //接收端需要帧头中的类型区分编码
+    {
+        std::cerr << "Rate control needs -p framed or -p credit" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (control_path != NULL && strcmp(control_path, "-") == 0 && input_media != NULL && (strcmp(input_media, "-") == 0 || strncmp(input_media, "pipe:", 5) == 0)) //标准输入只能有一个用途
+    {
+        std::cerr << "Control channel and input media cannot both be stdin" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if ((strchr(output_device, ':') == NULL || strncmp(output_device, "serial:", 7) == 0) && access(strncmp(output_device, "serial:", 7) == 0 ? output_device + 7 : output_device, R_OK|W_OK)) //其他输出端在打开时报错
     {
         std::cerr << "Cannot open " << output_device << std::endl;
         exit(EXIT_FAILURE);
     }
 
+    startup_timer timer("first packet written");
+    pipeline_config config;
+    config.input_media      = input_media != NULL ? input_media : "";
+    config.playlist         = playlist; //打不开的项在播放时跳过
+    config.output_device    = output_device;
+    config.baudrate         = baudrate;
+    config.audio_threshold  = audio_threshold; //现在可以在命令行测试这个阈值
+    config.audio_samplerate = audio_samplerate;
+    config.timer            = startup_timing ? &timer : NULL; //不需要计时则不传给各模块
+    config.live             = live;
+    config.mmap_io          = mmap_input;
+    config.transfer_priority = rt_priority;
+    config.decoder_cpus     = stage_cpus[0];
+    config.gray_cpus        = stage_cpus[1];
+    config.fft_cpus         = stage_cpus[2];
+    config.transfer_cpus    = stage_cpus[3];
+    config.prefault         = lock_memory;
+    config.unpaced          = unpaced;
+    config.link_protocol    = protocol;
+    config.executor_threads = executor_threads;
+    config.dither_hysteresis = dither_hysteresis;
+    config.rate_control     = rate_control;
+    config.color            = color;
+    config.color_dither     = color_dither;
+    config.screen_width     = screen_width;
+    config.screen_height    = screen_height;
+    if (probe_seconds > 0)
+    {
+        try
+        {
+            probe_link(config, probe_seconds);
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return 0;
+    }
+    if (lock_memory)
+    {
+        int ret = realtime::lock_memory();
+        if (ret != 0)
+            std::cerr << "Warning: unable to lock memory: " << strerror(ret) << std::endl;
+    }
+    config.input_options    = input_options;
+    if (input_format)
+        config.input_format = input_format;
+    if (fast_start)
+    {
+        config.probesize        = FAST_START_PROBESIZE;
+        config.analyze_duration = FAST_START_ANALYZE_DURATION;
+        config.wisdom_dir       = wisdom_cache_dir();
+    }
     try
     {
-        avdecoder av(input_media);
-        av.open();
-        gray2bw gray(av.get_video_width(), av.get_video_height(), 128, 64);
-        fft freq(av.get_audio_samplerate(), av.get_video_framerate(), audio_threshold); //现在可以在命令行测试这个阈值
-        transfer trans(output_device, baudrate, av.get_video_framerate(), 1024, 1);
-        std::thread dec_t(&avdecoder::streamed_decode, &av, std::ref(av_video), std::ref(av_video_lock), std::ref(av_audio), std::ref(av_audio_lock), std::ref(decode_done));
-        std::thread gray_t(&gray2bw::streamed_convert, &gray, std::ref(av_video), std::ref(av_video_lock), std::ref(gray_video), std::ref(gray_video_lock), std::ref(decode_done), std::ref(gray_done));
-        std::thread freq_t(&fft::streamed_calculate, &freq, std::ref(av_audio), std::ref(av_audio_lock), std::ref(fft_audio), std::ref(fft_audio_lock), std::ref(decode_done), std::ref(fft_done));
-        std::thread trans_t(&transfer::streamed_start, &trans, std::ref(gray_video), std::ref(gray_video_lock), std::ref(fft_audio), std::ref(fft_audio_lock), std::ref(gray_done), std::ref(fft_done));
-        dec_t.join();
-        gray_t.join();
-        freq_t.join();
-        trans_t.join();
+        tracer trace(trace_file ? trace_file : "");
+        if (trace_file)
+        {
+            config.trace = &trace; //不需要跟踪则不记录
+            trace.start();
+        }
+        if (!drops.empty())
+        {
+            run_bus(config, drops);
+            return 0;
+        }
+        pipeline p(config);
+        metrics_server server(p.get_metrics(), metrics_socket ? metrics_socket : "");
+        if (metrics_socket)
+            server.start();
+        control_server control(p, control_path ? control_path : "");
+        auto begin = std::chrono::steady_clock::now();
+        p.start();
+        if (control_path)
+            control.start();
+        p.wait();
+        if (unpaced)
+            report_throughput(p.get_metrics(), std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+        if (live)
+            report_latency(p.get_metrics(), p.get_video_framerate());
+        if (wakeup_report)
+        {
+            p.get_metrics().report_wakeup(std::cerr);
+            report_cpu(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+        }
     }
     catch (std::exception &e)
     {
         std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
     }
     return 0;
 }
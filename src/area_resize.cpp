@@ -0,0 +1,161 @@
+#include "serial_video/area_resize.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Construct a new area_resize::area_resize object
+ *
+ * @param in_width 输入宽度
+ * @param in_height 输入高度
+ * @param out_width 输出宽度
+ * @param out_height 输出高度
+ */
+area_resize::area_resize(int in_width, int in_height, int out_width, int out_height)
+{
+    if (in_width <= 0 || in_height <= 0 || out_width <= 0 || out_height <= 0)
+    {
+        std::invalid_argument ex("Image size below 0!");
+        throw ex;
+    }
+    this->in_width      = in_width;
+    this->in_height     = in_height;
+    this->out_width     = out_width;
+    this->out_height    = out_height;
+    area_resize::build_table(in_width, out_width, this->x_spans, this->x_weights);
+    area_resize::build_table(in_height, out_height, this->y_spans, this->y_weights);
+    this->row_acc.resize(in_width);
+}
+
+/**
+ * @brief 缩放一帧
+ *
+ * @param in 输入帧（in_width * in_height字节，行间无填充）
+ * @param out 输出帧（out_width * out_height字节）
+ */
+void area_resize::resize(const uint8_t *in, uint8_t *out)
+{
+    uint32_t *acc = this->row_acc.data();
+    for (const span &ys : this->y_spans)
+    {
+        // 纵向：把覆盖的输入行按系数累加到一行
+        for (int k = 0; k < ys.count; k++)
+        {
+            area_resize::accumulate_row(in + (size_t)(ys.first + k) * this->in_width, this->y_weights[ys.weight + k], acc, this->in_width, k == 0);
+        }
+        // 横向：对累加行按系数求和，结果为Q28，四舍五入回8位
+        for (const span &xs : this->x_spans)
+        {
+            uint64_t sum = 0;
+            const uint32_t *src = acc + xs.first;
+            const uint16_t *w = this->x_weights.data() + xs.weight;
+            for (int k = 0; k < xs.count; k++)
+                sum += (uint64_t)src[k] * w[k];
+            uint32_t value = (sum + (1ull << (2 * AREA_WEIGHT_BITS - 1))) >> (2 * AREA_WEIGHT_BITS);
+            *out++ = value > 255 ? 255 : value;
+        }
+    }
+}
+
+/**
+ * @brief 计算一个方向上的系数表（私有方法）
+ *
+ * 输出像素i覆盖输入区间[i*scale, (i+1)*scale)，每个输入像素的系数为其被覆盖的长度/scale；
+ * 放大时（scale<1）区间落在一到两个输入像素内，同样按覆盖长度加权。
+ * 定点化后把舍入误差补到系数最大的像素上，保证每个输出像素的系数之和恰好为AREA_WEIGHT_ONE。
+ *
+ * @param in_size 输入长度
+ * @param out_size 输出长度
+ * @param spans 各输出像素的覆盖范围
+ * @param weights 系数
+ */
+void area_resize::build_table(int in_size, int out_size, std::vector<span> &spans, std::vector<uint16_t> &weights)
+{
+    const double scale = (double)in_size / out_size;
+    spans.clear();
+    weights.clear();
+    for (int i = 0; i < out_size; i++)
+    {
+        double begin = i * scale, end = (i + 1) * scale;
+        int first = (int)floor(begin), last = (int)ceil(end) - 1;
+        if (last >= in_size)
+            last = in_size - 1;
+        span s = {first, 0, (int)weights.size()};
+        int sum = 0, max_index = -1, max_weight = -1;
+        for (int j = first; j <= last; j++)
+        {
+            double cover = std::min(end, (double)(j + 1)) - std::max(begin, (double)j);
+            int w = (int)lround(cover / scale * AREA_WEIGHT_ONE);
+            if (w <= 0)
+                continue; // 浮点误差导致的空覆盖
+            if (s.count == 0)
+                s.first = j;
+            weights.push_back(w);
+            if (w > max_weight)
+            {
+                max_weight = w;
+                max_index = weights.size() - 1;
+            }
+            sum += w;
+            s.count++;
+        }
+        weights[max_index] += AREA_WEIGHT_ONE - sum;
+        spans.push_back(s);
+    }
+}
+
+/**
+ * @brief 把一行输入按系数累加到累加行（私有方法）
+ *
+ * @param row 输入行
+ * @param weight 系数（Q14）
+ * @param acc 累加行
+ * @param length 行长度
+ * @param first 为1时覆盖累加行而不是累加
+ */
+void area_resize::accumulate_row(const uint8_t *row, uint16_t weight, uint32_t *acc, int length, int first)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16(weight);
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i px = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i lo = _mm_unpacklo_epi8(px, zero); // 8个16位像素
+        __m128i hi = _mm_unpackhi_epi8(px, zero);
+        // 16位乘法的低半部分和高半部分交错拼成32位乘积
+        __m128i lo_l = _mm_mullo_epi16(lo, w), lo_h = _mm_mulhi_epu16(lo, w);
+        __m128i hi_l = _mm_mullo_epi16(hi, w), hi_h = _mm_mulhi_epu16(hi, w);
+        __m128i p0 = _mm_unpacklo_epi16(lo_l, lo_h);
+        __m128i p1 = _mm_unpackhi_epi16(lo_l, lo_h);
+        __m128i p2 = _mm_unpacklo_epi16(hi_l, hi_h);
+        __m128i p3 = _mm_unpackhi_epi16(hi_l, hi_h);
+        __m128i *dst = (__m128i *)(acc + i);
+        if (!first)
+        {
+            p0 = _mm_add_epi32(p0, _mm_loadu_si128(dst));
+            p1 = _mm_add_epi32(p1, _mm_loadu_si128(dst + 1));
+            p2 = _mm_add_epi32(p2, _mm_loadu_si128(dst + 2));
+            p3 = _mm_add_epi32(p3, _mm_loadu_si128(dst + 3));
+        }
+        _mm_storeu_si128(dst, p0);
+        _mm_storeu_si128(dst + 1, p1);
+        _mm_storeu_si128(dst + 2, p2);
+        _mm_storeu_si128(dst + 3, p3);
+    }
+#endif
+    if (first)
+    {
+        for (; i < length; i++)
+            acc[i] = (uint32_t)row[i] * weight;
+    }
+    else
+    {
+        for (; i < length; i++)
+            acc[i] += (uint32_t)row[i] * weight;
+    }
+}
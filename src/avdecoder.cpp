@@ -1,11 +1,23 @@
 #include "serial_video/avdecoder.hpp"
+#include "serial_video/startup_timer.hpp"
+#include "serial_video/metrics.hpp"
+#include "serial_video/tracer.hpp"
+#include "serial_video/mmap_io.hpp"
 
 #include <iostream> // For debug message
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <thread>
 #include <chrono>
 
+extern "C"
+{
+#include <libavutil/opt.h>
+};
+
 /**
  * @brief 解码异常类
  *
@@ -52,6 +64,29 @@ avdecoder::avdecoder(const char *filename)
     this->audio_decoder         = NULL;
     this->hw_device_ctx         = NULL;
     this->video_hw_pix_fmt      = AV_PIX_FMT_NONE;
+    this->audio_out_samplerate  = 0;
+    this->probesize             = 0;
+    this->analyze_duration      = 0;
+    this->live                  = 0;
+    this->video_queue_limit     = VIDEO_QUEUE_LENGTH_MAX;
+    this->audio_queue_limit     = AUDIO_QUEUE_LENGTH_MAX;
+    this->use_mmap_io           = 0;
+    this->mapped_input          = NULL;
+    this->interrupt_flag        = NULL;
+    this->timer                 = NULL;
+    this->stats                 = NULL;
+    this->trace                 = NULL;
+    this->output_width          = 0;
+    this->output_height         = 0;
+    this->output_pix_fmt        = AV_PIX_FMT_GRAY8;
+    this->output_framerate      = 0;
+    this->forced_samplerate     = 0;
+    this->video_frames_out      = 0;
+    this->audio_samples_out     = 0;
+    this->audio_skip            = 0;
+    this->audio_enabled         = 1;
+    this->seek_serial           = 0;
+    this->seek_target_us        = 0;
     this->filepath              = filename;
     // this->open(std::string(filename));
 }
@@ -74,6 +109,29 @@ avdecoder::avdecoder(std::string filename)
     this->audio_decoder         = NULL;
     this->hw_device_ctx         = NULL;
     this->video_hw_pix_fmt      = AV_PIX_FMT_NONE;
+    this->audio_out_samplerate  = 0;
+    this->probesize             = 0;
+    this->analyze_duration      = 0;
+    this->live                  = 0;
+    this->video_queue_limit     = VIDEO_QUEUE_LENGTH_MAX;
+    this->audio_queue_limit     = AUDIO_QUEUE_LENGTH_MAX;
+    this->use_mmap_io           = 0;
+    this->mapped_input          = NULL;
+    this->interrupt_flag        = NULL;
+    this->timer                 = NULL;
+    this->stats                 = NULL;
+    this->trace                 = NULL;
+    this->output_width          = 0;
+    this->output_height         = 0;
+    this->output_pix_fmt        = AV_PIX_FMT_GRAY8;
+    this->output_framerate      = 0;
+    this->forced_samplerate     = 0;
+    this->video_frames_out      = 0;
+    this->audio_samples_out     = 0;
+    this->audio_skip            = 0;
+    this->audio_enabled         = 1;
+    this->seek_serial           = 0;
+    this->seek_target_us        = 0;
     this->filepath              = filename;
     // this->open(filename);
 }
@@ -99,6 +157,7 @@ avdecoder::~avdecoder()
         avcodec_close(this->audio_decoder_ctx);
         avcodec_free_context(&this->audio_decoder_ctx);
     }
+    delete this->mapped_input; // 自定义IO不随输入上下文释放，必须在其之后释放
 }
 
 /**
@@ -107,36 +166,99 @@ avdecoder::~avdecoder()
  */
 void avdecoder::open()
 {
-    if (access(this->filepath.c_str(), R_OK))
+    std::string url = this->filepath;
+    if (url == "-")
+        url = "pipe:0"; // 标准输入
+    if (url.compare(0, 5, "pipe:") != 0) // 管道协议没有路径可检查，其余（包括命名管道）按文件检查
     {
-        avdecoder_exception ex("Not enough permission to read file!"); // 路径不可读
-        throw ex;
+        if (access(url.c_str(), R_OK))
+        {
+            avdecoder_exception ex("Not enough permission to read file!"); // 路径不可读
+            throw ex;
+        }
+        struct stat statbuf;
+        stat(url.c_str(), &statbuf);
+        if (S_ISDIR(statbuf.st_mode))
+        {
+            avdecoder_exception ex("Path is a directory!"); // 给定路径为文件夹
+            throw ex;
+        }
     }
-    struct stat statbuf;
-    stat(this->filepath.c_str(), &statbuf);
-    if (statbuf.st_mode & S_IFDIR)
+
+    const AVInputFormat *format = NULL; // 指定的输入格式，为NULL时自动探测
+    if (!this->input_format.empty() && (format = av_find_input_format(this->input_format.c_str())) == NULL)
     {
-        avdecoder_exception ex("Path is a directory!"); // 给定路径为文件夹
+        avdecoder_exception ex("Unknown input format!");
         throw ex;
     }
-
-    if (avformat_open_input(&this->input_ctx, this->filepath.c_str(), NULL, NULL) < 0)
+    AVDictionary *format_opts = NULL; // 探测参数
+    if (this->live)
+    {
+        // 实时输入：不缓冲、尽量少探测，读到第一帧就开始输出
+        av_dict_set(&format_opts, "fflags", "nobuffer", 0);
+        av_dict_set_int(&format_opts, "probesize", LIVE_PROBESIZE, 0);
+        av_dict_set_int(&format_opts, "analyzeduration", 0, 0);
+        av_dict_set_int(&format_opts, "fpsprobesize", 0, 0);
+    }
+    if (this->probesize > 0)
+        av_dict_set_int(&format_opts, "probesize", this->probesize, 0);
+    if (this->analyze_duration > 0)
+        av_dict_set_int(&format_opts, "analyzeduration", this->analyze_duration, 0);
+    for (auto &opt : this->input_options) // 原始流的尺寸、像素格式、帧率等
+        av_dict_set(&format_opts, opt.first.c_str(), opt.second.c_str(), 0);
+    if (this->use_mmap_io && !this->live && url.compare(0, 5, "pipe:") != 0)
+    {
+        struct stat statbuf;
+        if (stat(url.c_str(), &statbuf) == 0 && S_ISREG(statbuf.st_mode)) // 只映射普通文件，命名管道等仍走默认协议
+        {
+            this->mapped_input = new mmap_io(url.c_str());
+            this->input_ctx = avformat_alloc_context();
+            if (this->input_ctx == NULL)
+            {
+                av_dict_free(&format_opts);
+                avdecoder_exception ex("Unable to allocate input context!");
+                throw ex;
+            }
+            this->input_ctx->pb = this->mapped_input->get_context();
+            this->input_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+    }
+    if (this->interrupt_flag != NULL)
+    {
+        if (this->input_ctx == NULL)
+            this->input_ctx = avformat_alloc_context();
+        if (this->input_ctx == NULL)
+        {
+            av_dict_free(&format_opts);
+            avdecoder_exception ex("Unable to allocate input context!");
+            throw ex;
+        }
+        this->input_ctx->interrupt_callback.callback = &avdecoder::interrupt_requested;
+        this->input_ctx->interrupt_callback.opaque = this->interrupt_flag;
+    }
+    if (avformat_open_input(&this->input_ctx, url.c_str(), format, &format_opts) < 0)
     {
+        av_dict_free(&format_opts);
         avdecoder_exception ex("Unable to open stream!"); // 打开输入流失败
         throw ex;
     }
+    av_dict_free(&format_opts);
+    if (this->timer != NULL)
+        this->timer->mark("input opened");
 
     if (avformat_find_stream_info(this->input_ctx, NULL) < 0) // 获取媒体信息
     {
         avdecoder_exception ex("Unable to determine stream format!"); // 获取失败
         throw ex;
     }
+    if (this->timer != NULL)
+        this->timer->mark("stream info probed");
 
     this->video_stream_index = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &this->video_decoder, 0);
     this->audio_stream_index = av_find_best_stream(input_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, &this->audio_decoder, 0); // 获取音视频流
     if (this->video_stream_index >= 0)
         this->video = this->input_ctx->streams[this->video_stream_index]; // 获取视频流
-    if (this->audio_stream_index >= 0)
+    if (this->audio_stream_index >= 0 && this->audio_enabled)
         this->audio = this->input_ctx->streams[this->audio_stream_index]; // 获取音频流
 
     /*-----------视频解码器初始化部分----------*/
@@ -203,6 +325,11 @@ void avdecoder::open()
         this->video_decoder_ctx->opaque         = this;
         this->video_decoder_ctx->pkt_timebase   = this->video->time_base; // 设置时间
         this->video_decoder_ctx->thread_count   = DEFAULT_THREAD_NUM;     // 解码线程数
+        if (this->live)
+        {
+            this->video_decoder_ctx->flags      |= AV_CODEC_FLAG_LOW_DELAY; // 解出即输出，不做帧重排缓冲
+            this->video_decoder_ctx->thread_type = FF_THREAD_SLICE;         // 帧级多线程会延迟thread_count帧，实时输入只用片级
+        }
 
 #ifdef ENABLE_HWACCEL
         if (hw_codec_configured)
@@ -254,6 +381,8 @@ void avdecoder::open()
             throw ex;
         }
     }
+    if (this->timer != NULL)
+        this->timer->mark("decoders opened");
 }
 
 /**
@@ -262,22 +391,21 @@ void avdecoder::open()
  * @param video_frame 用于保存视频帧的队列
  * @param audio_pcm 用于保存音频帧的队列
  */
-void avdecoder::decode(std::queue<uint8_t> &video_frame, std::queue<uint16_t> &audio_pcm)
+void avdecoder::decode(ring_buffer<uint8_t> &video_frame, ring_buffer<uint16_t> &audio_pcm)
 {
     avdecoder_exception ex;                                    // 异常信息
-    AVChannelLayout audio_out_layout = AV_CHANNEL_LAYOUT_MONO; // 单声道输出
-    AVSampleFormat audio_out_sample_fmt = AV_SAMPLE_FMT_S16;   // 16bit
     AVPacket *pkt = av_packet_alloc();                         // 分配数据包
     SwrContext *audio_swr_ctx = swr_alloc();                   // 音频重采样上下文
-    // 像素格式转换器上下文，转换为8位灰度
-    SwsContext *video_sws_ctx = sws_getContext(this->video_decoder_ctx->width, this->video_decoder_ctx->height, this->video_decoder_ctx->pix_fmt, this->video_decoder_ctx->width, this->video_decoder_ctx->height, AV_PIX_FMT_GRAY8, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    // 像素格式转换器上下文，转换为8位灰度（彩色输出时为RGB24）
+    SwsContext *video_sws_ctx = sws_getContext(this->video_decoder_ctx->width, this->video_decoder_ctx->height, this->video_decoder_ctx->pix_fmt, this->get_video_width(), this->get_video_height(), this->output_pix_fmt, this->get_sws_flags(), NULL, NULL, NULL);
     // 分配帧
     AVFrame *frame      = av_frame_alloc();
     AVFrame *sw_frame   = av_frame_alloc();
     AVFrame *gray_frame = av_frame_alloc();
     AVFrame *pcm        = av_frame_alloc();
-    uint16_t *audio_buffer  = (uint16_t *)av_malloc(this->audio_decoder_ctx->sample_rate);                                                                          // 分配音频缓冲区
-    uint8_t *video_buffer   = (uint8_t *)av_malloc(av_image_get_buffer_size(AV_PIX_FMT_GRAY8, this->video_decoder_ctx->width, this->video_decoder_ctx->height, 1)); // 分配视频缓冲区
+    int audio_buffer_samples = this->get_audio_out_samplerate();                                                                                             // 音频缓冲区可容纳1秒的输出
+    uint16_t *audio_buffer  = (uint16_t *)av_malloc(audio_buffer_samples * sizeof(uint16_t));                                                                     // 分配音频缓冲区
+    uint8_t *video_buffer   = (uint8_t *)av_malloc(this->get_video_frame_size()); // 分配视频缓冲区
 
     if (pkt == NULL)
     {
@@ -324,14 +452,14 @@ void avdecoder::decode(std::queue<uint8_t> &video_frame, std::queue<uint16_t> &a
         ex.set_info("Unable to allocate audio frame!");
         goto fail;
     }
-    if (av_image_fill_arrays(gray_frame->data, gray_frame->linesize, video_buffer, AV_PIX_FMT_GRAY8, this->video_decoder_ctx->width, this->video_decoder_ctx->height, 1) < 0) // 向灰度帧应用自己分配的缓冲区
+    if (av_image_fill_arrays(gray_frame->data, gray_frame->linesize, video_buffer, this->output_pix_fmt, this->get_video_width(), this->get_video_height(), 1) < 0) // 向灰度帧应用自己分配的缓冲区
     {
         ex.set_info("Unable to fill image array!");
         goto fail;
     }
 
-    // 重采样为16位整数单声道PCM（采样率不变）
-    if (swr_alloc_set_opts2(&audio_swr_ctx, &audio_out_layout, audio_out_sample_fmt, this->audio_decoder_ctx->sample_rate, &this->audio_decoder_ctx->ch_layout, this->audio_decoder_ctx->sample_fmt, this->audio_decoder_ctx->sample_rate, 0, NULL) < 0)
+    // 重采样为16位整数单声道PCM（可选降采样）
+    if (this->setup_audio_resampler(&audio_swr_ctx) < 0)
     {
         ex.set_info("Unable to setup audio resampler!");
         goto fail;
@@ -385,10 +513,7 @@ void avdecoder::decode(std::queue<uint8_t> &video_frame, std::queue<uint16_t> &a
                         goto fail;
                     }
                 }
-                for (int i = 0; i < this->video_decoder_ctx->width * this->video_decoder_ctx->height; i++)
-                {
-                    video_frame.push(gray_frame->data[0][i]);
-                }
+                video_frame.push(gray_frame->data[0], this->get_video_frame_size());
             }
         }
         else if (this->audio_decoder_ctx != NULL && pkt->stream_index == this->audio_stream_index) // 如果配置过音频解码器且该数据包属于音频流
@@ -411,11 +536,9 @@ void avdecoder::decode(std::queue<uint8_t> &video_frame, std::queue<uint16_t> &a
                     goto fail;
                 }
 
-                swr_convert(audio_swr_ctx, (uint8_t **)&audio_buffer, this->audio_decoder_ctx->sample_rate, (const uint8_t **)pcm->data, pcm->nb_samples); // 重采样
-                for (int i = 0; i < pcm->nb_samples; i++)
-                {
-                    audio_pcm.push(audio_buffer[i]); // 导出音频
-                }
+                int out_samples = swr_convert(audio_swr_ctx, (uint8_t **)&audio_buffer, audio_buffer_samples, (const uint8_t **)pcm->data, pcm->nb_samples); // 重采样
+                if (out_samples > 0)
+                    audio_pcm.push(audio_buffer, out_samples); // 导出音频
             }
         }
         av_packet_unref(pkt);
@@ -464,7 +587,9 @@ fail:
 }
 
 /**
- * @brief 用于多线程的流式解码
+ * @brief 用于多线程的流式解码：本线程解复用，视频和音频各在独立线程中解码
+ *
+ * 两路解码各自只在自己的输出队列上阻塞，视频解码慢不会卡住音频解码，反之亦然
  *
  * @param video_frame 用于保存视频帧的队列
  * @param video_lock 视频帧队列的锁
@@ -472,41 +597,322 @@ fail:
  * @param audio_lock 音频帧队列的锁
  * @param abort_flag 终止标志，终止后置1，也可由外界置1停止其运行
  */
-void avdecoder::streamed_decode(std::queue<uint8_t> &video_frame, std::mutex &video_lock, std::queue<uint16_t> &audio_pcm, std::mutex &audio_lock, std::atomic<int> &abort_flag)
+void avdecoder::streamed_decode(ring_buffer<uint8_t> &video_frame, std::mutex &video_lock, ring_buffer<uint16_t> &audio_pcm, std::mutex &audio_lock, std::atomic<int> &abort_flag)
 {
-    avdecoder_exception ex;                                    // 异常信息
-    AVChannelLayout audio_out_layout = AV_CHANNEL_LAYOUT_MONO; // 单声道输出
-    AVSampleFormat audio_out_sample_fmt = AV_SAMPLE_FMT_S16;   // 16bit
-    AVPacket *pkt = av_packet_alloc();                         // 分配数据包
-    SwrContext *audio_swr_ctx = swr_alloc();                   // 音频重采样上下文
-    // 像素格式转换器上下文，转换为8位灰度
-    SwsContext *video_sws_ctx = sws_getContext(this->video_decoder_ctx->width, this->video_decoder_ctx->height, this->video_decoder_ctx->pix_fmt, this->video_decoder_ctx->width, this->video_decoder_ctx->height, AV_PIX_FMT_GRAY8, SWS_FAST_BILINEAR, NULL, NULL, NULL);
-    // 分配帧
-    AVFrame *frame      = av_frame_alloc();
-    AVFrame *sw_frame   = av_frame_alloc();
-    AVFrame *gray_frame = av_frame_alloc();
-    AVFrame *pcm        = av_frame_alloc();
-    uint16_t *audio_buffer  = (uint16_t *)av_malloc(this->audio_decoder_ctx->sample_rate);                                                                          // 分配音频缓冲区
-    uint8_t *video_buffer   = (uint8_t *)av_malloc(av_image_get_buffer_size(AV_PIX_FMT_GRAY8, this->video_decoder_ctx->width, this->video_decoder_ctx->height, 1)); // 分配视频缓冲区
+    packet_queue video_packets, audio_packets;       // 解复用到解码之间的数据包队列
+    std::atomic<int> decode_failed(0);               // 任一解码线程失败
+    std::exception_ptr video_ex = NULL, audio_ex = NULL;
+    std::thread video_t, audio_t;
+    video_packets.limit = this->live ? 1 : DEMUX_VIDEO_PACKETS_MAX; // 实时输入不预读
+    audio_packets.limit = DEMUX_AUDIO_PACKETS_MAX;
+    // 队列和空数据包池一次分配到上限，之后不再扩容
+    video_packets.packets.reserve(video_packets.limit);
+    video_packets.spare.reserve(video_packets.limit + 1);
+    audio_packets.packets.reserve(audio_packets.limit);
+    audio_packets.spare.reserve(audio_packets.limit + 1);
 
-    if (pkt == NULL)
+    if (this->video_decoder_ctx != NULL)
     {
-        ex.set_info("Unable to allocate packet!");
-        goto fail;
+        video_t = std::thread([&] {
+            try
+            {
+                this->decode_video_packets(video_packets, video_frame, video_lock, abort_flag, decode_failed);
+            }
+            catch (...)
+            {
+                video_ex = std::current_exception();
+                decode_failed = 1;
+            }
+        });
     }
-    if (audio_swr_ctx == NULL)
+    if (this->audio_decoder_ctx != NULL)
     {
-        ex.set_info("Unable to allocate audio resampler!");
-        goto fail;
+        audio_t = std::thread([&] {
+            try
+            {
+                this->decode_audio_packets(audio_packets, audio_pcm, audio_lock, abort_flag, decode_failed);
+            }
+            catch (...)
+            {
+                audio_ex = std::current_exception();
+                decode_failed = 1;
+            }
+        });
     }
-    if (video_sws_ctx == NULL)
+
+    this->demux_packets(video_packets, audio_packets, abort_flag, decode_failed);
+    video_packets.eof = 1; // 不会再有新数据包，解码线程处理完剩余数据包后退出
+    audio_packets.eof = 1;
+    if (video_t.joinable())
+        video_t.join();
+    if (audio_t.joinable())
+        audio_t.join();
+    avdecoder::clear_packets(video_packets);
+    avdecoder::clear_packets(audio_packets);
+    abort_flag = 1;
+    if (video_ex)
+        std::rethrow_exception(video_ex);
+    if (audio_ex)
+        std::rethrow_exception(audio_ex);
+}
+
+/**
+ * @brief 解复用线程：读出数据包并按流分发到数据包队列（私有方法）
+ *
+ * @param video_packets 视频数据包队列
+ * @param audio_packets 音频数据包队列
+ * @param abort_flag 外部终止标志
+ * @param decode_failed 解码线程失败标志
+ */
+void avdecoder::demux_packets(packet_queue &video_packets, packet_queue &audio_packets, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed)
+{
+    trace_buffer *tb = this->trace != NULL ? this->trace->register_thread("demux") : NULL; // 本线程的跟踪缓冲区
+    int64_t packets = 0;                                                                   // 跟踪用的序号
+    AVPacket *pkt = av_packet_alloc(); // 读取用的数据包，读到后把内容转移给队列中的数据包
+    uint64_t demux_serial = 0;         // 已执行的跳转请求
+    while (pkt != NULL && abort_flag == 0 && decode_failed == 0)
     {
-        ex.set_info("Unable to allocate video scaler!");
-        goto fail;
+        uint64_t serial = this->seek_serial;
+        if (serial != demux_serial) // 有新的跳转请求（连续多次请求只执行最后一次）
+        {
+            demux_serial = serial;
+            this->seek_input(video_packets, audio_packets, serial, this->seek_target_us);
+        }
+        auto read_begin = std::chrono::steady_clock::now();
+        trace_span demux_span(tb, "demux", packets++);
+        if (av_read_frame(this->input_ctx, pkt) < 0) // 读出数据包
+            break;
+        demux_span.end();
+        uint64_t arrival_ns = metrics::now_ns(); // 数据包到达时刻，用于统计端到端延迟
+        if (this->stats != NULL)
+        {
+            metrics::add(this->stats->decoder.wait_input_ns, metrics::elapsed_ns(read_begin));
+            metrics::add(this->stats->decoder.frames_in, 1);
+        }
+        packet_queue *target = NULL;
+        if (this->video_decoder_ctx != NULL && pkt->stream_index == this->video_stream_index) // 如果配置过视频解码器且该数据包属于视频流
+            target = &video_packets;
+        else if (this->audio_decoder_ctx != NULL && pkt->stream_index == this->audio_stream_index) // 如果配置过音频解码器且该数据包属于音频流
+            target = &audio_packets;
+        if (target == NULL)
+        {
+            av_packet_unref(pkt); // 其他流的数据包直接丢弃，结构体留给下次读取
+            continue;
+        }
+        trace_span wait_span(tb, "queue wait (output)", packets - 1);
+        while (1)
+        {
+            target->lock.lock();
+            if (target->packets.size() < target->limit)
+                break; // 队列未满，写入
+            target->lock.unlock();
+            if (abort_flag > 0 || decode_failed > 0)
+            {
+                av_packet_free(&pkt);
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        AVPacket *queued = NULL;
+        if (!target->spare.empty())
+        {
+            queued = target->spare.front(); // 复用解码线程还回来的数据包
+            target->spare.pop();
+        }
+        else if ((queued = av_packet_alloc()) == NULL) // 预热阶段池中还没有数据包
+        {
+            target->lock.unlock();
+            break;
+        }
+        av_packet_move_ref(queued, pkt);                     // 只转移数据引用，pkt变为空包供下次读取
+        target->packets.push(queued_packet{queued, arrival_ns, 0, 0}); // 数据包的所有权交给解码线程
+        target->lock.unlock();
+        wait_span.end();
     }
-    if (audio_buffer == NULL)
+    if (pkt != NULL)
+        av_packet_free(&pkt);
+}
+
+/**
+ * @brief 从数据包队列取出一个数据包（私有方法）
+ *
+ * @param queue 数据包队列
+ * @param item 取出的数据包（或跳转标记），数据包用完后由调用者用recycle_packet归还
+ * @param abort_flag 外部终止标志
+ * @param decode_failed 解码线程失败标志
+ * @return int 取到数据包返回1，队列已结束或需要终止时返回0
+ */
+int avdecoder::pop_packet(packet_queue &queue, queued_packet &item, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed)
+{
+    while (abort_flag == 0 && decode_failed == 0)
     {
-        ex.set_info("Unable to allocate audio buffer!");
+        queue.lock.lock();
+        if (!queue.packets.empty())
+        {
+            item = queue.packets.front();
+            queue.packets.pop();
+            queue.lock.unlock();
+            return 1;
+        }
+        queue.lock.unlock();
+        if (queue.eof > 0) // 先检查队列再检查结束标志，保证结束前的数据包都被取走
+        {
+            queue.lock.lock();
+            int empty = queue.packets.empty();
+            queue.lock.unlock();
+            if (empty)
+                return 0;
+            continue;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return 0;
+}
+
+/**
+ * @brief 执行跳转：定位到目标之前最近的关键帧，丢弃队列中旧位置的数据包并放入跳转标记（私有方法，在解复用线程中调用）
+ *
+ * 解码线程收到标记后冲洗解码器，并丢弃目标之前的帧，所以输出从目标位置精确开始
+ *
+ * @param video_packets 视频数据包队列
+ * @param audio_packets 音频数据包队列
+ * @param serial 跳转请求序号
+ * @param target_us 目标位置（微秒，相对于媒体开头）
+ */
+void avdecoder::seek_input(packet_queue &video_packets, packet_queue &audio_packets, uint64_t serial, int64_t target_us)
+{
+    int64_t start = this->input_ctx->start_time != AV_NOPTS_VALUE ? this->input_ctx->start_time : 0;
+    if (av_seek_frame(this->input_ctx, -1, start + target_us, AVSEEK_FLAG_BACKWARD) < 0) // 不指定流时时间单位为AV_TIME_BASE
+        std::cerr << "Warning: unable to seek to " << target_us / 1e6 << " s" << std::endl;
+    packet_queue *queues[2] = {&video_packets, &audio_packets};
+    for (packet_queue *queue : queues)
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        while (!queue->packets.empty())
+        {
+            queued_packet item = queue->packets.front();
+            queue->packets.pop();
+            if (item.pkt == NULL)
+                continue; // 上一次跳转还没被取走的标记
+            av_packet_unref(item.pkt);
+            queue->spare.push(item.pkt);
+        }
+        queue->packets.push(queued_packet{NULL, metrics::now_ns(), serial, target_us});
+    }
+}
+
+/**
+ * @brief 视频流本身的帧率，平均帧率未知（原始视频、部分mkv/ts报告0/1或0/0）时由libav按r_frame_rate等推测（私有方法）
+ *
+ * @return double 帧率，仍无法确定时返回0
+ */
+double avdecoder::source_framerate(void)
+{
+    AVRational rate = av_guess_frame_rate(this->input_ctx, this->video, NULL);
+    if (rate.num <= 0 || rate.den <= 0)
+        return 0;
+    return av_q2d(rate);
+}
+
+/**
+ * @brief 计算解码帧相对于媒体开头的时间（私有方法）
+ *
+ * @param frame 解码出的帧
+ * @param stream 所属的流
+ * @return int64_t 时间（微秒），没有时间戳时返回INT64_MAX（视为已到达目标）
+ */
+int64_t avdecoder::frame_time_us(const AVFrame *frame, const AVStream *stream)
+{
+    if (frame->best_effort_timestamp == AV_NOPTS_VALUE)
+        return INT64_MAX;
+    int64_t start = this->input_ctx->start_time != AV_NOPTS_VALUE ? this->input_ctx->start_time : 0;
+    return (int64_t)(frame->best_effort_timestamp * 1e6 * stream->time_base.num / stream->time_base.den) - start;
+}
+
+/**
+ * @brief 请求跳转到指定位置，立即返回，由解复用线程在读取下一个数据包前执行
+ *
+ * @param seconds 目标位置（秒，相对于媒体开头）
+ */
+void avdecoder::request_seek(double seconds)
+{
+    this->seek_target_us = (int64_t)(seconds * 1e6);
+    this->seek_serial++;
+}
+
+/**
+ * @brief 把用完的数据包放回队列的空数据包池（私有方法）
+ *
+ * @param queue 数据包队列
+ * @param pkt 数据包，归还后置NULL
+ */
+void avdecoder::recycle_packet(packet_queue &queue, AVPacket *&pkt)
+{
+    av_packet_unref(pkt);
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.spare.push(pkt);
+    pkt = NULL;
+}
+
+/**
+ * @brief 释放数据包队列中剩余的数据包和空数据包池（私有方法）
+ *
+ * @param queue 数据包队列
+ */
+void avdecoder::clear_packets(packet_queue &queue)
+{
+    std::lock_guard<std::mutex> guard(queue.lock);
+    while (!queue.packets.empty())
+    {
+        if (queue.packets.front().pkt != NULL) // 跳转标记没有数据包
+            av_packet_free(&queue.packets.front().pkt);
+        queue.packets.pop();
+    }
+    while (!queue.spare.empty())
+    {
+        av_packet_free(&queue.spare.front());
+        queue.spare.pop();
+    }
+}
+
+/**
+ * @brief 视频解码线程：解码、转换为灰度并写入视频帧队列（私有方法）
+ *
+ * @param packets 视频数据包队列
+ * @param video_frame 视频帧队列
+ * @param video_lock 视频帧队列的锁
+ * @param abort_flag 外部终止标志
+ * @param decode_failed 解码线程失败标志
+ */
+void avdecoder::decode_video_packets(packet_queue &packets, ring_buffer<uint8_t> &video_frame, std::mutex &video_lock, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed)
+{
+    avdecoder_exception ex;                                                                  // 异常信息
+    trace_buffer *tb = this->trace != NULL ? this->trace->register_thread("video decoder") : NULL; // 本线程的跟踪缓冲区
+    int64_t video_frames = 0;                                                                // 跟踪用的序号
+    const int width = this->video_decoder_ctx->width, height = this->video_decoder_ctx->height;
+    const int out_width = this->get_video_width(), out_height = this->get_video_height(); // 固定了输出格式时缩放到该尺寸
+    // 固定了输出帧率时按帧率之比重复或丢弃帧
+    const double source_rate = this->source_framerate();
+    const double frame_step = this->output_framerate > 0 && source_rate > 0 ? this->output_framerate / source_rate : 1; // 原帧率未知时逐帧输出
+    double frame_credit = 0;
+    const int64_t frame_half_us = source_rate > 0 ? (int64_t)(500000 / source_rate) : 0; // 跳转时目标落在两帧之间则取后一帧
+    AVPacket *pkt = NULL;
+    uint64_t arrival_ns = 0;
+    queued_packet item = {NULL, 0, 0, 0};
+    uint64_t decoder_serial = 0;        // 已处理的跳转标记
+    int64_t skip_until_us = INT64_MIN;  // 跳转后丢弃此时刻之前的帧
+    int flushing = 0;
+    const int out_frame_size = this->get_video_frame_size();
+    // 像素格式转换器上下文，转换为8位灰度（彩色输出时为RGB24）
+    SwsContext *video_sws_ctx = sws_getContext(width, height, this->video_decoder_ctx->pix_fmt, out_width, out_height, this->output_pix_fmt, this->get_sws_flags(), NULL, NULL, NULL);
+    AVFrame *frame      = av_frame_alloc();
+    AVFrame *sw_frame   = av_frame_alloc();
+    AVFrame *gray_frame = av_frame_alloc();
+    uint8_t *video_buffer = (uint8_t *)av_malloc(out_frame_size); // 分配视频缓冲区
+
+    if (video_sws_ctx == NULL)
+    {
+        ex.set_info("Unable to allocate video scaler!");
         goto fail;
     }
     if (video_buffer == NULL)
@@ -529,134 +935,137 @@ void avdecoder::streamed_decode(std::queue<uint8_t> &video_frame, std::mutex &vi
         ex.set_info("Unable to allocate gray frame!");
         goto fail;
     }
-    if (pcm == NULL)
-    {
-        ex.set_info("Unable to allocate audio frame!");
-        goto fail;
-    }
-    if (av_image_fill_arrays(gray_frame->data, gray_frame->linesize, video_buffer, AV_PIX_FMT_GRAY8, this->video_decoder_ctx->width, this->video_decoder_ctx->height, 1) < 0) // 向灰度帧应用自己分配的缓冲区
+    if (av_image_fill_arrays(gray_frame->data, gray_frame->linesize, video_buffer, this->output_pix_fmt, out_width, out_height, 1) < 0) // 向灰度帧应用自己分配的缓冲区
     {
         ex.set_info("Unable to fill image array!");
         goto fail;
     }
 
-    // 重采样为16位整数单声道PCM（采样率不变）
-    if (swr_alloc_set_opts2(&audio_swr_ctx, &audio_out_layout, audio_out_sample_fmt, this->audio_decoder_ctx->sample_rate, &this->audio_decoder_ctx->ch_layout, this->audio_decoder_ctx->sample_fmt, this->audio_decoder_ctx->sample_rate, 0, NULL) < 0)
-    {
-        ex.set_info("Unable to setup audio resampler!");
-        goto fail;
-    }
-    if (swr_init(audio_swr_ctx) < 0) // 初始化重采样上下文
-    {
-        ex.set_info("Unable to initalize audio resampler!");
-        goto fail;
-    }
-
-    while (abort_flag == 0 && av_read_frame(this->input_ctx, pkt) >= 0) // 读出数据包
+    while (!flushing)
     {
-        if (this->video_decoder_ctx != NULL && pkt->stream_index == this->video_stream_index) // 如果配置过视频解码器且该数据包属于视频流
+        if (!this->pop_packet(packets, item, abort_flag, decode_failed))
         {
-            if (avcodec_send_packet(this->video_decoder_ctx, pkt) < 0) // 发送数据包到视频解码器
+            if (abort_flag > 0 || decode_failed > 0)
+                break;
+            flushing = 1; // 输入结束，冲洗解码器中剩余的帧
+        }
+        else if (item.pkt == NULL) // 跳转标记，之后的数据包从新位置前的关键帧开始
+        {
+            avcodec_flush_buffers(this->video_decoder_ctx);
+            decoder_serial = item.seek_serial;
+            skip_until_us = item.seek_target_us - frame_half_us;
+            frame_credit = 0;
+            this->video_frames_out = 0; // 播放列表按跳转之后的帧数对齐音频
+            continue;
+        }
+        else
+        {
+            pkt = item.pkt;
+            arrival_ns = item.arrival_ns;
+        }
+        trace_span decode_span(tb, "video decode", video_frames); // 到解出第一帧为止
+        int send_ret = avcodec_send_packet(this->video_decoder_ctx, pkt); // 发送数据包到视频解码器（冲洗时为NULL）
+        if (pkt != NULL)
+            avdecoder::recycle_packet(packets, pkt);
+        if (send_ret < 0 && !flushing)
+        {
+            ex.set_info("Unable to send packet to video decoder!");
+            goto fail;
+        }
+        while (1)
+        {
+            int video_rec_ret = avcodec_receive_frame(this->video_decoder_ctx, frame); // 接收帧
+
+            if (video_rec_ret == AVERROR(EAGAIN) || video_rec_ret == AVERROR_EOF)
             {
-                ex.set_info("Unable to send packet to video decoder!");
+                break;
+            }
+            else if (video_rec_ret < 0)
+            {
+                ex.set_info("Unable to receive frame from video decoder!");
                 goto fail;
             }
-            while (1)
+            decode_span.end();
+            if (decoder_serial != this->seek_serial || this->frame_time_us(frame, this->video) < skip_until_us)
+                continue; // 跳转请求还未生效时旧位置的帧，或关键帧到跳转目标之间的帧
+            trace_span sws_span(tb, "sws convert", video_frames);
+            if (frame->format == this->video_hw_pix_fmt) // 确实是硬件帧
             {
-                int video_rec_ret = avcodec_receive_frame(this->video_decoder_ctx, frame); // 接收帧
-
-                if (video_rec_ret == AVERROR(EAGAIN) || video_rec_ret == AVERROR_EOF)
-                {
-                    break;
-                }
-                else if (video_rec_ret < 0)
+                if (av_hwframe_transfer_data(sw_frame, frame, 0) < 0) // 从硬件接收帧数据
                 {
-                    ex.set_info("Unable to receive frame from video decoder!");
+                    ex.set_info("Unable to receive data from HW frame!");
                     goto fail;
                 }
-                if (frame->format == this->video_hw_pix_fmt) // 确实是硬件帧
-                {
-                    if (av_hwframe_transfer_data(sw_frame, frame, 0) < 0) // 从硬件接收帧数据
-                    {
-                        ex.set_info("Unable to receive data from HW frame!");
-                        goto fail;
-                    }
-                    if (sws_scale(video_sws_ctx, sw_frame->data, sw_frame->linesize, 0, this->video_decoder_ctx->height, gray_frame->data, gray_frame->linesize) < 0) // 转换格式
-                    {
-                        ex.set_info("Unable to convert pix format!");
-                        goto fail;
-                    }
-                }
-                else // 本来就是软件帧
+                if (sws_scale(video_sws_ctx, sw_frame->data, sw_frame->linesize, 0, height, gray_frame->data, gray_frame->linesize) < 0) // 转换格式
                 {
-                    if (sws_scale(video_sws_ctx, frame->data, frame->linesize, 0, this->video_decoder_ctx->height, gray_frame->data, gray_frame->linesize) < 0) // 转换格式
-                    {
-                        ex.set_info("Unable to convert pix format!");
-                        goto fail;
-                    }
+                    ex.set_info("Unable to convert pix format!");
+                    goto fail;
                 }
-                while (1)
+            }
+            else // 本来就是软件帧
+            {
+                if (sws_scale(video_sws_ctx, frame->data, frame->linesize, 0, height, gray_frame->data, gray_frame->linesize) < 0) // 转换格式
                 {
-                    video_lock.lock();
-                    int s = video_frame.size(); // 先加锁，再获取队列长度
-                    video_lock.unlock();
-                    if ((s * sizeof(uint8_t)) < VIDEO_QUEUE_LENGTH_MAX)
-                        break; // 队列足够短，开始向队列写入
-                    std::this_thread::sleep_for(std::chrono::microseconds(1));
+                    ex.set_info("Unable to convert pix format!");
+                    goto fail;
                 }
+            }
+            sws_span.end();
+            frame_credit += frame_step;
+            int repeats = (int)frame_credit; // 本帧输出的次数，帧率不变时总是1
+            frame_credit -= repeats;
+            if (repeats == 0)
+                continue;
+            auto wait_begin = std::chrono::steady_clock::now();
+            trace_span wait_span(tb, "queue wait (output)", video_frames);
+            while (1)
+            {
                 video_lock.lock();
-                for (int i = 0; i < this->video_decoder_ctx->width * this->video_decoder_ctx->height; i++)
-                {
-                    video_frame.push(gray_frame->data[0][i]); // 写入
-                }
+                int s = video_frame.size(); // 先加锁，再获取队列长度
                 video_lock.unlock();
+                if ((s * sizeof(uint8_t)) < this->video_queue_limit)
+                    break; // 队列足够短，开始向队列写入
+                if (abort_flag > 0 || decode_failed > 0)
+                    goto done;
+                std::this_thread::sleep_for(std::chrono::microseconds(1));
             }
-        }
-        else if (this->audio_decoder_ctx != NULL && pkt->stream_index == this->audio_stream_index) // 如果配置过音频解码器且该数据包属于音频流
-        {
-            if (avcodec_send_packet(this->audio_decoder_ctx, pkt) < 0) // 向音频解码器发送数据包
+            wait_span.end();
+            if (this->stats != NULL)
+                metrics::add(this->stats->decoder.wait_output_ns, metrics::elapsed_ns(wait_begin));
+            video_lock.lock();
+            if (decoder_serial != this->seek_serial) // 等待期间有了新的跳转请求，队列可能已被清空
             {
-                ex.set_info("Unable to send packet to audio decoder!");
-                goto fail;
+                video_lock.unlock();
+                continue;
             }
-            while (1)
+            for (int i = 0; i < repeats; i++)
+                video_frame.push(gray_frame->data[0], out_frame_size); // 写入
+            this->video_frames_out += repeats;
+            if (this->stats != NULL)
             {
-                int audio_rec_ret = avcodec_receive_frame(this->audio_decoder_ctx, pcm); // 从音频解码器接收帧
-                if (audio_rec_ret == AVERROR(EAGAIN) || audio_rec_ret == AVERROR_EOF)
-                {
-                    break;
-                }
-                else if (audio_rec_ret < 0)
-                {
-                    ex.set_info("Unable to receive pcm from audio decoder!");
-                    goto fail;
-                }
-
-                swr_convert(audio_swr_ctx, (uint8_t **)&audio_buffer, this->audio_decoder_ctx->sample_rate, (const uint8_t **)pcm->data, pcm->nb_samples); // 重采样
-                while (1)
-                {
-                    audio_lock.lock();
-                    int s = audio_pcm.size(); // 先加锁，再获取队列长度
-                    audio_lock.unlock();
-                    if ((s * sizeof(uint16_t)) < AUDIO_QUEUE_LENGTH_MAX)
-                        break; // 队列足够短，开始向队列写入
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                }
-                audio_lock.lock();
-                for (int i = 0; i < pcm->nb_samples; i++)
-                {
-                    audio_pcm.push(audio_buffer[i]); // 导出音频
-                }
-                audio_lock.unlock();
+                metrics::set(this->stats->av_video_depth, video_frame.size());
+                this->stats->frame_arrived(video_frames, arrival_ns);
             }
+            video_lock.unlock();
+            if (this->stats != NULL)
+                metrics::add(this->stats->decoder.frames_out, 1);
+            video_frames++;
+            if (this->timer != NULL && video_frames == 1) // 只记录第一帧，之后不再进入计时器
+                this->timer->mark("first frame decoded");
         }
-        av_packet_unref(pkt);
     }
 
-    if (pkt)
+done:
+    sws_freeContext(video_sws_ctx);
+    av_frame_free(&frame);
+    av_frame_free(&sw_frame);
+    av_frame_free(&gray_frame);
+    av_free(video_buffer);
+    return;
+
+fail:
+    if (pkt != NULL)
         av_packet_free(&pkt);
-    if (audio_swr_ctx)
-        swr_free(&audio_swr_ctx);
     if (video_sws_ctx)
         sws_freeContext(video_sws_ctx);
     if (frame)
@@ -665,37 +1074,211 @@ void avdecoder::streamed_decode(std::queue<uint8_t> &video_frame, std::mutex &vi
         av_frame_free(&sw_frame);
     if (gray_frame)
         av_frame_free(&gray_frame);
-    if (pcm)
-        av_frame_free(&pcm);
-    if (audio_buffer)
-        av_free(audio_buffer);
     if (video_buffer)
         av_free(video_buffer);
-    abort_flag = 1;
+    throw ex;
+}
+
+/**
+ * @brief 音频解码线程：解码、重采样并写入音频队列（私有方法）
+ *
+ * @param packets 音频数据包队列
+ * @param audio_pcm 音频队列
+ * @param audio_lock 音频队列的锁
+ * @param abort_flag 外部终止标志
+ * @param decode_failed 解码线程失败标志
+ */
+void avdecoder::decode_audio_packets(packet_queue &packets, ring_buffer<uint16_t> &audio_pcm, std::mutex &audio_lock, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed)
+{
+    avdecoder_exception ex;                                                                  // 异常信息
+    trace_buffer *tb = this->trace != NULL ? this->trace->register_thread("audio decoder") : NULL; // 本线程的跟踪缓冲区
+    int64_t audio_frames = 0;                                                                // 跟踪用的序号
+    AVPacket *pkt = NULL;
+    queued_packet item = {NULL, 0, 0, 0};
+    uint64_t decoder_serial = 0;        // 已处理的跳转标记
+    int64_t skip_until_us = INT64_MIN;  // 跳转后丢弃此时刻之前的样本
+    int flushing = 0;
+    SwrContext *audio_swr_ctx = swr_alloc();                                                  // 音频重采样上下文
+    AVFrame *pcm = av_frame_alloc();
+    int audio_buffer_samples = this->get_audio_out_samplerate();                               // 音频缓冲区可容纳1秒的输出
+    uint16_t *audio_buffer = (uint16_t *)av_malloc(audio_buffer_samples * sizeof(uint16_t)); // 分配音频缓冲区
+
+    if (audio_swr_ctx == NULL)
+    {
+        ex.set_info("Unable to allocate audio resampler!");
+        goto fail;
+    }
+    if (audio_buffer == NULL)
+    {
+        ex.set_info("Unable to allocate audio buffer!");
+        goto fail;
+    }
+    if (pcm == NULL)
+    {
+        ex.set_info("Unable to allocate audio frame!");
+        goto fail;
+    }
+    // 重采样为16位整数单声道PCM（可选降采样）
+    if (this->setup_audio_resampler(&audio_swr_ctx) < 0)
+    {
+        ex.set_info("Unable to setup audio resampler!");
+        goto fail;
+    }
+    if (swr_init(audio_swr_ctx) < 0) // 初始化重采样上下文
+    {
+        ex.set_info("Unable to initalize audio resampler!");
+        goto fail;
+    }
+
+    while (!flushing)
+    {
+        if (!this->pop_packet(packets, item, abort_flag, decode_failed))
+        {
+            if (abort_flag > 0 || decode_failed > 0)
+                break;
+            flushing = 1; // 输入结束，冲洗解码器中剩余的帧
+        }
+        else if (item.pkt == NULL) // 跳转标记
+        {
+            avcodec_flush_buffers(this->audio_decoder_ctx);
+            if (swr_init(audio_swr_ctx) < 0) // 重采样器中旧位置的样本也丢弃，新位置从空的滤波器开始，audio_skip不必计入其延迟
+            {
+                ex.set_info("Unable to reset audio resampler!");
+                goto fail;
+            }
+            decoder_serial = item.seek_serial;
+            skip_until_us = item.seek_target_us;
+            this->audio_skip = 0;
+            this->audio_samples_out = 0;
+            continue;
+        }
+        else
+            pkt = item.pkt;
+        trace_span decode_span(tb, "audio decode", audio_frames);
+        int send_ret = avcodec_send_packet(this->audio_decoder_ctx, pkt); // 向音频解码器发送数据包（冲洗时为NULL）
+        if (pkt != NULL)
+            avdecoder::recycle_packet(packets, pkt);
+        if (send_ret < 0 && !flushing)
+        {
+            ex.set_info("Unable to send packet to audio decoder!");
+            goto fail;
+        }
+        while (1)
+        {
+            int audio_rec_ret = avcodec_receive_frame(this->audio_decoder_ctx, pcm); // 从音频解码器接收帧
+            if (audio_rec_ret == AVERROR(EAGAIN) || audio_rec_ret == AVERROR_EOF)
+            {
+                break;
+            }
+            else if (audio_rec_ret < 0)
+            {
+                ex.set_info("Unable to receive pcm from audio decoder!");
+                goto fail;
+            }
+            decode_span.end();
+            if (decoder_serial != this->seek_serial)
+                continue; // 跳转请求还未生效时旧位置的样本
+            if (skip_until_us != INT64_MIN)
+            {
+                int64_t begin_us = this->frame_time_us(pcm, this->audio);
+                if (begin_us != INT64_MAX && begin_us + (int64_t)pcm->nb_samples * 1000000 / this->audio_decoder_ctx->sample_rate <= skip_until_us)
+                    continue; // 整帧都在跳转目标之前
+                if (begin_us != INT64_MAX && begin_us < skip_until_us)
+                    this->audio_skip = (skip_until_us - begin_us) * this->get_audio_out_samplerate() / 1000000; // 从目标处开始输出
+                skip_until_us = INT64_MIN;
+            }
+
+            trace_span swr_span(tb, "resample", audio_frames);
+            int out_samples = swr_convert(audio_swr_ctx, (uint8_t **)&audio_buffer, audio_buffer_samples, (const uint8_t **)pcm->data, pcm->nb_samples); // 重采样
+            swr_span.end();
+            if (!this->push_audio(audio_pcm, audio_lock, audio_buffer, out_samples, decoder_serial, abort_flag, decode_failed, tb, audio_frames))
+                goto done;
+            audio_frames++;
+        }
+    }
+    if (flushing && decoder_serial == this->seek_serial) // 输入结束：取出重采样器（降采样的抗混叠滤波器）中剩余的样本
+    {
+        int out_samples;
+        while ((out_samples = swr_convert(audio_swr_ctx, (uint8_t **)&audio_buffer, audio_buffer_samples, NULL, 0)) > 0)
+        {
+            if (!this->push_audio(audio_pcm, audio_lock, audio_buffer, out_samples, decoder_serial, abort_flag, decode_failed, tb, audio_frames))
+                goto done;
+        }
+    }
+
+done:
+    swr_free(&audio_swr_ctx);
+    av_frame_free(&pcm);
+    av_free(audio_buffer);
     return;
 
 fail:
-    if (pkt)
+    if (pkt != NULL)
         av_packet_free(&pkt);
     if (audio_swr_ctx)
         swr_free(&audio_swr_ctx);
-    if (video_sws_ctx)
-        sws_freeContext(video_sws_ctx);
-    if (frame)
-        av_frame_free(&frame);
-    if (sw_frame)
-        av_frame_free(&sw_frame);
-    if (gray_frame)
-        av_frame_free(&gray_frame);
     if (pcm)
         av_frame_free(&pcm);
     if (audio_buffer)
         av_free(audio_buffer);
-    if (video_buffer)
-        av_free(video_buffer);
     throw ex;
 }
 
+/**
+ * @brief 等待音频队列有空位后写入重采样后的样本，开头按audio_skip丢弃（私有方法）
+ *
+ * @param audio_pcm 音频PCM队列
+ * @param audio_lock 音频PCM队列的锁
+ * @param samples 重采样后的样本，丢弃开头时就地移动
+ * @param count 样本数，不大于0时只等待
+ * @param serial 样本所属的跳转序号，与当前不同时不写入
+ * @param abort_flag 外部终止标志
+ * @param decode_failed 解码线程失败标志
+ * @param tb 跟踪缓冲区，为NULL时不跟踪
+ * @param audio_frames 跟踪用的序号
+ * @return int 等待期间终止时返回0，否则返回1
+ */
+int avdecoder::push_audio(ring_buffer<uint16_t> &audio_pcm, std::mutex &audio_lock, uint16_t *samples, int count, uint64_t serial, std::atomic<int> &abort_flag, std::atomic<int> &decode_failed, trace_buffer *tb, int64_t audio_frames)
+{
+    auto wait_begin = std::chrono::steady_clock::now();
+    trace_span wait_span(tb, "queue wait (output)", audio_frames);
+    while (1)
+    {
+        audio_lock.lock();
+        int s = audio_pcm.size(); // 先加锁，再获取队列长度
+        audio_lock.unlock();
+        if ((s * sizeof(uint16_t)) < this->audio_queue_limit)
+            break; // 队列足够短，开始向队列写入
+        if (abort_flag > 0 || decode_failed > 0)
+            return 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    wait_span.end();
+    if (this->stats != NULL)
+        metrics::add(this->stats->audio_decoder.wait_output_ns, metrics::elapsed_ns(wait_begin));
+    std::lock_guard<std::mutex> guard(audio_lock);
+    if (serial != this->seek_serial) // 等待期间有了新的跳转请求，队列可能已被清空
+        return 1;
+    if (count > 0 && this->audio_skip > 0) // 丢弃开头的样本，用于与视频对齐
+    {
+        int skip = (int)std::min<int64_t>(this->audio_skip, count);
+        this->audio_skip -= skip;
+        count -= skip;
+        memmove(samples, samples + skip, count * sizeof(uint16_t));
+    }
+    if (count > 0)
+    {
+        audio_pcm.push(samples, count); // 导出音频
+        this->audio_samples_out += count;
+    }
+    if (this->stats != NULL)
+    {
+        metrics::set(this->stats->av_audio_depth, audio_pcm.size());
+        metrics::add(this->stats->audio_decoder.frames_out, 1);
+    }
+    return 1;
+}
+
 /**
  * @brief 获取当前视频流帧率
  *
@@ -703,23 +1286,312 @@ fail:
  */
 double avdecoder::get_video_framerate(void)
 {
+    if (this->video != NULL && this->output_framerate > 0)
+        return this->output_framerate;
     if (this->video != NULL)
-        return (double)this->video->avg_frame_rate.num / this->video->avg_frame_rate.den;
+        return this->source_framerate();
     return -1;
 }
 
 /**
- * @brief 获取当前音频流采样率
+ * @brief 获取输出音频的采样率
  *
- * @return double 音频流有效时返回采样率，无效则返回-1
+ * @return double 音频流有效时返回（降采样后的）输出采样率，无效则返回-1
  */
 double avdecoder::get_audio_samplerate(void)
 {
     if (this->audio != NULL)
-        return (double)this->audio_decoder_ctx->sample_rate;
+        return (double)this->get_audio_out_samplerate();
     return -1;
 }
 
+/**
+ * @brief 设置输出音频的采样率，用于在FFT之前降采样
+ *
+ * @param samplerate 输出采样率（单位：Hz），为0时保持原采样率
+ */
+void avdecoder::set_audio_samplerate(int samplerate)
+{
+    if (samplerate < 0)
+    {
+        std::invalid_argument ex("samplerate below 0!");
+        throw ex;
+    }
+    if (samplerate > 0 && samplerate < AUDIO_SAMPLERATE_MIN)
+    {
+        std::invalid_argument ex("samplerate too low for buzzer frequency range!");
+        throw ex;
+    }
+    this->audio_out_samplerate = samplerate;
+}
+
+/**
+ * @brief 固定流式解码的输出格式，使播放列表中后续各项与第一项一致，下游无需重建
+ *
+ * 视频缩放到给定尺寸（不保持宽高比），按帧率之比重复或丢弃帧；音频重采样到给定采样率
+ *
+ * @param width 输出宽度，为0时保持原尺寸
+ * @param height 输出高度
+ * @param framerate 输出帧率，为0时保持原帧率
+ * @param samplerate 输出采样率，为0时按set_audio_samplerate的设置
+ */
+void avdecoder::set_output_format(int width, int height, double framerate, int samplerate)
+{
+    if (width < 0 || height < 0 || framerate < 0 || samplerate < 0)
+    {
+        std::invalid_argument ex("Invalid output format!");
+        throw ex;
+    }
+    this->output_width      = width;
+    this->output_height     = height;
+    this->output_framerate  = framerate;
+    this->forced_samplerate = samplerate;
+}
+
+/**
+ * @brief 设置视频帧的像素格式（须在开始解码之前设置），默认为8位灰度
+ *
+ * 彩色输出（AV_PIX_FMT_RGB24）通常配合set_output_format直接缩放到屏幕尺寸，
+ * 此时swscale用区域平均缩小，避免大幅缩小时的混叠
+ *
+ * @param format AV_PIX_FMT_GRAY8或AV_PIX_FMT_RGB24
+ */
+void avdecoder::set_pixel_format(AVPixelFormat format)
+{
+    if (format != AV_PIX_FMT_GRAY8 && format != AV_PIX_FMT_RGB24)
+    {
+        std::invalid_argument ex("Unsupported output pixel format!");
+        throw ex;
+    }
+    this->output_pix_fmt = format;
+}
+
+/**
+ * @brief 获取swscale的缩放算法（私有方法）
+ *
+ * @return int 灰度输出由gray2bw缩小，这里只做格式转换，用最快的双线性；彩色输出在这里缩小到屏幕尺寸，用区域平均
+ */
+int avdecoder::get_sws_flags(void)
+{
+    return this->output_pix_fmt == AV_PIX_FMT_GRAY8 ? SWS_FAST_BILINEAR : SWS_AREA;
+}
+
+/**
+ * @brief 设置是否解码音频（须在open之前设置），禁用后音频数据包在解复用时直接丢弃
+ *
+ * @param enabled 为0时不解码音频
+ */
+void avdecoder::set_audio_enabled(int enabled)
+{
+    this->audio_enabled = enabled;
+}
+
+/**
+ * @brief 在音频输出开头丢弃一些样本，用于播放列表切换时让音频与视频对齐（须在streamed_decode之前设置）
+ *
+ * @param samples 样本数
+ */
+void avdecoder::set_audio_skip(int64_t samples)
+{
+    this->audio_skip = samples;
+}
+
+/**
+ * @brief 获取streamed_decode已输出的视频帧数
+ *
+ * @return int64_t 帧数
+ */
+int64_t avdecoder::get_video_frames_out(void)
+{
+    return this->video_frames_out;
+}
+
+/**
+ * @brief 获取streamed_decode已输出的音频样本数
+ *
+ * @return int64_t 样本数
+ */
+int64_t avdecoder::get_audio_samples_out(void)
+{
+    return this->audio_samples_out;
+}
+
+/**
+ * @brief 限制打开输入时的探测数据量，用于快速启动
+ *
+ * @param probesize 最大探测字节数，为0时使用libav默认值
+ * @param analyze_duration 最大分析时长（单位：微秒），为0时使用libav默认值
+ */
+void avdecoder::set_probe_limit(int64_t probesize, int64_t analyze_duration)
+{
+    this->probesize         = probesize;
+    this->analyze_duration  = analyze_duration;
+}
+
+/**
+ * @brief 指定输入格式（如rawvideo、yuv4mpegpipe），用于无法探测的原始流
+ *
+ * @param format libav输入格式名称，为空时自动探测
+ */
+void avdecoder::set_input_format(const std::string &format)
+{
+    this->input_format = format;
+}
+
+/**
+ * @brief 设置输入格式的私有选项（如video_size、pixel_format、framerate）
+ *
+ * @param key 选项名
+ * @param value 选项值
+ */
+void avdecoder::set_input_option(const std::string &key, const std::string &value)
+{
+    this->input_options.push_back(std::make_pair(key, value));
+}
+
+/**
+ * @brief 设置实时输入模式：最少探测、不缓冲、解码器低延迟
+ *
+ * @param live 为1时启用
+ */
+void avdecoder::set_live(int live)
+{
+    this->live = live;
+}
+
+/**
+ * @brief 设置视频输出队列的最大长度
+ *
+ * @param length 最大长度（字节），实时模式下通常设为一帧
+ */
+void avdecoder::set_queue_limit(size_t length)
+{
+    this->video_queue_limit = length;
+}
+
+/**
+ * @brief 设置音频输出队列的最大长度
+ *
+ * @param length 最大长度（字节），离线渲染时放大以便FFT批量变换
+ */
+void avdecoder::set_audio_queue_limit(size_t length)
+{
+    this->audio_queue_limit = length;
+}
+
+/**
+ * @brief 设置中断标志，须在open之前；标志置1后libav中阻塞的打开和读取立即失败（读取失败按输入结束处理）
+ *
+ * @param flag 中断标志，为NULL时不中断
+ */
+void avdecoder::set_interrupt_flag(std::atomic<int> *flag)
+{
+    this->interrupt_flag = flag;
+}
+
+/**
+ * @brief libav的中断回调（私有方法）
+ *
+ * @param flag 中断标志
+ * @return int 需要中断时返回1
+ */
+int avdecoder::interrupt_requested(void *flag)
+{
+    return ((std::atomic<int> *)flag)->load(std::memory_order_relaxed) != 0;
+}
+
+/**
+ * @brief 设置是否通过mmap读取本地文件（代替libav默认的file协议）
+ *
+ * @param enabled 为1时启用，对管道和实时输入无效
+ */
+void avdecoder::set_mmap_io(int enabled)
+{
+    this->use_mmap_io = enabled;
+}
+
+/**
+ * @brief 获取mmap读取回调被调用的次数
+ *
+ * @return uint64_t 次数，未使用mmap时返回0
+ */
+uint64_t avdecoder::get_io_read_calls(void)
+{
+    if (this->mapped_input == NULL)
+        return 0;
+    return this->mapped_input->get_read_calls();
+}
+
+/**
+ * @brief 设置启动阶段计时器
+ *
+ * @param timer 计时器，为NULL时不计时
+ */
+void avdecoder::set_startup_timer(startup_timer *timer)
+{
+    this->timer = timer;
+}
+
+/**
+ * @brief 设置运行指标
+ *
+ * @param stats 指标，为NULL时不统计
+ */
+void avdecoder::set_metrics(metrics *stats)
+{
+    this->stats = stats;
+}
+
+/**
+ * @brief 设置逐帧跟踪记录器
+ *
+ * @param trace 跟踪记录器，为NULL时不跟踪
+ */
+void avdecoder::set_tracer(tracer *trace)
+{
+    this->trace = trace;
+}
+
+/**
+ * @brief 获取实际输出的音频采样率（私有方法）
+ *
+ * @return int 设置过输出采样率且低于原采样率时返回设置值，否则返回原采样率
+ */
+int avdecoder::get_audio_out_samplerate(void)
+{
+    if (this->forced_samplerate > 0)
+        return this->forced_samplerate; // 播放列表中各项统一输出采样率，可能升采样
+    if (this->audio_decoder_ctx == NULL)
+        return this->audio_out_samplerate;
+    if (this->audio_out_samplerate > 0 && this->audio_out_samplerate < this->audio_decoder_ctx->sample_rate)
+        return this->audio_out_samplerate; // 只降采样，不升采样
+    return this->audio_decoder_ctx->sample_rate;
+}
+
+/**
+ * @brief 配置音频重采样器为16位单声道输出（私有方法）
+ *
+ * @param swr_ctx 重采样上下文
+ * @return int 成功返回0，失败返回负数
+ */
+int avdecoder::setup_audio_resampler(SwrContext **swr_ctx)
+{
+    AVChannelLayout audio_out_layout = AV_CHANNEL_LAYOUT_MONO; // 单声道输出
+    AVSampleFormat audio_out_sample_fmt = AV_SAMPLE_FMT_S16;   // 16bit
+    int out_samplerate = this->get_audio_out_samplerate();
+    int ret = swr_alloc_set_opts2(swr_ctx, &audio_out_layout, audio_out_sample_fmt, out_samplerate, &this->audio_decoder_ctx->ch_layout, this->audio_decoder_ctx->sample_fmt, this->audio_decoder_ctx->sample_rate, 0, NULL);
+    if (ret < 0)
+        return ret;
+    if (out_samplerate < this->audio_decoder_ctx->sample_rate) // 降采样时需要抗混叠滤波
+    {
+        if ((ret = av_opt_set_int(*swr_ctx, "filter_size", AUDIO_RESAMPLE_FILTER_SIZE, 0)) < 0)
+            return ret;
+        if ((ret = av_opt_set_double(*swr_ctx, "cutoff", AUDIO_RESAMPLE_CUTOFF, 0)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
 /**
  * @brief 获取当前视频帧宽度
  *
@@ -727,11 +1599,25 @@ double avdecoder::get_audio_samplerate(void)
  */
 int avdecoder::get_video_width(void)
 {
+    if (this->video_decoder_ctx != NULL && this->output_width > 0)
+        return this->output_width;
     if (this->video_decoder_ctx != NULL)
         return this->video_decoder_ctx->width;
     return -1;
 }
 
+/**
+ * @brief 获取一帧视频在队列中占用的字节数
+ *
+ * @return int 字节数，视频流无效时返回-1
+ */
+int avdecoder::get_video_frame_size(void)
+{
+    if (this->video_decoder_ctx == NULL)
+        return -1;
+    return av_image_get_buffer_size(this->output_pix_fmt, this->get_video_width(), this->get_video_height(), 1);
+}
+
 /**
  * @brief 获取当前视频帧高度
  *
@@ -739,6 +1625,8 @@ int avdecoder::get_video_width(void)
  */
 int avdecoder::get_video_height(void)
 {
+    if (this->video_decoder_ctx != NULL && this->output_height > 0)
+        return this->output_height;
     if (this->video_decoder_ctx != NULL)
         return this->video_decoder_ctx->height;
     return -1;
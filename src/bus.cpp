@@ -0,0 +1,183 @@
+#include "serial_video/bus.hpp"
+
+#include <stdexcept>
+#include <iomanip>
+
+/**
+ * @brief Construct a new bus sink::bus sink object
+ *
+ * @param owner 所属的总线
+ * @param addr 接收端地址
+ * @param framerate 该地址的帧率
+ */
+bus_sink::bus_sink(bus *owner, uint8_t addr, double framerate)
+{
+    this->owner = owner;
+    this->addr = addr;
+    this->period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / framerate));
+    this->opened = 0;
+    this->pending = 0;
+    this->bytes = 0;
+    this->packets = 0;
+    this->late_packets = 0;
+    this->wait_ns = 0;
+}
+
+/**
+ * @brief 打开：第一个打开的地址打开共用的输出端
+ *
+ */
+void bus_sink::open(void)
+{
+    std::lock_guard<std::mutex> guard(this->owner->lock);
+    if (this->opened)
+        return;
+    if (this->owner->opened == 0)
+        this->owner->output->open();
+    this->opened = 1;
+    this->owner->opened++;
+}
+
+/**
+ * @brief 排队写入一个数据包，轮到截止时刻最早的数据包时才写入
+ *
+ * @param data 数据包
+ * @param length 长度
+ * @return ssize_t 写入的字节数，与共用输出端的write相同
+ */
+ssize_t bus_sink::write(const uint8_t *data, size_t length)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> guard(this->owner->lock);
+    this->pending = 1;
+    this->deadline = begin + this->period;
+    while (this->owner->busy || this->owner->earliest() != this)
+        this->owner->turn.wait(guard);
+    this->owner->busy = 1;
+    guard.unlock();
+    auto write_begin = std::chrono::steady_clock::now();
+    ssize_t written = this->owner->output->write(data, length); // 不持有锁，其他地址可以继续排队
+    auto end = std::chrono::steady_clock::now();
+    guard.lock();
+    this->owner->busy = 0;
+    this->pending = 0;
+    this->wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(write_begin - begin).count();
+    if (written > 0)
+    {
+        this->bytes += written;
+        this->owner->bytes += written;
+    }
+    this->packets++;
+    if (end > this->deadline)
+        this->late_packets++;
+    this->owner->turn.notify_all();
+    return written;
+}
+
+/**
+ * @brief 关闭：最后一个关闭的地址关闭共用的输出端
+ *
+ */
+void bus_sink::close(void)
+{
+    std::lock_guard<std::mutex> guard(this->owner->lock);
+    if (!this->opened)
+        return;
+    this->opened = 0;
+    if (--this->owner->opened == 0)
+        this->owner->output->close();
+}
+
+/**
+ * @brief 共用的输出端是否为串口
+ *
+ * @return int 是串口返回1
+ */
+int bus_sink::is_serial(void)
+{
+    return this->owner->output->is_serial();
+}
+
+/**
+ * @brief Construct a new bus::bus object
+ *
+ * @param output 共用的输出端，由调用者持有，生命周期须长于总线
+ */
+bus::bus(sink *output)
+{
+    if (output == NULL)
+    {
+        std::invalid_argument ex("Bus needs an output!");
+        throw ex;
+    }
+    this->output = output;
+    this->opened = 0;
+    this->busy = 0;
+    this->bytes = 0;
+}
+
+/**
+ * @brief 为一个地址创建输出端
+ *
+ * @param addr 接收端地址（帧头中的addr），不能是广播地址，同一总线上不能重复
+ * @param framerate 该地址的帧率，决定其数据包的截止时刻
+ * @return sink* 输出端，由总线持有
+ */
+sink *bus::attach(uint8_t addr, double framerate)
+{
+    if (framerate <= 0)
+    {
+        std::invalid_argument ex("Invalid framerate!");
+        throw ex;
+    }
+    std::lock_guard<std::mutex> guard(this->lock);
+    for (auto &endpoint : this->endpoints)
+    {
+        if (endpoint->addr == addr)
+        {
+            std::invalid_argument ex("Address already attached to the bus!");
+            throw ex;
+        }
+    }
+    this->endpoints.emplace_back(new bus_sink(this, addr, framerate));
+    return this->endpoints.back().get();
+}
+
+/**
+ * @brief 在排队的数据包中找出截止时刻最早的（私有方法，调用者持有锁）
+ *
+ * @return bus_sink* 其所属的地址，没有排队的数据包时返回NULL
+ */
+bus_sink *bus::earliest(void)
+{
+    bus_sink *first = NULL;
+    for (auto &endpoint : this->endpoints)
+    {
+        if (endpoint->pending && (first == NULL || endpoint->deadline < first->deadline))
+            first = endpoint.get();
+    }
+    return first;
+}
+
+/**
+ * @brief 输出各地址占用的带宽
+ *
+ * @param out 输出流
+ * @param seconds 运行时间
+ * @param baudrate 波特率（8N1）
+ */
+void bus::report(std::ostream &out, double seconds, int baudrate)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (seconds <= 0 || this->bytes == 0)
+        return;
+    double line_rate = baudrate / 10.0;
+    out << "Bus: " << this->bytes / seconds << " B/s (" << this->bytes / seconds * 100 / line_rate << "% of " << baudrate << " baud 8N1)" << std::endl;
+    for (auto &endpoint : this->endpoints)
+    {
+        out << "  address 0x" << std::hex << std::setw(2) << std::setfill('0') << (int)endpoint->addr << std::dec << std::setfill(' ') << ": "
+            << endpoint->bytes / seconds << " B/s (" << endpoint->bytes * 100.0 / this->bytes << "% of bus traffic), "
+            << endpoint->packets / seconds << " fps, " << endpoint->late_packets << " late packets, avg wait "
+            << (endpoint->packets > 0 ? endpoint->wait_ns / 1e6 / endpoint->packets : 0) << " ms" << std::endl;
+    }
+}
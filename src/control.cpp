@@ -0,0 +1,238 @@
+#include "serial_video/control.hpp"
+#include "serial_video/pipeline.hpp"
+#include "serial_video/metrics.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <chrono>
+#include <fstream> //for std::ios_base::failure
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * @brief Construct a new control server::control server object
+ *
+ * @param target 受控的流水线
+ * @param path Unix域套接字路径，为"-"时使用标准输入输出
+ */
+control_server::control_server(pipeline &target, const char *path) : target(target)
+{
+    this->path      = path;
+    this->listen_fd = -1;
+    this->client_fd = -1;
+    this->stop_flag = 0;
+}
+
+/**
+ * @brief Destroy the control server::control server object
+ *
+ */
+control_server::~control_server()
+{
+    this->stop();
+}
+
+/**
+ * @brief 创建套接字（或使用标准输入）并启动服务线程
+ *
+ */
+void control_server::start()
+{
+    if (this->path == "-")
+    {
+        this->stop_flag = 0;
+        this->serve_thread = std::thread(&control_server::serve, this);
+        return;
+    }
+
+    struct sockaddr_un addr;
+    if (this->path.size() >= sizeof(addr.sun_path))
+    {
+        std::ios_base::failure ex("Control socket path too long!");
+        throw ex;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, this->path.c_str());
+
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->listen_fd < 0)
+    {
+        std::ios_base::failure ex("Unable to create control socket!");
+        throw ex;
+    }
+    unlink(this->path.c_str()); // 清理上次运行残留的套接字文件
+    if (bind(this->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(this->listen_fd, 1) < 0)
+    {
+        std::ios_base::failure ex("Unable to bind control socket!");
+        close(this->listen_fd);
+        this->listen_fd = -1;
+        throw ex;
+    }
+    this->stop_flag = 0;
+    this->serve_thread = std::thread(&control_server::serve, this);
+}
+
+/**
+ * @brief 停止服务线程并删除套接字
+ *
+ */
+void control_server::stop()
+{
+    this->stop_flag = 1;
+    if (this->serve_thread.joinable())
+        this->serve_thread.join();
+    if (this->client_fd >= 0 && this->client_fd != STDIN_FILENO)
+        close(this->client_fd);
+    this->client_fd = -1;
+    if (this->listen_fd >= 0)
+    {
+        close(this->listen_fd);
+        unlink(this->path.c_str());
+        this->listen_fd = -1;
+    }
+}
+
+/**
+ * @brief 服务线程，逐行读取命令并回复（私有方法）
+ *
+ */
+void control_server::serve()
+{
+    std::string pending;
+    char buffer[CONTROL_LINE_MAX];
+    if (this->listen_fd < 0)
+        this->client_fd = STDIN_FILENO;
+    while (this->stop_flag == 0)
+    {
+        if (this->client_fd < 0)
+        {
+            // 等待下一个连接
+            struct pollfd pfd = {this->listen_fd, POLLIN, 0};
+            if (poll(&pfd, 1, CONTROL_POLL_INTERVAL_MS) <= 0)
+                continue;
+            this->client_fd = accept4(this->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            pending.clear();
+            continue;
+        }
+
+        struct pollfd cfd = {this->client_fd, POLLIN, 0};
+        if (poll(&cfd, 1, CONTROL_POLL_INTERVAL_MS) <= 0)
+            continue;
+        ssize_t n = ::read(this->client_fd, buffer, sizeof(buffer));
+        if (n <= 0)
+        {
+            // 连接断开，或标准输入到达末尾
+            if (this->client_fd == STDIN_FILENO)
+                return;
+            close(this->client_fd);
+            this->client_fd = -1;
+            continue;
+        }
+        pending.append(buffer, n);
+
+        size_t end;
+        while ((end = pending.find('\n')) != std::string::npos)
+        {
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty())
+                continue;
+            this->reply(this->client_fd == STDIN_FILENO ? STDOUT_FILENO : this->client_fd, this->execute(line));
+        }
+        if (pending.size() > CONTROL_LINE_MAX)
+        {
+            this->reply(this->client_fd == STDIN_FILENO ? STDOUT_FILENO : this->client_fd, "error: line too long");
+            pending.clear();
+        }
+    }
+}
+
+/**
+ * @brief 执行一条命令（私有方法）
+ *
+ * @param line 命令行
+ * @return std::string 回复（不含换行）
+ */
+std::string control_server::execute(const std::string &line)
+{
+    std::istringstream in(line);
+    std::string command;
+    in >> command;
+    std::ostringstream out;
+
+    if (command == "pause" || command == "resume")
+    {
+        if (this->target.pause(command == "pause") < 0)
+            return "error: not running";
+        return "ok";
+    }
+    else if (command == "seek")
+    {
+        double seconds;
+        if (!(in >> seconds) || seconds < 0)
+            return "error: usage: seek SECONDS";
+        metrics &stats = this->target.get_metrics();
+        uint64_t seeks = stats.seeks.load();
+        if (this->target.seek(seconds) < 0)
+            return "error: nothing to seek";
+
+        // 等待新位置的第一个数据包写出，以回报端到端的跳转延迟
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CONTROL_SEEK_WAIT_MS);
+        while (stats.seeks.load() == seeks && std::chrono::steady_clock::now() < deadline && this->stop_flag == 0)
+        {
+            usleep(1000);
+        }
+        if (stats.seeks.load() == seeks)
+            return "ok pending";
+        out << "ok " << stats.seek_latency_ns_last.load() / 1e6 << " ms";
+        return out.str();
+    }
+    else if (command == "rate")
+    {
+        double rate;
+        if (!(in >> rate) || rate <= 0)
+            return "error: usage: rate FACTOR";
+        if (this->target.set_rate(rate) < 0)
+            return "error: not running";
+        return "ok";
+    }
+    else if (command == "status")
+    {
+        out << "ok " << (this->target.is_running() ? (this->target.is_paused() ? "paused" : "playing") : "stopped")
+            << " rate=" << this->target.get_rate();
+        return out.str();
+    }
+    else if (command == "stop")
+    {
+        this->target.stop();
+        return "ok";
+    }
+    return "error: unknown command " + command;
+}
+
+/**
+ * @brief 发送一行回复（私有方法）
+ *
+ * @param fd 目标描述符
+ * @param text 回复（不含换行）
+ */
+void control_server::reply(int fd, const std::string &text)
+{
+    std::string data = text + "\n";
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = (fd == STDOUT_FILENO) ? ::write(fd, data.data() + sent, data.size() - sent)
+                                          : send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL); // 客户端提前断开时不触发SIGPIPE
+        if (n <= 0)
+            break;
+        sent += n;
+    }
+}
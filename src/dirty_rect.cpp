@@ -0,0 +1,264 @@
+#include "serial_video/dirty_rect.hpp"
+#include "serial_video/link_protocol.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @brief Construct a new dirty rect::dirty rect object
+ *
+ * @param width 帧宽度（像素）
+ * @param height 帧高度（像素）
+ * @param max_payload 负载的上限（字节，含音频字节），至少能放下一个整行的矩形
+ */
+dirty_rect::dirty_rect(int width, int height, size_t max_payload)
+{
+    if (width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF)
+    {
+        std::invalid_argument ex("Frame size out of range!");
+        throw ex;
+    }
+    if (max_payload < 1 + RECT_HEADER_SIZE + (size_t)width * RECT_BYTES_PER_PIXEL || max_payload > 0xFFFF)
+    {
+        std::invalid_argument ex("max_payload out of range!");
+        throw ex;
+    }
+    this->width = width;
+    this->height = height;
+    this->tiles_x = (width + RECT_TILE_SIZE - 1) / RECT_TILE_SIZE;
+    this->tiles_y = (height + RECT_TILE_SIZE - 1) / RECT_TILE_SIZE;
+    this->max_payload = max_payload;
+    this->reference.resize((size_t)width * height * RECT_BYTES_PER_PIXEL);
+    this->sent.resize(this->tiles_x * this->tiles_y);
+    this->dirty.resize(this->tiles_x * this->tiles_y);
+    this->output.resize(max_payload);
+    this->reset();
+}
+
+/**
+ * @brief 编码一个数据包的负载，预先分配了全部缓冲区，运行时不再分配
+ *
+ * @param packet 视频帧（width*height*2字节）+音频字节
+ * @param budget 本帧的字节预算（含帧头和CRC），不限时为HUGE_VAL
+ * @return size_t 负载长度，负载由get_output获取
+ */
+size_t dirty_rect::encode(const uint8_t *packet, double budget)
+{
+    const size_t stride = (size_t)this->width * RECT_BYTES_PER_PIXEL;
+    this->balance = std::min(this->balance + budget, budget * RECT_CARRY_FRAMES);
+    double avail = this->balance - LINK_OVERHEAD;
+    size_t limit = avail < 1 ? 1 : (avail < this->max_payload ? (size_t)avail : this->max_payload); // 音频字节总要发送
+
+    // 找出有变化（或接收端还没有）的块
+    for (int ty = 0; ty < this->tiles_y; ty++)
+    {
+        for (int tx = 0; tx < this->tiles_x; tx++)
+        {
+            int i = ty * this->tiles_x + tx;
+            if (!this->sent[i])
+            {
+                this->dirty[i] = 1;
+                continue;
+            }
+            int x = tx * RECT_TILE_SIZE, y = ty * RECT_TILE_SIZE;
+            size_t offset = y * stride + x * RECT_BYTES_PER_PIXEL, bytes = (size_t)(std::min(x + RECT_TILE_SIZE, this->width) - x) * RECT_BYTES_PER_PIXEL;
+            this->dirty[i] = 0;
+            for (int row = y; row < std::min(y + RECT_TILE_SIZE, this->height) && !this->dirty[i]; row++, offset += stride)
+                this->dirty[i] = memcmp(packet + offset, this->reference.data() + offset, bytes) != 0;
+        }
+    }
+
+    size_t used = 1;
+    this->output[0] = packet[stride * this->height];
+    this->rects = 0;
+    if (this->send_rows(packet, this->resume_row, used, limit))
+    {
+        // 变化都已发出，预算有余时重发一块行
+        int y = this->refresh_row * RECT_TILE_SIZE, h = std::min(y + RECT_TILE_SIZE, this->height) - y;
+        if (used + RECT_HEADER_SIZE + stride * h <= limit)
+        {
+            this->add_rect(packet, 0, y, this->width, h, used);
+            this->refresh_row = (this->refresh_row + 1) % this->tiles_y;
+        }
+    }
+    this->balance -= LINK_OVERHEAD + used;
+    return used;
+}
+
+/**
+ * @brief 从first_row开始（回绕）把有变化的块合并为矩形写入输出（私有方法）
+ *
+ * 同一块行中连续的变化块合并为一段，下面的块行在同一范围内也全部有变化时向下延伸。
+ * 放不下时按整块截断（先减少块行，一块行也放不下时减少宽度），接收端的每一块要么是新的、要么是旧的
+ *
+ * @param frame 视频帧
+ * @param first_row 开始的块行
+ * @param used 输出中已用的字节数
+ * @param limit 输出的上限
+ * @return int 全部发出返回1，预算用完返回0（resume_row指向中断的块行）
+ */
+int dirty_rect::send_rows(const uint8_t *frame, int first_row, size_t &used, size_t limit)
+{
+    const size_t tile_bytes = RECT_TILE_SIZE * RECT_TILE_SIZE * RECT_BYTES_PER_PIXEL;
+    for (int n = 0; n < this->tiles_y; n++)
+    {
+        int ty = (first_row + n) % this->tiles_y;
+        uint8_t *row_dirty = this->dirty.data() + ty * this->tiles_x;
+        for (int tx = 0; tx < this->tiles_x;)
+        {
+            if (!row_dirty[tx])
+            {
+                tx++;
+                continue;
+            }
+            int end = tx + 1;
+            while (end < this->tiles_x && row_dirty[end])
+                end++;
+            int rows = 1;
+            while (ty + rows < this->tiles_y && std::all_of(row_dirty + rows * this->tiles_x + tx, row_dirty + rows * this->tiles_x + end, [](uint8_t d) { return d != 0; }))
+                rows++;
+            int x = tx * RECT_TILE_SIZE, y = ty * RECT_TILE_SIZE;
+            int w = std::min(end * RECT_TILE_SIZE, this->width) - x, h = std::min((ty + rows) * RECT_TILE_SIZE, this->height) - y;
+            size_t room = limit - used, need = RECT_HEADER_SIZE + (size_t)w * h * RECT_BYTES_PER_PIXEL;
+            int complete = need <= room;
+            if (!complete)
+            {
+                size_t fit = room > RECT_HEADER_SIZE ? room - RECT_HEADER_SIZE : 0;
+                int fit_rows = fit / ((size_t)w * RECT_TILE_SIZE * RECT_BYTES_PER_PIXEL);
+                if (fit_rows > 0) // 截掉下面的块行
+                {
+                    rows = fit_rows;
+                    h = rows * RECT_TILE_SIZE;
+                }
+                else if (fit >= tile_bytes) // 一块行也放不下，截掉右边的块
+                {
+                    end = tx + fit / tile_bytes;
+                    rows = 1;
+                    w = std::min(end * RECT_TILE_SIZE, this->width) - x;
+                    h = std::min(RECT_TILE_SIZE, this->height - y);
+                }
+                else
+                {
+                    this->resume_row = ty;
+                    return 0;
+                }
+            }
+            this->add_rect(frame, x, y, w, h, used);
+            for (int r = 0; r < rows; r++)
+            {
+                for (int i = tx; i < end; i++)
+                {
+                    row_dirty[r * this->tiles_x + i] = 0;
+                    this->sent[(ty + r) * this->tiles_x + i] = 1;
+                }
+            }
+            if (!complete)
+            {
+                this->resume_row = ty;
+                return 0;
+            }
+            tx = end;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief 把一个矩形写入输出并更新接收端的帧，调用者保证放得下（私有方法）
+ *
+ * @param frame 视频帧
+ * @param x 左上角横坐标
+ * @param y 左上角纵坐标
+ * @param w 宽度
+ * @param h 高度
+ * @param used 输出中已用的字节数
+ */
+void dirty_rect::add_rect(const uint8_t *frame, int x, int y, int w, int h, size_t &used)
+{
+    const size_t stride = (size_t)this->width * RECT_BYTES_PER_PIXEL, row_bytes = (size_t)w * RECT_BYTES_PER_PIXEL;
+    uint8_t *out = this->output.data() + used;
+    const uint16_t header[4] = {(uint16_t)x, (uint16_t)y, (uint16_t)w, (uint16_t)h};
+    for (int i = 0; i < 4; i++)
+    {
+        *out++ = header[i] & 0xFF;
+        *out++ = header[i] >> 8;
+    }
+    for (int row = y; row < y + h; row++, out += row_bytes)
+    {
+        size_t offset = row * stride + x * RECT_BYTES_PER_PIXEL;
+        memcpy(out, frame + offset, row_bytes);
+        memcpy(this->reference.data() + offset, frame + offset, row_bytes);
+    }
+    used += RECT_HEADER_SIZE + row_bytes * h;
+    this->rects++;
+}
+
+/**
+ * @brief 获取上一次编码的负载
+ *
+ * @return const uint8_t* 负载
+ */
+const uint8_t *dirty_rect::get_output(void)
+{
+    return this->output.data();
+}
+
+/**
+ * @brief 获取上一次编码发送的矩形数
+ *
+ * @return int 矩形数
+ */
+int dirty_rect::get_rects(void)
+{
+    return this->rects;
+}
+
+/**
+ * @brief 忘记接收端的帧（重新打开输出端、编码后的数据包没有发出或接收端可能丢帧时），下一帧起重新发送整个画面
+ *
+ */
+void dirty_rect::reset(void)
+{
+    std::fill(this->sent.begin(), this->sent.end(), 0);
+    this->balance = 0;
+    this->rects = 0;
+    this->resume_row = 0;
+    this->refresh_row = 0;
+}
+
+/**
+ * @brief 接收端：把一个LINK_TYPE_AV_RECT负载应用到当前帧
+ *
+ * @param payload 负载
+ * @param length 负载长度
+ * @param frame 接收端当前的帧（width*height*2字节），就地更新
+ * @param width 帧宽度
+ * @param height 帧高度
+ * @param audio 负载中的音频字节
+ * @return int 应用的矩形数，负载损坏（越界、长度不符）时返回-1，此前的矩形已经应用
+ */
+int dirty_rect::decode(const uint8_t *payload, size_t length, uint8_t *frame, int width, int height, uint8_t &audio)
+{
+    const size_t stride = (size_t)width * RECT_BYTES_PER_PIXEL;
+    if (length < 1)
+        return -1;
+    audio = payload[0];
+    size_t i = 1;
+    int count = 0;
+    while (i < length)
+    {
+        if (i + RECT_HEADER_SIZE > length)
+            return -1;
+        int x = payload[i] | payload[i + 1] << 8, y = payload[i + 2] | payload[i + 3] << 8;
+        int w = payload[i + 4] | payload[i + 5] << 8, h = payload[i + 6] | payload[i + 7] << 8;
+        i += RECT_HEADER_SIZE;
+        size_t row_bytes = (size_t)w * RECT_BYTES_PER_PIXEL;
+        if (w == 0 || h == 0 || x + w > width || y + h > height || i + row_bytes * h > length)
+            return -1;
+        for (int row = y; row < y + h; row++, i += row_bytes)
+            memcpy(frame + row * stride + x * RECT_BYTES_PER_PIXEL, payload + i, row_bytes);
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,203 @@
+#include "serial_video/executor.hpp"
+
+#include <thread>
+#include <stdexcept>
+
+/**
+ * @brief Construct a new executor::executor object
+ *
+ * @param threads 运行任务的线程数（含调用run的线程）
+ */
+executor::executor(int threads)
+{
+    if (threads <= 0)
+    {
+        std::invalid_argument ex("threads below 1!");
+        throw ex;
+    }
+    this->threads   = threads;
+    this->next      = 0;
+    this->remaining = 0;
+    this->untimed_waiters = 0;
+    this->wakes     = 0;
+    this->parked    = 0;
+    this->failure   = NULL;
+}
+
+/**
+ * @brief 添加任务（须在run之前）
+ *
+ * @param step 任务的恢复函数，返回TASK_*；返回TASK_SLEEP时把醒来时刻写入参数
+ */
+void executor::add(task step)
+{
+    this->tasks.push_back({std::move(step), TASK_YIELD, 0, std::chrono::steady_clock::now()});
+    this->remaining++;
+}
+
+/**
+ * @brief 设置额外线程的运行方式
+ *
+ * @param runner 在每个额外线程中被调用，须调用一次body（运行任务直到结束）
+ */
+void executor::set_thread_runner(std::function<void(const std::function<void(void)> &body)> runner)
+{
+    this->thread_runner = std::move(runner);
+}
+
+/**
+ * @brief 运行全部任务直到都已结束，调用线程也参与运行
+ *
+ * 一个任务抛出异常时其余任务不再被恢复，异常在所有线程退出后重新抛出
+ */
+void executor::run(void)
+{
+    std::vector<std::thread> extra;
+    for (int i = 1; i < this->threads; i++)
+    {
+        extra.emplace_back([this] {
+            if (this->thread_runner)
+                this->thread_runner([this] { this->worker(); });
+            else
+                this->worker();
+        });
+    }
+    this->worker();
+    for (std::thread &t : extra)
+    {
+        t.join();
+    }
+    if (this->failure)
+        std::rethrow_exception(this->failure);
+}
+
+/**
+ * @brief 工作线程：轮流恢复到期的任务，没有到期的任务时休眠到最早的到期时刻（私有方法）
+ *
+ */
+void executor::worker(void)
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (this->remaining > 0 && !this->failure)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto earliest = std::chrono::steady_clock::time_point::max();
+        entry *picked = NULL;
+        for (size_t i = 0; i < this->tasks.size(); i++) // 从上次之后的任务开始找，避免一个任务独占线程
+        {
+            size_t index = (this->next + i) % this->tasks.size();
+            entry &e = this->tasks[index];
+            if (e.running || e.state == TASK_DONE)
+                continue;
+            if (e.wakeup <= now)
+            {
+                picked = &e;
+                this->next = index + 1;
+                break;
+            }
+            if (e.wakeup < earliest)
+                earliest = e.wakeup;
+        }
+        if (picked == NULL)
+        {
+            if (earliest == std::chrono::steady_clock::time_point::max())
+            {
+                this->untimed_waiters++;
+                this->task_returned.wait(guard); // 其余任务都在别的线程上运行，等有任务返回
+                this->untimed_waiters--;
+            }
+            else // 返回的任务由返回它的线程接着调度，这里只需等到期
+                this->task_returned.wait_until(guard, earliest);
+            continue;
+        }
+
+        picked->running = 1;
+        uint64_t wakes = this->wakes.load(); // 必须在任务检查队列之前读取
+        guard.unlock();
+        int state;
+        std::chrono::steady_clock::time_point wakeup = now;
+        try
+        {
+            state = picked->step(wakeup);
+        }
+        catch (...)
+        {
+            guard.lock();
+            if (!this->failure)
+                this->failure = std::current_exception();
+            picked->running = 0;
+            picked->state = TASK_DONE;
+            this->remaining--;
+            this->task_returned.notify_all();
+            break;
+        }
+        guard.lock();
+        picked->running = 0;
+        picked->state = state;
+        if (state == TASK_DONE)
+        {
+            this->remaining--;
+            this->unpark(); // 等待这个任务的结束标志的任务
+        }
+        else if (state == TASK_BLOCKED)
+        {
+            this->parked++; // 与wake中的顺序相反，两者至少有一方看到对方的修改
+            if (this->wakes.load() != wakes) // 任务检查队列之后已经有过唤醒，马上再试
+            {
+                this->parked--;
+                picked->wakeup = now;
+            }
+            else
+                picked->wakeup = std::chrono::steady_clock::time_point::max();
+        }
+        else if (state == TASK_SLEEP)
+            picked->wakeup = wakeup;
+        else
+            picked->wakeup = now;
+        if (this->untimed_waiters > 0)
+            this->task_returned.notify_one();
+    }
+    this->task_returned.notify_all(); // 让其他线程也看到结束
+}
+
+/**
+ * @brief 唤醒所有因TASK_BLOCKED挂起的任务，在任务等待的队列或标志改变之后调用，可以在任意线程、持有队列锁时调用
+ *
+ * 没有挂起的任务时只有两次原子操作，不加锁
+ */
+void executor::wake(void)
+{
+    this->wakes++;
+    if (this->parked.load() == 0)
+        return;
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->unpark();
+}
+
+/**
+ * @brief 供ring_buffer::set_notify使用的回调
+ *
+ * @param exec 执行器
+ */
+void executor::notify(void *exec)
+{
+    ((executor *)exec)->wake();
+}
+
+/**
+ * @brief 让挂起的任务立即可以运行，调用者持有锁（私有方法）
+ *
+ */
+void executor::unpark(void)
+{
+    if (this->parked.load() == 0)
+        return;
+    for (entry &e : this->tasks)
+    {
+        if (e.running || e.state != TASK_BLOCKED || e.wakeup != std::chrono::steady_clock::time_point::max())
+            continue;
+        e.wakeup = std::chrono::steady_clock::now();
+        this->parked--;
+    }
+    this->task_returned.notify_all();
+}
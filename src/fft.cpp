@@ -1,15 +1,26 @@
 #include "serial_video/fft.hpp"
+#include "serial_video/startup_timer.hpp"
+#include "serial_video/metrics.hpp"
+#include "serial_video/tracer.hpp"
+#include "serial_video/executor.hpp"
 #include <thread>
+#include <mutex>
 #include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/stat.h>
+
+// FFTW的规划器（创建和销毁计划、wisdom）不是线程安全的，总线上的多路流水线会同时规划，统一在这把锁下进行
+static std::mutex planner_lock;
 
 /**
  * @brief Construct a new fft::fft object
  *
  * @param input_samplerate 输入数据采样率（单位：Hz）
- * @param output_samplerate 每秒输出频率数
+ * @param output_samplerate 每秒输出频率数（即视频帧率，可以不是整数）
  * @param threshold 阈值，当频谱中最大功率超过该阈值时才输出
  */
-fft::fft(int input_samplerate, int output_samplerate, double threshold)
+fft::fft(int input_samplerate, double output_samplerate, double threshold)
 {
     if (input_samplerate <= 0)
     {
@@ -30,6 +41,27 @@ fft::fft(int input_samplerate, int output_samplerate, double threshold)
     this->input_samplerate  = input_samplerate;
     this->output_samplerate = output_samplerate;
     this->threshold         = threshold;
+    this->timer             = NULL;
+    this->stats             = NULL;
+    this->trace             = NULL;
+    this->queue_limit       = FFT_QUEUE_LENGTH_MAX;
+    this->epoch             = NULL;
+    this->batch             = 0;
+    this->resume_length     = 0;
+    this->resume_input      = NULL;
+    this->resume_output     = NULL;
+    this->pending           = 0;
+    this->blocks            = 0;
+    this->tb                = NULL;
+}
+
+/**
+ * @brief Destroy the fft::fft object
+ *
+ */
+fft::~fft()
+{
+    this->release_resume(); // resume_calculate未运行到结束时（其他任务失败）
 }
 
 /**
@@ -38,20 +70,17 @@ fft::fft(int input_samplerate, int output_samplerate, double threshold)
  * @param input 输入队列
  * @param output 输出队列
  */
-void fft::calculate(std::queue<uint16_t> &input, std::queue<uint8_t> &output)
+void fft::calculate(ring_buffer<uint16_t> &input, ring_buffer<uint8_t> &output)
 {
-    int length = input_samplerate / output_samplerate;                                       // 缓冲区长度
+    int length = (int)(input_samplerate / output_samplerate);                                       // 缓冲区长度（随输入采样率自适应）
     double *input_array = (double *)fftw_malloc(length * sizeof(double));                    // 实输入数据
-    fftw_complex *output_array = (fftw_complex *)fftw_malloc(length * sizeof(fftw_complex)); // 复输出数据
-    fftw_plan p = fftw_plan_dft_r2c_1d(length, input_array, output_array, FFTW_MEASURE);     // 创建傅立叶变换计划
+    fftw_complex *output_array = (fftw_complex *)fftw_malloc((length / 2 + 1) * sizeof(fftw_complex)); // 复输出数据（实数变换只有一半有效频点）
+    fftw_plan p = this->make_plan(length, 1, input_array, output_array);                     // 创建傅立叶变换计划
     while (!input.empty())
     {
         if (input.size() < length) // 当队列长度小于缓冲区
         {
-            while (!input.empty())
-            {
-                input.pop(); // 丢弃所有数据
-            }
+            input.clear(); // 丢弃所有数据
             break;
         }
         for (int i = 0; i < length; i++) // 加载数据
@@ -60,28 +89,10 @@ void fft::calculate(std::queue<uint16_t> &input, std::queue<uint8_t> &output)
             input.pop();
         }
         fftw_execute(p); // 执行变换
-        int maxp = 0;
-        double maxn = 0;
-        for (int i = 1; i < length; i++) // 从1开始，去除直流分量
-        {
-            double current = sqrt(output_array[i][0] * output_array[i][0] + output_array[i][1] * output_array[i][1]); // 计算功率
-            if (current > maxn && current > this->threshold)
-            {
-                maxn = current;
-                maxp = i;
-            }
-        }
-        int freq = 0;
-        if (maxp > 0)
-            freq = (maxp - 1) * this->input_samplerate / length; // 计算频率
-        freq >>= 4;                                              // 除以16以匹配uint8_t的输出格式
-        if (freq > 255)                                          // 剔除超过范围的结果
-            output.push(0);
-        else
-            output.push(freq);
+        output.push(this->peak_frequency(output_array, length));
     }
     // 清理
-    fftw_destroy_plan(p);
+    this->destroy_plan(p);
     fftw_free(input_array);
     fftw_free(output_array);
 }
@@ -96,23 +107,41 @@ void fft::calculate(std::queue<uint16_t> &input, std::queue<uint8_t> &output)
  * @param abort_flag 终止标志
  * @param process_done 运行完成标志
  */
-void fft::streamed_calculate(std::queue<uint16_t> &input, std::mutex &input_lock, std::queue<uint8_t> &output, std::mutex &output_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
+void fft::streamed_calculate(ring_buffer<uint16_t> &input, std::mutex &input_lock, ring_buffer<uint8_t> &output, std::mutex &output_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
 {
-    int length = input_samplerate / output_samplerate;                                       // 缓冲区长度
+    int length = (int)(input_samplerate / output_samplerate);                                       // 缓冲区长度（随输入采样率自适应）
     double *input_array = (double *)fftw_malloc(length * sizeof(double));                    // 实输入数据
-    fftw_complex *output_array = (fftw_complex *)fftw_malloc(length * sizeof(fftw_complex)); // 复输出数据
-    fftw_plan p = fftw_plan_dft_r2c_1d(length, input_array, output_array, FFTW_MEASURE);     // 创建傅立叶变换计划
+    fftw_complex *output_array = (fftw_complex *)fftw_malloc((length / 2 + 1) * sizeof(fftw_complex)); // 复输出数据（实数变换只有一半有效频点）
+    fftw_plan p = this->make_plan(length, 1, input_array, output_array);                     // 创建傅立叶变换计划
+    // 批量变换的计划和缓冲区，输入积压了足够多的窗口时一次变换FFT_BATCH_WINDOWS个，不足时仍逐个变换
+    int batch = (this->batch && this->queue_limit >= FFT_BATCH_WINDOWS) ? FFT_BATCH_WINDOWS : 0;
+    double *batch_input = NULL;
+    fftw_complex *batch_output = NULL;
+    fftw_plan batch_plan = NULL;
+    std::vector<uint16_t> batch_pcm(batch * length);
+    std::vector<uint8_t> batch_freqs(batch > 0 ? batch : 1);
+    if (batch > 0)
+    {
+        batch_input = (double *)fftw_malloc((size_t)batch * length * sizeof(double));
+        batch_output = (fftw_complex *)fftw_malloc((size_t)batch * (length / 2 + 1) * sizeof(fftw_complex));
+        batch_plan = this->make_plan(length, batch, batch_input, batch_output);
+    }
+    if (this->timer != NULL)
+        this->timer->mark("fft planned");
+    trace_buffer *tb = this->trace != NULL ? this->trace->register_thread("fft") : NULL; // 本线程的跟踪缓冲区
+    int64_t blocks = 0;                                                                     // 音频块序号
     while (1)
     {
+        auto wait_begin = std::chrono::steady_clock::now();
+        trace_span wait_span(tb, "queue wait (input)", blocks);
         while (1)
         {
             input_lock.lock();  // 输入加锁
             if (abort_flag > 0 && input.size() < length) // 已终止且剩余数据不足以填满缓冲区
             {
-                while (!input.empty())
-                {
-                    input.pop(); // 丢弃所有数据
-                }
+                if (this->stats != NULL && !input.empty())
+                    metrics::add(this->stats->fft.dropped_frames, 1);
+                input.clear();        // 丢弃所有数据
                 input_lock.unlock(); // 输入解锁
                 goto done;               // 退出处理循环
             }
@@ -121,45 +150,429 @@ void fft::streamed_calculate(std::queue<uint16_t> &input, std::mutex &input_lock
             input_lock.unlock();                                       // 输入解锁
             std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
-        for (int i = 0; i < length; i++)
+        wait_span.end();
+        size_t windows = (batch > 0 && input.size() >= (size_t)batch * length) ? batch : 1; // 本次变换的窗口数
+        if (windows > 1)
+            input.pop(batch_pcm.data(), windows * length);
+        else
         {
-            input_array[i] = input.front();
-            input.pop();
+            for (int i = 0; i < length; i++)
+            {
+                input_array[i] = input.front();
+                input.pop();
+            }
         }
+        uint32_t input_epoch = this->epoch != NULL ? this->epoch->load() : 0; // 持有输入锁时读取，与清空队列互斥
+        if (this->stats != NULL)
+            metrics::set(this->stats->av_audio_depth, input.size());
         input_lock.unlock(); // 输入解锁
-        fftw_execute(p);     // 执行变换
-        int maxp = 0;
-        double maxn = 0;
-        for (int i = 1; i < length; i++) // 去除直流分量
+        if (this->stats != NULL)
         {
-            double current = sqrt(output_array[i][0] * output_array[i][0] + output_array[i][1] * output_array[i][1]); // 计算功率
-            if (current > maxn && current > this->threshold)
-            {
-                maxn = current;
-                maxp = i;
-            }
+            metrics::add(this->stats->fft.wait_input_ns, metrics::elapsed_ns(wait_begin));
+            metrics::add(this->stats->fft.frames_in, windows);
+        }
+        trace_span fft_span(tb, "fft", blocks);
+        if (windows > 1)
+            this->execute_batch(batch_plan, batch_pcm.data(), windows, batch_input, batch_output, batch_freqs.data());
+        else
+        {
+            fftw_execute(p);     // 执行变换
+            batch_freqs[0] = this->peak_frequency(output_array, length);
         }
-        int freq = 0;
-        if (maxp > 0)
-            freq = (maxp - 1) * this->input_samplerate / length; // 计算频率
-        freq >>= 4;                                              // 除以16以匹配uint8_t的输出格式
+        fft_span.end();
+        wait_begin = std::chrono::steady_clock::now();
+        trace_span out_wait_span(tb, "queue wait (output)", blocks);
         while (1)
         {
             output_lock.lock();
-            if (output.size() < FFT_QUEUE_LENGTH_MAX) // 如果有足够空间输出
+            if (output.size() + windows <= this->queue_limit) // 如果有足够空间输出
                 break;
             output_lock.unlock();
             std::this_thread::sleep_for(std::chrono::microseconds(1));
         }
-        if (freq > 255) // 剔除超过范围的结果
-            output.push(0);
-        else
-            output.push(freq);
+        out_wait_span.end();
+        if (this->epoch != NULL && this->epoch->load() != input_epoch) // 处理期间队列已被清空，这一块属于旧位置
+        {
+            output_lock.unlock();
+            continue;
+        }
+        output.push(batch_freqs.data(), windows);
+        if (this->stats != NULL)
+            metrics::set(this->stats->fft_audio_depth, output.size());
         output_lock.unlock(); // 输出解锁
+        if (this->stats != NULL)
+        {
+            metrics::add(this->stats->fft.wait_output_ns, metrics::elapsed_ns(wait_begin));
+            metrics::add(this->stats->fft.frames_out, windows);
+        }
+        blocks += windows;
     }
     // 清理
-    done:fftw_destroy_plan(p);
+    done:this->destroy_plan(p);
     fftw_free(input_array);
     fftw_free(output_array);
+    if (batch_plan != NULL)
+        this->destroy_plan(batch_plan);
+    fftw_free(batch_input);
+    fftw_free(batch_output);
     process_done = 1;
 }
+
+/**
+ * @brief streamed_calculate的协作式版本，由executor反复恢复，每次最多计算一个音频块
+ *
+ * @param input 输入队列
+ * @param input_lock 输入锁
+ * @param output 输出队列
+ * @param output_lock 输出锁
+ * @param abort_flag 终止标志
+ * @param process_done 运行完成标志
+ * @return int TASK_YIELD、TASK_BLOCKED或TASK_DONE
+ */
+int fft::resume_calculate(ring_buffer<uint16_t> &input, std::mutex &input_lock, ring_buffer<uint8_t> &output, std::mutex &output_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
+{
+    if (this->resume_length == 0) // 第一次恢复
+    {
+        this->resume_length = (int)(input_samplerate / output_samplerate);
+        this->resume_input = (double *)fftw_malloc(this->resume_length * sizeof(double));
+        this->resume_output = (fftw_complex *)fftw_malloc((this->resume_length / 2 + 1) * sizeof(fftw_complex));
+        this->resume_plan = this->make_plan(this->resume_length, 1, this->resume_input, this->resume_output);
+        if (this->timer != NULL)
+            this->timer->mark("fft planned");
+        this->tb = this->trace != NULL ? this->trace->register_thread("fft") : NULL;
+        this->wait_begin = std::chrono::steady_clock::now();
+    }
+    const int length = this->resume_length;
+    if (!this->pending)
+    {
+        {
+            std::lock_guard<std::mutex> input_guard(input_lock);
+            if (abort_flag > 0 && input.size() < length) // 已终止且剩余数据不足以填满缓冲区
+            {
+                if (this->stats != NULL && !input.empty())
+                    metrics::add(this->stats->fft.dropped_frames, 1);
+                input.clear();
+                this->release_resume();
+                process_done = 1;
+                return TASK_DONE;
+            }
+            if (input.size() < length)
+                return TASK_BLOCKED;
+            for (int i = 0; i < length; i++)
+            {
+                this->resume_input[i] = input.front();
+                input.pop();
+            }
+            this->pending_epoch = this->epoch != NULL ? this->epoch->load() : 0; // 持有输入锁时读取，与清空队列互斥
+            if (this->stats != NULL)
+                metrics::set(this->stats->av_audio_depth, input.size());
+        }
+        if (this->stats != NULL)
+        {
+            metrics::add(this->stats->fft.wait_input_ns, metrics::elapsed_ns(this->wait_begin));
+            metrics::add(this->stats->fft.frames_in, 1);
+        }
+        trace_span fft_span(this->tb, "fft", this->blocks);
+        fftw_execute(this->resume_plan);
+        this->pending_freq = this->peak_frequency(this->resume_output, length);
+        fft_span.end();
+        this->pending = 1;
+        this->wait_begin = std::chrono::steady_clock::now();
+    }
+
+    {
+        std::lock_guard<std::mutex> output_guard(output_lock);
+        if (output.size() >= this->queue_limit)
+            return TASK_BLOCKED;
+        this->pending = 0;
+        if (this->stats != NULL)
+            metrics::add(this->stats->fft.wait_output_ns, metrics::elapsed_ns(this->wait_begin));
+        this->wait_begin = std::chrono::steady_clock::now();
+        if (this->epoch != NULL && this->epoch->load() != this->pending_epoch) // 处理期间队列已被清空，这一块属于旧位置
+            return TASK_YIELD;
+        output.push(this->pending_freq);
+        if (this->stats != NULL)
+            metrics::set(this->stats->fft_audio_depth, output.size());
+    }
+    if (this->stats != NULL)
+        metrics::add(this->stats->fft.frames_out, 1);
+    this->blocks++;
+    return TASK_YIELD;
+}
+
+/**
+ * @brief 释放resume_calculate的计划和缓冲区（私有方法）
+ *
+ */
+void fft::release_resume(void)
+{
+    if (this->resume_length == 0)
+        return;
+    this->destroy_plan(this->resume_plan);
+    fftw_free(this->resume_input);
+    fftw_free(this->resume_output);
+    this->resume_input = NULL;
+    this->resume_output = NULL;
+    this->resume_length = 0;
+}
+
+/**
+ * @brief 批量计算整段PCM的峰值功率频率（用于离线渲染）
+ *
+ * @param pcm 连续的PCM缓冲区
+ * @param count 采样点数
+ * @param output 输出的频率轨道，每个窗口一个字节
+ * @param thread_num 并行线程数
+ */
+void fft::batch_calculate(const uint16_t *pcm, size_t count, std::vector<uint8_t> &output, int thread_num)
+{
+    int length = (int)(input_samplerate / output_samplerate); // 窗口长度
+    int bins = length / 2 + 1;                         // 实数变换的有效频点数
+    size_t windows = count / length;                   // 不足一个窗口的尾部数据丢弃
+    output.resize(windows);
+    if (windows == 0)
+        return;
+    if (thread_num < 1)
+        thread_num = 1;
+    if ((size_t)thread_num > windows)
+        thread_num = windows;
+    size_t per_thread = (windows + thread_num - 1) / thread_num; // 每个线程负责的窗口数
+    int batch = std::min((size_t)FFT_BATCH_WINDOWS, per_thread); // 单个计划一次变换的窗口数
+
+    // 每个线程使用独立的缓冲区，共用同一个计划（fftw_execute_dft_r2c是线程安全的）
+    std::vector<double *> input_arrays(thread_num);
+    std::vector<fftw_complex *> output_arrays(thread_num);
+    for (int t = 0; t < thread_num; t++)
+    {
+        input_arrays[t] = (double *)fftw_malloc((size_t)batch * length * sizeof(double));
+        output_arrays[t] = (fftw_complex *)fftw_malloc((size_t)batch * bins * sizeof(fftw_complex));
+        if (input_arrays[t] == NULL || output_arrays[t] == NULL)
+        {
+            for (int i = 0; i <= t; i++)
+            {
+                fftw_free(input_arrays[i]);
+                fftw_free(output_arrays[i]);
+            }
+            throw std::bad_alloc();
+        }
+    }
+    // 一次计划完成batch个窗口的变换，窗口在输入中首尾相接，频谱在输出中首尾相接
+    fftw_plan p = this->make_plan(length, batch, input_arrays[0], output_arrays[0]);
+
+    auto worker = [&](int t)
+    {
+        size_t first = t * per_thread;
+        size_t last = std::min(windows, first + per_thread);
+        double *in = input_arrays[t];
+        fftw_complex *out = output_arrays[t];
+        for (size_t w = first; w < last; w += batch)
+        {
+            size_t n = std::min((size_t)batch, last - w); // 本次有效窗口数，多余窗口的结果直接忽略
+            this->execute_batch(p, pcm + w * length, n, in, out, output.data() + w);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < thread_num; t++)
+    {
+        threads.emplace_back(worker, t);
+    }
+    worker(0); // 当前线程处理第一段
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    // 清理
+    this->destroy_plan(p);
+    for (int t = 0; t < thread_num; t++)
+    {
+        fftw_free(input_arrays[t]);
+        fftw_free(output_arrays[t]);
+    }
+}
+
+/**
+ * @brief 用批量计划变换首尾相接的若干个窗口（私有方法）
+ *
+ * @param p 批量计划（howmany个窗口，fftw_execute_dft_r2c是线程安全的，可以在多个线程中共用）
+ * @param pcm 连续的PCM，windows个窗口
+ * @param windows 有效窗口数，不超过计划的窗口数，多余窗口的结果直接忽略
+ * @param input_array 本线程的实输入缓冲区
+ * @param output_array 本线程的复输出缓冲区
+ * @param freqs 输出的频率，每个窗口一个字节
+ */
+void fft::execute_batch(fftw_plan p, const uint16_t *pcm, size_t windows, double *input_array, fftw_complex *output_array, uint8_t *freqs)
+{
+    int length = (int)(input_samplerate / output_samplerate);
+    int bins = length / 2 + 1;
+    for (size_t i = 0; i < windows * length; i++) // 批量转换为浮点
+    {
+        input_array[i] = pcm[i];
+    }
+    fftw_execute_dft_r2c(p, input_array, output_array);
+    for (size_t k = 0; k < windows; k++)
+    {
+        freqs[k] = this->peak_frequency(output_array + k * bins, length);
+    }
+}
+
+/**
+ * @brief 从频谱中找出功率最大的频率（私有方法）
+ *
+ * @param spectrum 实数变换的输出频谱（length / 2 + 1个频点）
+ * @param length 变换长度
+ * @return uint8_t 除以16后的频率，低于阈值或超出范围时为0
+ */
+uint8_t fft::peak_frequency(const fftw_complex *spectrum, int length)
+{
+    int maxp = 0;
+    double maxn = 0;
+    for (int i = 1; i < length / 2 + 1; i++) // 从1开始，去除直流分量
+    {
+        double current = sqrt(spectrum[i][0] * spectrum[i][0] + spectrum[i][1] * spectrum[i][1]); // 计算功率
+        if (current > maxn && current > this->threshold)
+        {
+            maxn = current;
+            maxp = i;
+        }
+    }
+    int freq = 0;
+    if (maxp > 0)
+        freq = (maxp - 1) * this->input_samplerate / length; // 计算频率
+    freq >>= 4;                                              // 除以16以匹配uint8_t的输出格式
+    if (freq > 255)                                          // 剔除超过范围的结果
+        return 0;
+    return freq;
+}
+
+/**
+ * @brief 设置FFTW wisdom缓存目录，规划时按变换长度读取和保存wisdom以加快启动
+ *
+ * @param dir 缓存目录，为空时不使用缓存
+ */
+void fft::set_wisdom_dir(const std::string &dir)
+{
+    this->wisdom_dir = dir;
+}
+
+/**
+ * @brief 设置启动阶段计时器
+ *
+ * @param timer 计时器，为NULL时不计时
+ */
+void fft::set_startup_timer(startup_timer *timer)
+{
+    this->timer = timer;
+}
+
+/**
+ * @brief 设置运行指标
+ *
+ * @param stats 指标，为NULL时不统计
+ */
+void fft::set_metrics(metrics *stats)
+{
+    this->stats = stats;
+}
+
+/**
+ * @brief 设置逐帧跟踪记录器
+ *
+ * @param trace 跟踪记录器，为NULL时不跟踪
+ */
+void fft::set_tracer(tracer *trace)
+{
+    this->trace = trace;
+}
+
+/**
+ * @brief 设置输出队列的最大长度
+ *
+ * @param length 最大长度（帧），实时模式下通常只保留几帧
+ */
+void fft::set_queue_limit(size_t length)
+{
+    this->queue_limit = length;
+}
+
+/**
+ * @brief 设置冲洗纪元，输出时与取输入时不同则丢弃本块（见gray2bw::set_epoch）
+ *
+ * @param epoch 纪元计数器，为NULL时不检查
+ */
+void fft::set_epoch(std::atomic<uint32_t> *epoch)
+{
+    this->epoch = epoch;
+}
+
+/**
+ * @brief 设置流式计算是否批量变换：输入队列中积压了FFT_BATCH_WINDOWS个窗口时一次变换这些窗口，
+ * 用于不控制节奏的离线渲染（此时解码器远远领先，需要放大音频队列）；实时播放时输入很少积压，不必开启。
+ * 协作式版本仍逐个变换
+ *
+ * @param enabled 为1时批量变换
+ */
+void fft::set_batch(int enabled)
+{
+    this->batch = enabled;
+}
+
+/**
+ * @brief 获取每个窗口的采样点数
+ *
+ * @return int 采样点数
+ */
+int fft::get_window_length(void)
+{
+    return (int)(this->input_samplerate / this->output_samplerate);
+}
+
+/**
+ * @brief 创建howmany个窗口首尾相接的实数变换计划，有缓存时先导入wisdom（私有方法）
+ *
+ * @param length 变换长度
+ * @param howmany 窗口个数
+ * @param input_array 实输入数据（规划时会被覆盖）
+ * @param output_array 复输出数据
+ * @return fftw_plan 傅立叶变换计划
+ */
+fftw_plan fft::make_plan(int length, int howmany, double *input_array, fftw_complex *output_array)
+{
+    std::lock_guard<std::mutex> guard(planner_lock);
+    std::string wisdom_file;
+    int imported = 0;
+    if (!this->wisdom_dir.empty())
+    {
+        wisdom_file = this->wisdom_dir + "/fftw_r2c_" + std::to_string(length);
+        if (howmany > 1)
+            wisdom_file += "x" + std::to_string(howmany);
+        wisdom_file += ".wisdom";
+        imported = fftw_import_wisdom_from_filename(wisdom_file.c_str()); // 缓存命中时规划几乎不耗时
+    }
+
+    fftw_plan p = fftw_plan_many_dft_r2c(1, &length, howmany, input_array, NULL, 1, length, output_array, NULL, 1, length / 2 + 1, FFTW_MEASURE);
+
+    if (!wisdom_file.empty() && !imported)
+    {
+        // 逐级创建缓存目录，失败也不影响运行
+        for (size_t pos = this->wisdom_dir.find('/', 1); ; pos = this->wisdom_dir.find('/', pos + 1))
+        {
+            mkdir(this->wisdom_dir.substr(0, pos).c_str(), 0755);
+            if (pos == std::string::npos)
+                break;
+        }
+        fftw_export_wisdom_to_filename(wisdom_file.c_str());
+    }
+    return p;
+}
+
+/**
+ * @brief 销毁计划（私有方法）
+ *
+ * @param p 傅立叶变换计划
+ */
+void fft::destroy_plan(fftw_plan p)
+{
+    std::lock_guard<std::mutex> guard(planner_lock);
+    fftw_destroy_plan(p);
+}
@@ -1,6 +1,22 @@
 #include "serial_video/gray2bw.hpp"
+#include "serial_video/startup_timer.hpp"
+#include "serial_video/metrics.hpp"
+#include "serial_video/tracer.hpp"
+#include "serial_video/executor.hpp"
+#include "serial_video/shm_ring.hpp"
 #include <thread>
 #include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+// 五档抖动各档的2x2图案：左上、左下、右上、右下
+static const uint8_t dither_patterns[5][4] = {
+    {0, 0, 0, 0},
+    {0, 255, 0, 0},
+    {0, 255, 255, 0},
+    {0, 255, 255, 255},
+    {255, 255, 255, 255}};
 
 /**
  * @brief Construct a new gray2bw::gray2bw object
@@ -38,6 +54,24 @@ gray2bw::gray2bw(int in_width, int in_height, int out_width, int out_height)
     this->m_in_height   = in_height;
     this->m_out_width   = out_width;
     this->m_out_height  = out_height;
+    this->m_timer       = NULL;
+    this->m_stats       = NULL;
+    this->m_trace       = NULL;
+    this->m_queue_limit = BW_QUEUE_LENGTH_MAX;
+    this->m_epoch       = NULL;
+    this->m_hysteresis  = 0;
+    this->m_pending     = 0;
+    this->m_frames      = -1;
+    this->m_tb          = NULL;
+    this->m_resizer.reset(new area_resize(in_width, in_height, out_width, out_height)); // 预先计算缩放系数
+
+    // 预先分配各级帧缓冲区，运行时不再分配
+    this->in_frame.resize(in_width * in_height);
+    this->resized_frame.resize(out_width * out_height);
+    this->bw_frame.resize(out_width * out_height);
+    this->packed_frame.resize(out_width * out_height / 8);
+    this->m_prev_packed.resize(out_width * out_height / 8);
+    this->m_levels.assign((out_width / 2) * (out_height / 2), 0xFF); // 0xFF表示还没有上一帧
 }
 
 /**
@@ -46,89 +80,19 @@ gray2bw::gray2bw(int in_width, int in_height, int out_width, int out_height)
  * @param in_stream 输入流
  * @param out_stream 输出流
  */
-void gray2bw::convert(std::queue<uint8_t> &in_stream, std::queue<uint8_t> &out_stream)
+void gray2bw::convert(ring_buffer<uint8_t> &in_stream, ring_buffer<uint8_t> &out_stream)
 {
-    this->in_frame.create(cv::Size(this->m_in_width, this->m_in_height), CV_8UC1);    // 创建输入矩阵
-    this->out_frame.create(cv::Size(this->m_out_width, this->m_out_height), CV_8UC1); // 创建空白输出矩阵
     while (!in_stream.empty())
     {
         if (in_stream.size() < this->m_in_width * this->m_in_height) // 输入队列不足一帧，但仍有数据
         {
-            while (!in_stream.empty())
-            {
-                in_stream.pop(); // 全部丢弃
-            }
+            in_stream.clear(); // 全部丢弃
             break;
         }
-        for (int i = 0; i < this->m_in_width * this->m_in_height; i++)
-        {
-            this->in_frame.data[i] = in_stream.front(); // 输入矩阵
-            in_stream.pop();
-        }
-
-        cv::Mat temp_frame;
-        cv::resize(this->in_frame, temp_frame, cv::Size(this->m_out_width, this->m_out_height)); // 缩放至目标大小
-
-        // 五档抖动
-        for (int i = 0; i < this->m_out_height; i += 2)
-        {
-            for (int j = 0; j < this->m_out_width; j += 2)
-            {
-                uint8_t avg = (temp_frame.at<uint8_t>(i, j) + temp_frame.at<uint8_t>(i, j + 1) + temp_frame.at<uint8_t>(i + 1, j) + temp_frame.at<uint8_t>(i + 1, j + 1)) / 4;
-                if (avg < 51)
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 0;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 0;
-                }
-                else if (avg < 102)
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 255;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 0;
-                }
-                else if (avg < 153)
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 255;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 255;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 0;
-                }
-                else if (avg < 204)
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 255;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 255;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 255;
-                }
-                else
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 255;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 255;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 255;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 255;
-                }
-            }
-        }
-        for (int page = 0; page < this->m_out_height; page += 8)
-        {
-            for (int col = 0; col < this->m_out_width; col++)
-            {
-                uint8_t data = 0;
-                for (int i = 0; i < 8; i++)
-                {
-                    data >>= 1;
-                    if (this->out_frame.data[col + (page + i) * this->m_out_width])
-                        data |= 0x80;
-                }
-                out_stream.push(data);
-            }
-        }
+        in_stream.pop(this->in_frame.data(), this->in_frame.size()); // 输入帧
+        this->process(NULL, 0);
+        out_stream.push(this->packed_frame.data(), this->packed_frame.size());
     }
-    in_frame.release();
-    out_frame.release();
 }
 
 /**
@@ -141,21 +105,22 @@ void gray2bw::convert(std::queue<uint8_t> &in_stream, std::queue<uint8_t> &out_s
  * @param abort_flag 终止标志
  * @param process_done 运行完成标志
  */
-void gray2bw::streamed_convert(std::queue<uint8_t> &in_stream, std::mutex &in_lock, std::queue<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
+void gray2bw::streamed_convert(ring_buffer<uint8_t> &in_stream, std::mutex &in_lock, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
 {
-    this->in_frame.create(cv::Size(this->m_in_width, this->m_in_height), CV_8UC1);    // 创建输入矩阵
-    this->out_frame.create(cv::Size(this->m_out_width, this->m_out_height), CV_8UC1); // 创建空白输出矩阵
+    trace_buffer *tb = this->m_trace != NULL ? this->m_trace->register_thread("gray2bw") : NULL; // 本线程的跟踪缓冲区
+    int64_t frames = 0;                                                                         // 帧序号
     while (1)
     {
+        auto wait_begin = std::chrono::steady_clock::now();
+        trace_span wait_span(tb, "queue wait (input)", frames);
         while (1)
         {
             in_lock.lock();                                                                // 输入加锁
             if (abort_flag > 0 && in_stream.size() < this->m_in_height * this->m_in_width) // 已终止且剩余输入不足一帧
             {
-                while (!in_stream.empty())
-                {
-                    in_stream.pop(); // 丢弃全部输入
-                }
+                if (this->m_stats != NULL && !in_stream.empty())
+                    metrics::add(this->m_stats->gray.dropped_frames, 1);
+                in_stream.clear(); // 丢弃全部输入
                 in_lock.unlock(); // 解锁退出
                 goto done;
             }
@@ -164,88 +129,366 @@ void gray2bw::streamed_convert(std::queue<uint8_t> &in_stream, std::mutex &in_lo
             in_lock.unlock();
             std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
-        for (int i = 0; i < this->m_in_width * this->m_in_height; i++)
+        wait_span.end();
+        in_stream.pop(this->in_frame.data(), this->in_frame.size()); // 输入帧
+        uint32_t input_epoch = this->m_epoch != NULL ? this->m_epoch->load() : 0; // 持有输入锁时读取，与清空队列互斥
+        if (this->m_stats != NULL)
+            metrics::set(this->m_stats->av_video_depth, in_stream.size());
+        in_lock.unlock();
+        if (this->m_stats != NULL)
         {
-            this->in_frame.data[i] = in_stream.front(); // 输入矩阵
-            in_stream.pop();
+            metrics::add(this->m_stats->gray.wait_input_ns, metrics::elapsed_ns(wait_begin));
+            metrics::add(this->m_stats->gray.frames_in, 1);
         }
-        in_lock.unlock();
 
-        cv::Mat temp_frame;
-        cv::resize(this->in_frame, temp_frame, cv::Size(this->m_out_width, this->m_out_height)); // 缩放至目标大小
+        this->process(tb, frames);
 
-        // 五档抖动
-        for (int i = 0; i < this->m_out_height; i += 2)
+        // 等队列长度够短再输出
+        wait_begin = std::chrono::steady_clock::now();
+        trace_span out_wait_span(tb, "queue wait (output)", frames);
+        while (1)
         {
-            for (int j = 0; j < this->m_out_width; j += 2)
-            {
-                uint8_t avg = (temp_frame.at<uint8_t>(i, j) + temp_frame.at<uint8_t>(i, j + 1) + temp_frame.at<uint8_t>(i + 1, j) + temp_frame.at<uint8_t>(i + 1, j + 1)) / 4;
-                if (avg < 51)
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 0;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 0;
-                }
-                else if (avg < 102)
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 255;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 0;
-                }
-                else if (avg < 153)
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 255;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 255;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 0;
-                }
-                else if (avg < 204)
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 0;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 255;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 255;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 255;
-                }
-                else
-                {
-                    this->out_frame.at<uint8_t>(i, j)           = 255;
-                    this->out_frame.at<uint8_t>(i + 1, j)       = 255;
-                    this->out_frame.at<uint8_t>(i, j + 1)       = 255;
-                    this->out_frame.at<uint8_t>(i + 1, j + 1)   = 255;
-                }
-            }
+            out_lock.lock();
+            if (out_stream.size() < this->m_queue_limit)
+                break;
+            out_lock.unlock();
+            std::this_thread::sleep_for(std::chrono::microseconds(1));
         }
+        out_wait_span.end();
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.wait_output_ns, metrics::elapsed_ns(wait_begin));
+        if (this->m_epoch != NULL && this->m_epoch->load() != input_epoch) // 处理期间队列已被清空，这一帧属于旧位置
+        {
+            out_lock.unlock();
+            continue;
+        }
+        out_stream.push(this->packed_frame.data(), this->packed_frame.size());
+        if (this->m_stats != NULL)
+            metrics::set(this->m_stats->gray_video_depth, out_stream.size());
+        out_lock.unlock(); // 输出解锁
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.frames_out, 1);
+        frames++;
+        if (this->m_timer != NULL && frames == 1) // 只记录第一帧，之后不再进入计时器
+            this->m_timer->mark("first frame converted");
+    }
+    done:process_done = 1;
+}
+
+/**
+ * @brief 直接转换共享内存帧环中的帧（用于多线程），帧不经过解码器和输入队列
+ *
+ * 缩放直接读取共享内存中的槽，不复制；缩放完后检查槽在此期间没有被写入端覆盖，否则丢弃这一帧。
+ * 之后的抖动和取模只用到缩放结果，这时写入端已经可以重用这个槽
+ *
+ * @param source 已打开的帧环读取端，帧尺寸与构造时的输入尺寸一致
+ * @param out_stream 输出流
+ * @param out_lock 输出流的锁
+ * @param abort_flag 终止标志
+ * @param process_done 运行完成标志
+ */
+void gray2bw::streamed_convert(shm_reader &source, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
+{
+    trace_buffer *tb = this->m_trace != NULL ? this->m_trace->register_thread("gray2bw") : NULL; // 本线程的跟踪缓冲区
+    int64_t frames = 0;                                                                         // 帧序号
+    while (1)
+    {
+        auto wait_begin = std::chrono::steady_clock::now();
+        trace_span wait_span(tb, "shm wait", frames);
+        const uint8_t *in = source.acquire(abort_flag);
+        wait_span.end();
+        if (in == NULL) // 写入端已关闭或已终止
+            break;
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.wait_input_ns, metrics::elapsed_ns(wait_begin));
+
+        trace_span resize_span(tb, "resize", frames);
+        this->resize(in, this->resized_frame.data());
+        resize_span.end();
+        if (!source.release()) // 缩放期间被覆盖，读取端已计入丢帧
+            continue;
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.frames_in, 1);
+        this->finish(tb, frames);
 
         // 等队列长度够短再输出
+        wait_begin = std::chrono::steady_clock::now();
+        trace_span out_wait_span(tb, "queue wait (output)", frames);
         while (1)
         {
             out_lock.lock();
-            int length = out_stream.size();
-            if (length < BW_QUEUE_LENGTH_MAX)
+            if (out_stream.size() < this->m_queue_limit)
                 break;
             out_lock.unlock();
             std::this_thread::sleep_for(std::chrono::microseconds(1));
         }
-        // 重新取模为列行式
-        for (int page = 0; page < this->m_out_height; page += 8)
+        out_wait_span.end();
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.wait_output_ns, metrics::elapsed_ns(wait_begin));
+        out_stream.push(this->packed_frame.data(), this->packed_frame.size());
+        if (this->m_stats != NULL)
+            metrics::set(this->m_stats->gray_video_depth, out_stream.size());
+        out_lock.unlock(); // 输出解锁
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.frames_out, 1);
+        frames++;
+        if (this->m_timer != NULL && frames == 1) // 只记录第一帧，之后不再进入计时器
+            this->m_timer->mark("first frame converted");
+    }
+    process_done = 1;
+}
+
+/**
+ * @brief streamed_convert的协作式版本，由executor反复恢复，每次最多转换一帧
+ *
+ * 输入不足一帧或输出队列已满时不等待，返回TASK_BLOCKED；已转换的帧保留到下次恢复时输出
+ *
+ * @param in_stream 输入流
+ * @param in_lock 输入流的锁
+ * @param out_stream 输出流
+ * @param out_lock 输出流的锁
+ * @param abort_flag 终止标志
+ * @param process_done 运行完成标志
+ * @return int TASK_YIELD、TASK_BLOCKED或TASK_DONE
+ */
+int gray2bw::resume_convert(ring_buffer<uint8_t> &in_stream, std::mutex &in_lock, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
+{
+    if (this->m_frames < 0) // 第一次恢复
+    {
+        this->m_tb = this->m_trace != NULL ? this->m_trace->register_thread("gray2bw") : NULL;
+        this->m_frames = 0;
+        this->m_wait_begin = std::chrono::steady_clock::now();
+    }
+    if (!this->m_pending)
+    {
         {
-            for (int col = 0; col < this->m_out_width; col++)
+            std::lock_guard<std::mutex> in_guard(in_lock);
+            if (abort_flag > 0 && in_stream.size() < this->m_in_height * this->m_in_width) // 已终止且剩余输入不足一帧
             {
-                uint8_t data = 0;
-                for (int i = 0; i < 8; i++)
-                {
-                    data >>= 1;
-                    if (this->out_frame.data[col + (page + i) * this->m_out_width])
-                        data |= 0x80;
-                }
-                out_stream.push(data);
+                if (this->m_stats != NULL && !in_stream.empty())
+                    metrics::add(this->m_stats->gray.dropped_frames, 1);
+                in_stream.clear();
+                process_done = 1;
+                return TASK_DONE;
             }
+            if (in_stream.size() < this->m_in_width * this->m_in_height)
+                return TASK_BLOCKED;
+            in_stream.pop(this->in_frame.data(), this->in_frame.size());
+            this->m_pending_epoch = this->m_epoch != NULL ? this->m_epoch->load() : 0; // 持有输入锁时读取，与清空队列互斥
+            if (this->m_stats != NULL)
+                metrics::set(this->m_stats->av_video_depth, in_stream.size());
         }
-        out_lock.unlock(); // 输出解锁
+        if (this->m_stats != NULL)
+        {
+            metrics::add(this->m_stats->gray.wait_input_ns, metrics::elapsed_ns(this->m_wait_begin));
+            metrics::add(this->m_stats->gray.frames_in, 1);
+        }
+        this->process(this->m_tb, this->m_frames);
+        this->m_pending = 1;
+        this->m_wait_begin = std::chrono::steady_clock::now();
     }
-    done:this->in_frame.release();
-    this->out_frame.release();
-    process_done = 1;
+
+    {
+        std::lock_guard<std::mutex> out_guard(out_lock);
+        if (out_stream.size() >= this->m_queue_limit)
+            return TASK_BLOCKED;
+        this->m_pending = 0;
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.wait_output_ns, metrics::elapsed_ns(this->m_wait_begin));
+        this->m_wait_begin = std::chrono::steady_clock::now();
+        if (this->m_epoch != NULL && this->m_epoch->load() != this->m_pending_epoch) // 处理期间队列已被清空，这一帧属于旧位置
+            return TASK_YIELD;
+        out_stream.push(this->packed_frame.data(), this->packed_frame.size());
+        if (this->m_stats != NULL)
+            metrics::set(this->m_stats->gray_video_depth, out_stream.size());
+    }
+    if (this->m_stats != NULL)
+        metrics::add(this->m_stats->gray.frames_out, 1);
+    this->m_frames++;
+    if (this->m_timer != NULL && this->m_frames == 1) // 只记录第一帧，之后不再进入计时器
+        this->m_timer->mark("first frame converted");
+    return TASK_YIELD;
+}
+
+/**
+ * @brief 缩放、抖动并重新取模一帧：in_frame -> packed_frame（私有方法）
+ *
+ * @param tb 跟踪缓冲区，为NULL时不跟踪
+ * @param frame 帧序号
+ */
+void gray2bw::process(trace_buffer *tb, int64_t frame)
+{
+    trace_span resize_span(tb, "resize", frame);
+    this->resize(this->in_frame.data(), this->resized_frame.data()); // 缩放至目标大小
+    resize_span.end();
+    this->finish(tb, frame);
+}
+
+/**
+ * @brief 抖动并重新取模已缩放的一帧：resized_frame -> packed_frame（私有方法）
+ *
+ * @param tb 跟踪缓冲区，为NULL时不跟踪
+ * @param frame 帧序号
+ */
+void gray2bw::finish(trace_buffer *tb, int64_t frame)
+{
+    trace_span dither_span(tb, "dither", frame);
+    this->dither(this->resized_frame.data(), this->bw_frame.data()); // 五档抖动
+    dither_span.end();
+
+    trace_span pack_span(tb, "pack", frame);
+    this->pack(this->bw_frame.data(), this->packed_frame.data()); // 重新取模为列行式
+    pack_span.end();
+
+    if (this->m_stats != NULL)
+    {
+        uint64_t changed = 0;
+        for (size_t i = 0; i < this->packed_frame.size(); i++)
+            changed += this->packed_frame[i] != this->m_prev_packed[i];
+        metrics::add(this->m_stats->changed_bytes, changed);
+        memcpy(this->m_prev_packed.data(), this->packed_frame.data(), this->packed_frame.size());
+    }
+}
+
+/**
+ * @brief 把一帧灰度图像缩放至输出大小（区域平均）
+ *
+ * @param in 输入帧（in_width * in_height字节）
+ * @param out 输出帧（out_width * out_height字节）
+ */
+void gray2bw::resize(const uint8_t *in, uint8_t *out)
+{
+    this->m_resizer->resize(in, out);
+}
+
+/**
+ * @brief 以2x2块为单位的五档抖动
+ *
+ * 设置了迟滞量时，块的平均灰度只要还在上一帧档位的范围外扩迟滞量以内就沿用上一帧的图案，
+ * 缓慢变化或带噪声的画面不会在档位边界上来回翻转
+ *
+ * @param in 缩放后的灰度帧（out_width * out_height字节）
+ * @param out 二值帧，每像素0或255
+ */
+void gray2bw::dither(const uint8_t *in, uint8_t *out)
+{
+    const int w = this->m_out_width;
+    uint8_t *levels = this->m_levels.data();
+    for (int i = 0; i < this->m_out_height; i += 2)
+    {
+        for (int j = 0; j < w; j += 2, levels++)
+        {
+            int avg = (in[i * w + j] + in[i * w + j + 1] + in[(i + 1) * w + j] + in[(i + 1) * w + j + 1]) / 4;
+            int level = std::min(avg / BW_LEVEL_STEP, 4);
+            int prev = *levels;
+            if (this->m_hysteresis > 0 && prev != 0xFF && level != prev &&
+                avg >= prev * BW_LEVEL_STEP - this->m_hysteresis && avg < (prev + 1) * BW_LEVEL_STEP + this->m_hysteresis)
+                level = prev; // 变化没有超过迟滞量，保持上一帧的图案
+            *levels = level;
+            const uint8_t *pattern = dither_patterns[level];
+            out[i * w + j]              = pattern[0];
+            out[(i + 1) * w + j]        = pattern[1];
+            out[i * w + j + 1]          = pattern[2];
+            out[(i + 1) * w + j + 1]    = pattern[3];
+        }
+    }
+}
+
+/**
+ * @brief 把二值帧取模为列行式（每8行为一页，每列一个字节，低位在上）
+ *
+ * @param in 二值帧（out_width * out_height字节）
+ * @param out 取模结果（get_frame_size()字节）
+ */
+void gray2bw::pack(const uint8_t *in, uint8_t *out)
+{
+    for (int page = 0; page < this->m_out_height; page += 8)
+    {
+        for (int col = 0; col < this->m_out_width; col++)
+        {
+            uint8_t data = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                data >>= 1;
+                if (in[col + (page + i) * this->m_out_width])
+                    data |= 0x80;
+            }
+            *out++ = data;
+        }
+    }
+}
+
+/**
+ * @brief 获取取模后每帧的字节数
+ *
+ * @return int 字节数
+ */
+int gray2bw::get_frame_size(void)
+{
+    return this->m_out_width * this->m_out_height / 8;
+}
+
+/**
+ * @brief 设置启动阶段计时器
+ *
+ * @param timer 计时器，为NULL时不计时
+ */
+void gray2bw::set_startup_timer(startup_timer *timer)
+{
+    this->m_timer = timer;
+}
+
+/**
+ * @brief 设置运行指标
+ *
+ * @param stats 指标，为NULL时不统计
+ */
+void gray2bw::set_metrics(metrics *stats)
+{
+    this->m_stats = stats;
+}
+
+/**
+ * @brief 设置逐帧跟踪记录器
+ *
+ * @param trace 跟踪记录器，为NULL时不跟踪
+ */
+void gray2bw::set_tracer(tracer *trace)
+{
+    this->m_trace = trace;
+}
+
+/**
+ * @brief 设置输出队列的最大长度
+ *
+ * @param length 最大长度（字节），实时模式下通常设为一帧
+ */
+void gray2bw::set_queue_limit(size_t length)
+{
+    this->m_queue_limit = length;
+}
+
+/**
+ * @brief 设置抖动的迟滞量，减少帧间翻转的像素（即帧间变化的字节数）和闪烁
+ *
+ * @param margin 迟滞量（灰度级，0-50），为0时每帧独立抖动
+ */
+void gray2bw::set_hysteresis(int margin)
+{
+    if (margin < 0 || margin >= BW_LEVEL_STEP)
+    {
+        std::invalid_argument ex("hysteresis margin out of range!");
+        throw ex;
+    }
+    this->m_hysteresis = margin;
+}
+
+/**
+ * @brief 设置冲洗纪元：取输入时记下纪元，输出时纪元已变（期间队列被清空，如跳转）则丢弃这一帧
+ *
+ * @param epoch 纪元计数器，由清空队列的一方在持有全部队列锁时加1，为NULL时不检查
+ */
+void gray2bw::set_epoch(std::atomic<uint32_t> *epoch)
+{
+    this->m_epoch = epoch;
 }
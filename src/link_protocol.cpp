@@ -0,0 +1,210 @@
+#include "serial_video/link_protocol.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @brief Construct a new link_protocol::link_protocol object
+ *
+ * @param max_payload 接收时允许的最大负载长度，更长的帧视为错误
+ */
+link_protocol::link_protocol(size_t max_payload)
+{
+    if (max_payload > 0xFFFF)
+    {
+        std::invalid_argument ex("Link payload too large!");
+        throw ex;
+    }
+    this->max_payload       = max_payload;
+    this->buffer.resize(2 * (LINK_OVERHEAD + max_payload)); // 至少能放下一个完整的帧和其后的部分数据
+    this->filled            = 0;
+    this->frame_size        = 0;
+    this->crc_errors        = 0;
+    this->discarded_bytes   = 0;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE（多项式0x1021，初值0xFFFF）
+ *
+ * @param data 数据
+ * @param length 长度
+ * @param crc 初值，分段计算时传入上一段的结果
+ * @return uint16_t CRC
+ */
+uint16_t link_protocol::crc16(const uint8_t *data, size_t length, uint16_t crc)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+/**
+ * @brief 写入帧头，负载由调用者直接写在frame + LINK_HEADER_SIZE处，避免再复制一次
+ *
+ * @param frame 帧缓冲区
+ * @param addr 地址
+ * @param type 类型
+ * @param seq 序号
+ * @param length 负载长度
+ */
+void link_protocol::write_header(uint8_t *frame, uint8_t addr, uint8_t type, uint16_t seq, uint16_t length)
+{
+    frame[0] = LINK_SYNC_0;
+    frame[1] = LINK_SYNC_1;
+    frame[2] = addr;
+    frame[3] = type;
+    frame[4] = seq & 0xFF;
+    frame[5] = seq >> 8;
+    frame[6] = length & 0xFF;
+    frame[7] = length >> 8;
+}
+
+/**
+ * @brief 在负载之后写入CRC
+ *
+ * @param frame 已写好帧头和负载的帧缓冲区
+ * @param length 负载长度
+ */
+void link_protocol::write_crc(uint8_t *frame, uint16_t length)
+{
+    uint16_t crc = link_protocol::crc16(frame + 2, LINK_HEADER_SIZE - 2 + length);
+    frame[LINK_HEADER_SIZE + length]     = crc & 0xFF;
+    frame[LINK_HEADER_SIZE + length + 1] = crc >> 8;
+}
+
+/**
+ * @brief 编码一帧
+ *
+ * @param frame 输出缓冲区，至少LINK_OVERHEAD + length字节
+ * @param addr 地址
+ * @param type 类型
+ * @param seq 序号
+ * @param payload 负载
+ * @param length 负载长度
+ * @return size_t 帧的总长度
+ */
+size_t link_protocol::encode(uint8_t *frame, uint8_t addr, uint8_t type, uint16_t seq, const uint8_t *payload, uint16_t length)
+{
+    link_protocol::write_header(frame, addr, type, seq, length);
+    if (length > 0)
+        memcpy(frame + LINK_HEADER_SIZE, payload, length);
+    link_protocol::write_crc(frame, length);
+    return LINK_OVERHEAD + length;
+}
+
+/**
+ * @brief 输入接收到的字节，收齐一帧时返回
+ *
+ * 用法：while (parser.feed(data + off, n - off, consumed)) { off += consumed; 处理帧; } off += consumed;
+ *
+ * @param data 数据
+ * @param length 长度
+ * @param consumed 本次存入的字节数，返回1时剩余的字节需要再次输入
+ * @return int 收到一个CRC正确的帧返回1，可通过get_*读取，直到下一次调用feed
+ */
+int link_protocol::feed(const uint8_t *data, size_t length, size_t &consumed)
+{
+    if (this->frame_size > 0) // 丢弃上次返回的帧
+    {
+        this->drop(this->frame_size);
+        this->frame_size = 0;
+    }
+    consumed = std::min(length, this->buffer.size() - this->filled);
+    memcpy(this->buffer.data() + this->filled, data, consumed);
+    this->filled += consumed;
+    while (this->filled > 0)
+    {
+        // 把同步字移到缓冲区开头
+        size_t start = 0;
+        while (start < this->filled && !(this->buffer[start] == LINK_SYNC_0 && (start + 1 == this->filled || this->buffer[start + 1] == LINK_SYNC_1)))
+            start++;
+        if (start > 0)
+        {
+            this->discarded_bytes += start;
+            this->drop(start);
+        }
+        if (this->filled < LINK_HEADER_SIZE)
+            return 0;
+        size_t payload = this->get_length();
+        if (payload > this->max_payload)
+        {
+            this->discarded_bytes++;
+            this->drop(1); // 不是真正的帧头，从下一字节重新搜索
+            continue;
+        }
+        if (this->filled < LINK_OVERHEAD + payload)
+            return 0;
+        uint16_t crc = link_protocol::crc16(this->buffer.data() + 2, LINK_HEADER_SIZE - 2 + payload);
+        if ((this->buffer[LINK_HEADER_SIZE + payload] | (this->buffer[LINK_HEADER_SIZE + payload + 1] << 8)) != crc)
+        {
+            this->crc_errors++;
+            this->discarded_bytes++;
+            this->drop(1);
+            continue;
+        }
+        this->frame_size = LINK_OVERHEAD + payload;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 丢弃缓冲区开头的字节（私有方法）
+ *
+ * @param count 字节数
+ */
+void link_protocol::drop(size_t count)
+{
+    memmove(this->buffer.data(), this->buffer.data() + count, this->filled - count);
+    this->filled -= count;
+}
+
+uint8_t link_protocol::get_addr(void)
+{
+    return this->buffer[2];
+}
+
+uint8_t link_protocol::get_type(void)
+{
+    return this->buffer[3];
+}
+
+uint16_t link_protocol::get_seq(void)
+{
+    return this->buffer[4] | (this->buffer[5] << 8);
+}
+
+uint16_t link_protocol::get_length(void)
+{
+    return this->buffer[6] | (this->buffer[7] << 8);
+}
+
+const uint8_t *link_protocol::get_payload(void)
+{
+    return this->buffer.data() + LINK_HEADER_SIZE;
+}
+
+/**
+ * @brief 获取CRC错误的帧数
+ *
+ * @return uint64_t 帧数
+ */
+uint64_t link_protocol::get_crc_errors(void)
+{
+    return this->crc_errors;
+}
+
+/**
+ * @brief 获取因不属于任何有效帧而丢弃的字节数
+ *
+ * @return uint64_t 字节数
+ */
+uint64_t link_protocol::get_discarded_bytes(void)
+{
+    return this->discarded_bytes;
+}
@@ -0,0 +1,338 @@
+#include "serial_video/metrics.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <fstream> //for std::ios_base::failure
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define METRICS_POLL_INTERVAL_MS 100 // 服务线程检查停止标志的间隔
+#define METRICS_REQUEST_WAIT_MS 50   // 等待客户端发送HTTP请求的时间
+
+// 唤醒延迟直方图各桶的上界（纳秒）
+static const uint64_t wakeup_bounds_ns[METRICS_WAKEUP_BUCKETS] = {10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+
+/**
+ * @brief Construct a new metrics::metrics object
+ *
+ */
+metrics::metrics()
+{
+    for (int i = 0; i < METRICS_LATENCY_RING; i++)
+    {
+        this->arrival_frame[i].store(0, std::memory_order_relaxed);
+        this->arrival_ns[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i <= METRICS_WAKEUP_BUCKETS; i++)
+        this->wakeup_buckets[i].store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 记录一次定时唤醒的延迟（传输线程调用）
+ *
+ * @param late_ns 实际醒来时刻比预定时刻晚的纳秒数
+ */
+void metrics::record_wakeup(uint64_t late_ns)
+{
+    int bucket = 0;
+    while (bucket < METRICS_WAKEUP_BUCKETS && late_ns > wakeup_bounds_ns[bucket])
+        bucket++;
+    metrics::add(this->wakeup_buckets[bucket], 1);
+    metrics::add(this->wakeup_ns, late_ns);
+    metrics::add(this->wakeups, 1);
+    if (late_ns > this->wakeup_ns_max.load(std::memory_order_relaxed))
+        metrics::set(this->wakeup_ns_max, late_ns);
+}
+
+/**
+ * @brief 以文本直方图输出唤醒延迟，用于比较实时调度前后的抖动
+ *
+ * @param out 输出流
+ */
+void metrics::report_wakeup(std::ostream &out)
+{
+    uint64_t total = this->wakeups.load(std::memory_order_relaxed);
+    if (total == 0)
+        return;
+    out << "Transfer wakeup latency over " << total << " wakeups: avg " << this->wakeup_ns.load(std::memory_order_relaxed) / 1e3 / total
+        << " us, max " << this->wakeup_ns_max.load(std::memory_order_relaxed) / 1e3 << " us" << std::endl;
+    for (int i = 0; i <= METRICS_WAKEUP_BUCKETS; i++)
+    {
+        uint64_t count = this->wakeup_buckets[i].load(std::memory_order_relaxed);
+        char label[32];
+        if (i < METRICS_WAKEUP_BUCKETS)
+            snprintf(label, sizeof(label), "<= %8.0f us", wakeup_bounds_ns[i] / 1e3);
+        else
+            snprintf(label, sizeof(label), ">  %8.0f us", wakeup_bounds_ns[METRICS_WAKEUP_BUCKETS - 1] / 1e3);
+        out << "  " << label << " " << std::string(count * 50 / total, '#') << " " << count << std::endl;
+    }
+}
+
+/**
+ * @brief 记录一个视频帧的到达时刻（解码线程调用）
+ *
+ * @param frame 视频帧序号
+ * @param arrival_ns 读到该帧数据包的时刻（now_ns()）
+ */
+void metrics::frame_arrived(uint64_t frame, uint64_t arrival_ns)
+{
+    int slot = frame % METRICS_LATENCY_RING;
+    this->arrival_frame[slot].store(0, std::memory_order_relaxed); // 先作废，避免读到新旧混合的记录
+    this->arrival_ns[slot].store(arrival_ns, std::memory_order_release);
+    this->arrival_frame[slot].store(frame + 1, std::memory_order_release);
+}
+
+/**
+ * @brief 记录一个视频帧已写入串口，累计端到端延迟（传输线程调用）
+ *
+ * 传输落后解码超过环形缓冲区容量时（离线播放、大队列），该帧的到达时刻已被覆盖，不计入统计
+ *
+ * @param frame 视频帧序号（即数据包序号）
+ */
+void metrics::frame_written(uint64_t frame)
+{
+    int slot = frame % METRICS_LATENCY_RING;
+    if (this->arrival_frame[slot].load(std::memory_order_acquire) != frame + 1)
+        return;
+    uint64_t arrival = this->arrival_ns[slot].load(std::memory_order_acquire);
+    if (this->arrival_frame[slot].load(std::memory_order_acquire) != frame + 1)
+        return;
+    uint64_t latency = metrics::now_ns() - arrival;
+    metrics::add(this->latency_ns, latency);
+    metrics::add(this->latency_samples, 1);
+    metrics::set(this->latency_ns_last, latency);
+    if (latency > this->latency_ns_max.load(std::memory_order_relaxed))
+        metrics::set(this->latency_ns_max, latency);
+}
+
+/**
+ * @brief 以Prometheus文本格式输出全部指标
+ *
+ * @param out 输出字符串
+ */
+void metrics::render(std::string &out)
+{
+    const struct
+    {
+        const char *name;
+        stage_metrics *stage;
+    } stages[] = {{"decoder", &this->decoder}, {"audio_decoder", &this->audio_decoder}, {"gray2bw", &this->gray}, {"fft", &this->fft}, {"transfer", &this->transfer}};
+    const struct
+    {
+        const char *name;
+        std::atomic<uint64_t> *depth;
+    } queues[] = {{"av_video", &this->av_video_depth}, {"gray_video", &this->gray_video_depth}, {"av_audio", &this->av_audio_depth}, {"fft_audio", &this->fft_audio_depth}};
+    std::ostringstream s;
+
+    s << "# HELP vons_stage_frames_in_total Frames consumed by each pipeline stage.\n";
+    s << "# TYPE vons_stage_frames_in_total counter\n";
+    for (auto &st : stages)
+        s << "vons_stage_frames_in_total{stage=\"" << st.name << "\"} " << st.stage->frames_in.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_stage_frames_out_total Frames produced by each pipeline stage.\n";
+    s << "# TYPE vons_stage_frames_out_total counter\n";
+    for (auto &st : stages)
+        s << "vons_stage_frames_out_total{stage=\"" << st.name << "\"} " << st.stage->frames_out.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_stage_dropped_frames_total Frames discarded by each pipeline stage.\n";
+    s << "# TYPE vons_stage_dropped_frames_total counter\n";
+    for (auto &st : stages)
+        s << "vons_stage_dropped_frames_total{stage=\"" << st.name << "\"} " << st.stage->dropped_frames.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_stage_blocked_seconds_total Time each stage spent blocked on its input or output.\n";
+    s << "# TYPE vons_stage_blocked_seconds_total counter\n";
+    for (auto &st : stages)
+    {
+        s << "vons_stage_blocked_seconds_total{stage=\"" << st.name << "\",side=\"input\"} " << st.stage->wait_input_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+        s << "vons_stage_blocked_seconds_total{stage=\"" << st.name << "\",side=\"output\"} " << st.stage->wait_output_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+    }
+    s << "# HELP vons_queue_depth Elements currently buffered between stages.\n";
+    s << "# TYPE vons_queue_depth gauge\n";
+    for (auto &q : queues)
+        s << "vons_queue_depth{queue=\"" << q.name << "\"} " << q.depth->load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_gray_changed_bytes_total Bytes of converted frames that differ from the previous frame.\n";
+    s << "# TYPE vons_gray_changed_bytes_total counter\n";
+    s << "vons_gray_changed_bytes_total " << this->changed_bytes.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_rate_frames_total Frames sent by the rate controller, by encoding.\n";
+    s << "# TYPE vons_rate_frames_total counter\n";
+    s << "vons_rate_frames_total{encoding=\"full\"} " << this->encoded_full.load(std::memory_order_relaxed) << "\n";
+    s << "vons_rate_frames_total{encoding=\"rle\"} " << this->encoded_rle.load(std::memory_order_relaxed) << "\n";
+    s << "vons_rate_frames_total{encoding=\"delta\"} " << this->encoded_delta.load(std::memory_order_relaxed) << "\n";
+    s << "vons_rate_frames_total{encoding=\"partial\"} " << this->encoded_partial.load(std::memory_order_relaxed) << "\n";
+    s << "vons_rate_frames_total{encoding=\"rect\"} " << this->encoded_rect.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_rate_rects_total Dirty rectangles sent in color mode.\n";
+    s << "# TYPE vons_rate_rects_total counter\n";
+    s << "vons_rate_rects_total " << this->rects.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_rate_encoded_bytes_total Bytes of encoded packets, headers included.\n";
+    s << "# TYPE vons_rate_encoded_bytes_total counter\n";
+    s << "vons_rate_encoded_bytes_total " << this->encoded_bytes.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_transfer_bytes_written_total Bytes written to the output device.\n";
+    s << "# TYPE vons_transfer_bytes_written_total counter\n";
+    s << "vons_transfer_bytes_written_total " << this->bytes_written.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_transfer_write_seconds Time spent in write() on the output device.\n";
+    s << "# TYPE vons_transfer_write_seconds summary\n";
+    s << "vons_transfer_write_seconds_sum " << this->write_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+    s << "vons_transfer_write_seconds_count " << this->writes.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_transfer_write_seconds_max Longest single write() on the output device.\n";
+    s << "# TYPE vons_transfer_write_seconds_max gauge\n";
+    s << "vons_transfer_write_seconds_max " << this->write_ns_max.load(std::memory_order_relaxed) / 1e9 << "\n";
+    s << "# HELP vons_transfer_late_frames_total Packets finished after their frame deadline.\n";
+    s << "# TYPE vons_transfer_late_frames_total counter\n";
+    s << "vons_transfer_late_frames_total " << this->late_frames.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_link_credit_wait_seconds_total Time spent waiting for the receiver to report free buffer slots.\n";
+    s << "# TYPE vons_link_credit_wait_seconds_total counter\n";
+    s << "vons_link_credit_wait_seconds_total " << this->credit_wait_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+    s << "# HELP vons_link_credit_timeouts_total Times no credit arrived in time and a probe packet was sent.\n";
+    s << "# TYPE vons_link_credit_timeouts_total counter\n";
+    s << "vons_link_credit_timeouts_total " << this->credit_timeouts.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_link_rx_errors_total Frames from the receiver dropped for a bad CRC.\n";
+    s << "# TYPE vons_link_rx_errors_total counter\n";
+    s << "vons_link_rx_errors_total " << this->link_rx_errors.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_seeks_total Seeks that reached the output.\n";
+    s << "# TYPE vons_seeks_total counter\n";
+    s << "vons_seeks_total " << this->seeks.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_seek_latency_seconds_total Time from seek request to the first packet from the new position being written.\n";
+    s << "# TYPE vons_seek_latency_seconds_total counter\n";
+    s << "vons_seek_latency_seconds_total " << this->seek_latency_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+    s << "# HELP vons_seek_latency_seconds_max Slowest seek so far.\n";
+    s << "# TYPE vons_seek_latency_seconds_max gauge\n";
+    s << "vons_seek_latency_seconds_max " << this->seek_latency_ns_max.load(std::memory_order_relaxed) / 1e9 << "\n";
+    s << "# HELP vons_transfer_wakeup_latency_seconds How late the transfer thread woke up for each frame period.\n";
+    s << "# TYPE vons_transfer_wakeup_latency_seconds histogram\n";
+    uint64_t cumulative = 0;
+    for (int i = 0; i < METRICS_WAKEUP_BUCKETS; i++)
+    {
+        cumulative += this->wakeup_buckets[i].load(std::memory_order_relaxed);
+        s << "vons_transfer_wakeup_latency_seconds_bucket{le=\"" << wakeup_bounds_ns[i] / 1e9 << "\"} " << cumulative << "\n";
+    }
+    cumulative += this->wakeup_buckets[METRICS_WAKEUP_BUCKETS].load(std::memory_order_relaxed);
+    s << "vons_transfer_wakeup_latency_seconds_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    s << "vons_transfer_wakeup_latency_seconds_sum " << this->wakeup_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+    s << "vons_transfer_wakeup_latency_seconds_count " << this->wakeups.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_latency_seconds Time from a video frame arriving at the input to its packet being written.\n";
+    s << "# TYPE vons_latency_seconds summary\n";
+    s << "vons_latency_seconds_sum " << this->latency_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+    s << "vons_latency_seconds_count " << this->latency_samples.load(std::memory_order_relaxed) << "\n";
+    s << "# HELP vons_latency_seconds_max Largest end-to-end latency observed.\n";
+    s << "# TYPE vons_latency_seconds_max gauge\n";
+    s << "vons_latency_seconds_max " << this->latency_ns_max.load(std::memory_order_relaxed) / 1e9 << "\n";
+    s << "# HELP vons_latency_seconds_last End-to-end latency of the most recent frame.\n";
+    s << "# TYPE vons_latency_seconds_last gauge\n";
+    s << "vons_latency_seconds_last " << this->latency_ns_last.load(std::memory_order_relaxed) / 1e9 << "\n";
+    out = s.str();
+}
+
+/**
+ * @brief Construct a new metrics server::metrics server object
+ *
+ * @param source 指标来源
+ * @param socket_path Unix域套接字路径
+ */
+metrics_server::metrics_server(metrics &source, const char *socket_path) : source(source)
+{
+    this->socket_path   = socket_path;
+    this->listen_fd     = -1;
+    this->stop_flag     = 0;
+}
+
+/**
+ * @brief Destroy the metrics server::metrics server object
+ *
+ */
+metrics_server::~metrics_server()
+{
+    this->stop();
+}
+
+/**
+ * @brief 创建套接字并启动服务线程
+ *
+ */
+void metrics_server::start()
+{
+    struct sockaddr_un addr;
+    if (this->socket_path.size() >= sizeof(addr.sun_path))
+    {
+        std::ios_base::failure ex("Metrics socket path too long!");
+        throw ex;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, this->socket_path.c_str());
+
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->listen_fd < 0)
+    {
+        std::ios_base::failure ex("Unable to create metrics socket!");
+        throw ex;
+    }
+    unlink(this->socket_path.c_str()); // 清理上次运行残留的套接字文件
+    if (bind(this->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(this->listen_fd, 4) < 0)
+    {
+        std::ios_base::failure ex("Unable to bind metrics socket!");
+        close(this->listen_fd);
+        this->listen_fd = -1;
+        throw ex;
+    }
+    this->stop_flag = 0;
+    this->serve_thread = std::thread(&metrics_server::serve, this);
+}
+
+/**
+ * @brief 停止服务线程并删除套接字
+ *
+ */
+void metrics_server::stop()
+{
+    if (this->listen_fd < 0)
+        return;
+    this->stop_flag = 1;
+    if (this->serve_thread.joinable())
+        this->serve_thread.join();
+    close(this->listen_fd);
+    unlink(this->socket_path.c_str());
+    this->listen_fd = -1;
+}
+
+/**
+ * @brief 服务线程，每个连接输出一次全部指标后关闭（私有方法）
+ *
+ */
+void metrics_server::serve()
+{
+    std::string body;
+    while (this->stop_flag == 0)
+    {
+        struct pollfd pfd = {this->listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, METRICS_POLL_INTERVAL_MS) <= 0)
+            continue;
+        int client = accept4(this->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+
+        // HTTP客户端（如curl --unix-socket）会先发请求，此时带上响应头；直接读取的客户端只收到指标文本
+        char request[512];
+        int is_http = 0;
+        struct pollfd cfd = {client, POLLIN, 0};
+        if (poll(&cfd, 1, METRICS_REQUEST_WAIT_MS) > 0)
+        {
+            ssize_t n = recv(client, request, sizeof(request), MSG_DONTWAIT);
+            is_http = (n >= 4 && memcmp(request, "GET ", 4) == 0);
+        }
+
+        this->source.render(body);
+        if (is_http)
+        {
+            body = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        }
+        size_t sent = 0;
+        while (sent < body.size())
+        {
+            ssize_t n = send(client, body.data() + sent, body.size() - sent, MSG_NOSIGNAL); // 客户端提前断开时不触发SIGPIPE
+            if (n <= 0)
+                break;
+            sent += n;
+        }
+        close(client);
+    }
+}
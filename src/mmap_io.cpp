@@ -0,0 +1,161 @@
+#include "serial_video/mmap_io.hpp"
+
+#include <cstring>
+#include <fstream> //for std::ios_base::failure
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern "C"
+{
+#include <libavutil/mem.h>
+#include <libavutil/error.h>
+};
+
+/**
+ * @brief Construct a new mmap_io::mmap_io object，映射整个文件
+ *
+ * @param path 本地文件路径
+ */
+mmap_io::mmap_io(const char *path)
+{
+    struct stat statbuf;
+    uint8_t *buffer = NULL;
+
+    this->path          = path;
+    this->data          = NULL;
+    this->size          = 0;
+    this->pos           = 0;
+    this->ctx           = NULL;
+    this->read_calls    = 0;
+    this->fd            = open(path, O_RDONLY | O_CLOEXEC);
+    if (this->fd < 0)
+    {
+        std::ios_base::failure ex("Unable to open media file!");
+        throw ex;
+    }
+    if (fstat(this->fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode))
+    {
+        close(this->fd);
+        std::ios_base::failure ex("Media file is not a regular file!");
+        throw ex;
+    }
+    this->size = statbuf.st_size;
+    if (this->size > 0)
+    {
+        this->data = (uint8_t *)mmap(NULL, this->size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if (this->data == MAP_FAILED)
+        {
+            close(this->fd);
+            std::ios_base::failure ex("Unable to map media file!");
+            throw ex;
+        }
+        madvise(this->data, this->size, MADV_SEQUENTIAL); // 顺序访问，内核加大预读并及早回收已读页
+    }
+
+    buffer = (uint8_t *)av_malloc(MMAP_IO_BUFFER_SIZE);
+    if (buffer != NULL)
+        this->ctx = avio_alloc_context(buffer, MMAP_IO_BUFFER_SIZE, 0, this, mmap_io::read_packet, NULL, mmap_io::seek);
+    if (this->ctx == NULL)
+    {
+        av_free(buffer);
+        if (this->data != NULL)
+            munmap(this->data, this->size);
+        close(this->fd);
+        std::ios_base::failure ex("Unable to allocate IO context!");
+        throw ex;
+    }
+}
+
+/**
+ * @brief Destroy the mmap_io::mmap_io object
+ *
+ */
+mmap_io::~mmap_io()
+{
+    if (this->ctx != NULL)
+    {
+        av_freep(&this->ctx->buffer); // 缓冲区可能已被libav重新分配，以上下文中的为准
+        avio_context_free(&this->ctx);
+    }
+    if (this->data != NULL)
+        munmap(this->data, this->size);
+    close(this->fd);
+}
+
+/**
+ * @brief 获取IO上下文，交给AVFormatContext::pb（需要同时置AVFMT_FLAG_CUSTOM_IO）
+ *
+ * @return AVIOContext* IO上下文，由本对象释放
+ */
+AVIOContext *mmap_io::get_context(void)
+{
+    return this->ctx;
+}
+
+/**
+ * @brief 获取读取回调被调用的次数（对应默认file协议下的read系统调用次数）
+ *
+ * @return uint64_t 次数
+ */
+uint64_t mmap_io::get_read_calls(void)
+{
+    return this->read_calls;
+}
+
+/**
+ * @brief 读取回调，从映射区复制数据
+ *
+ * @param opaque mmap_io对象
+ * @param buf 目标缓冲区
+ * @param buf_size 最多读取的字节数
+ * @return int 读取的字节数，文件结束时返回AVERROR_EOF
+ */
+int mmap_io::read_packet(void *opaque, uint8_t *buf, int buf_size)
+{
+    mmap_io *io = (mmap_io *)opaque;
+    io->read_calls++;
+    if (io->pos >= io->size)
+        return AVERROR_EOF;
+    size_t n = io->size - io->pos;
+    if (n > (size_t)buf_size)
+        n = buf_size;
+    memcpy(buf, io->data + io->pos, n);
+    io->pos += n;
+    return n;
+}
+
+/**
+ * @brief 定位回调
+ *
+ * @param opaque mmap_io对象
+ * @param offset 偏移
+ * @param whence SEEK_SET/SEEK_CUR/SEEK_END或AVSEEK_SIZE
+ * @return int64_t 新位置，AVSEEK_SIZE时返回文件大小
+ */
+int64_t mmap_io::seek(void *opaque, int64_t offset, int whence)
+{
+    mmap_io *io = (mmap_io *)opaque;
+    int64_t target;
+    switch (whence & ~AVSEEK_FORCE)
+    {
+    case AVSEEK_SIZE:
+        return io->size;
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = io->pos + offset;
+        break;
+    case SEEK_END:
+        target = io->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (target < 0 || (uint64_t)target > io->size)
+        return AVERROR(EINVAL);
+    io->pos = target;
+    return target;
+}
@@ -0,0 +1,677 @@
+#include "serial_video/pipeline.hpp"
+#include "serial_video/avdecoder.hpp"
+#include "serial_video/gray2bw.hpp"
+#include "serial_video/rgb565.hpp"
+#include "serial_video/fft.hpp"
+#include "serial_video/transfer.hpp"
+#include "serial_video/sink.hpp"
+#include "serial_video/bus.hpp"
+#include "serial_video/thread_pool.hpp"
+#include "serial_video/realtime.hpp"
+#include "serial_video/executor.hpp"
+#include "serial_video/shm_ring.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * @brief Construct a new pipeline::pipeline object
+ *
+ * @param config 流水线参数
+ * @param pool 运行各阶段的线程池，为NULL时使用自己的线程池
+ */
+pipeline::pipeline(const pipeline_config &config, thread_pool *pool) : config(config)
+{
+    if (config.baudrate <= 0)
+    {
+        std::invalid_argument ex("Invalid baudrate!");
+        throw ex;
+    }
+    if (pool == NULL)
+    {
+        this->own_pool.reset(new thread_pool());
+        pool = this->own_pool.get();
+    }
+    this->pool              = pool;
+    this->decode_done       = 0;
+    this->gray_done         = 0;
+    this->fft_done          = 0;
+    this->item_done         = 0;
+    this->epoch             = 0;
+    this->audio_queue_limit = AUDIO_QUEUE_LENGTH_MAX;
+    this->playing           = NULL;
+    this->coop              = NULL;
+    this->paused            = 0;
+    this->rate              = 1;
+    this->started           = 0;
+    this->running_stages    = 0;
+    this->stop_requested    = 0;
+}
+
+/**
+ * @brief Destroy the pipeline::pipeline object，停止并等待所有阶段退出
+ *
+ */
+pipeline::~pipeline()
+{
+    this->stop();
+    try
+    {
+        this->wait();
+    }
+    catch (...)
+    {
+    }
+}
+
+/**
+ * @brief 打开输入，创建各阶段并提交到线程池运行，立即返回
+ *
+ */
+void pipeline::start(void)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->state_lock);
+        if (this->started)
+        {
+            std::logic_error ex("Pipeline already started!");
+            throw ex;
+        }
+        this->started = 1;
+    }
+
+    double framerate;
+    int has_audio, video_width, video_height;
+    if (this->config.input_media.compare(0, strlen(SHM_RING_PREFIX), SHM_RING_PREFIX) == 0) // 外部渲染程序的帧直接送入gray2bw，不经过libav
+    {
+        if (this->config.color || !this->config.playlist.empty())
+        {
+            std::invalid_argument ex("Shared memory input supports neither color output nor playlists!");
+            throw ex;
+        }
+        this->shm.reset(new shm_reader(this->config.input_media.substr(strlen(SHM_RING_PREFIX))));
+        this->shm->set_metrics(&this->stats);
+        this->shm->open();
+        framerate       = this->shm->get_video_framerate();
+        has_audio       = 0;
+        video_width     = this->shm->get_video_width();
+        video_height    = this->shm->get_video_height();
+        if (this->config.timer != NULL)
+            this->config.timer->mark("input opened");
+    }
+    else
+    {
+        this->av.reset(this->open_decoder(this->config.input_media, 1));
+        framerate       = this->av->get_video_framerate();
+        has_audio       = this->av->get_audio_samplerate() > 0; // 原始视频输入没有音频
+        video_width     = this->av->get_video_width();
+        video_height    = this->av->get_video_height();
+    }
+    if (framerate <= 0)
+    {
+        std::invalid_argument ex("Unable to determine video framerate, specify it as an input option!");
+        throw ex;
+    }
+    int live = this->config.live || this->shm; // 共享内存输入总是实时的
+    int frame_size;
+    if (this->config.color) // 解码器已缩放到屏幕尺寸
+    {
+        this->color.reset(new rgb565(video_width, video_height));
+        this->color->set_startup_timer(this->config.timer);
+        this->color->set_metrics(&this->stats);
+        this->color->set_tracer(this->config.trace);
+        this->color->set_epoch(&this->epoch);
+        this->color->set_dither(this->config.color_dither);
+        frame_size = this->color->get_frame_size();
+    }
+    else
+    {
+        this->gray.reset(new gray2bw(video_width, video_height, this->config.screen_width, this->config.screen_height));
+        this->gray->set_startup_timer(this->config.timer);
+        this->gray->set_metrics(&this->stats);
+        this->gray->set_tracer(this->config.trace);
+        this->gray->set_epoch(&this->epoch);
+        this->gray->set_hysteresis(this->config.dither_hysteresis);
+        frame_size = this->gray->get_frame_size();
+    }
+    if (has_audio)
+    {
+        this->freq.reset(new fft(this->av->get_audio_samplerate(), framerate, this->config.audio_threshold));
+        this->freq->set_wisdom_dir(this->config.wisdom_dir);
+        this->freq->set_startup_timer(this->config.timer);
+        this->freq->set_metrics(&this->stats);
+        this->freq->set_tracer(this->config.trace);
+        this->freq->set_epoch(&this->epoch);
+        if (this->config.unpaced && !live && this->config.executor_threads == 0) // 离线渲染：解码器远远领先，让音频积压到一批再变换
+        {
+            this->freq->set_batch(1);
+            this->audio_queue_limit = (size_t)FFT_BATCH_WINDOWS * this->freq->get_window_length() * 2 * sizeof(uint16_t);
+            this->av->set_audio_queue_limit(this->audio_queue_limit);
+        }
+    }
+    sink_params output_params;
+    output_params.baudrate = this->config.baudrate;
+    output_params.framerate = framerate;
+    output_params.screen_width = this->config.screen_width;
+    output_params.screen_height = this->config.screen_height;
+    output_params.receive = this->config.link_protocol == LINK_PROTOCOL_CREDIT;
+    output_params.color = this->config.color;
+    sink *out;
+    if (this->config.shared_bus != NULL) // 输出端由总线持有
+        out = this->config.shared_bus->attach(this->config.link_addr, framerate);
+    else
+    {
+        this->output.reset(sink::create(this->config.output_device, output_params));
+        out = this->output.get();
+    }
+    this->trans.reset(new transfer(this->config.output_device.c_str(), this->config.baudrate, framerate, frame_size, 1));
+    this->trans->set_sink(out);
+    this->trans->set_paced(!this->config.unpaced);
+    this->trans->set_protocol(this->config.link_protocol, this->config.link_addr);
+    this->trans->set_rate_control(this->config.rate_control);
+    this->trans->set_link_share(this->config.link_share);
+    if (this->config.color)
+        this->trans->set_dirty_rects(this->config.screen_width, this->config.screen_height);
+    this->trans->set_startup_timer(this->config.timer);
+    this->trans->set_metrics(&this->stats);
+    this->trans->set_tracer(this->config.trace);
+    this->trans->set_audio_enabled(has_audio);
+    this->trans->set_epoch(&this->epoch);
+    double link_fps = this->config.baudrate / 10.0 * this->config.link_share / this->trans->get_packet_size(); // 8N1下线路（本路的份额）能承载的最大帧率
+    if (out->is_serial() && !this->config.unpaced && !this->config.rate_control && !(this->config.color && this->config.link_protocol != LINK_PROTOCOL_RAW) && framerate > link_fps) // 码率控制时按线路能力编码，脏矩形只发送变化
+        std::cerr << "Warning: " << this->config.baudrate << " baud carries at most " << link_fps << " fps of " << this->trans->get_packet_size() << "-byte packets, video is " << framerate << " fps (measure the real rate with --probe)" << std::endl;
+    if (live) // 每级队列只留一帧，避免积压造成延迟
+    {
+        if (this->color)
+            this->color->set_queue_limit(frame_size);
+        else
+            this->gray->set_queue_limit(frame_size);
+        if (has_audio)
+            this->freq->set_queue_limit(PIPELINE_LIVE_AUDIO_FRAMES);
+        if (this->av)
+        {
+            size_t video_frame_size = this->av->get_video_frame_size();
+            this->av->set_queue_limit(video_frame_size);
+            this->av_video.reserve(video_frame_size * 2); // 写入前队列可能还差一个字节不满一帧
+        }
+    }
+    // 各队列按上限预先分配（未满上限时才写入，所以最多再多一帧），稳定运行时不再扩容；
+    // 非实时模式下解码队列上限很大，由预热阶段按需扩容
+    this->gray_video.reserve((live ? frame_size : (this->color ? RGB565_QUEUE_LENGTH_MAX : BW_QUEUE_LENGTH_MAX)) + frame_size);
+    if (has_audio)
+    {
+        this->av_audio.reserve(this->audio_queue_limit / sizeof(uint16_t) + (size_t)this->av->get_audio_samplerate());
+        this->fft_audio.reserve((live ? PIPELINE_LIVE_AUDIO_FRAMES : FFT_QUEUE_LENGTH_MAX) + FFT_BATCH_WINDOWS);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(this->state_lock);
+        this->running_stages = (this->config.executor_threads > 0 || this->shm) ? 2 : (has_audio ? 4 : 3);
+        this->playing = this->av.get(); // 共享内存输入不能跳转
+    }
+    if (!has_audio)
+        this->fft_done = 1;
+    if (this->shm) // 读取和转换在同一个线程中，帧不经过解码队列；decode_done只作为终止标志
+        this->pool->submit([this] { this->run_stage(&pipeline::run_shm, &this->gray_done, "gray2bw", this->config.gray_cpus, 0); });
+    else
+        this->pool->submit([this] { this->run_stage(&pipeline::run_decoder, &this->decode_done, "decoder", this->config.decoder_cpus, 0); });
+    if (this->config.executor_threads > 0) // 解码器（或共享内存的读取）仍占一个线程（libav的调用和futex等待会阻塞），其余阶段共用执行器
+    {
+        this->pool->submit([this] { this->run_stage(&pipeline::run_cooperative, NULL, "executor", this->config.transfer_cpus, this->config.transfer_priority); });
+        return;
+    }
+    if (!this->shm)
+        this->pool->submit([this] { this->run_stage(&pipeline::run_gray, &this->gray_done, this->color ? "rgb565" : "gray2bw", this->config.gray_cpus, 0); });
+    if (has_audio)
+        this->pool->submit([this] { this->run_stage(&pipeline::run_fft, &this->fft_done, "fft", this->config.fft_cpus, 0); });
+    this->pool->submit([this] { this->run_stage(&pipeline::run_transfer, NULL, "transfer", this->config.transfer_cpus, this->config.transfer_priority); });
+}
+
+/**
+ * @brief 请求停止，立即返回，已缓冲的数据将被丢弃
+ *
+ */
+void pipeline::stop(void)
+{
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    this->stop_requested = 1;
+    this->item_done = 1;   // 播放列表中的当前一项也要停下
+    if (this->trans)
+        this->trans->set_paused(0); // 暂停中的传输阶段也要能看到终止
+    this->decode_done = 1; // 解码器在读取下一个数据包前检查此标志，下游随之逐级退出
+    if (this->coop != NULL)
+        this->coop->wake();
+    this->state_changed.notify_all();
+}
+
+/**
+ * @brief 等待所有阶段退出，若有阶段失败则重新抛出其异常
+ *
+ */
+void pipeline::wait(void)
+{
+    std::unique_lock<std::mutex> guard(this->state_lock);
+    while (this->running_stages > 0)
+    {
+        if (this->stop_requested)
+        {
+            // 清空队列，使阻塞在队列上的阶段尽快看到终止标志
+            guard.unlock();
+            this->drain();
+            guard.lock();
+        }
+        this->state_changed.wait_for(guard, std::chrono::milliseconds(1));
+    }
+    if (this->failure)
+    {
+        std::exception_ptr ex = this->failure;
+        this->failure = NULL;
+        std::rethrow_exception(ex);
+    }
+}
+
+/**
+ * @brief 查询是否还有阶段在运行
+ *
+ * @return int 运行中返回1
+ */
+int pipeline::is_running(void)
+{
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    return this->running_stages > 0;
+}
+
+/**
+ * @brief 获取输入视频帧率（即数据包发送速率）
+ *
+ * @return double 帧率，未启动时返回-1
+ */
+double pipeline::get_video_framerate(void)
+{
+    if (this->shm != NULL)
+        return this->shm->get_video_framerate();
+    if (this->av == NULL)
+        return -1;
+    return this->av->get_video_framerate();
+}
+
+/**
+ * @brief 获取本流水线的运行指标
+ *
+ * @return metrics& 指标
+ */
+metrics &pipeline::get_metrics(void)
+{
+    return this->stats;
+}
+
+/**
+ * @brief 暂停或继续输出（串口保持打开，上游各阶段随队列写满而阻塞）
+ *
+ * @param paused 为1时暂停
+ * @return int 成功返回0，未启动时返回-1
+ */
+int pipeline::pause(int paused)
+{
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    if (!this->trans || this->stop_requested)
+        return -1;
+    this->trans->set_paused(paused);
+    this->paused = paused;
+    return 0;
+}
+
+/**
+ * @brief 设置播放速度（只改变数据包的发送间隔，不丢帧）
+ *
+ * @param rate 倍率，1为原速
+ * @return int 成功返回0，未启动或倍率无效时返回-1
+ */
+int pipeline::set_rate(double rate)
+{
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    if (!this->trans || rate <= 0)
+        return -1;
+    this->trans->set_rate(rate);
+    this->rate = rate;
+    return 0;
+}
+
+/**
+ * @brief 跳转到当前一项的指定位置，立即返回
+ *
+ * 持有全部队列锁时请求跳转、清空队列并推进纪元：此前解码的帧在写入队列前被解码线程丢弃，
+ * 各阶段处理到一半的旧数据在输出前因纪元改变而丢弃，所以之后写出的第一个数据包就来自新位置。
+ * 解码线程从目标之前的关键帧解码到目标为止，延迟记入指标（vons_seek_latency_seconds_*）
+ *
+ * @param seconds 目标位置（秒，相对于当前一项的开头）
+ * @return int 成功返回0，没有正在解码的项（已播完或未启动）时返回-1
+ */
+int pipeline::seek(double seconds)
+{
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    if (this->playing == NULL || this->stop_requested || seconds < 0)
+        return -1;
+    metrics::set(this->stats.seek_begin_ns, metrics::now_ns());
+    std::lock_guard<std::mutex> vg(this->av_video_lock);
+    std::lock_guard<std::mutex> ag(this->av_audio_lock);
+    std::lock_guard<std::mutex> gg(this->gray_video_lock);
+    std::lock_guard<std::mutex> fg(this->fft_audio_lock);
+    this->playing->request_seek(seconds);
+    this->epoch++;
+    this->av_video.clear();
+    this->av_audio.clear();
+    this->gray_video.clear();
+    this->fft_audio.clear();
+    return 0;
+}
+
+/**
+ * @brief 查询是否已暂停
+ *
+ * @return int 暂停时返回1
+ */
+int pipeline::is_paused(void)
+{
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    return this->paused;
+}
+
+/**
+ * @brief 获取播放速度
+ *
+ * @return double 倍率
+ */
+double pipeline::get_rate(void)
+{
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    return this->rate;
+}
+
+/**
+ * @brief 在线程池中运行一个阶段，记录异常并保证完成标志被置位
+ *
+ * @param body 阶段主体
+ * @param done_flag 阶段完成标志，下游据此退出
+ * @param name 阶段名称（用于警告信息）
+ * @param cpus 绑定的CPU，为空时不绑定
+ * @param priority SCHED_FIFO优先级，为0时不修改
+ */
+void pipeline::run_stage(void (pipeline::*body)(void), std::atomic<int> *done_flag, const char *name, const std::vector<int> &cpus, int priority)
+{
+    std::exception_ptr ex = NULL;
+    {
+        realtime rt; // 阶段结束后恢复线程设置，线程池中的线程还要给别的任务用
+        int ret;
+        if ((ret = rt.pin(cpus)) != 0)
+            std::cerr << "Warning: unable to pin " << name << " to CPUs: " << strerror(ret) << std::endl;
+        if ((ret = rt.set_fifo(priority)) != 0)
+            std::cerr << "Warning: unable to run " << name << " with SCHED_FIFO priority " << priority << ": " << strerror(ret) << std::endl;
+        if (this->config.prefault)
+            realtime::prefault_stack();
+        try
+        {
+            (this->*body)();
+        }
+        catch (...)
+        {
+            ex = std::current_exception();
+        }
+    }
+    if (done_flag != NULL)
+        *done_flag = 1;
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    if (ex)
+    {
+        if (!this->failure)
+            this->failure = ex;
+        this->stop_requested = 1; // 一个阶段失败，其余阶段也停下
+        this->item_done = 1;
+        this->decode_done = 1;
+    }
+    if (this->coop != NULL) // 解码（或共享内存读取）阶段结束，执行器中的任务要看到终止标志
+        this->coop->wake();
+    this->running_stages--;
+    this->state_changed.notify_all();
+}
+
+/**
+ * @brief 创建、配置并打开一个解码器
+ *
+ * @param media 输入媒体
+ * @param first 为1时是第一项，输出格式由它决定；否则统一为第一项的格式
+ * @return avdecoder* 已打开的解码器，由调用者释放
+ */
+avdecoder *pipeline::open_decoder(const std::string &media, int first)
+{
+    std::unique_ptr<avdecoder> decoder(new avdecoder(media));
+    decoder->set_audio_samplerate(this->config.audio_samplerate);
+    decoder->set_probe_limit(this->config.probesize, this->config.analyze_duration);
+    decoder->set_startup_timer(first ? this->config.timer : NULL);
+    decoder->set_metrics(&this->stats);
+    decoder->set_tracer(this->config.trace);
+    decoder->set_live(this->config.live);
+    decoder->set_mmap_io(this->config.mmap_io);
+    decoder->set_interrupt_flag(&this->decode_done); // stop后不再阻塞在打开或读取输入上
+    decoder->set_input_format(this->config.input_format);
+    for (auto &opt : this->config.input_options)
+        decoder->set_input_option(opt.first, opt.second);
+    if (!first)
+    {
+        int samplerate = this->av->get_audio_samplerate() > 0 ? (int)this->av->get_audio_samplerate() : 0;
+        decoder->set_audio_enabled(samplerate > 0); // 第一项没有音频时FFT阶段不存在，后续项的音频无处可去
+        decoder->set_output_format(this->av->get_video_width(), this->av->get_video_height(), this->av->get_video_framerate(), samplerate);
+        decoder->set_queue_limit(this->config.live ? (size_t)this->av->get_video_frame_size() : VIDEO_QUEUE_LENGTH_MAX);
+        decoder->set_audio_queue_limit(this->audio_queue_limit);
+    }
+    else if (this->config.color) // 彩色输出由swscale直接缩放到屏幕尺寸
+        decoder->set_output_format(this->config.screen_width, this->config.screen_height, 0, 0);
+    if (this->config.color)
+        decoder->set_pixel_format(AV_PIX_FMT_RGB24);
+    decoder->open();
+    return decoder.release();
+}
+
+/**
+ * @brief 播放列表切换时补齐或截掉音频，使下一项的第一帧视频与其音频对齐（FFT按帧率切分音频样本）
+ *
+ * @param finished 刚结束的一项
+ * @param next 下一项，尚未开始解码
+ */
+void pipeline::align_audio(avdecoder *finished, avdecoder *next)
+{
+    double samplerate = this->av->get_audio_samplerate();
+    if (samplerate <= 0)
+        return;
+    int64_t expected = (int64_t)(finished->get_video_frames_out() * samplerate / this->av->get_video_framerate());
+    int64_t missing = expected - finished->get_audio_samples_out();
+    if (missing < 0)
+    {
+        next->set_audio_skip(-missing); // 音频比视频长，从下一项开头扣除
+        return;
+    }
+    std::lock_guard<std::mutex> guard(this->av_audio_lock);
+    for (int64_t i = 0; i < missing; i++)
+        this->av_audio.push(0); // 音频比视频短（或没有音频），补静音
+}
+
+/**
+ * @brief 解码阶段：依次解码播放列表中的各项，播放当前一项时在后台打开下一项，
+ * 切换时下游各阶段、输出端和队列都保持不变，数据包节奏不中断
+ *
+ */
+void pipeline::run_decoder(void)
+{
+    std::unique_ptr<avdecoder> current;
+    size_t next_index = 0;
+    while (1)
+    {
+        std::unique_ptr<avdecoder> next;
+        std::thread opener;
+        auto open_next = [&] { // 在后台打开列表中的下一项
+            const std::string media = this->config.playlist[next_index++];
+            opener = std::thread([this, &next, media] {
+                try
+                {
+                    next.reset(this->open_decoder(media, 0));
+                }
+                catch (std::exception &e)
+                {
+                    std::cerr << "Warning: skipping " << media << ": " << e.what() << std::endl;
+                }
+            });
+        };
+        if (next_index < this->config.playlist.size())
+            open_next();
+        avdecoder *playing = current ? current.get() : this->av.get();
+        try
+        {
+            playing->streamed_decode(this->av_video, this->av_video_lock, this->av_audio, this->av_audio_lock, this->item_done);
+        }
+        catch (...)
+        {
+            if (opener.joinable())
+                opener.join(); // 后台线程引用本轮的next，必须在离开本轮之前结束
+            throw;
+        }
+        while (opener.joinable())
+        {
+            opener.join();
+            if (next || next_index >= this->config.playlist.size())
+                continue;
+            {
+                std::lock_guard<std::mutex> guard(this->state_lock);
+                if (this->stop_requested)
+                    continue;
+            }
+            open_next(); // 下一项打不开，接着打开再下一项（只有这时才会出现间隙）
+        }
+        {
+            std::lock_guard<std::mutex> guard(this->state_lock);
+            if (this->stop_requested || !next)
+            {
+                this->playing = NULL;
+                break;
+            }
+            this->item_done = 0;
+            this->playing = next.get();
+        }
+        this->align_audio(playing, next.get());
+        current = std::move(next); // 第一项（this->av）保留，其输出格式是后续各项的基准
+    }
+}
+
+void pipeline::run_gray(void)
+{
+    if (this->color)
+        this->color->streamed_convert(this->av_video, this->av_video_lock, this->gray_video, this->gray_video_lock, this->decode_done, this->gray_done);
+    else
+        this->gray->streamed_convert(this->av_video, this->av_video_lock, this->gray_video, this->gray_video_lock, this->decode_done, this->gray_done);
+}
+
+void pipeline::run_shm(void)
+{
+    this->gray->streamed_convert(*this->shm, this->gray_video, this->gray_video_lock, this->decode_done, this->gray_done);
+}
+
+void pipeline::run_fft(void)
+{
+    this->freq->streamed_calculate(this->av_audio, this->av_audio_lock, this->fft_audio, this->fft_audio_lock, this->decode_done, this->fft_done);
+}
+
+void pipeline::run_transfer(void)
+{
+    this->trans->streamed_start(this->gray_video, this->gray_video_lock, this->fft_audio, this->fft_audio_lock, this->gray_done, this->fft_done);
+}
+
+/**
+ * @brief 协作式执行：gray2bw、FFT和传输作为任务在config.executor_threads个线程上轮流运行，
+ * 在队列空、满和节奏定时器上挂起而不是各占一个线程轮询
+ *
+ */
+void pipeline::run_cooperative(void)
+{
+    executor exec(this->config.executor_threads);
+    exec.set_thread_runner([this](const std::function<void(void)> &body) { // 额外线程与调用线程（由run_stage设置）使用相同的CPU和优先级
+        realtime rt;
+        int ret;
+        if ((ret = rt.pin(this->config.transfer_cpus)) != 0)
+            std::cerr << "Warning: unable to pin executor to CPUs: " << strerror(ret) << std::endl;
+        if ((ret = rt.set_fifo(this->config.transfer_priority)) != 0)
+            std::cerr << "Warning: unable to run executor with SCHED_FIFO priority " << this->config.transfer_priority << ": " << strerror(ret) << std::endl;
+        if (this->config.prefault)
+            realtime::prefault_stack();
+        body();
+    });
+    if (!this->shm) // 共享内存输入的转换在读取线程中进行
+    {
+        exec.add([this](std::chrono::steady_clock::time_point &) {
+            if (this->color)
+                return this->color->resume_convert(this->av_video, this->av_video_lock, this->gray_video, this->gray_video_lock, this->decode_done, this->gray_done);
+            return this->gray->resume_convert(this->av_video, this->av_video_lock, this->gray_video, this->gray_video_lock, this->decode_done, this->gray_done);
+        });
+    }
+    if (this->freq)
+    {
+        exec.add([this](std::chrono::steady_clock::time_point &) {
+            return this->freq->resume_calculate(this->av_audio, this->av_audio_lock, this->fft_audio, this->fft_audio_lock, this->decode_done, this->fft_done);
+        });
+    }
+    exec.add([this](std::chrono::steady_clock::time_point &wakeup) {
+        return this->trans->resume_start(this->gray_video, this->gray_video_lock, this->fft_audio, this->fft_audio_lock, this->gray_done, this->fft_done, wakeup);
+    });
+    this->set_queue_notify(&exec);
+    try
+    {
+        exec.run();
+    }
+    catch (...)
+    {
+        this->set_queue_notify(NULL);
+        this->gray_done = 1; // 失败时未结束的任务不会再被恢复
+        this->fft_done = 1;
+        throw;
+    }
+    this->set_queue_notify(NULL);
+}
+
+/**
+ * @brief 丢弃所有队列中的数据
+ *
+ */
+void pipeline::drain(void)
+{
+    std::lock_guard<std::mutex> vg(this->av_video_lock);
+    std::lock_guard<std::mutex> ag(this->av_audio_lock);
+    std::lock_guard<std::mutex> gg(this->gray_video_lock);
+    std::lock_guard<std::mutex> fg(this->fft_audio_lock);
+    this->av_video.clear();
+    this->av_audio.clear();
+    this->gray_video.clear();
+    this->fft_audio.clear();
+}
+
+/**
+ * @brief 设置各队列的通知回调，使执行器中挂起的任务在队列改变时被唤醒（私有方法）
+ *
+ * @param exec 执行器，为NULL时取消通知（执行器退出后解码器可能仍在写入队列）
+ */
+void pipeline::set_queue_notify(executor *exec)
+{
+    {
+        std::lock_guard<std::mutex> vg(this->av_video_lock);
+        std::lock_guard<std::mutex> ag(this->av_audio_lock);
+        std::lock_guard<std::mutex> gg(this->gray_video_lock);
+        std::lock_guard<std::mutex> fg(this->fft_audio_lock);
+        void (*notify)(void *) = exec != NULL ? &executor::notify : NULL;
+        this->av_video.set_notify(notify, exec);
+        this->av_audio.set_notify(notify, exec);
+        this->gray_video.set_notify(notify, exec);
+        this->fft_audio.set_notify(notify, exec);
+    }
+    std::lock_guard<std::mutex> guard(this->state_lock);
+    this->coop = exec;
+}
@@ -0,0 +1,303 @@
+#include "serial_video/rate_control.hpp"
+#include "serial_video/link_protocol.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @brief Construct a new rate control::rate control object
+ *
+ * @param frame_size 视频帧大小（字节）
+ */
+rate_control::rate_control(size_t frame_size)
+{
+    if (frame_size == 0 || frame_size > 0xFFFF)
+    {
+        std::invalid_argument ex("frame_size out of range!");
+        throw ex;
+    }
+    this->frame_size = frame_size;
+    this->reference.resize(frame_size);
+    this->output.resize(frame_size + 1);
+    this->rle.resize(frame_size + 1);
+    this->delta.resize(frame_size + 1);
+    this->reset();
+}
+
+/**
+ * @brief 编码一个数据包的负载，预先分配了全部缓冲区，运行时不再分配
+ *
+ * @param packet 视频帧+音频字节
+ * @param budget 本帧的字节预算（含帧头和CRC）
+ * @param type 选择的帧类型
+ * @return size_t 负载长度，负载由get_output获取
+ */
+size_t rate_control::encode(const uint8_t *packet, double budget, uint8_t &type)
+{
+    const size_t fs = this->frame_size;
+    this->balance = std::min(this->balance + budget, budget * RATE_CARRY_FRAMES);
+    double avail = this->balance - LINK_OVERHEAD - 1; // 音频字节总要发送
+    int key = !this->synced || this->since_key >= RATE_KEYFRAME_INTERVAL;
+
+    // 无损的候选：全帧、RLE（比全帧短时）、变化段（有参考帧时）
+    size_t rle_size = encode_rle(packet, fs, this->rle.data() + 1, fs - 1);
+    size_t resume = 0, delta_size = fs;
+    if (this->synced)
+    {
+        delta_size = encode_delta(packet, this->reference.data(), fs, this->delta.data() + 1, fs - 1, 0, resume);
+        if (resume != fs) // 没有全部放下，不比全帧短
+            delta_size = fs;
+    }
+    size_t key_size = rle_size > 0 ? rle_size : fs;
+    if (!this->synced) // 接收端还没有帧，超支也只能发完整帧
+        this->encoding = rle_size > 0 ? RATE_ENCODING_RLE : RATE_ENCODING_FULL;
+    else if (key_size <= avail && (key || key_size <= delta_size)) // 预算内最短的无损编码，该发完整帧时优先完整帧
+        this->encoding = rle_size > 0 ? RATE_ENCODING_RLE : RATE_ENCODING_FULL;
+    else if (delta_size <= avail) // 完整帧放不下时推迟，先发变化段
+        this->encoding = RATE_ENCODING_DELTA;
+    else
+        this->encoding = RATE_ENCODING_PARTIAL;
+
+    size_t length;
+    this->output[0] = packet[fs];
+    switch (this->encoding)
+    {
+    case RATE_ENCODING_FULL:
+        type = LINK_TYPE_AV;
+        memcpy(this->output.data(), packet, fs + 1);
+        length = fs + 1;
+        break;
+    case RATE_ENCODING_RLE:
+        type = LINK_TYPE_AV_RLE;
+        memcpy(this->output.data() + 1, this->rle.data() + 1, rle_size);
+        length = rle_size + 1;
+        break;
+    case RATE_ENCODING_DELTA:
+        type = LINK_TYPE_AV_DELTA;
+        memcpy(this->output.data() + 1, this->delta.data() + 1, delta_size);
+        length = delta_size + 1;
+        break;
+    default: // 只发预算内的变化段，从上次中断处开始，其余留给之后的帧
+    {
+        size_t limit = avail > 0 ? (size_t)avail : 0;
+        type = LINK_TYPE_AV_DELTA;
+        length = encode_delta(packet, this->reference.data(), fs, this->output.data() + 1, std::min(limit, fs - 1), this->refresh_offset, resume) + 1;
+        this->refresh_offset = resume % fs;
+        break;
+    }
+    }
+
+    uint8_t audio;
+    decode(type, this->output.data(), length, this->reference.data(), fs, audio); // 与接收端做同样的更新
+    this->balance -= length + LINK_OVERHEAD;
+    this->synced = 1;
+    this->since_key = (type == LINK_TYPE_AV_DELTA) ? this->since_key + 1 : 0;
+    return length;
+}
+
+/**
+ * @brief 获取上次encode的负载
+ *
+ * @return const uint8_t* 负载
+ */
+const uint8_t *rate_control::get_output(void)
+{
+    return this->output.data();
+}
+
+/**
+ * @brief 获取上次encode选择的编码
+ *
+ * @return int RATE_ENCODING_*
+ */
+int rate_control::get_encoding(void)
+{
+    return this->encoding;
+}
+
+/**
+ * @brief 认为接收端没有可用的帧（如接收端复位），下一帧发送完整帧，预算清零
+ *
+ */
+void rate_control::reset(void)
+{
+    this->balance = 0;
+    this->synced = 0;
+    this->since_key = 0;
+    this->refresh_offset = 0;
+    this->encoding = RATE_ENCODING_FULL;
+}
+
+/**
+ * @brief 游程编码
+ *
+ * @param in 输入
+ * @param length 输入长度
+ * @param out 输出
+ * @param limit 输出的最大长度
+ * @return size_t 输出长度，超过limit时返回0
+ */
+size_t rate_control::encode_rle(const uint8_t *in, size_t length, uint8_t *out, size_t limit)
+{
+    size_t i = 0, used = 0;
+    while (i < length)
+    {
+        size_t run = 1;
+        while (i + run < length && run < 130 && in[i + run] == in[i])
+            run++;
+        if (run >= 3) // 重复3次以上才值得编码为重复组
+        {
+            if (used + 2 > limit)
+                return 0;
+            out[used++] = (uint8_t)(run + 125);
+            out[used++] = in[i];
+            i += run;
+            continue;
+        }
+        // 原样组：直到出现3次以上的重复
+        size_t literal = 0;
+        while (i + literal < length && literal < 128)
+        {
+            if (i + literal + 2 < length && in[i + literal] == in[i + literal + 1] && in[i + literal] == in[i + literal + 2])
+                break;
+            literal++;
+        }
+        if (used + 1 + literal > limit)
+            return 0;
+        out[used++] = (uint8_t)(literal - 1);
+        memcpy(out + used, in + i, literal);
+        used += literal;
+        i += literal;
+    }
+    return used;
+}
+
+/**
+ * @brief 编码相对参考帧的变化段，从start开始扫描到末尾再从头扫描到start
+ *
+ * @param frame 当前帧
+ * @param reference 参考帧（接收端当前的帧）
+ * @param length 帧长度
+ * @param out 输出
+ * @param limit 输出的最大长度
+ * @param start 开始扫描的偏移
+ * @param resume 因超出limit而停下的偏移，全部放下时为length
+ * @return size_t 输出长度
+ */
+size_t rate_control::encode_delta(const uint8_t *frame, const uint8_t *reference, size_t length, uint8_t *out, size_t limit, size_t start, size_t &resume)
+{
+    size_t used = 0;
+    const size_t ranges[2][2] = {{start, length}, {0, start}};
+    for (int r = 0; r < 2; r++)
+    {
+        size_t i = ranges[r][0], end = ranges[r][1];
+        while (i < end)
+        {
+            if (frame[i] == reference[i])
+            {
+                i++;
+                continue;
+            }
+            size_t last = i;
+            for (size_t j = i + 1; j < end && j - i < RATE_SEGMENT_MAX; j++)
+            {
+                if (frame[j] != reference[j])
+                    last = j;
+                else if (j - last > RATE_DELTA_GAP)
+                    break;
+            }
+            size_t count = last - i + 1;
+            if (used + 3 + count > limit)
+            {
+                if (used + 3 >= limit) // 连一个字节都放不下
+                {
+                    resume = i;
+                    return used;
+                }
+                count = limit - used - 3; // 截断这一段，剩下的从resume继续
+                last = i + count - 1;
+            }
+            out[used++] = i & 0xFF;
+            out[used++] = i >> 8;
+            out[used++] = (uint8_t)count;
+            memcpy(out + used, frame + i, count);
+            used += count;
+            i = last + 1;
+            if (used + 3 >= limit && i < end)
+            {
+                resume = i;
+                return used;
+            }
+        }
+    }
+    resume = length;
+    return used;
+}
+
+/**
+ * @brief 解码一个数据包的负载，更新接收端的当前帧（接收端与编码器共用）
+ *
+ * @param type 帧类型
+ * @param payload 负载
+ * @param length 负载长度
+ * @param frame 当前帧，按负载更新
+ * @param frame_size 帧长度
+ * @param audio 音频字节
+ * @return int 成功返回0，负载格式错误返回-1（帧可能已部分更新）
+ */
+int rate_control::decode(uint8_t type, const uint8_t *payload, size_t length, uint8_t *frame, size_t frame_size, uint8_t &audio)
+{
+    if (type == LINK_TYPE_AV)
+    {
+        if (length != frame_size + 1)
+            return -1;
+        memcpy(frame, payload, frame_size);
+        audio = payload[frame_size];
+        return 0;
+    }
+    if (length < 1)
+        return -1;
+    audio = payload[0];
+    size_t i = 1;
+    if (type == LINK_TYPE_AV_RLE)
+    {
+        size_t filled = 0;
+        while (i < length)
+        {
+            uint8_t c = payload[i++];
+            if (c < 128)
+            {
+                if (i + c + 1 > length || filled + c + 1 > frame_size)
+                    return -1;
+                memcpy(frame + filled, payload + i, c + 1);
+                filled += c + 1;
+                i += c + 1;
+            }
+            else
+            {
+                if (i >= length || filled + c - 125 > frame_size)
+                    return -1;
+                memset(frame + filled, payload[i++], c - 125);
+                filled += c - 125;
+            }
+        }
+        return filled == frame_size ? 0 : -1;
+    }
+    if (type == LINK_TYPE_AV_DELTA)
+    {
+        while (i < length)
+        {
+            if (i + 3 > length)
+                return -1;
+            size_t offset = payload[i] | (payload[i + 1] << 8), count = payload[i + 2];
+            i += 3;
+            if (count == 0 || i + count > length || offset + count > frame_size)
+                return -1;
+            memcpy(frame + offset, payload + i, count);
+            i += count;
+        }
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,149 @@
+#include "serial_video/realtime.hpp"
+
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * @brief Construct a new realtime::realtime object，保存当前线程的设置
+ *
+ */
+realtime::realtime()
+{
+    this->thread            = pthread_self();
+    this->cpus_changed      = 0;
+    this->policy_changed    = 0;
+    CPU_ZERO(&this->saved_cpus);
+    pthread_getaffinity_np(this->thread, sizeof(this->saved_cpus), &this->saved_cpus);
+    pthread_getschedparam(this->thread, &this->saved_policy, &this->saved_param);
+}
+
+/**
+ * @brief Destroy the realtime::realtime object，恢复线程原来的设置
+ *
+ */
+realtime::~realtime()
+{
+    if (this->policy_changed)
+        pthread_setschedparam(this->thread, this->saved_policy, &this->saved_param);
+    if (this->cpus_changed)
+        pthread_setaffinity_np(this->thread, sizeof(this->saved_cpus), &this->saved_cpus);
+}
+
+/**
+ * @brief 把当前线程绑定到指定CPU（之后创建的子线程继承此设置）
+ *
+ * @param cpus CPU编号列表，为空时不修改
+ * @return int 成功返回0，失败返回errno
+ */
+int realtime::pin(const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+        return 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    int ret = pthread_setaffinity_np(this->thread, sizeof(set), &set);
+    if (ret == 0)
+        this->cpus_changed = 1;
+    return ret;
+}
+
+/**
+ * @brief 以SCHED_FIFO实时优先级运行当前线程（需要CAP_SYS_NICE或足够的RLIMIT_RTPRIO）
+ *
+ * @param priority 优先级（1-99），为0时不修改
+ * @return int 成功返回0，失败返回errno
+ */
+int realtime::set_fifo(int priority)
+{
+    if (priority <= 0)
+        return 0;
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int ret = pthread_setschedparam(this->thread, SCHED_FIFO, &param);
+    if (ret == 0)
+        this->policy_changed = 1;
+    return ret;
+}
+
+/**
+ * @brief 锁定进程的全部内存，避免缺页和换页造成的停顿（需要CAP_IPC_LOCK或足够的RLIMIT_MEMLOCK）
+ *
+ * @return int 成功返回0，失败返回errno
+ */
+int realtime::lock_memory(void)
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        return errno;
+    return 0;
+}
+
+/**
+ * @brief 逐页写入缓冲区，使其在进入实时循环前就已分配物理页
+ *
+ * @param buffer 缓冲区
+ * @param length 长度（字节）
+ */
+void realtime::prefault(void *buffer, size_t length)
+{
+    volatile uint8_t *p = (volatile uint8_t *)buffer;
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < length; i += page)
+        p[i] = p[i];
+    if (length > 0)
+        p[length - 1] = p[length - 1];
+}
+
+/**
+ * @brief 预先触碰当前线程的栈
+ *
+ */
+void realtime::prefault_stack(void)
+{
+    volatile uint8_t stack[REALTIME_STACK_PREFAULT];
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < sizeof(stack); i += page)
+        stack[i] = 0; // volatile写入不会被优化掉
+}
+
+/**
+ * @brief 解析CPU列表，如"0-2,5"
+ *
+ * @param list CPU列表字符串
+ * @param cpus 解析结果
+ * @return int 成功返回0，格式错误返回-1
+ */
+int realtime::parse_cpu_list(const char *list, std::vector<int> &cpus)
+{
+    cpus.clear();
+    const char *p = list;
+    while (*p != '\0')
+    {
+        char *end;
+        long first = strtol(p, &end, 10), last;
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+            return -1;
+        last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE)
+                return -1;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return -1;
+    }
+    return cpus.empty() ? -1 : 0;
+}
@@ -0,0 +1,350 @@
+#include "serial_video/rgb565.hpp"
+#include "serial_video/startup_timer.hpp"
+#include "serial_video/metrics.hpp"
+#include "serial_video/tracer.hpp"
+#include "serial_video/executor.hpp"
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+// 4x4 Bayer矩阵，阈值0-15
+static const uint8_t bayer_matrix[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5}};
+
+/**
+ * @brief Construct a new rgb565::rgb565 object
+ *
+ * @param width 视频帧的宽度（即屏幕宽度）
+ * @param height 视频帧的高度
+ */
+rgb565::rgb565(int width, int height)
+{
+    if (width <= 0)
+    {
+        std::invalid_argument ex("width below 0!");
+        throw ex;
+    }
+    if (height <= 0)
+    {
+        std::invalid_argument ex("height below 0!");
+        throw ex;
+    }
+
+    // 保存参数
+    this->m_width       = width;
+    this->m_height      = height;
+    this->m_timer       = NULL;
+    this->m_stats       = NULL;
+    this->m_trace       = NULL;
+    this->m_queue_limit = RGB565_QUEUE_LENGTH_MAX;
+    this->m_epoch       = NULL;
+    this->m_dither      = 0;
+    this->m_pending     = 0;
+    this->m_frames      = -1;
+    this->m_tb          = NULL;
+
+    // 预先分配帧缓冲区，运行时不再分配
+    this->in_frame.resize(width * height * 3);
+    this->packed_frame.resize(width * height * 2);
+    this->m_prev_packed.resize(width * height * 2);
+}
+
+/**
+ * @brief 将RGB24视频流转换为RGB565视频流
+ *
+ * @param in_stream 输入流
+ * @param out_stream 输出流
+ */
+void rgb565::convert(ring_buffer<uint8_t> &in_stream, ring_buffer<uint8_t> &out_stream)
+{
+    while (!in_stream.empty())
+    {
+        if (in_stream.size() < this->in_frame.size()) // 输入队列不足一帧，但仍有数据
+        {
+            in_stream.clear(); // 全部丢弃
+            break;
+        }
+        in_stream.pop(this->in_frame.data(), this->in_frame.size()); // 输入帧
+        this->process(NULL, 0);
+        out_stream.push(this->packed_frame.data(), this->packed_frame.size());
+    }
+}
+
+/**
+ * @brief 将RGB24视频流转换为RGB565视频流（用于多线程）
+ *
+ * @param in_stream 输入流
+ * @param in_lock 输入流的锁
+ * @param out_stream 输出流
+ * @param out_lock 输出流的锁
+ * @param abort_flag 终止标志
+ * @param process_done 运行完成标志
+ */
+void rgb565::streamed_convert(ring_buffer<uint8_t> &in_stream, std::mutex &in_lock, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
+{
+    trace_buffer *tb = this->m_trace != NULL ? this->m_trace->register_thread("rgb565") : NULL; // 本线程的跟踪缓冲区
+    int64_t frames = 0;                                                                        // 帧序号
+    while (1)
+    {
+        auto wait_begin = std::chrono::steady_clock::now();
+        trace_span wait_span(tb, "queue wait (input)", frames);
+        while (1)
+        {
+            in_lock.lock();                                                 // 输入加锁
+            if (abort_flag > 0 && in_stream.size() < this->in_frame.size()) // 已终止且剩余输入不足一帧
+            {
+                if (this->m_stats != NULL && !in_stream.empty())
+                    metrics::add(this->m_stats->gray.dropped_frames, 1);
+                in_stream.clear(); // 丢弃全部输入
+                in_lock.unlock(); // 解锁退出
+                goto done;
+            }
+            if (in_stream.size() >= this->in_frame.size())
+                break;
+            in_lock.unlock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        wait_span.end();
+        in_stream.pop(this->in_frame.data(), this->in_frame.size()); // 输入帧
+        uint32_t input_epoch = this->m_epoch != NULL ? this->m_epoch->load() : 0; // 持有输入锁时读取，与清空队列互斥
+        if (this->m_stats != NULL)
+            metrics::set(this->m_stats->av_video_depth, in_stream.size());
+        in_lock.unlock();
+        if (this->m_stats != NULL)
+        {
+            metrics::add(this->m_stats->gray.wait_input_ns, metrics::elapsed_ns(wait_begin));
+            metrics::add(this->m_stats->gray.frames_in, 1);
+        }
+
+        this->process(tb, frames);
+
+        // 等队列长度够短再输出
+        wait_begin = std::chrono::steady_clock::now();
+        trace_span out_wait_span(tb, "queue wait (output)", frames);
+        while (1)
+        {
+            out_lock.lock();
+            if (out_stream.size() < this->m_queue_limit)
+                break;
+            out_lock.unlock();
+            std::this_thread::sleep_for(std::chrono::microseconds(1));
+        }
+        out_wait_span.end();
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.wait_output_ns, metrics::elapsed_ns(wait_begin));
+        if (this->m_epoch != NULL && this->m_epoch->load() != input_epoch) // 处理期间队列已被清空，这一帧属于旧位置
+        {
+            out_lock.unlock();
+            continue;
+        }
+        out_stream.push(this->packed_frame.data(), this->packed_frame.size());
+        if (this->m_stats != NULL)
+            metrics::set(this->m_stats->gray_video_depth, out_stream.size());
+        out_lock.unlock(); // 输出解锁
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.frames_out, 1);
+        frames++;
+        if (this->m_timer != NULL && frames == 1) // 只记录第一帧，之后不再进入计时器
+            this->m_timer->mark("first frame converted");
+    }
+    done:process_done = 1;
+}
+
+/**
+ * @brief streamed_convert的协作式版本，由executor反复恢复，每次最多转换一帧
+ *
+ * 输入不足一帧或输出队列已满时不等待，返回TASK_BLOCKED；已转换的帧保留到下次恢复时输出
+ *
+ * @param in_stream 输入流
+ * @param in_lock 输入流的锁
+ * @param out_stream 输出流
+ * @param out_lock 输出流的锁
+ * @param abort_flag 终止标志
+ * @param process_done 运行完成标志
+ * @return int TASK_YIELD、TASK_BLOCKED或TASK_DONE
+ */
+int rgb565::resume_convert(ring_buffer<uint8_t> &in_stream, std::mutex &in_lock, ring_buffer<uint8_t> &out_stream, std::mutex &out_lock, std::atomic<int> &abort_flag, std::atomic<int> &process_done)
+{
+    if (this->m_frames < 0) // 第一次恢复
+    {
+        this->m_tb = this->m_trace != NULL ? this->m_trace->register_thread("rgb565") : NULL;
+        this->m_frames = 0;
+        this->m_wait_begin = std::chrono::steady_clock::now();
+    }
+    if (!this->m_pending)
+    {
+        {
+            std::lock_guard<std::mutex> in_guard(in_lock);
+            if (abort_flag > 0 && in_stream.size() < this->in_frame.size()) // 已终止且剩余输入不足一帧
+            {
+                if (this->m_stats != NULL && !in_stream.empty())
+                    metrics::add(this->m_stats->gray.dropped_frames, 1);
+                in_stream.clear();
+                process_done = 1;
+                return TASK_DONE;
+            }
+            if (in_stream.size() < this->in_frame.size())
+                return TASK_BLOCKED;
+            in_stream.pop(this->in_frame.data(), this->in_frame.size());
+            this->m_pending_epoch = this->m_epoch != NULL ? this->m_epoch->load() : 0; // 持有输入锁时读取，与清空队列互斥
+            if (this->m_stats != NULL)
+                metrics::set(this->m_stats->av_video_depth, in_stream.size());
+        }
+        if (this->m_stats != NULL)
+        {
+            metrics::add(this->m_stats->gray.wait_input_ns, metrics::elapsed_ns(this->m_wait_begin));
+            metrics::add(this->m_stats->gray.frames_in, 1);
+        }
+        this->process(this->m_tb, this->m_frames);
+        this->m_pending = 1;
+        this->m_wait_begin = std::chrono::steady_clock::now();
+    }
+
+    {
+        std::lock_guard<std::mutex> out_guard(out_lock);
+        if (out_stream.size() >= this->m_queue_limit)
+            return TASK_BLOCKED;
+        this->m_pending = 0;
+        if (this->m_stats != NULL)
+            metrics::add(this->m_stats->gray.wait_output_ns, metrics::elapsed_ns(this->m_wait_begin));
+        this->m_wait_begin = std::chrono::steady_clock::now();
+        if (this->m_epoch != NULL && this->m_epoch->load() != this->m_pending_epoch) // 处理期间队列已被清空，这一帧属于旧位置
+            return TASK_YIELD;
+        out_stream.push(this->packed_frame.data(), this->packed_frame.size());
+        if (this->m_stats != NULL)
+            metrics::set(this->m_stats->gray_video_depth, out_stream.size());
+    }
+    if (this->m_stats != NULL)
+        metrics::add(this->m_stats->gray.frames_out, 1);
+    this->m_frames++;
+    if (this->m_timer != NULL && this->m_frames == 1) // 只记录第一帧，之后不再进入计时器
+        this->m_timer->mark("first frame converted");
+    return TASK_YIELD;
+}
+
+/**
+ * @brief 量化并打包一帧：in_frame -> packed_frame（私有方法）
+ *
+ * @param tb 跟踪缓冲区，为NULL时不跟踪
+ * @param frame 帧序号
+ */
+void rgb565::process(trace_buffer *tb, int64_t frame)
+{
+    trace_span pack_span(tb, "pack", frame);
+    this->pack(this->in_frame.data(), this->packed_frame.data());
+    pack_span.end();
+
+    if (this->m_stats != NULL)
+    {
+        uint64_t changed = 0;
+        for (size_t i = 0; i < this->packed_frame.size(); i++)
+            changed += this->packed_frame[i] != this->m_prev_packed[i];
+        metrics::add(this->m_stats->changed_bytes, changed);
+        memcpy(this->m_prev_packed.data(), this->packed_frame.data(), this->packed_frame.size());
+    }
+}
+
+/**
+ * @brief 把RGB24帧量化为RGB565（大端）
+ *
+ * 开启抖动时每个像素先按其在4x4 Bayer矩阵中的阈值加上不到一个量化步长的偏移再截断，
+ * 平滑的渐变在5/6位下不会出现色带；偏移随位置固定，静止画面的输出也不变
+ *
+ * @param in RGB24帧（width * height * 3字节）
+ * @param out RGB565帧（get_frame_size()字节）
+ */
+void rgb565::pack(const uint8_t *in, uint8_t *out)
+{
+    for (int y = 0; y < this->m_height; y++)
+    {
+        const uint8_t *thresholds = bayer_matrix[y & 3];
+        for (int x = 0; x < this->m_width; x++, in += 3, out += 2)
+        {
+            int r = in[0], g = in[1], b = in[2];
+            if (this->m_dither)
+            {
+                int t = thresholds[x & 3];
+                r = std::min(r + t / 2, 255); // 5位的步长为8，偏移0-7
+                g = std::min(g + t / 4, 255); // 6位的步长为4，偏移0-3
+                b = std::min(b + t / 2, 255);
+            }
+            out[0] = (r & 0xF8) | (g >> 5);
+            out[1] = ((g << 3) & 0xE0) | (b >> 3);
+        }
+    }
+}
+
+/**
+ * @brief 获取每帧的字节数
+ *
+ * @return int 字节数
+ */
+int rgb565::get_frame_size(void)
+{
+    return this->m_width * this->m_height * 2;
+}
+
+/**
+ * @brief 设置启动阶段计时器
+ *
+ * @param timer 计时器，为NULL时不计时
+ */
+void rgb565::set_startup_timer(startup_timer *timer)
+{
+    this->m_timer = timer;
+}
+
+/**
+ * @brief 设置运行指标
+ *
+ * @param stats 指标，为NULL时不统计
+ */
+void rgb565::set_metrics(metrics *stats)
+{
+    this->m_stats = stats;
+}
+
+/**
+ * @brief 设置逐帧跟踪记录器
+ *
+ * @param trace 跟踪记录器，为NULL时不跟踪
+ */
+void rgb565::set_tracer(tracer *trace)
+{
+    this->m_trace = trace;
+}
+
+/**
+ * @brief 设置输出队列的最大长度
+ *
+ * @param length 最大长度（字节），实时模式下通常设为一帧
+ */
+void rgb565::set_queue_limit(size_t length)
+{
+    this->m_queue_limit = length;
+}
+
+/**
+ * @brief 开启或关闭有序抖动
+ *
+ * @param enabled 为1时开启
+ */
+void rgb565::set_dither(int enabled)
+{
+    this->m_dither = enabled;
+}
+
+/**
+ * @brief 设置冲洗纪元：取输入时记下纪元，输出时纪元已变（期间队列被清空，如跳转）则丢弃这一帧
+ *
+ * @param epoch 纪元计数器，由清空队列的一方在持有全部队列锁时加1，为NULL时不检查
+ */
+void rgb565::set_epoch(std::atomic<uint32_t> *epoch)
+{
+    this->m_epoch = epoch;
+}
@@ -0,0 +1,67 @@
+#include "serial_video/serial_port.hpp"
+
+#include <cerrno>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <asm/termbits.h> // struct termios2，不能与<termios.h>同时包含
+#else
+#include <termios.h>
+#endif
+
+/**
+ * @brief 把串口配置为8N1原始模式，非阻塞读取（VMIN=VTIME=0），并清空收发缓冲区
+ *
+ * @param fd 已打开的串口
+ * @param baudrate 波特率，任意正整数
+ * @param receive 为1时启用接收（CREAD）
+ * @param actual 不为NULL时写入驱动实际设置的波特率
+ * @return int 成功返回0，失败返回errno
+ */
+int serial_port::configure(int fd, int baudrate, int receive, int *actual)
+{
+#ifdef __linux__
+    struct termios2 cfg;
+    if (ioctl(fd, TCGETS2, &cfg) == -1)
+        return errno;
+    // 等同于cfmakeraw
+    cfg.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+    cfg.c_oflag &= ~OPOST;
+    cfg.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    cfg.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CBAUD | (CBAUD << IBSHIFT));
+    cfg.c_cflag |= CS8 | CLOCAL | BOTHER | (BOTHER << IBSHIFT); // 8位数据、无校验、一位停止位，忽略控制线
+    if (receive)
+        cfg.c_cflag |= CREAD; // 读取流量控制帧
+    else
+        cfg.c_cflag &= ~CREAD;
+    cfg.c_ispeed = baudrate;
+    cfg.c_ospeed = baudrate;
+    cfg.c_cc[VTIME] = 0;
+    cfg.c_cc[VMIN] = 0; // 非阻塞读取，没有数据时read立即返回0
+    ioctl(fd, TCFLSH, TCIOFLUSH);
+    if (ioctl(fd, TCSETS2, &cfg) == -1)
+        return errno;
+    if (actual != NULL) // 驱动会把波特率调整为分频器能达到的最接近值
+        *actual = ioctl(fd, TCGETS2, &cfg) == 0 ? (int)cfg.c_ospeed : baudrate;
+#else
+    struct termios cfg;
+    if (tcgetattr(fd, &cfg) == -1)
+        return errno;
+    cfmakeraw(&cfg);
+    cfg.c_cflag |= CLOCAL;
+    if (receive)
+        cfg.c_cflag |= CREAD;
+    else
+        cfg.c_cflag &= ~CREAD;
+    cfg.c_cflag &= ~CSTOPB;
+    cfg.c_cc[VTIME] = 0;
+    cfg.c_cc[VMIN] = 0;
+    if (cfsetspeed(&cfg, baudrate) == -1) // BSD的speed_t就是波特率数值
+        return errno;
+    tcflush(fd, TCIOFLUSH);
+    if (tcsetattr(fd, TCSANOW, &cfg) == -1)
+        return errno;
+    if (actual != NULL)
+        *actual = baudrate;
+#endif
+    return 0;
+}
@@ -0,0 +1,362 @@
+#include "serial_video/shm_ring.hpp"
+#include "serial_video/metrics.hpp"
+
+#include <chrono>
+#include <climits>
+#include <fstream> //for std::ios_base::failure
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/**
+ * @brief 补上shm_open要求的前导斜杠
+ *
+ * @param name 共享内存名称
+ * @return std::string 规范化的名称
+ */
+static std::string shm_ring_name(const std::string &name)
+{
+    return (name.empty() || name[0] != '/') ? "/" + name : name;
+}
+
+/**
+ * @brief 等待futex字不再等于value（映像由多个进程共享，不能用FUTEX_PRIVATE_FLAG）
+ *
+ * @param word futex字
+ * @param value 期望的旧值，已经不相等时立即返回
+ * @param timeout_ms 超时（毫秒）
+ */
+static void futex_wait(std::atomic<uint32_t> *word, uint32_t value, int timeout_ms)
+{
+    struct timespec timeout = {timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000};
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+/**
+ * @brief 唤醒在futex字上等待的全部读取端
+ *
+ * @param word futex字
+ */
+static void futex_wake(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * @brief 按SHM_RING_ALIGN向上取整
+ *
+ */
+static uint64_t shm_ring_align(uint64_t size)
+{
+    return (size + SHM_RING_ALIGN - 1) / SHM_RING_ALIGN * SHM_RING_ALIGN;
+}
+
+/**
+ * @brief Construct a new shm_reader::shm_reader object
+ *
+ * @param name 共享内存名称（shm_open，可以省略前导斜杠）
+ */
+shm_reader::shm_reader(const std::string &name)
+{
+    this->name      = shm_ring_name(name);
+    this->fd        = -1;
+    this->map       = NULL;
+    this->map_size  = 0;
+    this->header    = NULL;
+    this->slots     = NULL;
+    this->stats     = NULL;
+    this->next      = 0;
+    this->current   = 0;
+    this->seq       = 0;
+    this->frames    = 0;
+}
+
+/**
+ * @brief Destroy the shm_reader::shm_reader object
+ *
+ */
+shm_reader::~shm_reader()
+{
+    if (this->map != NULL)
+        munmap(this->map, this->map_size);
+    if (this->fd >= 0)
+        close(this->fd);
+}
+
+/**
+ * @brief 只读映射共享内存并检查头部
+ *
+ */
+void shm_reader::open(void)
+{
+    struct stat statbuf;
+    this->fd = shm_open(this->name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (this->fd < 0)
+    {
+        std::ios_base::failure ex("Unable to open shared memory ring!");
+        throw ex;
+    }
+    if (fstat(this->fd, &statbuf) < 0 || (size_t)statbuf.st_size < sizeof(shm_ring_header))
+    {
+        std::ios_base::failure ex("Shared memory ring too small!");
+        throw ex;
+    }
+    this->map_size = statbuf.st_size;
+    this->map = (uint8_t *)mmap(NULL, this->map_size, PROT_READ, MAP_SHARED, this->fd, 0);
+    if (this->map == MAP_FAILED)
+    {
+        this->map = NULL;
+        std::ios_base::failure ex("Unable to map shared memory ring!");
+        throw ex;
+    }
+
+    const shm_ring_header *h = (const shm_ring_header *)this->map;
+    if (h->magic != SHM_RING_MAGIC || h->version != SHM_RING_VERSION)
+    {
+        std::invalid_argument ex("Not a shared memory ring or version mismatch!");
+        throw ex;
+    }
+    if (h->width == 0 || h->height == 0 || h->fps_num == 0 || h->fps_den == 0 || h->slots < SHM_RING_SLOTS_MIN ||
+        h->slot_size < (uint64_t)h->width * h->height)
+    {
+        std::invalid_argument ex("Invalid shared memory ring header!");
+        throw ex;
+    }
+    if (h->data_offset % SHM_RING_ALIGN != 0 || h->data_offset < sizeof(shm_ring_header) + (uint64_t)h->slots * sizeof(shm_ring_slot) ||
+        h->data_offset + (uint64_t)h->slots * h->slot_size > this->map_size)
+    {
+        std::invalid_argument ex("Shared memory ring layout exceeds its size!");
+        throw ex;
+    }
+    this->header = (shm_ring_header *)this->map;
+    this->slots = (shm_ring_slot *)(this->map + sizeof(shm_ring_header));
+    uint32_t published = this->header->frames.load(std::memory_order_acquire);
+    this->next = published > 0 ? published - 1 : 0; // 写入端已在运行时先显示它最新的一帧（只在变化时发布的渲染程序不会黑屏）
+}
+
+/**
+ * @brief 等待并取得最新的一帧，返回的指针直接指向共享内存中的槽，处理完后必须调用release检查是否有效
+ *
+ * 读取端落后时跳过中间的帧（实时输入只关心最新画面），跳过的帧计入解码阶段的丢帧数
+ *
+ * @param abort_flag 终止标志
+ * @return const uint8_t* 帧（width*height字节GRAY8），写入端已关闭或已终止时返回NULL
+ */
+const uint8_t *shm_reader::acquire(std::atomic<int> &abort_flag)
+{
+    auto wait_begin = std::chrono::steady_clock::now();
+    while (abort_flag == 0)
+    {
+        uint32_t published = this->header->frames.load(std::memory_order_acquire);
+        if (published != this->next)
+        {
+            uint32_t n = published - 1;
+            shm_ring_slot &slot = this->slots[n % this->header->slots];
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq != 2 * n + 2) // 两次读取之间写入端已经绕了一圈，重新取最新的一帧
+                continue;
+            if (this->stats != NULL)
+            {
+                metrics::add(this->stats->decoder.wait_input_ns, metrics::elapsed_ns(wait_begin));
+                metrics::add(this->stats->decoder.frames_in, n - this->next + 1);
+                metrics::add(this->stats->decoder.dropped_frames, n - this->next);
+            }
+            this->current = n;
+            this->seq = seq;
+            return this->map + this->header->data_offset + (size_t)(n % this->header->slots) * this->header->slot_size;
+        }
+        if (this->header->closed.load(std::memory_order_acquire))
+            return NULL;
+        futex_wait(&this->header->frames, published, SHM_RING_WAIT_MS);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 检查acquire取得的帧在读取期间没有被写入端覆盖（seqlock）
+ *
+ * @return int 帧完整返回1，已被覆盖（读到的数据可能新旧混合）返回0，调用者应丢弃处理结果
+ */
+int shm_reader::release(void)
+{
+    shm_ring_slot &slot = this->slots[this->current % this->header->slots];
+    uint64_t timestamp = slot.timestamp_ns.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire); // 之前对槽的读取不会被重排到下面检查seq之后
+    this->next = this->current + 1;
+    if (slot.seq.load(std::memory_order_relaxed) != this->seq)
+    {
+        if (this->stats != NULL)
+            metrics::add(this->stats->decoder.dropped_frames, 1);
+        return 0;
+    }
+    if (this->stats != NULL)
+    {
+        this->stats->frame_arrived(this->frames, timestamp);
+        metrics::add(this->stats->decoder.frames_out, 1);
+    }
+    this->frames++;
+    return 1;
+}
+
+/**
+ * @brief 获取帧宽度
+ *
+ * @return int 宽度（像素）
+ */
+int shm_reader::get_video_width(void)
+{
+    return this->header != NULL ? (int)this->header->width : -1;
+}
+
+/**
+ * @brief 获取帧高度
+ *
+ * @return int 高度（像素）
+ */
+int shm_reader::get_video_height(void)
+{
+    return this->header != NULL ? (int)this->header->height : -1;
+}
+
+/**
+ * @brief 获取写入端声明的帧率
+ *
+ * @return double 帧率，未打开时返回-1
+ */
+double shm_reader::get_video_framerate(void)
+{
+    return this->header != NULL ? (double)this->header->fps_num / this->header->fps_den : -1;
+}
+
+/**
+ * @brief 设置运行指标（读取端记在解码阶段名下）
+ *
+ * @param stats 指标，为NULL时不统计
+ */
+void shm_reader::set_metrics(metrics *stats)
+{
+    this->stats = stats;
+}
+
+/**
+ * @brief Construct a new shm_writer::shm_writer object，创建共享内存并写好头部
+ *
+ * 同名的旧共享内存先被删除，仍映射着它的读取端不受影响（不会因截断而收到SIGBUS）
+ *
+ * @param name 共享内存名称（shm_open，可以省略前导斜杠）
+ * @param width 帧宽度
+ * @param height 帧高度
+ * @param fps_num 帧率分子
+ * @param fps_den 帧率分母
+ * @param slots 槽数
+ */
+shm_writer::shm_writer(const std::string &name, int width, int height, int fps_num, int fps_den, int slots)
+{
+    if (width <= 0 || height <= 0 || fps_num <= 0 || fps_den <= 0)
+    {
+        std::invalid_argument ex("Invalid frame size or framerate!");
+        throw ex;
+    }
+    if (slots < SHM_RING_SLOTS_MIN)
+    {
+        std::invalid_argument ex("Too few slots!");
+        throw ex;
+    }
+    uint64_t data_offset = shm_ring_align(sizeof(shm_ring_header) + (uint64_t)slots * sizeof(shm_ring_slot));
+    uint64_t slot_size = shm_ring_align((uint64_t)width * height);
+    if (slot_size > UINT32_MAX || data_offset + slots * slot_size > UINT32_MAX)
+    {
+        std::invalid_argument ex("Shared memory ring too large!");
+        throw ex;
+    }
+
+    this->name      = shm_ring_name(name);
+    this->map_size  = data_offset + slots * slot_size;
+    this->frames    = 0;
+    shm_unlink(this->name.c_str());
+    this->fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (this->fd < 0)
+    {
+        std::ios_base::failure ex("Unable to create shared memory ring!");
+        throw ex;
+    }
+    if (ftruncate(this->fd, this->map_size) < 0)
+        goto fail;
+    this->map = (uint8_t *)mmap(NULL, this->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (this->map == MAP_FAILED)
+        goto fail;
+
+    // 新建的共享内存全部为0：没有帧，所有槽的seq为0
+    this->header                = (shm_ring_header *)this->map;
+    this->slots                 = (shm_ring_slot *)(this->map + sizeof(shm_ring_header));
+    this->header->version       = SHM_RING_VERSION;
+    this->header->width         = width;
+    this->header->height        = height;
+    this->header->fps_num       = fps_num;
+    this->header->fps_den       = fps_den;
+    this->header->slots         = slots;
+    this->header->slot_size     = slot_size;
+    this->header->data_offset   = data_offset;
+    std::atomic_thread_fence(std::memory_order_release);
+    this->header->magic         = SHM_RING_MAGIC; // 最后写入，读取端看到magic时其余字段都已就绪
+    return;
+
+fail:
+    ::close(this->fd);
+    shm_unlink(this->name.c_str());
+    std::ios_base::failure ex("Unable to map shared memory ring!");
+    throw ex;
+}
+
+/**
+ * @brief Destroy the shm_writer::shm_writer object，通知读取端结束并删除共享内存
+ *
+ */
+shm_writer::~shm_writer()
+{
+    this->close();
+    munmap(this->map, this->map_size);
+    ::close(this->fd);
+    shm_unlink(this->name.c_str());
+}
+
+/**
+ * @brief 开始写入下一帧
+ *
+ * @return uint8_t* 槽（width*height字节GRAY8），写完后调用end_frame发布
+ */
+uint8_t *shm_writer::begin_frame(void)
+{
+    uint32_t index = this->frames % this->header->slots;
+    this->slots[index].seq.store(2 * this->frames + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // 读取端看到新像素时一定也看到奇数的seq
+    return this->map + this->header->data_offset + (size_t)index * this->header->slot_size;
+}
+
+/**
+ * @brief 发布begin_frame开始的一帧并唤醒读取端
+ *
+ */
+void shm_writer::end_frame(void)
+{
+    shm_ring_slot &slot = this->slots[this->frames % this->header->slots];
+    slot.timestamp_ns.store(metrics::now_ns(), std::memory_order_relaxed); // steady_clock即CLOCK_MONOTONIC
+    slot.seq.store(2 * this->frames + 2, std::memory_order_release);
+    this->frames++;
+    this->header->frames.store(this->frames, std::memory_order_release);
+    futex_wake(&this->header->frames);
+}
+
+/**
+ * @brief 标记写入端已结束，读取端取完最新的一帧后退出
+ *
+ */
+void shm_writer::close(void)
+{
+    this->header->closed.store(1, std::memory_order_release);
+    futex_wake(&this->header->frames);
+}
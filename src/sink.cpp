@@ -0,0 +1,423 @@
+#include "serial_video/sink.hpp"
+#include "serial_video/serial_port.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <cerrno>
+#include <stdexcept>
+#include <fstream> //for std::ios_base::failure
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+sink::~sink()
+{
+}
+
+/**
+ * @brief 非阻塞地读取接收端回传的数据
+ *
+ * @param data 缓冲区
+ * @param length 缓冲区长度
+ * @return ssize_t 读到的字节数，没有数据时返回0，不支持读取时返回-1
+ */
+ssize_t sink::read(uint8_t * /*data*/, size_t /*length*/)
+{
+    errno = ENOTSUP;
+    return -1;
+}
+
+/**
+ * @brief 是否支持读取回传数据
+ *
+ * @return int 支持返回1
+ */
+int sink::can_read(void)
+{
+    return 0;
+}
+
+/**
+ * @brief 等待已写入的数据全部发出（串口的内核发送缓冲区），其他输出端直接返回
+ *
+ */
+void sink::drain(void)
+{
+}
+
+/**
+ * @brief 是否为串口（只有串口需要按波特率控制节奏）
+ *
+ * @return int 是串口返回1
+ */
+int sink::is_serial(void)
+{
+    return 0;
+}
+
+/**
+ * @brief 由描述字符串创建输出端
+ *
+ * @param spec 描述字符串，格式为类型:路径，不带已知前缀时视为串口设备路径
+ * @param params 输出端参数
+ * @return sink* 输出端，由调用者释放
+ */
+sink *sink::create(const std::string &spec, const sink_params &params)
+{
+    size_t colon = spec.find(':');
+    std::string type = colon == std::string::npos ? "" : spec.substr(0, colon);
+    std::string path = colon == std::string::npos ? spec : spec.substr(colon + 1);
+    if (type == "serial")
+        return new serial_sink(path, params.baudrate, params.receive);
+    if (type == "file")
+        return new file_sink(path);
+    if (type == "unix")
+        return new unix_sink(path);
+    if (type == "null")
+        return new null_sink();
+    if (type == "pgm")
+        return new preview_sink(path, preview_sink::PGM, params);
+    if (type == "y4m")
+        return new preview_sink(path, preview_sink::Y4M, params);
+    return new serial_sink(spec, params.baudrate, params.receive); // 兼容原来直接给出串口路径的用法
+}
+
+/**
+ * @brief Construct a new serial_sink::serial_sink object
+ *
+ * @param device 串口设备路径
+ * @param baudrate 波特率，任意值（由驱动取最接近的可用速率）
+ * @param receive 为1时启用接收（CREAD），用于读取接收端的流量控制帧
+ */
+serial_sink::serial_sink(const std::string &device, int baudrate, int receive)
+{
+    this->device_path = device;
+    this->receive = receive;
+    this->fd = -1;
+    this->baudrate = baudrate;
+}
+
+serial_sink::~serial_sink()
+{
+    this->close();
+}
+
+/**
+ * @brief 打开串口并配置为8N1原始模式
+ *
+ */
+void serial_sink::open(void)
+{
+    int fd = ::open(this->device_path.c_str(), O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        std::ios_base::failure ex("Unable to open serial port!");
+        throw ex;
+    }
+
+    int actual, ret = serial_port::configure(fd, this->baudrate, this->receive, &actual);
+    if (ret != 0)
+    {
+        std::ios_base::failure ex("Unable to configure serial port at " + std::to_string(this->baudrate) + " baud: " + strerror(ret));
+        ::close(fd);
+        throw ex;
+    }
+    if (std::abs(actual - this->baudrate) > this->baudrate * SERIAL_PORT_BAUD_TOLERANCE)
+        std::cerr << "Warning: " << this->device_path << " runs at " << actual << " baud instead of " << this->baudrate << std::endl;
+    this->fd = fd;
+}
+
+ssize_t serial_sink::write(const uint8_t *data, size_t length)
+{
+    size_t done = 0;
+    while (done < length) // 被信号打断或驱动只接受了一部分时接着写，数据包不能被截断
+    {
+        ssize_t ret = ::write(this->fd, data + done, length - done);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return done > 0 ? (ssize_t)done : ret;
+        done += ret;
+    }
+    return done;
+}
+
+void serial_sink::drain(void)
+{
+    if (this->fd >= 0)
+        tcdrain(this->fd);
+}
+
+void serial_sink::close(void)
+{
+    if (this->fd >= 0)
+        ::close(this->fd);
+    this->fd = -1;
+}
+
+ssize_t serial_sink::read(uint8_t *data, size_t length)
+{
+    if (!this->receive)
+        return sink::read(data, length);
+    return ::read(this->fd, data, length);
+}
+
+int serial_sink::can_read(void)
+{
+    return this->receive;
+}
+
+int serial_sink::is_serial(void)
+{
+    return 1;
+}
+
+/**
+ * @brief Construct a new file_sink::file_sink object
+ *
+ * @param path 文件路径，不存在时创建，已存在的普通文件被截断
+ */
+file_sink::file_sink(const std::string &path)
+{
+    this->path = path;
+    this->fd = -1;
+}
+
+file_sink::~file_sink()
+{
+    this->close();
+}
+
+/**
+ * @brief 打开文件，命名管道会阻塞到读端打开为止
+ *
+ */
+void file_sink::open(void)
+{
+    struct stat st;
+    int is_fifo = stat(this->path.c_str(), &st) == 0 && S_ISFIFO(st.st_mode);
+    if (is_fifo)
+        signal(SIGPIPE, SIG_IGN); // 读端退出时让write返回EPIPE，而不是直接杀死进程
+    this->fd = ::open(this->path.c_str(), is_fifo ? O_WRONLY : O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd < 0)
+    {
+        std::ios_base::failure ex("Unable to open output file " + this->path + ": " + strerror(errno));
+        throw ex;
+    }
+}
+
+/**
+ * @brief 写入全部数据（普通文件和管道都可能只写入一部分）
+ *
+ * @param data 数据
+ * @param length 长度
+ * @return ssize_t 写入的字节数，出错返回-1
+ */
+ssize_t file_sink::write(const uint8_t *data, size_t length)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t ret = ::write(this->fd, data + done, length - done);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return done > 0 ? (ssize_t)done : ret;
+        done += ret;
+    }
+    return done;
+}
+
+void file_sink::close(void)
+{
+    if (this->fd >= 0)
+        ::close(this->fd);
+    this->fd = -1;
+}
+
+/**
+ * @brief Construct a new unix_sink::unix_sink object
+ *
+ * @param path 套接字路径
+ */
+unix_sink::unix_sink(const std::string &path)
+{
+    this->path = path;
+    this->fd = -1;
+}
+
+unix_sink::~unix_sink()
+{
+    this->close();
+}
+
+/**
+ * @brief 连接到套接字
+ *
+ */
+void unix_sink::open(void)
+{
+    struct sockaddr_un addr;
+    if (this->path.size() >= sizeof(addr.sun_path))
+    {
+        std::invalid_argument ex("Socket path too long!");
+        throw ex;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, this->path.c_str(), sizeof(addr.sun_path) - 1);
+    this->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->fd < 0 || connect(this->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        std::ios_base::failure ex("Unable to connect to " + this->path + ": " + strerror(errno));
+        this->close();
+        throw ex;
+    }
+}
+
+/**
+ * @brief 发送全部数据，对端关闭时返回-1而不是产生SIGPIPE
+ *
+ * @param data 数据
+ * @param length 长度
+ * @return ssize_t 发送的字节数，出错返回-1
+ */
+ssize_t unix_sink::write(const uint8_t *data, size_t length)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t ret = send(this->fd, data + done, length - done, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return done > 0 ? (ssize_t)done : ret;
+        done += ret;
+    }
+    return done;
+}
+
+ssize_t unix_sink::read(uint8_t *data, size_t length)
+{
+    ssize_t ret = recv(this->fd, data, length, MSG_DONTWAIT);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    return ret;
+}
+
+int unix_sink::can_read(void)
+{
+    return 1;
+}
+
+void unix_sink::close(void)
+{
+    if (this->fd >= 0)
+        ::close(this->fd);
+    this->fd = -1;
+}
+
+void null_sink::open(void)
+{
+}
+
+ssize_t null_sink::write(const uint8_t * /*data*/, size_t length)
+{
+    return length;
+}
+
+void null_sink::close(void)
+{
+}
+
+/**
+ * @brief Construct a new preview_sink::preview_sink object
+ *
+ * @param path 输出文件路径
+ * @param type 图像格式
+ * @param params 输出端参数（需要屏幕宽高和帧率）
+ */
+preview_sink::preview_sink(const std::string &path, format type, const sink_params &params) : file(path)
+{
+    if (params.screen_width <= 0 || params.screen_height <= 0 || params.screen_height % 8 != 0)
+    {
+        std::invalid_argument ex("Preview output needs the screen size!");
+        throw ex;
+    }
+    if (params.color)
+    {
+        std::invalid_argument ex("Preview output only supports 1bpp frames!");
+        throw ex;
+    }
+    this->type = type;
+    this->width = params.screen_width;
+    this->height = params.screen_height;
+    this->framerate = params.framerate;
+    std::string header;
+    if (type == PGM)
+        header = "P5\n" + std::to_string(this->width) + " " + std::to_string(this->height) + "\n255\n"; // 每帧一个完整的PGM，多帧PGM依次拼接
+    else
+        header = "FRAME\n";
+    this->header_size = header.size();
+    this->image.resize(this->header_size + this->width * this->height);
+    memcpy(this->image.data(), header.data(), this->header_size);
+}
+
+/**
+ * @brief 打开文件，Y4M格式写入流头
+ *
+ */
+void preview_sink::open(void)
+{
+    this->file.open();
+    if (this->type == Y4M)
+    {
+        long den = 1;
+        if (std::fabs(this->framerate - std::lround(this->framerate)) > 1e-6) // 非整数帧率写成分数，NTSC帧率（如29.97）为N/1001
+            den = std::fabs(this->framerate * 1001 / 1000 - std::lround(this->framerate * 1001 / 1000)) < 1e-3 ? 1001 : 1000;
+        long num = std::lround(this->framerate * den);
+        std::string header = "YUV4MPEG2 W" + std::to_string(this->width) + " H" + std::to_string(this->height) + " F" + std::to_string(num) + ":" + std::to_string(den) + " Ip A1:1 Cmono\n";
+        if (this->file.write((const uint8_t *)header.data(), header.size()) != (ssize_t)header.size())
+        {
+            std::ios_base::failure ex("Unable to write preview header!");
+            throw ex;
+        }
+    }
+}
+
+/**
+ * @brief 把数据包开头的列行式视频帧还原为8位灰度图像写入文件
+ *
+ * @param data 数据包
+ * @param length 数据包长度
+ * @return ssize_t 成功时返回length，数据包不足一帧或写入失败返回-1
+ */
+ssize_t preview_sink::write(const uint8_t *data, size_t length)
+{
+    if (length < (size_t)this->width * this->height / 8)
+        return -1;
+    uint8_t *pixels = this->image.data() + this->header_size;
+    for (int page = 0; page < this->height / 8; page++)
+    {
+        for (int col = 0; col < this->width; col++)
+        {
+            uint8_t bits = *data++;
+            for (int i = 0; i < 8; i++) // 低位在上
+                pixels[(page * 8 + i) * this->width + col] = (bits >> i) & 1 ? 255 : 0;
+        }
+    }
+    if (this->file.write(this->image.data(), this->image.size()) != (ssize_t)this->image.size())
+        return -1;
+    return length;
+}
+
+void preview_sink::close(void)
+{
+    this->file.close();
+}
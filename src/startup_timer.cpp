@@ -0,0 +1,75 @@
+#include "serial_video/startup_timer.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+/**
+ * @brief Construct a new startup timer::startup timer object
+ *
+ * @param final_phase 最后一个阶段的名称，记录到该阶段时自动向标准错误输出报告
+ */
+startup_timer::startup_timer(const char *final_phase)
+{
+    this->origin        = std::chrono::steady_clock::now();
+    this->final_phase   = final_phase;
+    this->reported      = 0;
+    this->finished      = 0;
+}
+
+/**
+ * @brief 记录一个阶段的完成时间（可在任意线程调用，同名阶段只记录第一次），
+ * 最后一个阶段记录并报告之后不再记录任何阶段
+ *
+ * @param phase 阶段名称
+ */
+void startup_timer::mark(const char *phase)
+{
+    if (this->finished.load(std::memory_order_relaxed))
+        return;
+    auto now = std::chrono::steady_clock::now();
+    int is_final;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (auto &p : this->phases)
+        {
+            if (p.first == phase)
+                return; // 已经记录过
+        }
+        this->phases.emplace_back(phase, now);
+        is_final = (this->final_phase == phase && !this->reported);
+        if (is_final)
+        {
+            this->reported = 1;
+            this->finished.store(1, std::memory_order_relaxed);
+        }
+    }
+    if (is_final)
+        this->report(std::cerr);
+}
+
+/**
+ * @brief 按时间顺序输出各阶段的累计耗时和阶段耗时
+ *
+ * @param out 输出流
+ */
+void startup_timer::report(std::ostream &out)
+{
+    std::vector<std::pair<std::string, std::chrono::steady_clock::time_point>> sorted;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        sorted = this->phases;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b)
+                     { return a.second < b.second; });
+
+    auto last = this->origin;
+    out << "Startup timing (ms, cumulative / phase):" << std::endl;
+    for (auto &p : sorted)
+    {
+        double total = std::chrono::duration<double, std::milli>(p.second - this->origin).count();
+        double delta = std::chrono::duration<double, std::milli>(p.second - last).count();
+        out << "\t" << std::fixed << std::setprecision(1) << std::setw(8) << total << " / " << std::setw(8) << delta << "\t" << p.first << std::endl;
+        last = p.second;
+    }
+}
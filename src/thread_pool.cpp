@@ -0,0 +1,80 @@
+#include "serial_video/thread_pool.hpp"
+
+/**
+ * @brief Construct a new thread_pool::thread_pool object
+ *
+ */
+thread_pool::thread_pool()
+{
+    this->idle_threads  = 0;
+    this->stop_flag     = 0;
+}
+
+/**
+ * @brief Destroy the thread_pool::thread_pool object，等待已提交的任务全部完成
+ *
+ */
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stop_flag = 1;
+    }
+    this->task_ready.notify_all();
+    for (std::thread &t : this->threads)
+    {
+        t.join();
+    }
+}
+
+/**
+ * @brief 提交任务，立即返回
+ *
+ * @param task 任务，不应抛出异常
+ */
+void thread_pool::submit(std::function<void()> task)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->tasks.push(std::move(task));
+    if (this->idle_threads < (int)this->tasks.size()) // 空闲线程不够，新建一个
+        this->threads.emplace_back(&thread_pool::worker, this);
+    else
+        this->task_ready.notify_one();
+}
+
+/**
+ * @brief 获取线程池中的线程总数
+ *
+ * @return int 线程数
+ */
+int thread_pool::get_thread_count(void)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->threads.size();
+}
+
+/**
+ * @brief 工作线程，循环取出任务执行
+ *
+ */
+void thread_pool::worker(void)
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (1)
+    {
+        if (this->tasks.empty())
+        {
+            if (this->stop_flag)
+                break;
+            this->idle_threads++;
+            this->task_ready.wait(guard, [this] { return this->stop_flag || !this->tasks.empty(); });
+            this->idle_threads--;
+            continue;
+        }
+        std::function<void()> task = std::move(this->tasks.front());
+        this->tasks.pop();
+        guard.unlock();
+        task();
+        guard.lock();
+    }
+}
@@ -0,0 +1,186 @@
+#include "serial_video/tracer.hpp"
+
+#include <iostream>
+#include <fstream> //for std::ios_base::failure
+
+/**
+ * @brief Construct a new trace buffer::trace buffer object
+ *
+ * @param thread_name 线程名称
+ * @param tid 线程编号
+ */
+trace_buffer::trace_buffer(const char *thread_name, int tid)
+{
+    this->thread_name   = thread_name;
+    this->tid           = tid;
+    this->dropped       = 0;
+    this->head          = 0;
+    this->tail          = 0;
+}
+
+/**
+ * @brief 写入一个事件（只能由所属线程调用）
+ *
+ * @param name 事件名称
+ * @param frame 帧序号
+ * @param begin_ns 开始时间
+ * @param end_ns 结束时间
+ */
+void trace_buffer::push(const char *name, int64_t frame, int64_t begin_ns, int64_t end_ns)
+{
+    uint64_t h = this->head.load(std::memory_order_relaxed);
+    if (h - this->tail.load(std::memory_order_acquire) >= TRACE_BUFFER_EVENTS) // 缓冲区已满，丢弃而不是等待
+    {
+        this->dropped.store(this->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    trace_event &e = this->events[h % TRACE_BUFFER_EVENTS];
+    e.name      = name;
+    e.frame     = frame;
+    e.begin_ns  = begin_ns;
+    e.end_ns    = end_ns;
+    this->head.store(h + 1, std::memory_order_release);
+}
+
+/**
+ * @brief 读出一个事件（只能由写出线程调用）
+ *
+ * @param event 读出的事件
+ * @return int 有事件时返回1，否则返回0
+ */
+int trace_buffer::pop(trace_event &event)
+{
+    uint64_t t = this->tail.load(std::memory_order_relaxed);
+    if (t == this->head.load(std::memory_order_acquire))
+        return 0;
+    event = this->events[t % TRACE_BUFFER_EVENTS];
+    this->tail.store(t + 1, std::memory_order_release);
+    return 1;
+}
+
+/**
+ * @brief Construct a new tracer::tracer object
+ *
+ * @param path 输出的JSON文件路径
+ */
+tracer::tracer(const char *path)
+{
+    this->path          = path;
+    this->out           = NULL;
+    this->first_event   = 1;
+    this->described     = 0;
+    this->stop_flag     = 0;
+}
+
+/**
+ * @brief Destroy the tracer::tracer object
+ *
+ */
+tracer::~tracer()
+{
+    this->stop();
+}
+
+/**
+ * @brief 打开输出文件并启动后台写出线程
+ *
+ */
+void tracer::start()
+{
+    this->out = fopen(this->path.c_str(), "w");
+    if (this->out == NULL)
+    {
+        std::ios_base::failure ex("Unable to open trace file!");
+        throw ex;
+    }
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", this->out);
+    this->stop_flag = 0;
+    this->flush_thread = std::thread(&tracer::flush_loop, this);
+}
+
+/**
+ * @brief 写出剩余事件并关闭文件
+ *
+ */
+void tracer::stop()
+{
+    if (this->out == NULL)
+        return;
+    this->stop_flag = 1;
+    if (this->flush_thread.joinable())
+        this->flush_thread.join();
+    this->flush();
+    fputs("\n]}\n", this->out);
+    fclose(this->out);
+    this->out = NULL;
+
+    uint64_t dropped = 0;
+    for (auto &b : this->buffers)
+    {
+        dropped += b->dropped;
+    }
+    if (dropped > 0)
+        std::cerr << "Warning: " << dropped << " trace events dropped, trace buffers were full" << std::endl;
+}
+
+/**
+ * @brief 为调用线程分配事件缓冲区，每个线程在开始工作前调用一次
+ *
+ * @param thread_name 在时间线上显示的线程名
+ * @return trace_buffer* 该线程专用的缓冲区，在tracer销毁前一直有效
+ */
+trace_buffer *tracer::register_thread(const char *thread_name)
+{
+    std::lock_guard<std::mutex> guard(this->buffers_lock);
+    this->buffers.emplace_back(new trace_buffer(thread_name, this->buffers.size() + 1));
+    return this->buffers.back().get();
+}
+
+/**
+ * @brief 获取单调时钟的当前时间
+ *
+ * @return int64_t 纳秒
+ */
+int64_t tracer::now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief 后台写出线程（私有方法）
+ *
+ */
+void tracer::flush_loop()
+{
+    while (this->stop_flag == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_FLUSH_INTERVAL_MS));
+        this->flush();
+    }
+}
+
+/**
+ * @brief 把所有缓冲区中的事件写入文件（私有方法）
+ *
+ */
+void tracer::flush()
+{
+    std::lock_guard<std::mutex> guard(this->buffers_lock); // 只和线程注册互斥，不影响各线程写入事件
+    for (; this->described < this->buffers.size(); this->described++) // 新注册线程的名称
+    {
+        trace_buffer *b = this->buffers[this->described].get();
+        fprintf(this->out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", this->first_event ? "" : ",\n", b->tid, b->thread_name.c_str());
+        this->first_event = 0;
+    }
+    trace_event e;
+    for (auto &b : this->buffers)
+    {
+        while (b->pop(e))
+        {
+            // ts和dur以微秒为单位
+            fprintf(this->out, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"frame\":%lld}}", this->first_event ? "" : ",\n", e.name, b->thread_name.c_str(), e.begin_ns / 1e3, (e.end_ns - e.begin_ns) / 1e3, b->tid, (long long)e.frame);
+            this->first_event = 0;
+        }
+    }
+    fflush(this->out);
+}
@@ -1,121 +1,61 @@
 #include "serial_video/transfer.hpp"
+#include "serial_video/startup_timer.hpp"
+#include "serial_video/metrics.hpp"
+#include "serial_video/tracer.hpp"
+#include "serial_video/sink.hpp"
+#include "serial_video/link_protocol.hpp"
+#include "serial_video/executor.hpp"
+#include "serial_video/rate_control.hpp"
+#include "serial_video/dirty_rect.hpp"
 
 #include <thread>
 #include <chrono>
-#include <fcntl.h>
-#include <unistd.h>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
 #include <fstream> //for std::ios_base::failure
 
 /**
  * @brief Construct a new transfer::transfer object
  *
- * @param device 串口设备路径
+ * @param device 串口设备路径或输出端描述（见sink::create）
  * @param baudrate 波特率
- * @param framerate 视频帧率
+ * @param framerate 视频帧率（可以不是整数，如29.97）
  * @param frame_size 视频帧大小
  * @param audio_size 音频帧大小
  */
-transfer::transfer(const char *device, int baudrate, int framerate, int frame_size, int audio_size)
+transfer::transfer(const char *device, int baudrate, double framerate, int frame_size, int audio_size)
 {
     this->device_path   = device;
     this->frame_size    = frame_size;
     this->audio_size    = audio_size;
     this->framerate     = framerate;
-    switch (baudrate)
-    {
-    case 50:
-        this->baudrate = B50;
-        break;
-    case 75:
-        this->baudrate = B75;
-        break;
-    case 110:
-        this->baudrate = B110;
-        break;
-    case 134:
-        this->baudrate = B134;
-        break;
-    case 150:
-        this->baudrate = B150;
-        break;
-    case 200:
-        this->baudrate = B200;
-        break;
-    case 300:
-        this->baudrate = B300;
-        break;
-    case 600:
-        this->baudrate = B600;
-        break;
-    case 1200:
-        this->baudrate = B1200;
-        break;
-    case 1800:
-        this->baudrate = B1800;
-        break;
-    case 2400:
-        this->baudrate = B2400;
-        break;
-    case 4800:
-        this->baudrate = B4800;
-        break;
-    case 9600:
-        this->baudrate = B9600;
-        break;
-    case 19200:
-        this->baudrate = B19200;
-        break;
-    case 38400:
-        this->baudrate = B38400;
-        break;
-    case 57600:
-        this->baudrate = B57600;
-        break;
-    case 115200:
-        this->baudrate = B115200;
-        break;
-    case 230400:
-        this->baudrate = B230400;
-        break;
-    case 460800:
-        this->baudrate = B460800;
-        break;
-    case 500000:
-        this->baudrate = B500000;
-        break;
-    case 576000:
-        this->baudrate = B576000;
-        break;
-    case 921600:
-        this->baudrate = B921600;
-        break;
-    case 1000000:
-        this->baudrate = B1000000;
-        break;
-    case 1152000:
-        this->baudrate = B1152000;
-        break;
-    case 1500000:
-        this->baudrate = B1500000;
-        break;
-    case 2000000:
-        this->baudrate = B2000000;
-        break;
-    case 2500000:
-        this->baudrate = B2500000;
-        break;
-    case 3000000:
-        this->baudrate = B3000000;
-        break;
-    case 3500000:
-        this->baudrate = B3500000;
-        break;
-    case 4000000:
-        this->baudrate = B4000000;
-        break;
-    default:
-        this->baudrate = B115200;
-    }
+    this->timer         = NULL;
+    this->stats         = NULL;
+    this->trace         = NULL;
+    this->audio_enabled = 1;
+    this->baudrate      = baudrate;
+    this->paced         = 1;
+    this->paused        = 0;
+    this->rate          = 1;
+    this->epoch         = NULL;
+    this->output        = NULL;
+    this->protocol      = LINK_PROTOCOL_RAW;
+    this->link_addr     = 0;
+    this->seq           = 0;
+    this->rate_controlled = 0;
+    this->link_share = 1;
+    this->rect_width    = 0;
+    this->rect_height   = 0;
+    this->packets       = 0;
+    this->written_epoch = 0;
+    this->resume_state  = 0;
+    this->resume_output = NULL;
+    this->resume_tb     = NULL;
+}
+
+transfer::~transfer()
+{
 }
 
 /**
@@ -124,75 +64,31 @@ transfer::transfer(const char *device, int baudrate, int framerate, int frame_si
  * @param video 视频帧队列
  * @param audio 音频帧队列
  */
-void transfer::start(std::queue<uint8_t> &video, std::queue<uint8_t> &audio)
+void transfer::start(ring_buffer<uint8_t> &video, ring_buffer<uint8_t> &audio)
 {
-    struct termios serial_cfg;
-
-    int fd = open(device_path.c_str(), O_RDWR | O_NOCTTY);
-    if (fd < 0)
-    {
-        std::ios_base::failure ex("Unable to open serial port!");
-        throw ex;
-    }
-
-    if (tcgetattr(fd, &serial_cfg) == -1)
-    {
-        std::ios_base::failure ex("Unable to get serial configuration!");
-        close(fd);
-        throw ex;
-    }
-
-    cfmakeraw(&serial_cfg);
-    cfsetspeed(&serial_cfg, this->baudrate);
-    serial_cfg.c_cflag |= CLOCAL;  // 本地模式，忽略控制线
-    serial_cfg.c_cflag &= ~CREAD;  // 禁用读取
-    serial_cfg.c_cflag &= ~CSTOPB; // 一位停止位
-    serial_cfg.c_cflag &= ~CSIZE;  // 清除数据位设置
-    serial_cfg.c_cflag |= CS8;     // 8位数据
-    serial_cfg.c_cflag &= ~PARENB; // 无校验
-
-    tcflush(fd, TCIOFLUSH);
-    serial_cfg.c_cc[VTIME] = 0;
-    serial_cfg.c_cc[VMIN] = 0; // 非阻塞读取（其实无所谓了，反正不读取）
-    tcflush(fd, TCIOFLUSH);
-
-    if (tcsetattr(fd, TCSANOW, &serial_cfg) == -1)
-    {
-        std::ios_base::failure ex("Unable to apply serial configuration");
-        close(fd);
-        throw ex;
-    }
-    char *buffer = new char[this->frame_size + this->audio_size];
+    sink *output = this->open_output();
+    char *buffer = new char[LINK_OVERHEAD + this->frame_size + this->audio_size];
+    uint8_t *payload = (uint8_t *)buffer + (this->protocol != LINK_PROTOCOL_RAW ? LINK_HEADER_SIZE : 0); // 帧协议下在缓冲区里直接留出帧头
     while (!video.empty() || !audio.empty())
     {
-        auto wakeup_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(1000 / this->framerate);
+        auto wakeup_time = std::chrono::steady_clock::now() + this->frame_period();
         if (video.size() < this->frame_size || audio.size() < this->audio_size) // 剩余数据已不足以组成一个数据包
         {                                                                       // 丢弃所有数据
-            while (!video.empty())
-            {
-                video.pop();
-            }
-            while (!audio.empty())
-            {
-                audio.pop();
-            }
+            video.clear();
+            audio.clear();
             break;
         }
-        for (int i = 0; i < this->frame_size; i++) // 读取一帧视频到缓冲区
-        {
-            buffer[i] = video.front();
-            video.pop();
-        }
-        for (int i = 0; i < this->audio_size; i++) // 读取一帧音频到缓冲区
-        {
-            buffer[this->frame_size + i] = audio.front();
-            audio.pop();
-        }
-        write(fd, buffer, this->frame_size + this->audio_size); // 向串口写入
-        std::this_thread::sleep_until(wakeup_time);             // 一小段休眠，以保证帧率准确
+        video.pop(payload, this->frame_size);                     // 读取一帧视频到缓冲区
+        audio.pop(payload + this->frame_size, this->audio_size); // 读取一帧音频到缓冲区
+        size_t packet_size = this->seal_packet((uint8_t *)buffer);
+        if (this->protocol == LINK_PROTOCOL_CREDIT)
+            this->wait_credit(output); // 等接收端有空闲缓冲区
+        output->write((const uint8_t *)buffer, packet_size); // 向串口写入
+        if (this->paced)
+            std::this_thread::sleep_until(wakeup_time); // 一小段休眠，以保证帧率准确
     }
     delete[] buffer;
-    close(fd);
+    output->close();
 }
 
 /**
@@ -204,48 +100,26 @@ void transfer::start(std::queue<uint8_t> &video, std::queue<uint8_t> &audio)
  * @param alock 音频队列锁
  * @param abort_flag 结束标志，置1后结束
  */
-void transfer::streamed_start(std::queue<uint8_t> &video, std::mutex &vlock, std::queue<uint8_t> &audio, std::mutex &alock, std::atomic<int> &video_abort_flag, std::atomic<int> &audio_abort_flag)
+void transfer::streamed_start(ring_buffer<uint8_t> &video, std::mutex &vlock, ring_buffer<uint8_t> &audio, std::mutex &alock, std::atomic<int> &video_abort_flag, std::atomic<int> &audio_abort_flag)
 {
-    struct termios serial_cfg;
-
-    int fd = open(device_path.c_str(), O_RDWR | O_NOCTTY);
-    if (fd < 0)
-    {
-        std::ios_base::failure ex("Unable to open serial port!");
-        throw ex;
-    }
-
-    if (tcgetattr(fd, &serial_cfg) == -1)
-    {
-        std::ios_base::failure ex("Unable to get serial configuration!");
-        close(fd);
-        throw ex;
-    }
-
-    cfmakeraw(&serial_cfg);
-    cfsetspeed(&serial_cfg, this->baudrate);
-    serial_cfg.c_cflag |= CLOCAL;  // 本地模式，忽略控制线
-    serial_cfg.c_cflag &= ~CREAD;  // 禁用读取
-    serial_cfg.c_cflag &= ~CSTOPB; // 一位停止位
-    serial_cfg.c_cflag &= ~CSIZE;  // 清除数据位设置
-    serial_cfg.c_cflag |= CS8;     // 8位数据
-    serial_cfg.c_cflag &= ~PARENB; // 无校验
-
-    tcflush(fd, TCIOFLUSH);
-    serial_cfg.c_cc[VTIME] = 0;
-    serial_cfg.c_cc[VMIN] = 0; // 非阻塞读取（其实无所谓了，反正不读取）
-    tcflush(fd, TCIOFLUSH);
-
-    if (tcsetattr(fd, TCSANOW, &serial_cfg) == -1)
-    {
-        std::ios_base::failure ex("Unable to apply serial configuration");
-        close(fd);
-        throw ex;
-    }
-    char *buffer = new char[this->frame_size + this->audio_size];
+    sink *output = this->open_output();
+    if (this->timer != NULL)
+        this->timer->mark("serial port opened"); // 其他输出端也沿用这个名字，便于对比
+    char *buffer = new char[LINK_OVERHEAD + this->frame_size + this->audio_size];
+    memset(buffer, 0, LINK_OVERHEAD + this->frame_size + this->audio_size);
+    uint8_t *payload = (uint8_t *)buffer + (this->protocol != LINK_PROTOCOL_RAW ? LINK_HEADER_SIZE : 0); // 帧协议下在缓冲区里直接留出帧头
+    const size_t audio_need = this->audio_enabled ? this->audio_size : 0; // 没有音频时不读取音频队列，音频字节保持为0（静音）
+    trace_buffer *tb = this->trace != NULL ? this->trace->register_thread("transfer") : NULL; // 本线程的跟踪缓冲区
+    this->packets = 0;
+    this->written_epoch = this->epoch != NULL ? this->epoch->load() : 0;
     while (1)
     {
-        auto wakeup_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(1000 / this->framerate);
+        if (this->paused) // 暂停时不取数据，上游随队列写满而阻塞
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        auto wakeup_time = std::chrono::steady_clock::now() + this->frame_period();
         size_t vsize, asize;
         vlock.lock();
         vsize = video.size();
@@ -253,70 +127,681 @@ void transfer::streamed_start(std::queue<uint8_t> &video, std::mutex &vlock, std
         alock.lock();
         asize = audio.size();
         alock.unlock();
-        if ((video_abort_flag > 0 && vsize < this->frame_size) || (audio_abort_flag > 0 && asize < this->audio_size)) // 已终止，且剩余数据已不足以组成一个数据包
+        if ((video_abort_flag > 0 && vsize < this->frame_size) || (audio_abort_flag > 0 && asize < audio_need)) // 已终止，且剩余数据已不足以组成一个数据包
         {
             while (video_abort_flag == 0)
             {
                 vlock.lock();
-                while (!video.empty())
-                {
-                    video.pop(); //丢弃视频帧所有数据
-                }
+                video.clear(); //丢弃视频帧所有数据
                 vlock.unlock();
                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
             vlock.lock();
-            while (!video.empty())
-            {
-                video.pop(); //丢弃视频帧所有数据
-            }
+            video.clear(); //丢弃视频帧所有数据
             vlock.unlock();
 
             while (audio_abort_flag == 0)
             {
                 alock.lock();
-                while (!audio.empty())
-                {
-                    audio.pop(); //丢弃音频帧所有数据
-                }
+                audio.clear(); //丢弃音频帧所有数据
                 alock.unlock();
                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
             alock.lock();
-            while (!audio.empty())
-            {
-                audio.pop(); //丢弃音频帧所有数据
-            }
+            audio.clear(); //丢弃音频帧所有数据
             alock.unlock();
             break;
         }
-        while (vsize < this->frame_size || asize < this->audio_size) // 等待直至队列长度足够
+        auto wait_begin = std::chrono::steady_clock::now();
+        trace_span wait_span(tb, "queue wait (input)", this->packets);
+        while (vsize < this->frame_size || asize < audio_need) // 等待直至队列长度足够
         {
+            if ((video_abort_flag > 0 && vsize < this->frame_size) || (audio_abort_flag > 0 && asize < audio_need))
+                break; // 上游在等待期间结束，回到循环开头按终止处理
+            std::this_thread::sleep_for(std::chrono::microseconds(100)); // 每0.1毫秒读取一次队列长度
             vlock.lock();
             vsize = video.size();
             vlock.unlock();
             alock.lock();
             asize = audio.size();
             alock.unlock();
-            std::this_thread::sleep_for(std::chrono::microseconds(100)); // 每0.1毫秒读取一次队列长度
         }
+        wait_span.end();
+        if (this->stats != NULL)
+            metrics::add(this->stats->transfer.wait_input_ns, metrics::elapsed_ns(wait_begin));
+        if (vsize < this->frame_size || asize < audio_need)
+            continue;
         vlock.lock(); // 视频加锁
-        for (int i = 0; i < this->frame_size; i++)
+        alock.lock(); // 音频加锁
+        if (video.size() < this->frame_size || audio.size() < audio_need) // 队列可能已被外部清空（流水线停止时）
         {
-            buffer[i] = video.front(); // 读入缓冲区
-            video.pop();
+            alock.unlock();
+            vlock.unlock();
+            continue;
         }
+        video.pop(payload, this->frame_size); // 读入缓冲区
+        uint32_t packet_epoch = this->epoch != NULL ? this->epoch->load() : 0; // 持有两个队列锁时读取
+        if (this->stats != NULL)
+            metrics::set(this->stats->gray_video_depth, video.size());
         vlock.unlock(); // 视频解锁
-        alock.lock();   // 音频加锁
-        for (int i = 0; i < this->audio_size; i++)
+        audio.pop(payload + this->frame_size, audio_need); // 读入缓冲区
+        if (this->stats != NULL)
+            metrics::set(this->stats->fft_audio_depth, audio.size());
+        alock.unlock();                                         // 音频解锁
+        if (this->stats != NULL)
+            metrics::add(this->stats->transfer.frames_in, 1);
+        if (this->epoch != NULL && this->epoch->load() != packet_epoch)
+            continue; // 取出后队列被清空（跳转），这个数据包属于旧位置，不编码
+        size_t packet_size = this->seal_packet((uint8_t *)buffer);
+        if (this->protocol == LINK_PROTOCOL_CREDIT)
         {
-            buffer[this->frame_size + i] = audio.front(); // 读入缓冲区
-            audio.pop();
+            trace_span credit_span(tb, "credit wait", this->packets);
+            this->wait_credit(output); // 等接收端有空闲缓冲区，不计入写入时间
+        }
+        if (this->epoch != NULL && this->epoch->load() != packet_epoch)
+        {
+            this->resync_receiver(); // 等待回报期间发生跳转，已编码的数据包不发送
+            continue;
+        }
+        this->write_packet(output, (const uint8_t *)buffer, packet_size, packet_epoch, tb, wakeup_time);
+        if (this->paced && std::chrono::steady_clock::now() < wakeup_time)
+        {
+            std::this_thread::sleep_until(wakeup_time); // 休眠以保证帧率准确
+            if (this->stats != NULL)
+                this->stats->record_wakeup(metrics::elapsed_ns(wakeup_time)); // 实际醒来比预定时刻晚了多少
         }
-        alock.unlock();                                         // 音频解锁
-        write(fd, buffer, this->frame_size + this->audio_size); // 写入串口
-        std::this_thread::sleep_until(wakeup_time);             // 休眠以保证帧率准确
     }
     delete[] buffer;
-    close(fd);
+    output->close();
+}
+
+/**
+ * @brief streamed_start的协作式版本，由executor反复恢复，每次最多发送一个数据包
+ *
+ * 队列不足一个数据包时返回TASK_BLOCKED，由队列的改变唤醒；等待接收端回报（轮询输出端）或发送后距下一周期还有时间时
+ * 返回TASK_SLEEP，由executor在wakeup时刻再恢复，所以节奏定时器不占用线程
+ *
+ * @param video 视频帧队列
+ * @param vlock 视频队列锁
+ * @param audio 音频帧队列
+ * @param alock 音频队列锁
+ * @param video_abort_flag 视频结束标志
+ * @param audio_abort_flag 音频结束标志
+ * @param wakeup 返回TASK_SLEEP时的醒来时刻
+ * @return int TASK_*
+ */
+int transfer::resume_start(ring_buffer<uint8_t> &video, std::mutex &vlock, ring_buffer<uint8_t> &audio, std::mutex &alock, std::atomic<int> &video_abort_flag, std::atomic<int> &audio_abort_flag, std::chrono::steady_clock::time_point &wakeup)
+{
+    const size_t audio_need = this->audio_enabled ? this->audio_size : 0;
+    uint8_t *buffer = this->resume_buffer.data();
+    switch (this->resume_state)
+    {
+    case 0: // 第一次恢复：打开输出端
+        this->resume_output = this->open_output();
+        if (this->timer != NULL)
+            this->timer->mark("serial port opened");
+        this->resume_buffer.assign(LINK_OVERHEAD + this->frame_size + this->audio_size, 0);
+        buffer = this->resume_buffer.data();
+        this->resume_tb = this->trace != NULL ? this->trace->register_thread("transfer") : NULL;
+        this->packets = 0;
+        this->written_epoch = this->epoch != NULL ? this->epoch->load() : 0;
+        this->resume_cycle = 0;
+        this->resume_state = 1;
+        // fall through
+    case 1: // 等待一个数据包的数据
+    {
+        if (this->paused)
+        {
+            this->resume_cycle = 0;
+            wakeup = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+            return TASK_SLEEP;
+        }
+        if (!this->resume_cycle)
+        {
+            this->resume_wakeup = std::chrono::steady_clock::now() + this->frame_period();
+            this->resume_wait_begin = std::chrono::steady_clock::now();
+            this->resume_cycle = 1;
+        }
+        std::lock_guard<std::mutex> video_guard(vlock);
+        std::lock_guard<std::mutex> audio_guard(alock);
+        if ((video_abort_flag > 0 && video.size() < this->frame_size) || (audio_abort_flag > 0 && audio.size() < audio_need)) // 已终止，且剩余数据已不足以组成一个数据包
+        {
+            video.clear();
+            audio.clear();
+            if (video_abort_flag == 0 || audio_abort_flag == 0)
+                return TASK_BLOCKED; // 等另一路也结束，期间继续丢弃
+            this->resume_output->close();
+            this->resume_state = 4;
+            return TASK_DONE;
+        }
+        if (video.size() < this->frame_size || audio.size() < audio_need)
+            return TASK_BLOCKED;
+        uint8_t *payload = buffer + (this->protocol != LINK_PROTOCOL_RAW ? LINK_HEADER_SIZE : 0);
+        video.pop(payload, this->frame_size);
+        audio.pop(payload + this->frame_size, audio_need);
+        this->resume_epoch = this->epoch != NULL ? this->epoch->load() : 0; // 持有两个队列锁时读取
+        if (this->stats != NULL)
+        {
+            metrics::set(this->stats->gray_video_depth, video.size());
+            metrics::set(this->stats->fft_audio_depth, audio.size());
+            metrics::add(this->stats->transfer.wait_input_ns, metrics::elapsed_ns(this->resume_wait_begin));
+            metrics::add(this->stats->transfer.frames_in, 1);
+        }
+        if (this->epoch != NULL && this->epoch->load() != this->resume_epoch)
+        {
+            this->resume_cycle = 0;
+            return TASK_YIELD; // 取出后队列被清空（跳转），这个数据包属于旧位置，不编码
+        }
+        this->resume_packet_size = this->seal_packet(buffer);
+        this->resume_wait_begin = std::chrono::steady_clock::now();
+        this->resume_state = 2;
+    }
+        // fall through
+    case 2: // 等待接收端回报并写出
+        if (this->protocol == LINK_PROTOCOL_CREDIT)
+        {
+            if (!this->credit_ready(this->resume_output))
+            {
+                wakeup = std::chrono::steady_clock::now() + std::chrono::microseconds(LINK_CREDIT_POLL_US); // 回报来自输出端，没有队列会唤醒
+                return TASK_SLEEP;
+            }
+            if (this->stats != NULL)
+                metrics::add(this->stats->credit_wait_ns, metrics::elapsed_ns(this->resume_wait_begin));
+        }
+        this->resume_cycle = 0;
+        this->resume_state = 1;
+        if (this->epoch != NULL && this->epoch->load() != this->resume_epoch)
+        {
+            this->resync_receiver(); // 等待回报期间发生跳转，已编码的数据包不发送
+            return TASK_YIELD;
+        }
+        this->write_packet(this->resume_output, buffer, this->resume_packet_size, this->resume_epoch, this->resume_tb, this->resume_wakeup);
+        if (this->paced && std::chrono::steady_clock::now() < this->resume_wakeup)
+        {
+            this->resume_state = 3;
+            wakeup = this->resume_wakeup;
+            return TASK_SLEEP;
+        }
+        return TASK_YIELD;
+    case 3: // 从节奏定时器醒来
+        if (this->stats != NULL)
+            this->stats->record_wakeup(metrics::elapsed_ns(this->resume_wakeup));
+        this->resume_state = 1;
+        return TASK_YIELD;
+    default:
+        return TASK_DONE;
+    }
+}
+
+/**
+ * @brief 写出一个数据包并统计（私有方法）
+ *
+ * @param output 输出端
+ * @param buffer 数据包
+ * @param packet_size 数据包大小
+ * @param packet_epoch 数据包取出时的纪元，与上一个不同时记录跳转完成
+ * @param tb 跟踪缓冲区，为NULL时不跟踪
+ * @param wakeup_time 本周期结束的时刻，写完晚于它时记为迟到
+ */
+void transfer::write_packet(sink *output, const uint8_t *buffer, size_t packet_size, uint32_t packet_epoch, trace_buffer *tb, std::chrono::steady_clock::time_point wakeup_time)
+{
+    auto write_begin = std::chrono::steady_clock::now();
+    trace_span write_span(tb, "serial write", this->packets);
+    ssize_t written = output->write(buffer, packet_size); // 写入串口
+    write_span.end();
+    if (this->stats != NULL)
+    {
+        uint64_t write_ns = metrics::elapsed_ns(write_begin);
+        metrics::add(this->stats->transfer.wait_output_ns, write_ns);
+        metrics::add(this->stats->write_ns, write_ns);
+        metrics::add(this->stats->writes, 1);
+        if (write_ns > this->stats->write_ns_max.load(std::memory_order_relaxed))
+            metrics::set(this->stats->write_ns_max, write_ns);
+        if (written > 0)
+            metrics::add(this->stats->bytes_written, written);
+        if (written == (ssize_t)packet_size)
+        {
+            metrics::add(this->stats->transfer.frames_out, 1);
+            this->stats->frame_written(this->packets);
+        }
+        else
+            metrics::add(this->stats->transfer.dropped_frames, 1); // 写入不完整
+        if (this->paced && std::chrono::steady_clock::now() > wakeup_time)
+            metrics::add(this->stats->late_frames, 1); // 本帧已超出帧周期
+    }
+    if (written != (ssize_t)packet_size)
+        this->resync_receiver(); // 接收端丢弃了不完整的帧，编码器的参考帧已前移
+    if (this->timer != NULL && this->packets == 0) // 只记录第一个数据包，之后不再进入计时器
+        this->timer->mark("first packet written");
+    if (packet_epoch != this->written_epoch && written == (ssize_t)packet_size)
+    {
+        this->written_epoch = packet_epoch;
+        this->seek_reached();
+    }
+    this->packets++;
+}
+
+/**
+ * @brief 设置逐帧跟踪记录器
+ *
+ * @param trace 跟踪记录器，为NULL时不跟踪
+ */
+void transfer::set_tracer(tracer *trace)
+{
+    this->trace = trace;
+}
+
+/**
+ * @brief 设置运行指标
+ *
+ * @param stats 指标，为NULL时不统计
+ */
+void transfer::set_metrics(metrics *stats)
+{
+    this->stats = stats;
+}
+
+/**
+ * @brief 设置启动阶段计时器
+ *
+ * @param timer 计时器，为NULL时不计时
+ */
+void transfer::set_startup_timer(startup_timer *timer)
+{
+    this->timer = timer;
+}
+
+/**
+ * @brief 设置是否有音频输入
+ *
+ * @param enabled 为0时不读取音频队列，每个数据包的音频字节填0（静音）
+ */
+void transfer::set_audio_enabled(int enabled)
+{
+    this->audio_enabled = enabled;
+}
+
+/**
+ * @brief 设置输出端，不设置时按构造时给出的设备描述自行创建
+ *
+ * @param output 输出端，由调用者持有，传输结束时被关闭
+ */
+void transfer::set_sink(sink *output)
+{
+    this->output = output;
+}
+
+/**
+ * @brief 设置是否按帧率控制发送节奏
+ *
+ * @param paced 为0时不休眠，以流水线能达到的最快速度输出（用于测量吞吐）
+ */
+void transfer::set_paced(int paced)
+{
+    this->paced = paced;
+}
+
+/**
+ * @brief 打开输出端（私有方法）
+ *
+ * @return sink* 已打开的输出端
+ */
+sink *transfer::open_output(void)
+{
+    if (this->protocol != LINK_PROTOCOL_RAW && (size_t)this->frame_size + this->audio_size > 0xFFFF)
+    {
+        std::invalid_argument ex("Link payload too large!"); // 帧头中的负载长度只有16位
+        throw ex;
+    }
+    sink *output = this->output;
+    if (output == NULL)
+    {
+        sink_params params;
+        params.baudrate = this->baudrate;
+        params.framerate = this->framerate;
+        params.receive = this->protocol == LINK_PROTOCOL_CREDIT;
+        this->own_output.reset(sink::create(this->device_path, params));
+        output = this->own_output.get();
+    }
+    output->open();
+    if (this->protocol == LINK_PROTOCOL_CREDIT && !output->can_read())
+    {
+        output->close();
+        std::invalid_argument ex("Flow control needs an output that can read back (serial: or unix:)!");
+        throw ex;
+    }
+    // 还没有收到接收端的回报时，只允许发出一帧作为探测
+    this->seq           = 0;
+    this->ack_seq       = 0xFFFF;
+    this->free_slots    = 1;
+    this->last_credit   = std::chrono::steady_clock::now();
+    if (this->protocol == LINK_PROTOCOL_CREDIT && !this->parser)
+        this->parser.reset(new link_protocol(LINK_CREDIT_PAYLOAD_MAX));
+    if (this->rect_width > 0 && this->protocol != LINK_PROTOCOL_RAW)
+    {
+        if (this->audio_size != 1)
+        {
+            output->close();
+            std::invalid_argument ex("Dirty rectangles need one audio byte per packet!");
+            throw ex;
+        }
+        this->rects.reset(new dirty_rect(this->rect_width, this->rect_height, this->frame_size + this->audio_size)); // 重新打开后从整个画面开始
+    }
+    else if (this->rate_controlled)
+    {
+        if (this->protocol == LINK_PROTOCOL_RAW || this->audio_size != 1)
+        {
+            output->close();
+            std::invalid_argument ex("Rate control needs the framed or credit protocol!");
+            throw ex;
+        }
+        this->encoder.reset(new rate_control(this->frame_size)); // 重新打开后接收端的帧不再可信，从完整帧开始
+    }
+    return output;
+}
+
+/**
+ * @brief 获取一个数据包在链路上的字节数（含帧头和CRC）
+ *
+ * @return size_t 字节数
+ */
+size_t transfer::get_packet_size(void)
+{
+    return (this->protocol != LINK_PROTOCOL_RAW ? LINK_OVERHEAD : 0) + this->frame_size + this->audio_size;
+}
+
+/**
+ * @brief 测量输出端实际能持续达到的吞吐：不控制节奏地连续发送空白数据包（帧协议和流量控制照常进行），
+ * 预热TRANSFER_PROBE_WARMUP_MS填满内核和适配器的缓冲区后开始计数，结束时等待缓冲区发空
+ *
+ * @param seconds 计数时长（秒）
+ * @return double 吞吐（字节/秒），除以get_packet_size()即为可持续的最大帧率
+ */
+double transfer::probe(double seconds)
+{
+    sink *output = this->open_output();
+    const size_t packet_capacity = LINK_OVERHEAD + this->frame_size + this->audio_size;
+    uint8_t *buffer = new uint8_t[packet_capacity];
+    memset(buffer, 0, packet_capacity);
+    auto warmup_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(TRANSFER_PROBE_WARMUP_MS);
+    auto begin = warmup_end, end = warmup_end + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    int64_t bytes = 0;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        size_t packet_size = this->seal_packet(buffer, 0);
+        if (this->protocol == LINK_PROTOCOL_CREDIT)
+            this->wait_credit(output);
+        ssize_t written = output->write(buffer, packet_size);
+        if (written != (ssize_t)packet_size)
+        {
+            delete[] buffer;
+            output->close();
+            std::ios_base::failure ex("Write failed while probing the link!");
+            throw ex;
+        }
+        if (std::chrono::steady_clock::now() >= warmup_end)
+            bytes += written;
+    }
+    output->drain();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    delete[] buffer;
+    output->close();
+    return elapsed > 0 ? bytes / elapsed : 0;
+}
+
+/**
+ * @brief 暂停或继续输出，暂停期间不从队列取数据
+ *
+ * @param paused 为1时暂停
+ */
+void transfer::set_paused(int paused)
+{
+    this->paused = paused;
+}
+
+/**
+ * @brief 设置播放速度，只改变数据包的发送间隔
+ *
+ * @param rate 倍率，1为原速
+ */
+void transfer::set_rate(double rate)
+{
+    if (rate <= 0)
+    {
+        std::invalid_argument ex("Invalid playback rate!");
+        throw ex;
+    }
+    this->rate = rate;
+}
+
+/**
+ * @brief 设置冲洗纪元，写出前纪元已变则丢弃数据包，写出新纪元的第一个数据包时记录跳转延迟
+ *
+ * @param epoch 纪元计数器，为NULL时不检查
+ */
+void transfer::set_epoch(std::atomic<uint32_t> *epoch)
+{
+    this->epoch = epoch;
+}
+
+/**
+ * @brief 当前速度下的数据包间隔（私有方法）
+ *
+ * @return std::chrono::steady_clock::duration 间隔
+ */
+std::chrono::steady_clock::duration transfer::frame_period(void)
+{
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / (this->framerate * this->rate)));
+}
+
+/**
+ * @brief 新位置的第一个数据包已写出，记录跳转延迟（私有方法）
+ *
+ */
+void transfer::seek_reached(void)
+{
+    if (this->stats == NULL || this->stats->seek_begin_ns == 0)
+        return;
+    uint64_t latency = metrics::now_ns() - this->stats->seek_begin_ns;
+    metrics::add(this->stats->seeks, 1);
+    metrics::add(this->stats->seek_latency_ns, latency);
+    metrics::set(this->stats->seek_latency_ns_last, latency);
+    if (latency > this->stats->seek_latency_ns_max.load(std::memory_order_relaxed))
+        metrics::set(this->stats->seek_latency_ns_max, latency);
+}
+
+/**
+ * @brief 设置链路协议
+ *
+ * @param protocol LINK_PROTOCOL_RAW、LINK_PROTOCOL_FRAMED或LINK_PROTOCOL_CREDIT
+ * @param addr 帧头中的接收端地址
+ */
+void transfer::set_protocol(int protocol, uint8_t addr)
+{
+    this->protocol = protocol;
+    this->link_addr = addr;
+}
+
+/**
+ * @brief 帧协议下为缓冲区中的数据包加上帧头和CRC，开启码率控制时先按预算编码负载（私有方法）
+ *
+ * @param buffer 数据包缓冲区，负载从LINK_HEADER_SIZE处开始
+ * @param encode 为0时不编码（测量吞吐时发送完整的数据包）
+ * @return size_t 需要写入的字节数
+ */
+size_t transfer::seal_packet(uint8_t *buffer, int encode)
+{
+    uint16_t length = this->frame_size + this->audio_size;
+    if (this->protocol == LINK_PROTOCOL_RAW)
+        return length;
+    uint8_t type = LINK_TYPE_AV;
+    if (this->rects && encode)
+    {
+        length = this->rects->encode(buffer + LINK_HEADER_SIZE, this->rate_controlled ? this->frame_budget() : HUGE_VAL);
+        memcpy(buffer + LINK_HEADER_SIZE, this->rects->get_output(), length);
+        type = LINK_TYPE_AV_RECT;
+        if (this->stats != NULL)
+        {
+            metrics::add(this->stats->encoded_rect, 1);
+            metrics::add(this->stats->rects, this->rects->get_rects());
+            metrics::add(this->stats->encoded_bytes, LINK_OVERHEAD + length);
+        }
+    }
+    else if (this->encoder && encode)
+    {
+        length = this->encoder->encode(buffer + LINK_HEADER_SIZE, this->frame_budget(), type);
+        memcpy(buffer + LINK_HEADER_SIZE, this->encoder->get_output(), length);
+        if (this->stats != NULL)
+        {
+            std::atomic<uint64_t> *counters[RATE_ENCODINGS] = {&this->stats->encoded_full, &this->stats->encoded_rle, &this->stats->encoded_delta, &this->stats->encoded_partial};
+            metrics::add(*counters[this->encoder->get_encoding()], 1);
+            metrics::add(this->stats->encoded_bytes, LINK_OVERHEAD + length);
+        }
+    }
+    link_protocol::write_header(buffer, this->link_addr, type, this->seq++, length);
+    link_protocol::write_crc(buffer, length);
+    return LINK_OVERHEAD + length;
+}
+
+/**
+ * @brief 编码器的参考帧不再是接收端实际的帧（已编码的数据包没有发出，或接收端可能丢失了在途的帧），
+ * 下一个数据包重新发送完整帧（私有方法）
+ *
+ */
+void transfer::resync_receiver(void)
+{
+    if (this->encoder)
+        this->encoder->reset();
+    if (this->rects)
+        this->rects->reset();
+}
+
+/**
+ * @brief 一个帧周期内本路在线路上能传送的字节数（8N1），即码率控制的每帧预算（私有方法）
+ *
+ * @return double 字节数，不控制节奏时不限
+ */
+double transfer::frame_budget(void)
+{
+    if (!this->paced)
+        return HUGE_VAL;
+    return this->baudrate / 10.0 * this->link_share * std::chrono::duration<double>(this->frame_period()).count();
+}
+
+/**
+ * @brief 开启或关闭码率控制：按波特率和帧率算出每帧的字节预算，在全帧、RLE、变化段中选择预算内最好的编码，
+ * 都放不下时只发送预算内的变化段（需要帧协议，接收端见rate_control::decode）
+ *
+ * @param enabled 为1时开启
+ */
+void transfer::set_rate_control(int enabled)
+{
+    this->rate_controlled = enabled;
+}
+
+/**
+ * @brief 设置本路可用的线路份额，多点总线上几路共用一条线路时每路只按自己的份额编码
+ *
+ * @param share 份额，范围(0, 1]
+ */
+void transfer::set_link_share(double share)
+{
+    if (share <= 0 || share > 1)
+    {
+        std::invalid_argument ex("Invalid link share!");
+        throw ex;
+    }
+    this->link_share = share;
+}
+
+/**
+ * @brief 设置视频帧为RGB565彩色帧，帧协议下按脏矩形发送（LINK_TYPE_AV_RECT，接收端见dirty_rect::decode），
+ * 开启码率控制时只发送预算内的矩形；裸数据包协议下仍发送完整帧
+ *
+ * @param width 帧宽度，为0时视频帧为1bpp取模数据
+ * @param height 帧高度
+ */
+void transfer::set_dirty_rects(int width, int height)
+{
+    if (width < 0 || height < 0 || (size_t)width * height * RECT_BYTES_PER_PIXEL != (width > 0 ? (size_t)this->frame_size : 0))
+    {
+        std::invalid_argument ex("Dirty rectangles do not match the frame size!");
+        throw ex;
+    }
+    this->rect_width = width;
+    this->rect_height = height;
+}
+
+/**
+ * @brief 读取接收端回传的流量控制帧（私有方法）
+ *
+ * @param output 输出端
+ */
+void transfer::poll_credit(sink *output)
+{
+    uint8_t data[LINK_CREDIT_READ_SIZE];
+    ssize_t n;
+    while ((n = output->read(data, sizeof(data))) > 0)
+    {
+        size_t offset = 0, consumed;
+        uint64_t crc_errors = this->parser->get_crc_errors();
+        while (this->parser->feed(data + offset, n - offset, consumed))
+        {
+            offset += consumed;
+            if (this->parser->get_type() != LINK_TYPE_CREDIT || this->parser->get_length() < 3)
+                continue;
+            if (this->parser->get_addr() != this->link_addr && this->link_addr != LINK_BROADCAST)
+                continue; // 多个接收端共用总线时只看自己的
+            const uint8_t *payload = this->parser->get_payload();
+            this->ack_seq = payload[0] | (payload[1] << 8);
+            this->free_slots = payload[2];
+            this->last_credit = std::chrono::steady_clock::now();
+        }
+        if (this->stats != NULL && this->parser->get_crc_errors() > crc_errors)
+            metrics::add(this->stats->link_rx_errors, this->parser->get_crc_errors() - crc_errors);
+    }
+}
+
+/**
+ * @brief 等待直到接收端还有空闲缓冲区（私有方法）
+ *
+ * 已发送未确认的帧数 = seq - (ack_seq + 1)。超过LINK_CREDIT_TIMEOUT_MS没有回报时认为接收端丢失了所有在途帧（或已复位），
+ * 再允许发出一帧作为探测，所以接收端重启或回报丢失时链路能自行恢复
+ *
+ * @param output 输出端
+ */
+void transfer::wait_credit(sink *output)
+{
+    auto begin = std::chrono::steady_clock::now();
+    while (!this->credit_ready(output))
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(LINK_CREDIT_POLL_US));
+    }
+    if (this->stats != NULL)
+        metrics::add(this->stats->credit_wait_ns, metrics::elapsed_ns(begin));
+}
+
+/**
+ * @brief 读取回报并检查接收端是否还有空闲缓冲区，不等待（私有方法）
+ *
+ * @param output 输出端
+ * @return int 可以发送下一帧时返回1
+ */
+int transfer::credit_ready(sink *output)
+{
+    this->poll_credit(output);
+    uint16_t in_flight = this->seq - 1 - (uint16_t)(this->ack_seq + 1); // 本帧的序号已在seal_packet中分配
+    if (in_flight < this->free_slots)
+        return 1;
+    if (std::chrono::steady_clock::now() - this->last_credit > std::chrono::milliseconds(LINK_CREDIT_TIMEOUT_MS))
+    {
+        this->ack_seq = this->seq - 2; // 视为之前的帧都已处理，只发这一帧
+        this->free_slots = 1;
+        this->last_credit = std::chrono::steady_clock::now();
+        this->resync_receiver(); // 在途的帧可能已丢失，这一帧之后从完整帧开始
+        if (this->stats != NULL)
+            metrics::add(this->stats->credit_timeouts, 1);
+        return 1;
+    }
+    return 0;
 }